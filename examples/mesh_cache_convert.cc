@@ -0,0 +1,46 @@
+#include <iostream>
+#include <string>
+#include <jtflib/mesh/io.h>
+
+#include "src/mesh_cache.h"
+
+using namespace std;
+using namespace riemann;
+
+static bool has_suffix(const string &str, const string &suffix) {
+  return str.size() >= suffix.size() &&
+      str.compare(str.size()-suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if ( argc < 2 ) {
+    cerr << "# usage: " << argv[0] << " mesh.obj|tet.vtk [...]\n";
+    cerr << "# writes mesh.obj.rmc next to each input\n";
+    return __LINE__;
+  }
+  for (int i = 1; i < argc; ++i) {
+    const string file(argv[i]);
+    mati_t cell; matd_t nods;
+    int state = 0;
+    if ( has_suffix(file, ".obj") )
+      state = jtf::mesh::load_obj(file.c_str(), cell, nods);
+    else if ( has_suffix(file, ".vtk") )
+      state = jtf::mesh::tet_mesh_read_from_vtk(file.c_str(), &nods, &cell);
+    else
+      state = __LINE__;
+    if ( state ) {
+      cerr << "[error] can not load " << file << endl;
+      return __LINE__;
+    }
+    const string cache = mesh_cache_path(file.c_str());
+    if ( write_mesh_cache(cache.c_str(), cell, nods, vector<mesh_field>(), file.c_str()) ) {
+      cerr << "[error] can not write " << cache << endl;
+      return __LINE__;
+    }
+    cout << "[info] " << file << " -> " << cache << ", "
+         << nods.size(2) << " verts, " << cell.size(2) << " cells\n";
+  }
+  cout << "[info] done\n";
+  return 0;
+}
@@ -18,6 +18,7 @@ struct argument {
   string ini_mesh;
   string pos_cons;
   string out_folder;
+  string method;
 };
 }
 
@@ -45,6 +46,7 @@ int main(int argc, char *argv[])
       ("initial_mesh,i", po::value<string>(), "initial mesh file")
       ("pos_cons,c", po::value<string>(), "constraint file")
       ("output_folder,o", po::value<string>(), "output folder")
+      ("method,m", po::value<string>()->default_value("newton"), "newton or vertex")
       ;
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -58,6 +60,7 @@ int main(int argc, char *argv[])
     args.ini_mesh   = vm["initial_mesh"].as<string>();
     args.pos_cons   = vm["pos_cons"].as<string>();
     args.out_folder = vm["output_folder"].as<string>();
+    args.method     = vm["method"].as<string>();
   }
   if ( !boost::filesystem::exists(args.out_folder) )
     boost::filesystem::create_directory(args.out_folder);
@@ -92,7 +95,10 @@ int main(int argc, char *argv[])
 //    nods0(colon(), 22) += 0.05*dir;
 //    solver.deform(&nods0[0], 1000);
 //  }
-  solver.deform(&nods0[0], 1001);
+  if ( args.method == "vertex" )
+    solver.deform(&nods0[0], 1001);
+  else
+    solver.deform_newton(&nods0[0]);
 
   sprintf(filename, "%s/deform.vtk", args.out_folder.c_str());
   ofstream os(filename); {
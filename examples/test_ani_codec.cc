@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <boost/filesystem.hpp>
+#include <jtflib/mesh/io.h>
+
+#include "src/ani_codec.h"
+
+using namespace std;
+using namespace riemann;
+
+static int encode(const char *indir, const char *file, const ani_codec_args &args) {
+  mati_t tris; matd_t rest, curr;
+  char input[256];
+  sprintf(input, "%s/rest.obj", indir);
+  if ( jtf::mesh::load_obj(input, tris, rest) ) {
+    cerr << "[Error] cant load rest configuration\n";
+    return __LINE__;
+  }
+  ani_sequence_encoder encoder(tris, rest, args);
+  if ( encoder.open(file) )
+    return __LINE__;
+  for (int i = 0; ; ++i) {
+    sprintf(input, "%s/%04d_00.obj", indir, i);
+    if ( jtf::mesh::load_obj(input, tris, curr) )
+      break;
+    if ( encoder.encode_frame(curr) ) {
+      cerr << "[Error] fail to encode frame " << i << endl;
+      return __LINE__;
+    }
+  }
+  return encoder.close();
+}
+
+static int decode(const char *file, const char *outdir) {
+  ani_sequence_decoder decoder;
+  if ( decoder.open(file) )
+    return __LINE__;
+  boost::filesystem::create_directories(outdir);
+  matd_t curr;
+  for (size_t i = 0; !decoder.decode_frame(curr); ++i) {
+    char output[256];
+    sprintf(output, "%s/%04zu_00.obj", outdir, i);
+    jtf::mesh::save_obj(output, decoder.tris(), curr);
+  }
+  decoder.report();
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if ( argc < 4 ) {
+    cerr << "# usage: " << argv[0] << " encode input_dir seq.rani [qstep] [direct|GS]\n";
+    cerr << "#        " << argv[0] << " decode seq.rani output_dir\n";
+    return __LINE__;
+  }
+  const string mode(argv[1]);
+  if ( mode == "encode" ) {
+    ani_codec_args args;
+    if ( argc > 4 )
+      args.qstep = atof(argv[4]);
+    if ( argc > 5 )
+      args.lin_solver = argv[5];
+    return encode(argv[2], argv[3], args);
+  }
+  if ( mode == "decode" )
+    return decode(argv[2], argv[3]);
+  cerr << "[Error] unknown mode " << mode << endl;
+  return __LINE__;
+}
@@ -6,7 +6,9 @@
 #include "src/json.h"
 #include "src/diffuse_dihedral_rot.h"
 #include "src/dual_graph.h"
+#include "src/mesh_topology.h"
 #include "src/config.h"
+#include "src/timer.h"
 //#include "igl/principal_curvature.h"
 //#include "igl/readOBJ.h"
 //#include "src/vtk.h"
@@ -210,8 +212,8 @@ int main(int argc, char *argv[])
 #else
 int main(int argc, char *argv[])
 {
-  if ( argc != 2 ) {
-    cerr << "#usage: ./prog input_dir\n";
+  if ( argc < 2 ) {
+    cerr << "#usage: ./prog input_dir [direct|GS]\n";
     return __LINE__;
   }
   // INPUT
@@ -225,15 +227,25 @@ int main(int argc, char *argv[])
 
   boost::filesystem::create_directories("./dress");
 
-  // BUILD SPANNING TREE OF DUAL GRAPH
-  shared_ptr<edge2cell_adjacent> ec;
-  shared_ptr<Graph> g;
-  build_tri_mesh_dual_graph(tris, ec, g);
+  // BUILD SPANNING TREE OF DUAL GRAPH, walked in one pre-order for all frames
+  shared_ptr<const mesh_topology> topo = mesh_topology::create(tris);
   tree_t mst;
-  get_minimum_spanning_tree(g, mst);
+  get_minimum_spanning_tree(*topo, mst);
 
-  // ENCODE: angles and anchors
+  const size_t root_face = 0;
+  const size_t leaf_face = get_farest_node(*topo, root_face);
+  tree_order_t order;
+  if ( get_preorder(*topo, mst, root_face, order) )
+    return __LINE__;
+
+  // ENCODE: angles and anchors, DECODE: with one decoder whose
+  // factorization and coloring persist over all frames
   diffuse_arap_encoder encoder;
+  diffuse_arap_decoder decoder(tris, nods);
+  const string lin_solver = argc > 2 ? argv[2] : "direct";
+  high_resolution_timer clk;
+  double decode_time = 0;
+  size_t frames = 0;
   for (int i = 0; i < 1000; ++i) {
     cout << "[Info] processing frame " << i << endl;
     sprintf(input, "%s/%04d_00.obj", argv[1], i);
@@ -242,8 +254,9 @@ int main(int argc, char *argv[])
       break;
     }
     vector<double> da;
-    matd_t root_curr;
-    encoder.calc_delta_angle(tris, nods, nods_curr, mst, 0, root_curr, da);
+    matd_t root_curr, leaf_curr;
+    encoder.calc_delta_angle(tris, nods, nods_curr, order,
+                             leaf_face, root_curr, leaf_curr, da);
     {
       char output[256];
       sprintf(output, "./dress/delta_angle_%04d.dat", i);
@@ -251,7 +264,19 @@ int main(int argc, char *argv[])
       sprintf(output, "./dress/delta_angle_%04d.txt", i);
       write_data_text(output, da);
     }
+
+    clk.start();
+    for (size_t k = 0; k < 3; ++k)
+      decoder.pin_down_vert(tris(k, root_face), &root_curr(0, k));
+    decoder.estimate_rotation(nods, order, root_curr, da);
+    matd_t rec_curr(3, nods.size(2));
+    decoder.solve(rec_curr, lin_solver);
+    clk.stop();
+    decode_time += clk.period();
+    ++frames;
   }
+  if ( frames > 0 )
+    printf("[Info] decoded %zu frames, %.3lf ms per frame\n", frames, decode_time/frames);
 
   cout << "[Info] done\n";
   return 0;
@@ -1,8 +1,114 @@
 #include <iostream>
+#include <boost/filesystem.hpp>
+#include <jtflib/mesh/io.h>
+#include <Eigen/Sparse>
+
+#include "igl/boundary_loop.h"
+#include "igl/map_vertices_to_circle.h"
+#include "src/aqp.h"
+#include "src/timer.h"
 
 using namespace std;
+using namespace Eigen;
+using namespace zjucad::matrix;
+using namespace riemann;
+
+/// Tutte embedding with the boundary on the unit circle, always injective
+static int tutte_embedding(const mati_t &tris, const matd_t &nods, matd_t &uv) {
+  MatrixXd V(nods.size(2), 3);
+  MatrixXi F(tris.size(2), 3);
+  for (size_t i = 0; i < nods.size(2); ++i)
+    V.row(i) = Vector3d(nods(0, i), nods(1, i), nods(2, i));
+  for (size_t i = 0; i < tris.size(2); ++i)
+    F.row(i) = Vector3i(tris(0, i), tris(1, i), tris(2, i));
+  VectorXi bnd;
+  igl::boundary_loop(F, bnd);
+  if ( bnd.size() == 0 ) {
+    cerr << "[error] mesh has no boundary\n";
+    return __LINE__;
+  }
+  MatrixXd bnd_uv;
+  igl::map_vertices_to_circle(V, bnd, bnd_uv);
+
+  const size_t nv = nods.size(2);
+  vector<char> is_bnd(nv, 0);
+  for (int i = 0; i < bnd.size(); ++i)
+    is_bnd[bnd[i]] = 1;
+  vector<Triplet<double>> trips;
+  MatrixXd rhs = MatrixXd::Zero(nv, 2);
+  for (int i = 0; i < bnd.size(); ++i) {
+    trips.push_back(Triplet<double>(bnd[i], bnd[i], 1.0));
+    rhs.row(bnd[i]) = bnd_uv.row(i);
+  }
+  for (size_t i = 0; i < tris.size(2); ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      const size_t p = tris(j, i), q = tris((j+1)%3, i);
+      if ( !is_bnd[p] ) {
+        trips.push_back(Triplet<double>(p, p, 1.0));
+        trips.push_back(Triplet<double>(p, q, -1.0));
+      }
+      if ( !is_bnd[q] ) {
+        trips.push_back(Triplet<double>(q, q, 1.0));
+        trips.push_back(Triplet<double>(q, p, -1.0));
+      }
+    }
+  }
+  SparseMatrix<double> L(nv, nv);
+  L.setFromTriplets(trips.begin(), trips.end());
+  SparseLU<SparseMatrix<double>> sol(L);
+  if ( sol.info() != Success )
+    return __LINE__;
+  MatrixXd x = sol.solve(rhs);
+  uv.resize(2, nv);
+  for (size_t i = 0; i < nv; ++i) {
+    uv(0, i) = x(i, 0);
+    uv(1, i) = x(i, 1);
+  }
+  // make the orientation agree with the surface
+  double signed_area = 0;
+  for (size_t i = 0; i < tris.size(2); ++i) {
+    Matrix2d D;
+    D.col(0) = Vector2d(uv(0, tris(1, i))-uv(0, tris(0, i)), uv(1, tris(1, i))-uv(1, tris(0, i)));
+    D.col(1) = Vector2d(uv(0, tris(2, i))-uv(0, tris(0, i)), uv(1, tris(2, i))-uv(1, tris(0, i)));
+    signed_area += D.determinant();
+  }
+  if ( signed_area < 0 )
+    uv(1, colon()) *= -1;
+  return 0;
+}
 
 int main(int argc, char *argv[])
 {
+  if ( argc < 2 ) {
+    cerr << "# usage: " << argv[0] << " model.obj [maxiter]\n";
+    return __LINE__;
+  }
+  boost::filesystem::create_directory("./aqp");
+
+  mati_t tris; matd_t nods, uv;
+  if ( jtf::mesh::load_obj(argv[1], tris, nods) )
+    return __LINE__;
+  if ( tutte_embedding(tris, nods, uv) )
+    return __LINE__;
+  matd_t uv3 = zeros<double>(3, nods.size(2));
+  uv3(colon(0, 1), colon()) = uv;
+  jtf::mesh::save_obj("./aqp/tutte.obj", tris, uv3);
+
+  aqp_args args;
+  args.maxiter   = argc > 2 ? atoi(argv[2]) : 100;
+  args.tolerance = 1e-6;
+  args.kappa     = 1000;
+  args.shrink    = 0.5;
+
+  high_resolution_timer clk;
+  clk.start();
+  aqp_param(tris, nods, vector<size_t>(), args, uv);
+  clk.stop();
+  clk.log();
+
+  uv3(colon(0, 1), colon()) = uv;
+  jtf::mesh::save_obj("./aqp/aqp_param.obj", tris, uv3);
+
+  cout << "[info] done\n";
   return 0;
 }
@@ -67,6 +67,9 @@ int main(int argc, char *argv[])
 #endif
 
     def.pre_compute(idx);
+    // plain local/global iterations as the reference count
+    matrix<double> plain = nods;
+    def.deformation(&plain[0], 0);
     def.deformation(&nods[0]);
 
     jtf::mesh::save_obj("./arap/deform.obj", tris, nods);
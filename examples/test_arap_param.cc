@@ -41,6 +41,8 @@ int main(int argc, char *argv[])
   // ARAP
   arap_param_solver arap(tris, nods);
   arap.precompute();
+  matd_t plain_uv = uv;
+  arap.solve(&plain_uv[0], 0);
   arap.solve(&uv[0]);
   uv3(colon(0, 1), colon()) = uv;
   jtf::mesh::save_obj("./arap_param/arap_param.obj", tris, uv3);
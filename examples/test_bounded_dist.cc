@@ -8,6 +8,8 @@
 
 #include "src/bounded_distortion.h"
 #include "src/vtk.h"
+#include "src/mesh_cache.h"
+#include "src/vtu_writer.h"
 
 using namespace std;
 using namespace riemann;
@@ -22,6 +24,7 @@ struct argument {
   string pos_cons_file;
   string output_folder;
   bd_args bd;
+  string vtk_format;
 };
 }
 
@@ -40,6 +43,23 @@ static int read_fixed_verts(const char *path, unordered_map<size_t, Vector3d> &f
   return 0;
 }
 
+static int write_cond_number(const string &prefix, const string &format,
+                             const mati_t &tets, const matd_t &nods, const matd_t &cond_num) {
+  if ( format == "vtu" ) {
+    vtu_writer vtu;
+    vtu.set_mesh(&nods[0], nods.size(2), &tets[0], tets.size(2), 4, vtu_writer::VTU_TET);
+    vtu.add_cell_data("cond_num", cond_num.begin());
+    return vtu.write((prefix+".vtu").c_str());
+  }
+  const vtk_format fmt = (format == "ascii") ? VTK_ASCII : VTK_BINARY;
+  ofstream os((prefix+".vtk").c_str(), ios::binary);
+  if ( os.fail() )
+    return __LINE__;
+  tet2vtk(os, &nods[0], nods.size(2), &tets[0], tets.size(2), fmt);
+  cell_data(os, &cond_num[0], cond_num.size(), "cond_num", "cond_num", fmt);
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
   po::options_description desc("Available options");
@@ -54,6 +74,8 @@ int main(int argc, char *argv[])
       ("spectral_radius", po::value<double>(), "set the spectral radius")
       ("maxiter,m",       po::value<size_t>()->default_value(20000), "max iterations")
       ("tolerance,e",     po::value<double>()->default_value(1e-8), "tolerance")
+      ("anderson_window", po::value<size_t>()->default_value(5), "anderson acceleration window, 0 to disable")
+      ("vtk_format",      po::value<string>()->default_value("binary"), "output format: ascii, binary or vtu")
       ;
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -72,13 +94,15 @@ int main(int argc, char *argv[])
     args.bd.sr         = vm["spectral_radius"].as<double>();
     args.bd.maxiter    = vm["maxiter"].as<size_t>();
     args.bd.tolerance  = vm["tolerance"].as<double>();
+    args.bd.aa_window  = vm["anderson_window"].as<size_t>();
+    args.vtk_format    = vm["vtk_format"].as<string>();
   }
   if ( !boost::filesystem::exists(args.output_folder) )
     boost::filesystem::create_directory(args.output_folder);
 
   mati_t tets; matd_t nods, nods0;
-  jtf::mesh::tet_mesh_read_from_vtk(args.src_tet_file.c_str(), &nods, &tets);
-  jtf::mesh::tet_mesh_read_from_vtk(args.ini_tet_file.c_str(), &nods0, &tets);
+  load_tet_vtk_cached(args.src_tet_file.c_str(), tets, nods);
+  load_tet_vtk_cached(args.ini_tet_file.c_str(), tets, nods0);
   unordered_map<size_t, Vector3d> fixv;
   read_fixed_verts(args.pos_cons_file.c_str(), fixv);
 
@@ -91,11 +115,8 @@ int main(int argc, char *argv[])
     matd_t cond_num;
     solver.calc_df_cond_number(&nods0[0], cond_num);
     char outfile[256];
-    sprintf(outfile, "%s/bd_initial_cond.vtk", args.output_folder.c_str());
-    ofstream os(outfile);
-    tet2vtk(os, &nods0[0], nods0.size(2), &tets[0], tets.size(2));
-    cell_data(os, &cond_num[0], cond_num.size(), "cond_num", "cond_num");
-    os.close();
+    sprintf(outfile, "%s/bd_initial_cond", args.output_folder.c_str());
+    write_cond_number(outfile, args.vtk_format, tets, nods0, cond_num);
   }
 
   solver.prefactorize();
@@ -105,12 +126,9 @@ int main(int argc, char *argv[])
     matd_t cond_num;
     solver.calc_df_cond_number(&nods0[0], cond_num);
     char outfile[256];
-    sprintf(outfile, "%s/bd_method%d_bound%.1lf_eps%.1e.vtk", args.output_folder.c_str(),
+    sprintf(outfile, "%s/bd_method%d_bound%.1lf_eps%.1e", args.output_folder.c_str(),
             args.bd.method, args.bd.K, args.bd.tolerance);
-    ofstream os(outfile);
-    tet2vtk(os, &nods0[0], nods0.size(2), &tets[0], tets.size(2));
-    cell_data(os, &cond_num[0], cond_num.size(), "cond_num", "cond_num");
-    os.close();
+    write_cond_number(outfile, args.vtk_format, tets, nods0, cond_num);
   }
 
   cout << "[info] done\n";
@@ -7,6 +7,7 @@
 #include "src/json.h"
 #include "src/conformal_volume.h"
 #include "src/vtk.h"
+#include "src/timer.h"
 
 using namespace std;
 using namespace riemann;
@@ -38,6 +39,37 @@ int main(int argc, char *argv[])
   verts(colon(1, 3), colon()) = nods;
 
   conformal_volume cv(tets, verts);
+  char outfile[256];
+  if ( json.isMember("charge_sites") ) {
+    // editing session, every edit switches charges at the cached sites
+    const Json::Value &sites = json["charge_sites"];
+    matd_t pos(3, sites.size());
+    for (unsigned int i = 0; i < sites.size(); ++i)
+      for (unsigned int j = 0; j < 3; ++j)
+        pos(j, i) = sites[i][j].asDouble();
+    cv.set_charge_sites(pos, json.isMember("basis_tol") ? json["basis_tol"].asDouble() : 0.0);
+    for (unsigned int k = 0; k < json["edits"].size(); ++k) {
+      Eigen::VectorXd intensity = Eigen::VectorXd::Zero(sites.size());
+      for (unsigned int i = 0; i < json["edits"][k].size(); ++i)
+        intensity[json["edits"][k][i]["site"].asUInt()] = json["edits"][k][i]["intensity"].asDouble();
+      high_resolution_timer clk;
+      clk.start();
+      cv.set_charge_intensity(intensity);
+      if ( cv.solve_eigen_prob() )
+        return __LINE__;
+      matd_t xnew = verts;
+      cv.solve_poisson_prob(&xnew[0]);
+      clk.stop();
+      clk.log();
+      sprintf(outfile, "%s/deform_%u.vtk", json["output_dir"].asString().c_str(), k);
+      matd_t nodes = xnew(colon(1, 3), colon());
+      ofstream os(outfile);
+      tet2vtk(os, &nodes[0], nodes.size(2), &tets[0], tets.size(2));
+      os.close();
+    }
+    cout << "[Info] done\n";
+    return 0;
+  }
   // parse charge
   for (unsigned int i = 0; i < json["charges"].size(); ++i) {
     const double pos[3] = {json["charges"][i]["pos"][0].asDouble(),
@@ -47,11 +79,11 @@ int main(int argc, char *argv[])
     printf("# charge %u: (%lf, %lf, %lf), %lf\n", i, pos[0], pos[1], pos[2], intensity);
     cv.set_charge(pos, intensity);
   }
-  cv.solve_eigen_prob();
+  if ( cv.solve_eigen_prob() )
+    return __LINE__;
   matd_t xnew = verts;
   cv.solve_poisson_prob(&xnew[0]);
 
-  char outfile[256];
   {
     sprintf(outfile, "%s/orig.vtk", json["output_dir"].asString().c_str());
     ofstream os(outfile);
@@ -5,6 +5,9 @@
 
 #include "igl/cotmatrix.h"
 #include "igl/readOBJ.h"
+#include "src/cotmatrix.h"
+#include "src/mesh_topology.h"
+#include "src/timer.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -14,13 +17,48 @@ int main(int argc, char *argv[])
 {
     MatrixXi F;
     MatrixXd V;
-    igl::readOBJ("../../dat/sphere.obj", V, F);
+    igl::readOBJ(argc > 1 ? argv[1] : "../../dat/sphere.obj", V, F);
 
+    riemann::high_resolution_timer clk;
     SparseMatrix<double> L;
+    clk.start();
     igl::cotmatrix(V, F, L);
+    clk.stop();
+    cout << "[info] igl cotmatrix\n";
+    clk.log();
 
     SparseMatrix<double> Lap = kroneckerProduct(L, Matrix3d::Identity());
     cout << Lap.coeff(200, 200) << endl;
+
+    matrix<size_t> tris(3, F.rows());
+    matrix<double> nods(3, V.rows());
+    for (size_t i = 0; i < tris.size(2); ++i)
+      for (size_t j = 0; j < 3; ++j)
+        tris(j, i) = F(i, j);
+    for (size_t i = 0; i < nods.size(2); ++i)
+      for (size_t j = 0; j < 3; ++j)
+        nods(j, i) = V(i, j);
+
+    clk.start();
+    auto topo = riemann::mesh_topology::create(tris);
+    clk.stop();
+    cout << "[info] topology\n";
+    clk.log();
+
+    SparseMatrix<double> RL, M;
+    clk.start();
+    riemann::cotmatrix(tris, nods, 3, &RL, false, topo);
+    clk.stop();
+    cout << "[info] riemann cotmatrix\n";
+    clk.log();
+    cout << "\t@difference to igl: " << (Lap-RL).norm() << endl;
+
+    clk.start();
+    riemann::massmatrix(tris, nods, 1, &M, riemann::MASS_CONSISTENT, topo);
+    clk.stop();
+    cout << "[info] consistent mass matrix\n";
+    clk.log();
+    cout << "\t@total area: " << M.sum() << endl;
     cout << "done\n";
     return 0;
 }
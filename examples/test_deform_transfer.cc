@@ -10,8 +10,8 @@ using namespace riemann;
 
 int main(int argc, char *argv[])
 {
-  if ( argc != 5 ) {
-    cerr << "usage: " << argv[0] << " source_ref.obj target_ref.obj vert_makers.cons source_def.obj\n";
+  if ( argc < 5 ) {
+    cerr << "usage: " << argv[0] << " source_ref.obj target_ref.obj vert_makers.cons source_def.obj [source_def.obj ...]\n";
     return __LINE__;
   }
   boost::filesystem::create_directory("./dt");
@@ -41,10 +41,22 @@ int main(int argc, char *argv[])
 
   dt.deformation_transfer_precompute();
 
-  dt.load_deformed_source_mesh(argv[4]);
-  dt.deformation_transfer();
-  dt.save_deformed_source_mesh("./dt/source_def.obj");
-  dt.save_deformed_target_mesh("./dt/target_def.obj");
+  if ( argc == 5 ) {
+    dt.load_deformed_source_mesh(argv[4]);
+    dt.deformation_transfer();
+    dt.save_deformed_source_mesh("./dt/source_def.obj");
+    dt.save_deformed_target_mesh("./dt/target_def.obj");
+  } else {
+    // stream all the source poses through one factorization
+    vector<string> src_def, tar_def;
+    for (int i = 4; i < argc; ++i) {
+      char outfile[256];
+      sprintf(outfile, "./dt/target_def_%03d.obj", i-4);
+      src_def.push_back(argv[i]);
+      tar_def.push_back(outfile);
+    }
+    dt.deformation_transfer_sequence(src_def, tar_def, true);
+  }
 
   cout << "[info] all done\n";
   return 0;
@@ -9,8 +9,8 @@ using namespace riemann;
 
 int main(int argc, char *argv[])
 {
-  if ( argc != 3 ) {
-    cerr << "# usage: " << argv[0] << " model.obj cons.ff\n";
+  if ( argc < 3 ) {
+    cerr << "# usage: " << argv[0] << " model.obj cons.ff [anderson_window]\n";
     return __LINE__;
   }
   boost::filesystem::create_directory("./ff_deform");
@@ -20,6 +20,7 @@ int main(int argc, char *argv[])
   pt.put("tolerance", 1e-12);
   pt.put("lambda", 0.1);
   pt.put("perturb", 0.1);
+  pt.put("anderson_window", argc > 3 ? atoi(argv[3]) : 5);
 
   frame_field_deform deformer(pt);
   deformer.load_mesh(argv[1]);
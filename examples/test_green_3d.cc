@@ -8,8 +8,8 @@ using namespace riemann;
 
 int main(int argc, char *argv[])
 {
-    if ( argc != 3 ) {
-        cerr << "usage: " << argv[0] << " model.obj cage.obj\n";
+    if ( argc != 3 && argc != 4 ) {
+        cerr << "usage: " << argv[0] << " model.obj cage.obj [coords.bin]\n";
         return __LINE__;
     }
     boost::filesystem::create_directory("./green3d");
@@ -17,6 +17,9 @@ int main(int argc, char *argv[])
     green_deform_3d def;
     def.load_sample_points(argv[1]);
     def.load_cage(argv[2]);
+    /// out-of-core coordinates in float32 tiles
+    if ( argc == 4 )
+        def.set_tiled(argv[3], 4096, true);
     def.calc_green_coords();
 
 //    /// for sphere
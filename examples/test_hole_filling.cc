@@ -126,6 +126,9 @@ int main(int argc, char *argv[])
   calc_infinitesimal_elem(loop);
   calc_bnd_indicator(loop);
   cout << "[INFO] scalar value on boundary:\n" << loop.sf << endl;
+  // octree far field, the grid then costs O(res^3 log #bnd)
+  if ( json.isMember("theta") )
+    build_far_field(loop, json["theta"].asDouble());
 
   eigen_vecd_t center(3);
   center << json["center"][0].asDouble(), json["center"][1].asDouble(), json["center"][2].asDouble();
@@ -145,6 +148,17 @@ int main(int argc, char *argv[])
   point_data(os, sf.data(), sf.size(), "sf");
   os.close();
 
+  // narrow band sampling and the surface of the iso value
+  if ( json.isMember("max_level") ) {
+    adaptive_grid grid;
+    const double iso = json["iso"].asDouble();
+    adaptive_grid_sampling(loop, bbox, json["max_level"].asInt(), grid, 3, 0.5, iso);
+    eigen_mati_t surf_tris; eigen_matd_t surf_nods;
+    extract_iso_surface(grid, iso, surf_tris, surf_nods);
+    sprintf(outfile, "%s/iso_surface.m%d.obj", json["outdir"].asString().c_str(), json["method"].asInt());
+    igl::writeOBJ(outfile, surf_nods, surf_tris);
+  }
+
   loop.T *= 0.1; loop.B *= 0.1; loop.N *= 0.1;
   string outx = json["outdir"].asString()+string("/T.vtk");
   draw_vert_direct_field(outx.c_str(), loop.pos.data(), loop.pos.rows(), loop.T.data());
@@ -2,19 +2,18 @@
 #include <jtflib/mesh/io.h>
 #include <boost/filesystem.hpp>
 
-#include "src/arpaca.h"
+#include "src/sparse_eigen.h"
 #include "src/cotmatrix.h"
 #include "src/vtk.h"
 
 using namespace std;
 using namespace zjucad::matrix;
 using namespace Eigen;
-using namespace arpaca;
 
 int main(int argc, char *argv[])
 {
-  if ( argc != 2 ) {
-    cerr << "# Usage: " << argv[0] << " model.obj\n";
+  if ( argc < 2 ) {
+    cerr << "# Usage: " << argv[0] << " model.obj [lanczos|lobpcg]\n";
     return __LINE__;
   }
   boost::filesystem::create_directory("./lap_eigen");
@@ -25,7 +24,13 @@ int main(int argc, char *argv[])
   SparseMatrix<double> L;
   riemann::cotmatrix(tris, nods, 1, &L);
   L = -L;
-  SymmetricEigenSolver<double> sol = arpaca::Solve(L, 50, ALGEBRAIC_SMALLEST);
+  riemann::shift_invert_eigensolver sol("laplacian eigen");
+  riemann::eigen_args args;
+  args.k = 50;
+  args.method = (argc > 2 && string(argv[2]) == "lobpcg") ? riemann::EIG_LOBPCG : riemann::EIG_LANCZOS;
+  if ( sol.compute(L, nullptr, args) || sol.solve() )
+    return __LINE__;
+  sol.report();
   cout << sol.eigenvalues() << endl;
 
   for (size_t i = 0; i < 50; ++i) {
@@ -10,6 +10,7 @@
 
 #include "src/polycube.h"
 #include "src/vtk.h"
+#include "src/mesh_cache.h"
 
 using namespace std;
 using namespace riemann;
@@ -142,7 +143,7 @@ int main(int argc, char *argv[])
   const string outdir = pt.get<string>("outdir.value");
   
   mati_t tets; matd_t nods;
-  jtf::mesh::tet_mesh_read_from_vtk(pt.get<string>("mesh.value").c_str(), &nods, &tets); {
+  load_tet_vtk_cached(pt.get<string>("mesh.value").c_str(), tets, nods); {
     string outfile = outdir+string("/orig.vtk");
     ofstream ofs(outfile);
     tet2vtk(ofs, &nods[0], nods.size(2), &tets[0], tets.size(2));
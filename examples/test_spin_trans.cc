@@ -6,6 +6,7 @@
 #include <zjucad/matrix/io.h>
 
 #include "src/spin_trans.h"
+#include "src/timer.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -16,7 +17,7 @@ using namespace Eigen;
 namespace test_spin {
 struct argument {
   string input_mesh;
-  string curv_file;
+  vector<string> curv_file;
   string output_folder;
 };
 }
@@ -43,7 +44,7 @@ int main(int argc, char *argv[])
   desc.add_options()
       ("help,h", "produce help message")
       ("input_mesh,i", po::value<string>(), "input mesh")
-      ("curv_file,c", po::value<string>(), "curvature change")
+      ("curv_file,c", po::value<vector<string>>(), "curvature change, repeat for a sequence of edits")
       ("output_folder,o", po::value<string>(), "output folder")
       ;
   po::variables_map vm;
@@ -55,7 +56,7 @@ int main(int argc, char *argv[])
   }
   test_spin::argument args; {
     args.input_mesh = vm["input_mesh"].as<string>();
-    args.curv_file = vm["curv_file"].as<string>();
+    args.curv_file = vm["curv_file"].as<vector<string>>();
     args.output_folder = vm["output_folder"].as<string>();
   }
   if ( !boost::filesystem::exists(args.output_folder) )
@@ -64,25 +65,37 @@ int main(int argc, char *argv[])
   // Input
   mati_t tris; matd_t nods;
   jtf::mesh::load_obj(args.input_mesh.c_str(), tris, nods);
-  matd_t delta = zeros<double>(tris.size(2), 1);
-  read_curvature_change(args.curv_file.c_str(), delta);
 
   // R^3->Im H
   matd_t nodx = zeros<double>(4, nods.size(2));
   nodx(colon(1, 3), colon()) = nods;
   matd_t xnew = nodx;
 
-  spin_trans solver(tris, nodx);
-  solver.set_curvature_change(delta);
-  solver.deform(xnew);
-
-  // Output
   char outfile[256];
   sprintf(outfile, "%s/origin.obj", args.output_folder.c_str());
   jtf::mesh::save_obj(outfile, tris, nods);
-  nods = xnew(colon(1, 3), colon());
-  sprintf(outfile, "%s/spin.obj", args.output_folder.c_str());
-  jtf::mesh::save_obj(outfile, tris, nods);
+
+  // one session for all edits, each starts from the last result
+  spin_trans solver(tris, nodx);
+  for (size_t k = 0; k < args.curv_file.size(); ++k) {
+    matd_t delta = zeros<double>(tris.size(2), 1);
+    read_curvature_change(args.curv_file[k].c_str(), delta);
+    high_resolution_timer clk;
+    clk.start();
+    solver.set_curvature_change(delta);
+    if ( solver.deform(xnew) )
+      return __LINE__;
+    clk.stop();
+    clk.log();
+
+    // Output
+    nods = xnew(colon(1, 3), colon());
+    if ( k == 0 )
+      sprintf(outfile, "%s/spin.obj", args.output_folder.c_str());
+    else
+      sprintf(outfile, "%s/spin_%zu.obj", args.output_folder.c_str(), k);
+    jtf::mesh::save_obj(outfile, tris, nods);
+  }
 
   cout << "[info] done\n";
   return 0;
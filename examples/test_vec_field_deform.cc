@@ -1,40 +1,119 @@
 #include <iostream>
 #include <boost/filesystem.hpp>
+#include <Eigen/Geometry>
 
 #include "src/vec_field_deform.h"
+#include "src/timer.h"
 
 using namespace std;
 using namespace Eigen;
+using namespace riemann;
+
+// the former fixed-substep advection of every vertex, kept as reference
+static void advect_all(const vector<shared_ptr<vector_field>> &vf, MatrixXd &nods) {
+  advector advect(vf);
+#pragma omp parallel for
+  for (size_t id = 0; id < nods.cols(); ++id)
+    nods.col(id) += advect(nods.col(id));
+}
+
+static void ref_translate(MatrixXd &nods, const Vec3 &src, const Vec3 &des, const double ri, const double ro) {
+  vector<shared_ptr<vector_field>> vf;
+  const Vec3 dir = des-src;
+  for (size_t i = 0; i < 100; ++i) {
+    vf.push_back(make_shared<vector_field>(Vec3(src+i/100.0*dir), ri, ro, dir, "translate"));
+    advect_all(vf, nods);
+  }
+}
+
+static void ref_twist(MatrixXd &nods, const Vec3 &center, const double ri, const double ro, const Vec3 &n, const size_t times) {
+  vector<shared_ptr<vector_field>> vf;
+  for (size_t i = 0; i < times; ++i) {
+    if ( i < 3 )
+      vf.push_back(make_shared<vector_field>(center, ri, ro, n, "twist"));
+    advect_all(vf, nods);
+  }
+}
+
+static void ref_bend(MatrixXd &nods, const Vec3 &center, const double ri, const double ro, const Vec3 &axis, const Vec3 &n, const double theta) {
+  vector<shared_ptr<vector_field>> vf;
+  const size_t times = theta/(2*0.001);
+  Vec3 normal = n;
+  const Matrix3d rot = AngleAxisd(0.001, axis).toRotationMatrix();
+  for (size_t i = 0; i < times; ++i) {
+    vf.push_back(make_shared<vector_field>(center, ri, ro, axis, normal));
+    normal = (rot*normal).eval();
+    advect_all(vf, nods);
+  }
+}
 
 int main(int argc, char *argv[])
 {
-    if ( argc != 2 ) {
-        cerr << "# Usage: " << argv[0] << " model.obj\n";
+    if ( argc < 2 ) {
+        cerr << "# Usage: " << argv[0] << " model.obj [translate|twist|bend] [compare]\n";
         return __LINE__;
     }
     boost::filesystem::create_directory("./vel_field_deform");
+    const string edit = argc > 2 ? argv[2] : "bend";
+    const bool compare = argc > 3 && string(argv[3]) == "compare";
 
     riemann::vel_field_deform def;
     def.load_model(argv[1]);
+    MatrixXd ref = def.nods();
 
-//    // for sphere
-//    Vector3d src(0, 1.0, 0);
-//    Vector3d des(0, 1.2, 0);
-//    const double ri = 0.01;
-//    const double ro = 0.8;
-//    def.translate_deform(src, des, ri, ro);
-
-//    // for beam twist
-//    Vector3d center(-6, 0, 0), n(1, 0, 0);
-//    const double ri = 12.05;
-//    const double ro = 14;
-//    def.twist_deform(center, ri, ro, n, 400);
-
-    // for beam bend
-    Vector3d center(0, 0, 0), n(1, 0, 0), axis(0, 0, -1);
-    const double ri = -2;
-    const double ro = 2;
-    def.bend_deform(center, ri, ro, axis, n, M_PI/2);
+    high_resolution_timer clk;
+    double ref_time = 0;
+    if ( edit == "translate" ) {
+        // for sphere
+        Vector3d src(0, 1.0, 0);
+        Vector3d des(0, 1.2, 0);
+        const double ri = 0.01;
+        const double ro = 0.8;
+        clk.start();
+        def.translate_deform(src, des, ri, ro);
+        clk.stop();
+        if ( compare ) {
+            high_resolution_timer rclk;
+            rclk.start();
+            ref_translate(ref, src, des, ri, ro);
+            rclk.stop();
+            ref_time = rclk.period();
+        }
+    } else if ( edit == "twist" ) {
+        // for beam twist
+        Vector3d center(-6, 0, 0), n(1, 0, 0);
+        const double ri = 12.05;
+        const double ro = 14;
+        clk.start();
+        def.twist_deform(center, ri, ro, n, 400);
+        clk.stop();
+        if ( compare ) {
+            high_resolution_timer rclk;
+            rclk.start();
+            ref_twist(ref, center, ri, ro, n, 400);
+            rclk.stop();
+            ref_time = rclk.period();
+        }
+    } else {
+        // for beam bend
+        Vector3d center(0, 0, 0), n(1, 0, 0), axis(0, 0, -1);
+        const double ri = -2;
+        const double ro = 2;
+        clk.start();
+        def.bend_deform(center, ri, ro, axis, n, M_PI/2);
+        clk.stop();
+        if ( compare ) {
+            high_resolution_timer rclk;
+            rclk.start();
+            ref_bend(ref, center, ri, ro, axis, n, M_PI/2);
+            rclk.stop();
+            ref_time = rclk.period();
+        }
+    }
+    printf("[info] %s of %zu vertices: %.3lf ms\n", edit.c_str(), (size_t)ref.cols(), clk.period());
+    if ( compare )
+        printf("[info] fixed substeps over all vertices: %.3lf ms, max deviation %e\n",
+               ref_time, (def.nods()-ref).colwise().norm().maxCoeff());
 
     def.save_model("./vel_field_deform/deform.obj");
     cout << "done\n";
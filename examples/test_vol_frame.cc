@@ -10,6 +10,7 @@
 #include "src/lbfgs_solve.h"
 #include "src/sh_zyz_convert.h"
 #include "src/write_vtk.h"
+#include "src/mesh_cache.h"
 #include "src/geometry_extend.h"
 
 using namespace std;
@@ -53,6 +54,21 @@ static void test_lbfgs_opt() {
   lbfgs_solve(F, x, 2, epsf, epsx, maxits);
 
   cout << x[0] << " " << x[1] << endl << endl;
+
+  // independent contexts run side by side
+  const size_t nrun = 8;
+  vector<double> xs(2*nrun, 0);
+#pragma omp parallel for
+  for (size_t i = 0; i < nrun; ++i) {
+    lbfgs_args args;
+    args.history = i+1;
+    args.verbose = 0;
+    lbfgs_context ctx(args);
+    ctx.minimize(*F, &xs[2*i]);
+  }
+  for (size_t i = 0; i < nrun; ++i)
+    cout << "history " << i+1 << ": " << xs[2*i] << " " << xs[2*i+1] << endl;
+  cout << endl;
 }
 
 static void test_alignment_energy() {
@@ -140,7 +156,7 @@ int main(int argc, char *argv[])
   const string out_folder = pt.get<string>("out_dir.value");
   
   mati_t tets; matd_t nods;
-  jtf::mesh::tet_mesh_read_from_vtk(pt.get<string>("mesh.value").c_str(), &nods, &tets);
+  load_tet_vtk_cached(pt.get<string>("mesh.value").c_str(), tets, nods);
   {
     string outfile = out_folder+string("/tet.vtk");
     ofstream ofs(outfile);
@@ -10,6 +10,7 @@
 
 #include "config.h"
 #include "geometry_extend.h"
+#include "proj_newton.h"
 
 #define TOLERANCE 1e-12
 
@@ -34,6 +35,16 @@ void advanced_iso_2d_hes_(double *hes, const double *x, const double *D, const d
 
 }
 
+/// column i holds the inverse of the 2x2 edge basis of triangle i
+static void calc_inv_bases(const mati_t &tris, const matd_t &nods, matd_t &binv) {
+  binv.resize(4, tris.size(2));
+  for (size_t i = 0; i < tris.size(2); ++i) {
+    matd_t base = nods(colon(), tris(colon(1, 2), i))-nods(colon(), tris(0, i))*ones<double>(1, 2);
+    inv(base);
+    std::copy(base.begin(), base.end(), &binv(0, i));
+  }
+}
+
 class mips_energy
 {
 public:
@@ -49,12 +60,7 @@ class mips_energy_2d : public mips_energy
 public:
   mips_energy_2d(const mati_t &tris, const matd_t &nods)
     : dim_(nods.size()), tris_(tris), s_(5.0) {
-    binv_.resize(4, tris_.size(2));
-    for (size_t i = 0; i < tris.size(2); ++i) {
-      matd_t base = nods(colon(), tris_(colon(1, 2), i))-nods(colon(), tris_(0, i))*ones<double>(1, 2);
-      inv(base);
-      std::copy(base.begin(), base.end(), &binv_(0, i));
-    }
+    calc_inv_bases(tris_, nods, binv_);
     calc_one_ring_face(tris_, p2f_);
   }
   size_t dim() const {
@@ -105,6 +111,68 @@ private:
   matd_t binv_;
 };
 
+/// the same energy per triangle for the global projected newton solver
+class mips_element_energy : public element_energy
+{
+public:
+  mips_element_energy(const mati_t &tris, const matd_t &nods)
+    : dim_(nods.size()), tris_(tris), s_(5.0) {
+    calc_inv_bases(tris_, nods, binv_);
+  }
+  size_t Nx() const {
+    return dim_;
+  }
+  size_t Ne() const {
+    return tris_.size(2);
+  }
+  size_t Nd() const {
+    return 6;
+  }
+  void Dof(const size_t i, size_t *dof) const {
+    for (size_t j = 0; j < 3; ++j) {
+      dof[2*j+0] = 2*tris_(j, i)+0;
+      dof[2*j+1] = 2*tris_(j, i)+1;
+    }
+  }
+  int Val(const double *x, const size_t i, double *val) const {
+    double vert[6], va = 0;
+    get_vert(x, i, vert);
+    advanced_iso_2d_(&va, vert, &binv_(0, i), &s_);
+    *val += va;
+    return 0;
+  }
+  int Gra(const double *x, const size_t i, double *gra) const {
+    double vert[6], jac[6] = {0};
+    get_vert(x, i, vert);
+    advanced_iso_2d_jac_(jac, vert, &binv_(0, i), &s_);
+    for (size_t j = 0; j < 6; ++j)
+      gra[j] += jac[j];
+    return 0;
+  }
+  int Hes(const double *x, const size_t i, double *hes) const {
+    double vert[6], H[36] = {0};
+    get_vert(x, i, vert);
+    advanced_iso_2d_hes_(H, vert, &binv_(0, i), &s_);
+    for (size_t j = 0; j < 36; ++j)
+      hes[j] += H[j];
+    return 0;
+  }
+  double MaxStep(const double *x, const double *d) const {
+    return tri_flip_free_step(tris_, x, d);
+  }
+private:
+  void get_vert(const double *x, const size_t i, double *vert) const {
+    for (size_t j = 0; j < 3; ++j) {
+      vert[2*j+0] = x[2*tris_(j, i)+0];
+      vert[2*j+1] = x[2*tris_(j, i)+1];
+    }
+  }
+  const size_t dim_;
+  const mati_t &tris_;
+  const double s_;
+  matd_t binv_;
+};
+
 class move_vertex
 {
 public:
@@ -174,6 +242,7 @@ private:
 mips_deformer_2d::mips_deformer_2d(const mati_t &tris, const matd_t &nods)
   : dim_(nods.size()) {
   move_ = make_shared<move_vertex>(tris, nods);
+  elem_ = make_shared<mips_element_energy>(tris, nods);
 }
 
 void mips_deformer_2d::set_fixed_vert(const unordered_set<size_t> &fixed) {
@@ -200,6 +269,18 @@ int mips_deformer_2d::deform(double *x, const size_t maxiter) const {
   return 0;
 }
 
+int mips_deformer_2d::deform_newton(double *x, const size_t maxiter) const {
+  cout << "[info] deform the mesh by projected newton" << endl;
+  vector<size_t> fixed;
+  for (auto &id : fixed_) {
+    fixed.push_back(2*id+0);
+    fixed.push_back(2*id+1);
+  }
+  proj_newton_args args;
+  args.maxiter = maxiter;
+  return proj_newton_solve(*elem_, x, fixed, args);
+}
+
 int mips_deformer_2d::apply(double *x) const {
 //  (*move_)(129, x);
 
@@ -10,6 +10,7 @@ using mati_t=zjucad::matrix::matrix<size_t>;
 using matd_t=zjucad::matrix::matrix<double>;
 
 class move_vertex;
+class mips_element_energy;
 
 class mips_deformer_2d
 {
@@ -17,6 +18,8 @@ public:
   mips_deformer_2d(const mati_t &tris, const matd_t &nods);
   void set_fixed_vert(const std::unordered_set<size_t> &fixed);
   int deform(double *x, const size_t maxiter=20000) const;
+  /// global projected newton, typically converges in tens of iterations
+  int deform_newton(double *x, const size_t maxiter=100) const;
   void unit_test() const;
 private:
   int apply(double *x) const;
@@ -24,6 +27,7 @@ private:
   const size_t dim_;
   std::unordered_set<size_t> fixed_;
   std::shared_ptr<move_vertex> move_;
+  std::shared_ptr<mips_element_energy> elem_;
 };
 
 }
@@ -0,0 +1,71 @@
+#include "anderson.h"
+
+#include <algorithm>
+#include <Eigen/QR>
+
+using namespace std;
+using namespace Eigen;
+
+namespace riemann {
+
+void anderson_acceleration::init(const size_t m, const VectorXd &x0) {
+  m_ = m;
+  dim_ = x0.size();
+  prev_df_.resize(dim_, m_);
+  prev_dg_.resize(dim_, m_);
+  M_.resize(m_, m_);
+  theta_.resize(m_);
+  df_scale_.resize(m_);
+  replace(x0);
+}
+
+void anderson_acceleration::replace(const VectorXd &x) {
+  curr_u_ = x;
+  iter_ = 0;
+  col_idx_ = 0;
+}
+
+const VectorXd &anderson_acceleration::compute(const VectorXd &g) {
+  if ( m_ == 0 ) {
+    curr_u_ = g;
+    return curr_u_;
+  }
+  curr_f_ = g-curr_u_;
+  if ( iter_ == 0 ) {
+    prev_df_.col(0) = -curr_f_;
+    prev_dg_.col(0) = -g;
+    curr_u_ = g;
+  } else {
+    // complete the differences started at the previous step
+    prev_df_.col(col_idx_) += curr_f_;
+    prev_dg_.col(col_idx_) += g;
+    const double eps = 1e-14;
+    const double scale = std::max(eps, prev_df_.col(col_idx_).norm());
+    df_scale_[col_idx_] = scale;
+    prev_df_.col(col_idx_) /= scale;
+
+    const size_t mk = std::min(m_, iter_);
+    if ( mk == 1 ) {
+      theta_[0] = 0;
+      const double df_norm = prev_df_.col(col_idx_).norm();
+      M_(0, 0) = df_norm*df_norm;
+      if ( df_norm > eps )
+        theta_[0] = (prev_df_.col(col_idx_)/df_norm).dot(curr_f_/df_norm);
+    } else {
+      // only one row/column of the normal matrix changes per step
+      VectorXd inner = prev_df_.leftCols(mk).transpose()*prev_df_.col(col_idx_);
+      M_.block(col_idx_, 0, 1, mk) = inner.transpose();
+      M_.block(0, col_idx_, mk, 1) = inner;
+      CompleteOrthogonalDecomposition<MatrixXd> cod(M_.topLeftCorner(mk, mk));
+      theta_.head(mk) = cod.solve(prev_df_.leftCols(mk).transpose()*curr_f_);
+    }
+    curr_u_ = g-prev_dg_.leftCols(mk)*(theta_.head(mk).array()/df_scale_.head(mk).array()).matrix();
+    col_idx_ = (col_idx_+1)%m_;
+    prev_df_.col(col_idx_) = -curr_f_;
+    prev_dg_.col(col_idx_) = -g;
+  }
+  ++iter_;
+  return curr_u_;
+}
+
+}
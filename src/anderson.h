@@ -0,0 +1,39 @@
+#ifndef ANDERSON_ACCELERATION_H
+#define ANDERSON_ACCELERATION_H
+
+#include <Eigen/Dense>
+
+namespace riemann {
+
+/// @brief Anderson acceleration of a fixed point iteration x <- G(x).
+/// Keeps the last m differences of x and G(x), and extrapolates the
+/// next iterate as the combination of G values minimizing the residual
+/// G(x)-x in least squares. A window of 0 turns it into plain G(x).
+///
+/// Usage in a local/global solver with a monotone energy:
+///   aa.init(m, x);
+///   loop: local step at x, E = energy(x)
+///         if E > prev_E: x = prev_G, aa.replace(x), redo local step
+///         G = global step from x
+///         x = aa.compute(G)
+class anderson_acceleration
+{
+public:
+  anderson_acceleration() : m_(0), dim_(0), iter_(0), col_idx_(0) {}
+  void init(const size_t m, const Eigen::VectorXd &x0);
+  /// restart the history from x, e.g. after a rejected extrapolation
+  void replace(const Eigen::VectorXd &x);
+  /// given G(x) of the current iterate return the next iterate
+  const Eigen::VectorXd &compute(const Eigen::VectorXd &g);
+  size_t window() const { return m_; }
+private:
+  size_t m_, dim_, iter_, col_idx_;
+  Eigen::VectorXd curr_u_, curr_f_;
+  Eigen::MatrixXd prev_df_, prev_dg_;
+  Eigen::MatrixXd M_;
+  Eigen::VectorXd theta_, df_scale_;
+};
+
+}
+
+#endif
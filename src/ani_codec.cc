@@ -0,0 +1,302 @@
+#include "ani_codec.h"
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+
+#include "config.h"
+#include "dual_graph.h"
+#include "diffuse_dihedral_rot.h"
+#include "mesh_topology.h"
+#include "timer.h"
+
+using namespace std;
+using namespace zjucad::matrix;
+
+namespace riemann {
+
+static const char ANI_MAGIC[4] = {'R', 'A', 'N', 'I'};
+static const uint32_t ANI_VERSION = 1;
+
+//==============================================================================
+static const uint32_t MODEL_INC = 32;
+static const uint32_t RC_TOP = 1u << 24, RC_BOT = 1u << 16;
+
+adaptive_model::adaptive_model(const size_t n)
+    : freq_(n, 1), total_(n) {
+  ASSERT(n > 0 && n < RC_BOT);
+}
+
+uint32_t adaptive_model::cum(const size_t s) const {
+  uint32_t c = 0;
+  for (size_t i = 0; i < s; ++i)
+    c += freq_[i];
+  return c;
+}
+
+size_t adaptive_model::find(const uint32_t c, uint32_t *cum) const {
+  uint32_t lo = 0;
+  size_t s = 0;
+  for ( ; s+1 < freq_.size() && lo+freq_[s] <= c; ++s)
+    lo += freq_[s];
+  *cum = lo;
+  return s;
+}
+
+void adaptive_model::update(const size_t s) {
+  freq_[s] += MODEL_INC;
+  total_ += MODEL_INC;
+  if ( total_ > RC_BOT ) {
+    total_ = 0;
+    for (auto &f : freq_) {
+      f = (f+1)/2;
+      total_ += f;
+    }
+  }
+}
+
+void range_encoder::encode(const adaptive_model &m, const size_t s) {
+  range_ /= m.total();
+  low_ += m.cum(s)*range_;
+  range_ *= m.freq(s);
+  while ( (low_^(low_+range_)) < RC_TOP || (range_ < RC_BOT && ((range_ = -low_&(RC_BOT-1)), true)) ) {
+    out_.push_back(low_ >> 24);
+    low_ <<= 8;
+    range_ <<= 8;
+  }
+}
+
+void range_encoder::finish() {
+  for (size_t i = 0; i < 4; ++i) {
+    out_.push_back(low_ >> 24);
+    low_ <<= 8;
+  }
+}
+
+range_decoder::range_decoder(const unsigned char *beg, const unsigned char *end)
+    : pos_(beg), end_(end), low_(0), range_(-1), code_(0) {
+  for (size_t i = 0; i < 4; ++i)
+    code_ = (code_ << 8)|next();
+}
+
+size_t range_decoder::decode(const adaptive_model &m) {
+  range_ /= m.total();
+  const uint32_t c = std::min((code_-low_)/range_, m.total()-1);
+  uint32_t cum = 0;
+  const size_t s = m.find(c, &cum);
+  low_ += cum*range_;
+  range_ *= m.freq(s);
+  while ( (low_^(low_+range_)) < RC_TOP || (range_ < RC_BOT && ((range_ = -low_&(RC_BOT-1)), true)) ) {
+    code_ = (code_ << 8)|next();
+    low_ <<= 8;
+    range_ <<= 8;
+  }
+  return s;
+}
+
+//==============================================================================
+/// small residuals get small symbols, the model scans from zero
+static inline size_t zigzag(const int q) {
+  return q >= 0 ? 2*q : -2*q-1;
+}
+
+static inline int unzigzag(const size_t s) {
+  return (s%2 == 0) ? s/2 : -(int)(s/2)-1;
+}
+
+template <typename T>
+static inline void write_pod(ostream &os, const T &v) {
+  os.write((const char *)&v, sizeof(T));
+}
+
+template <typename T>
+static inline bool read_pod(istream &is, T &v) {
+  return (bool)is.read((char *)&v, sizeof(T));
+}
+
+/// the spanning tree is walked in the same pre-order for every frame
+static int build_tree(const mesh_topology &topo, const size_t root, shared_ptr<tree_order_t> &order) {
+  tree_t mst;
+  if ( get_minimum_spanning_tree(topo, mst) )
+    return __LINE__;
+  order = make_shared<tree_order_t>();
+  return get_preorder(topo, mst, root, *order);
+}
+
+/// reconstruction shared by both ends, so their frames agree bit by bit
+static void reconstruct(diffuse_arap_decoder &dec, const mati_t &tris, const tree_order_t &order,
+                        const matd_t &root_curr, const vector<double> &da,
+                        const string &lin_solver, matd_t &prev, matd_t &curr) {
+  for (size_t k = 0; k < 3; ++k)
+    dec.pin_down_vert(tris(k, order.face[0]), &root_curr(0, k));
+  dec.estimate_rotation(prev, order, root_curr, da);
+  dec.solve(curr, lin_solver);
+  prev = curr;
+}
+
+//==============================================================================
+ani_sequence_encoder::ani_sequence_encoder(const mati_t &tris, const matd_t &rest, const ani_codec_args &args)
+    : tris_(tris), rest_(rest), args_(args), model_(2*args.bound+1), prev_(rest),
+      pred_(tris.size(2)-1, 0.0), frames_(0), bytes_(0) {
+  ASSERT(args_.bound > 0 && args_.root_face < tris_.size(2));
+  enc_ = make_shared<diffuse_arap_encoder>();
+  dec_ = make_shared<diffuse_arap_decoder>(tris_, rest_);
+  if ( build_tree(dec_->topology(), args_.root_face, order_) )
+    ASSERT(0);
+}
+
+ani_sequence_encoder::~ani_sequence_encoder() {
+  if ( ofs_.is_open() )
+    close();
+}
+
+int ani_sequence_encoder::open(const char *file) {
+  ofs_.open(file, ios::binary);
+  if ( ofs_.fail() ) {
+    cerr << "[Error] can not open " << file << endl;
+    return __LINE__;
+  }
+  ofs_.write(ANI_MAGIC, 4);
+  write_pod(ofs_, ANI_VERSION);
+  write_pod(ofs_, (uint64_t)rest_.size(2));
+  write_pod(ofs_, (uint64_t)tris_.size(2));
+  write_pod(ofs_, (uint64_t)0);  // frame number, patched by close()
+  write_pod(ofs_, args_.qstep);
+  write_pod(ofs_, (int32_t)args_.bound);
+  write_pod(ofs_, (uint64_t)args_.root_face);
+  write_pod(ofs_, (uint8_t)(args_.lin_solver == "GS"));
+  for (size_t i = 0; i < tris_.size(); ++i)
+    write_pod(ofs_, (uint32_t)tris_[i]);
+  ofs_.write((const char *)&rest_[0], rest_.size()*sizeof(double));
+  return ofs_.fail() ? __LINE__ : 0;
+}
+
+int ani_sequence_encoder::encode_frame(const matd_t &curr, matd_t *rec) {
+  if ( !ofs_.is_open() || curr.size(2) != rest_.size(2) )
+    return __LINE__;
+  vector<double> da;
+  matd_t root_curr, leaf_curr;
+  enc_->calc_delta_angle(tris_, prev_, curr, *order_, args_.root_face, root_curr, leaf_curr, da);
+  ASSERT(da.size() == pred_.size());
+
+  range_encoder coder;
+  for (size_t i = 0; i < da.size(); ++i) {
+    const double e = (da[i]-pred_[i])/args_.qstep;
+    const int q = std::max(-args_.bound, std::min(args_.bound, (int)std::lround(e)));
+    const size_t s = zigzag(q);
+    coder.encode(model_, s);
+    model_.update(s);
+    // the dequantized change predicts the next frame
+    pred_[i] += q*args_.qstep;
+  }
+  coder.finish();
+
+  ofs_.write((const char *)&root_curr[0], 9*sizeof(double));
+  write_pod(ofs_, (uint32_t)coder.bytes().size());
+  ofs_.write((const char *)coder.bytes().data(), coder.bytes().size());
+  bytes_ += 9*sizeof(double)+sizeof(uint32_t)+coder.bytes().size();
+  ++frames_;
+
+  matd_t curr_rec(3, rest_.size(2));
+  reconstruct(*dec_, tris_, *order_, root_curr, pred_, args_.lin_solver, prev_, curr_rec);
+  if ( rec )
+    *rec = curr_rec;
+  return ofs_.fail() ? __LINE__ : 0;
+}
+
+int ani_sequence_encoder::close() {
+  if ( !ofs_.is_open() )
+    return __LINE__;
+  ofs_.seekp(4+sizeof(uint32_t)+2*sizeof(uint64_t));
+  write_pod(ofs_, (uint64_t)frames_);
+  ofs_.close();
+  if ( frames_ > 0 )
+    printf("[info] encoded %zu frames, %.3lf bits per vertex per frame\n",
+           frames_, 8.0*bytes_/(frames_*rest_.size(2)));
+  return 0;
+}
+
+//==============================================================================
+ani_sequence_decoder::ani_sequence_decoder()
+    : frame_num_(0), frames_(0), time_(0) {}
+
+ani_sequence_decoder::~ani_sequence_decoder() {}
+
+int ani_sequence_decoder::open(const char *file) {
+  ifs_.open(file, ios::binary);
+  if ( ifs_.fail() ) {
+    cerr << "[Error] can not open " << file << endl;
+    return __LINE__;
+  }
+  char magic[4];
+  uint32_t version;
+  uint64_t nv, nf, nfr, root;
+  int32_t bound;
+  uint8_t gs;
+  if ( !ifs_.read(magic, 4) || memcmp(magic, ANI_MAGIC, 4) || !read_pod(ifs_, version) || version != ANI_VERSION ) {
+    cerr << "[Error] not an animation container " << file << endl;
+    return __LINE__;
+  }
+  if ( !read_pod(ifs_, nv) || !read_pod(ifs_, nf) || !read_pod(ifs_, nfr) ||
+       !read_pod(ifs_, args_.qstep) || !read_pod(ifs_, bound) || !read_pod(ifs_, root) || !read_pod(ifs_, gs) )
+    return __LINE__;
+  args_.bound = bound;
+  args_.root_face = root;
+  args_.lin_solver = gs ? "GS" : "direct";
+  frame_num_ = nfr;
+  tris_.resize(3, nf);
+  for (size_t i = 0; i < tris_.size(); ++i) {
+    uint32_t v;
+    if ( !read_pod(ifs_, v) )
+      return __LINE__;
+    tris_[i] = v;
+  }
+  rest_.resize(3, nv);
+  if ( !ifs_.read((char *)&rest_[0], rest_.size()*sizeof(double)) )
+    return __LINE__;
+
+  dec_ = make_shared<diffuse_arap_decoder>(tris_, rest_);
+  if ( build_tree(dec_->topology(), args_.root_face, order_) )
+    return __LINE__;
+  model_ = make_shared<adaptive_model>(2*args_.bound+1);
+  prev_ = rest_;
+  pred_.assign(nf-1, 0.0);
+  frames_ = 0;
+  time_ = 0;
+  return 0;
+}
+
+int ani_sequence_decoder::decode_frame(matd_t &curr) {
+  if ( frames_ >= frame_num_ )
+    return __LINE__;
+  high_resolution_timer clk;
+  clk.start();
+  matd_t root_curr(3, 3);
+  uint32_t nbytes = 0;
+  if ( !ifs_.read((char *)&root_curr[0], 9*sizeof(double)) || !read_pod(ifs_, nbytes) )
+    return __LINE__;
+  vector<unsigned char> buf(nbytes);
+  if ( !ifs_.read((char *)buf.data(), nbytes) )
+    return __LINE__;
+
+  range_decoder coder(buf.data(), buf.data()+buf.size());
+  for (size_t i = 0; i < pred_.size(); ++i) {
+    const size_t s = coder.decode(*model_);
+    model_->update(s);
+    pred_[i] += unzigzag(s)*args_.qstep;
+  }
+  curr.resize(3, rest_.size(2));
+  reconstruct(*dec_, tris_, *order_, root_curr, pred_, args_.lin_solver, prev_, curr);
+  clk.stop();
+  time_ += clk.period();
+  ++frames_;
+  return 0;
+}
+
+void ani_sequence_decoder::report() const {
+  if ( frames_ > 0 )
+    printf("[info] decoded %zu frames, %.3lf ms per frame, %.2lf fps\n",
+           frames_, time_/frames_, 1000.0*frames_/time_);
+}
+
+}
@@ -0,0 +1,132 @@
+#ifndef ANI_CODEC_H
+#define ANI_CODEC_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <zjucad/matrix/matrix.h>
+
+namespace riemann {
+
+using mati_t=zjucad::matrix::matrix<size_t>;
+using matd_t=zjucad::matrix::matrix<double>;
+
+struct tree_order_t;
+class diffuse_arap_encoder;
+class diffuse_arap_decoder;
+
+/// @brief adaptive frequency table over symbols 0...n-1, shared in
+/// lockstep by the range encoder and decoder
+class adaptive_model
+{
+public:
+  explicit adaptive_model(const size_t n);
+  size_t size() const { return freq_.size(); }
+  uint32_t total() const { return total_; }
+  uint32_t freq(const size_t s) const { return freq_[s]; }
+  uint32_t cum(const size_t s) const;
+  /// symbol whose cumulative interval contains c, cum receives its start
+  size_t find(const uint32_t c, uint32_t *cum) const;
+  void update(const size_t s);
+private:
+  std::vector<uint32_t> freq_;
+  uint32_t total_;
+};
+
+/// carry-less 32-bit range coder after Subbotin
+class range_encoder
+{
+public:
+  range_encoder() : low_(0), range_(-1) {}
+  void encode(const adaptive_model &m, const size_t s);
+  void finish();
+  const std::vector<unsigned char> &bytes() const { return out_; }
+private:
+  uint32_t low_, range_;
+  std::vector<unsigned char> out_;
+};
+
+class range_decoder
+{
+public:
+  range_decoder(const unsigned char *beg, const unsigned char *end);
+  size_t decode(const adaptive_model &m);
+private:
+  unsigned char next() { return pos_ < end_ ? *pos_++ : 0; }
+  const unsigned char *pos_, *end_;
+  uint32_t low_, range_, code_;
+};
+
+struct ani_codec_args {
+  double qstep;       // quantization step of the angle residuals in radians
+  int bound;          // residuals are clamped to [-bound, bound] steps
+  size_t root_face;   // face whose vertices are stored as anchors
+  std::string lin_solver;
+  ani_codec_args() : qstep(1e-3), bound(127), root_face(0), lin_solver("direct") {}
+};
+
+/**
+ * @brief streaming codec of a triangle mesh animation into one file.
+ *
+ * The container starts with the rest mesh and the codec arguments.
+ * Each frame stores the root face vertices and the dihedral angle
+ * changes along a spanning tree of the dual graph. The changes are
+ * predicted from those of the previous frame, and the quantized
+ * residuals are range coded with a model adapted over the whole
+ * sequence. The encoder runs the decoder to measure the angles
+ * against the reconstructed previous frame, so errors do not drift.
+ */
+class ani_sequence_encoder
+{
+public:
+  ani_sequence_encoder(const mati_t &tris, const matd_t &rest, const ani_codec_args &args=ani_codec_args());
+  ~ani_sequence_encoder();
+  int open(const char *file);
+  /// rec receives the frame as the decoder will reconstruct it
+  int encode_frame(const matd_t &curr, matd_t *rec=nullptr);
+  int close();
+private:
+  const mati_t tris_;
+  const matd_t rest_;
+  const ani_codec_args args_;
+  std::ofstream ofs_;
+  std::shared_ptr<tree_order_t> order_;
+  std::shared_ptr<diffuse_arap_encoder> enc_;
+  std::shared_ptr<diffuse_arap_decoder> dec_;
+  adaptive_model model_;
+  matd_t prev_;
+  std::vector<double> pred_;
+  size_t frames_, bytes_;
+};
+
+class ani_sequence_decoder
+{
+public:
+  ani_sequence_decoder();
+  ~ani_sequence_decoder();
+  int open(const char *file);
+  size_t frame_num() const { return frame_num_; }
+  const mati_t &tris() const { return tris_; }
+  const matd_t &rest() const { return rest_; }
+  /// non-zero once the sequence is exhausted
+  int decode_frame(matd_t &curr);
+  void report() const;
+private:
+  std::ifstream ifs_;
+  mati_t tris_;
+  matd_t rest_;
+  ani_codec_args args_;
+  size_t frame_num_, frames_;
+  std::shared_ptr<tree_order_t> order_;
+  std::shared_ptr<diffuse_arap_decoder> dec_;
+  std::shared_ptr<adaptive_model> model_;
+  matd_t prev_;
+  std::vector<double> pred_;
+  double time_;
+};
+
+}
+
+#endif
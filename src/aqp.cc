@@ -1,9 +1,19 @@
 #include "aqp.h"
 
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <Eigen/Dense>
+#include <Eigen/Eigenvalues>
+#include <zjucad/matrix/itr_matrix.h>
+
 #include "def.h"
+#include "config.h"
+#include "geometry_extend.h"
 
 using namespace std;
 using namespace Eigen;
+using namespace zjucad::matrix;
 
 namespace riemann {
 
@@ -17,33 +27,540 @@ void two_dim_iso_(double *val, const double *x, const double *Dm, const double *
 void two_dim_iso_jac_(double *jac, const double *x, const double *Dm, const double *area);
 void two_dim_iso_hes_(double *hes, const double *x, const double *Dm, const double *area);
 
+void tet_arap_(double *val, const double *x, const double *D, const double *R, const double *vol);
+void tet_arap_jac_(double *jac, const double *x, const double *D, const double *R, const double *vol);
+void tet_arap_hes_(double *hes, const double *x, const double *D, const double *R, const double *vol);
+
+}
+
+/// smallest positive root of c[0]+c[1]*t+...+c[deg]*t^deg, +inf if none
+static double smallest_positive_root(const double *c, int deg) {
+  const double inf = numeric_limits<double>::infinity();
+  double scale = 0;
+  for (int i = 0; i <= deg; ++i)
+    scale = std::max(scale, std::fabs(c[i]));
+  if ( scale == 0 )
+    return inf;
+  while ( deg > 0 && std::fabs(c[deg]) <= 1e-14*scale )
+    --deg;
+  if ( deg == 0 )
+    return inf;
+  if ( deg == 1 ) {
+    const double t = -c[0]/c[1];
+    return t > 0 ? t : inf;
+  }
+  if ( deg == 2 ) {
+    const double disc = c[1]*c[1]-4*c[2]*c[0];
+    if ( disc < 0 )
+      return inf;
+    // numerically stable pair of roots
+    const double q = -0.5*(c[1]+(c[1] >= 0 ? 1 : -1)*std::sqrt(disc));
+    double t = inf;
+    const double r1 = q/c[2], r2 = (q != 0) ? c[0]/q : inf;
+    if ( r1 > 0 ) t = std::min(t, r1);
+    if ( r2 > 0 ) t = std::min(t, r2);
+    return t;
+  }
+  // cubic, eigenvalues of the companion matrix
+  Matrix3d C = Matrix3d::Zero();
+  C(1, 0) = C(2, 1) = 1;
+  C(0, 2) = -c[0]/c[3];
+  C(1, 2) = -c[1]/c[3];
+  C(2, 2) = -c[2]/c[3];
+  EigenSolver<Matrix3d> sol(C, false);
+  double t = inf;
+  for (int i = 0; i < 3; ++i) {
+    const complex<double> r = sol.eigenvalues()[i];
+    if ( std::fabs(r.imag()) <= 1e-12*std::max(1.0, std::fabs(r.real())) && r.real() > 0 )
+      t = std::min(t, r.real());
+  }
+  return t;
 }
 
+//--------------------------------------------------------------------------
+//- energies
+//--------------------------------------------------------------------------
+
 class two_dim_arap_energy : public Functional<double>
 {
 public:
-  size_t Nx() const;
-  int Val(const double *x, double *val) const;
-  int Gra(const double *x, double *gra) const;
-  int Hes(const double *x, vector<Triplet<double>> *hes) const;
+  two_dim_arap_energy(const mati_t &tris, const matd_t &nods, const double w=1.0)
+    : tris_(tris), dim_(2*nods.size(2)), w_(w) {
+    init_rest_shape(tris, nods, Dm_, area_);
+    R_ = zeros<double>(4, tris.size(2));
+    R_(0, colon()) = R_(3, colon()) = ones<double>(1, tris.size(2));
+  }
+  static void init_rest_shape(const mati_t &tris, const matd_t &nods, matd_t &Dm, matd_t &area) {
+    matd_t origin, axis, luv;
+    calc_face_local_frame(tris, nods, origin, axis);
+    calc_local_uv(tris, nods, origin, axis, luv);
+    Dm.resize(4, tris.size(2));
+    area.resize(tris.size(2), 1);
+#pragma omp parallel for
+    for (size_t i = 0; i < tris.size(2); ++i) {
+      Matrix2d base;
+      base.col(0) = Vector2d(luv(2, i)-luv(0, i), luv(3, i)-luv(1, i));
+      base.col(1) = Vector2d(luv(4, i)-luv(0, i), luv(5, i)-luv(1, i));
+      area[i] = 0.5*std::fabs(base.determinant());
+      Map<Matrix2d>(&Dm(0, i)) = base.inverse();
+    }
+  }
+  size_t Nx() const {
+    return dim_;
+  }
+  int Val(const double *x, double *val) const {
+    itr_matrix<const double *> X(2, dim_/2, x);
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      matd_t vert = X(colon(), tris_(colon(), i));
+      double value = 0;
+      two_dim_arap_(&value, &vert[0], &Dm_(0, i), &R_(0, i), &area_[i]);
+      *val += w_*value;
+    }
+    return 0;
+  }
+  int Gra(const double *x, double *gra) const {
+    itr_matrix<const double *> X(2, dim_/2, x);
+    itr_matrix<double *> G(2, dim_/2, gra);
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      matd_t vert = X(colon(), tris_(colon(), i));
+      matd_t g = zeros<double>(2, 3);
+      two_dim_arap_jac_(&g[0], &vert[0], &Dm_(0, i), &R_(0, i), &area_[i]);
+      for (size_t j = 0; j < 3; ++j)
+        G(colon(), tris_(j, i)) += w_*g(colon(), j);
+    }
+    return 0;
+  }
+  int Hes(const double *x, vector<Triplet<double>> *hes) const {
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      // the hessian does not depend on x
+      matd_t vert = zeros<double>(2, 3);
+      matd_t H = zeros<double>(6, 6);
+      two_dim_arap_hes_(&H[0], &vert[0], &Dm_(0, i), &R_(0, i), &area_[i]);
+      for (size_t p = 0; p < 6; ++p) {
+        for (size_t q = 0; q < 6; ++q) {
+          if ( H(p, q) != 0.0 ) {
+            const size_t I = 2*tris_(p/2, i)+p%2, J = 2*tris_(q/2, i)+q%2;
+            hes->push_back(Triplet<double>(I, J, w_*H(p, q)));
+          }
+        }
+      }
+    }
+    return 0;
+  }
+private:
+  const mati_t &tris_;
+  const size_t dim_;
+  const double w_;
+  matd_t Dm_, area_, R_;
 };
 
+/// symmetric Dirichlet, +inf on inverted triangles
 class two_dim_iso_energy : public Functional<double>
 {
 public:
-  size_t Nx() const;
-  int Val(const double *x, double *val) const;
-  int Gra(const double *x, double *gra) const;
-  int Hes(const double *x, vector<Triplet<double>> *hes) const;
+  two_dim_iso_energy(const mati_t &tris, const matd_t &nods, const double w=1.0)
+    : tris_(tris), dim_(2*nods.size(2)), w_(w) {
+    two_dim_arap_energy::init_rest_shape(tris, nods, Dm_, area_);
+  }
+  size_t Nx() const {
+    return dim_;
+  }
+  int Val(const double *x, double *val) const {
+    itr_matrix<const double *> X(2, dim_/2, x);
+    double sum = 0;
+    bool inverted = false;
+#pragma omp parallel for reduction(+:sum) reduction(||:inverted)
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      matd_t vert = X(colon(), tris_(colon(), i));
+      Matrix2d Ds;
+      Ds.col(0) = Vector2d(vert(0, 1)-vert(0, 0), vert(1, 1)-vert(1, 0));
+      Ds.col(1) = Vector2d(vert(0, 2)-vert(0, 0), vert(1, 2)-vert(1, 0));
+      if ( Ds.determinant()*Map<const Matrix2d>(&Dm_(0, i)).determinant() <= 0 ) {
+        inverted = true;
+        continue;
+      }
+      double value = 0;
+      two_dim_iso_(&value, &vert[0], &Dm_(0, i), &area_[i]);
+      sum += value;
+    }
+    *val += inverted ? numeric_limits<double>::infinity() : w_*sum;
+    return 0;
+  }
+  int Gra(const double *x, double *gra) const {
+    itr_matrix<const double *> X(2, dim_/2, x);
+    itr_matrix<double *> G(2, dim_/2, gra);
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      matd_t vert = X(colon(), tris_(colon(), i));
+      matd_t g = zeros<double>(2, 3);
+      two_dim_iso_jac_(&g[0], &vert[0], &Dm_(0, i), &area_[i]);
+      for (size_t j = 0; j < 3; ++j)
+        G(colon(), tris_(j, i)) += w_*g(colon(), j);
+    }
+    return 0;
+  }
+  int Hes(const double *x, vector<Triplet<double>> *hes) const {
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      matd_t vert = zeros<double>(2, 3);
+      if ( x != nullptr )
+        vert = itr_matrix<const double *>(2, dim_/2, x)(colon(), tris_(colon(), i));
+      matd_t H = zeros<double>(6, 6);
+      two_dim_iso_hes_(&H[0], &vert[0], &Dm_(0, i), &area_[i]);
+      for (size_t p = 0; p < 6; ++p) {
+        for (size_t q = 0; q < 6; ++q) {
+          if ( H(p, q) != 0.0 ) {
+            const size_t I = 2*tris_(p/2, i)+p%2, J = 2*tris_(q/2, i)+q%2;
+            hes->push_back(Triplet<double>(I, J, w_*H(p, q)));
+          }
+        }
+      }
+    }
+    return 0;
+  }
+  /// largest step before some triangle degenerates
+  double MaxStep(const double *x, const double *p) const {
+    itr_matrix<const double *> X(2, dim_/2, x), P(2, dim_/2, p);
+    double t = numeric_limits<double>::infinity();
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      Matrix2d Ds, Dp;
+      for (size_t j = 0; j < 2; ++j) {
+        for (size_t k = 0; k < 2; ++k) {
+          Ds(k, j) = X(k, tris_(j+1, i))-X(k, tris_(0, i));
+          Dp(k, j) = P(k, tris_(j+1, i))-P(k, tris_(0, i));
+        }
+      }
+      const double c[3] = {Ds.determinant(),
+                           Ds(0, 0)*Dp(1, 1)+Dp(0, 0)*Ds(1, 1)-Ds(0, 1)*Dp(1, 0)-Dp(0, 1)*Ds(1, 0),
+                           Dp.determinant()};
+      t = std::min(t, smallest_positive_root(c, 2));
+    }
+    return t;
+  }
+private:
+  const mati_t &tris_;
+  const size_t dim_;
+  const double w_;
+  matd_t Dm_, area_;
 };
 
-class two_dim_pos_cons : public Constraint<double>
+/// Hessian of the Dirichlet part of tet_iso_energy
+class tet_arap_energy : public Functional<double>
 {
 public:
-  size_t Nx() const;
-  size_t Nf() const;
-  int Val(const double *x, double *val) const;
-  int Jac(const double *x, const size_t off, vector<Triplet<double>> *jac) const;
+  tet_arap_energy(const mati_t &tets, const matd_t &nods, const double w=1.0)
+    : tets_(tets), dim_(nods.size()), w_(w) {
+    init_rest_shape(tets, nods, D_, vol_);
+    R_ = zeros<double>(9, tets.size(2));
+    R_(0, colon()) = R_(4, colon()) = R_(8, colon()) = ones<double>(1, tets.size(2));
+  }
+  static void init_rest_shape(const mati_t &tets, const matd_t &nods, matd_t &D, matd_t &vol) {
+    D.resize(9, tets.size(2));
+    vol.resize(tets.size(2), 1);
+#pragma omp parallel for
+    for (size_t i = 0; i < tets.size(2); ++i) {
+      matd_t base = nods(colon(), tets(colon(1, 3), i))-nods(colon(), tets(0, i))*ones<double>(1, 3);
+      Map<const Matrix3d> B(&base[0]);
+      vol[i] = std::fabs(B.determinant())/6.0;
+      Map<Matrix3d>(&D(0, i)) = B.inverse();
+    }
+  }
+  size_t Nx() const {
+    return dim_;
+  }
+  int Val(const double *x, double *val) const {
+    itr_matrix<const double *> X(3, dim_/3, x);
+    for (size_t i = 0; i < tets_.size(2); ++i) {
+      matd_t vert = X(colon(), tets_(colon(), i));
+      double value = 0;
+      tet_arap_(&value, &vert[0], &D_(0, i), &R_(0, i), &vol_[i]);
+      *val += w_*value;
+    }
+    return 0;
+  }
+  int Gra(const double *x, double *gra) const {
+    itr_matrix<const double *> X(3, dim_/3, x);
+    itr_matrix<double *> G(3, dim_/3, gra);
+    for (size_t i = 0; i < tets_.size(2); ++i) {
+      matd_t vert = X(colon(), tets_(colon(), i));
+      matd_t g = zeros<double>(3, 4);
+      tet_arap_jac_(&g[0], &vert[0], &D_(0, i), &R_(0, i), &vol_[i]);
+      for (size_t j = 0; j < 4; ++j)
+        G(colon(), tets_(j, i)) += w_*g(colon(), j);
+    }
+    return 0;
+  }
+  int Hes(const double *x, vector<Triplet<double>> *hes) const {
+    for (size_t i = 0; i < tets_.size(2); ++i) {
+      matd_t H = zeros<double>(12, 12);
+      tet_arap_hes_(&H[0], nullptr, &D_(0, i), &R_(0, i), &vol_[i]);
+      for (size_t p = 0; p < 12; ++p) {
+        for (size_t q = 0; q < 12; ++q) {
+          if ( H(p, q) != 0.0 ) {
+            const size_t I = 3*tets_(p/3, i)+p%3, J = 3*tets_(q/3, i)+q%3;
+            hes->push_back(Triplet<double>(I, J, w_*H(p, q)));
+          }
+        }
+      }
+    }
+    return 0;
+  }
+private:
+  const mati_t &tets_;
+  const size_t dim_;
+  const double w_;
+  matd_t D_, vol_, R_;
 };
 
+/// symmetric Dirichlet vol*(|F|^2+|F^{-1}|^2), +inf on inverted tets
+class tet_iso_energy : public Functional<double>
+{
+public:
+  tet_iso_energy(const mati_t &tets, const matd_t &nods, const double w=1.0)
+    : tets_(tets), dim_(nods.size()), w_(w) {
+    tet_arap_energy::init_rest_shape(tets, nods, D_, vol_);
+  }
+  size_t Nx() const {
+    return dim_;
+  }
+  int Val(const double *x, double *val) const {
+    double sum = 0;
+    bool inverted = false;
+#pragma omp parallel for reduction(+:sum) reduction(||:inverted)
+    for (size_t i = 0; i < tets_.size(2); ++i) {
+      const Matrix3d F = calc_def_grad(x, i);
+      const double det = F.determinant();
+      if ( det <= 0 ) {
+        inverted = true;
+        continue;
+      }
+      sum += vol_[i]*(F.squaredNorm()+F.inverse().squaredNorm());
+    }
+    *val += inverted ? numeric_limits<double>::infinity() : w_*sum;
+    return 0;
+  }
+  int Gra(const double *x, double *gra) const {
+    itr_matrix<double *> G(3, dim_/3, gra);
+    for (size_t i = 0; i < tets_.size(2); ++i) {
+      const Matrix3d F = calc_def_grad(x, i);
+      const Matrix3d Finv = F.inverse();
+      const Matrix3d dF = 2*vol_[i]*(F-Finv.transpose()*Finv*Finv.transpose());
+      const Matrix3d dDs = w_*dF*Map<const Matrix3d>(&D_(0, i)).transpose();
+      for (size_t j = 0; j < 3; ++j) {
+        for (size_t k = 0; k < 3; ++k) {
+          G(k, tets_(j+1, i)) += dDs(k, j);
+          G(k, tets_(0, i)) -= dDs(k, j);
+        }
+      }
+    }
+    return 0;
+  }
+  int Hes(const double *x, vector<Triplet<double>> *hes) const {
+    return __LINE__;
+  }
+  /// largest step before some tet degenerates
+  double MaxStep(const double *x, const double *p) const {
+    double t = numeric_limits<double>::infinity();
+    for (size_t i = 0; i < tets_.size(2); ++i) {
+      const Matrix3d Ds = calc_edge_mat(x, i), Dp = calc_edge_mat(p, i);
+      // det(Ds+t*Dp) expanded with adjugates, rows are cofactors
+      Matrix3d adj_s, adj_p;
+      adj_s << Ds.col(1).cross(Ds.col(2)).transpose(),
+          Ds.col(2).cross(Ds.col(0)).transpose(),
+          Ds.col(0).cross(Ds.col(1)).transpose();
+      adj_p << Dp.col(1).cross(Dp.col(2)).transpose(),
+          Dp.col(2).cross(Dp.col(0)).transpose(),
+          Dp.col(0).cross(Dp.col(1)).transpose();
+      const double c[4] = {Ds.determinant(), (adj_s*Dp).trace(), (adj_p*Ds).trace(), Dp.determinant()};
+      t = std::min(t, smallest_positive_root(c, 3));
+    }
+    return t;
+  }
+private:
+  Matrix3d calc_edge_mat(const double *x, const size_t i) const {
+    Matrix3d Ds;
+    for (size_t j = 0; j < 3; ++j)
+      Ds.col(j) = Map<const Vector3d>(x+3*tets_(j+1, i))-Map<const Vector3d>(x+3*tets_(0, i));
+    return Ds;
+  }
+  Matrix3d calc_def_grad(const double *x, const size_t i) const {
+    return calc_edge_mat(x, i)*Map<const Matrix3d>(&D_(0, i));
+  }
+  const mati_t &tets_;
+  const size_t dim_;
+  const double w_;
+  matd_t D_, vol_;
+};
+
+/// pins vertices at their given positions
+class pos_cons : public Constraint<double>
+{
+public:
+  pos_cons(const size_t dim, const size_t nbr_vert, const vector<size_t> &fixed, const double *x0)
+    : dim_(dim), nx_(dim*nbr_vert), fixed_(fixed), pos_(dim*fixed.size()) {
+    for (size_t i = 0; i < fixed_.size(); ++i)
+      std::copy(x0+dim_*fixed_[i], x0+dim_*fixed_[i]+dim_, &pos_[dim_*i]);
+  }
+  size_t Nx() const {
+    return nx_;
+  }
+  size_t Nf() const {
+    return dim_*fixed_.size();
+  }
+  int Val(const double *x, double *val) const {
+    for (size_t i = 0; i < fixed_.size(); ++i)
+      for (size_t k = 0; k < dim_; ++k)
+        val[dim_*i+k] += x[dim_*fixed_[i]+k]-pos_[dim_*i+k];
+    return 0;
+  }
+  int Jac(const double *x, const size_t off, vector<Triplet<double>> *jac) const {
+    for (size_t i = 0; i < fixed_.size(); ++i)
+      for (size_t k = 0; k < dim_; ++k)
+        jac->push_back(Triplet<double>(off+dim_*i+k, dim_*fixed_[i]+k, 1.0));
+    return 0;
+  }
+private:
+  const size_t dim_, nx_;
+  const vector<size_t> fixed_;
+  vector<double> pos_;
+};
+
+//--------------------------------------------------------------------------
+//- solver
+//--------------------------------------------------------------------------
+
+aqp_solver::aqp_solver(const shared_ptr<Functional<double>> &energy,
+                       const shared_ptr<Functional<double>> &proxy,
+                       const shared_ptr<Constraint<double>> &cons,
+                       const max_step_t &max_step,
+                       const aqp_args &args)
+  : energy_(energy), proxy_(proxy), cons_(cons), max_step_(max_step), args_(args) {}
+
+int aqp_solver::prefactorize() {
+  const size_t nx = energy_->Nx(), nf = cons_.get() ? cons_->Nf() : 0;
+  vector<Triplet<double>> trips;
+  VectorXd zero = VectorXd::Zero(nx);
+  proxy_->Hes(&zero[0], &trips);
+  if ( cons_.get() ) {
+    vector<Triplet<double>> jac;
+    cons_->Jac(&zero[0], 0, &jac);
+    for (auto &t : jac) {
+      trips.push_back(Triplet<double>(nx+t.row(), t.col(), t.value()));
+      trips.push_back(Triplet<double>(t.col(), nx+t.row(), t.value()));
+    }
+  }
+  SparseMatrix<double> K(nx+nf, nx+nf);
+  K.setFromTriplets(trips.begin(), trips.end());
+  kkt_.compute(K);
+  if ( kkt_.info() != Success ) {
+    cerr << "[error] AQP prefactorization failed\n";
+    return __LINE__;
+  }
+  return 0;
+}
+
+int aqp_solver::line_search(const double *y, const VectorXd &p, const double *gra,
+                            const double val, double *t, double *new_val) const {
+  const size_t nx = energy_->Nx();
+  Map<const VectorXd> Y(y, nx), G(gra, nx);
+  const double slope = G.dot(p);
+  if ( slope >= 0 )
+    return __LINE__;
+  // stay clear of the first degenerate element
+  *t = std::min(1.0, 0.9*max_step_(y, p.data()));
+  VectorXd x(nx);
+  for (size_t i = 0; i < 64; ++i, *t *= args_.shrink) {
+    x = Y+(*t)*p;
+    *new_val = 0;
+    energy_->Val(&x[0], new_val);
+    if ( *new_val <= val+1e-4*(*t)*slope )
+      return 0;
+  }
+  return __LINE__;
+}
+
+int aqp_solver::solve(double *x) const {
+  const size_t nx = energy_->Nx(), nf = cons_.get() ? cons_->Nf() : 0;
+  Map<VectorXd> X(x, nx);
+  VectorXd xk = X, xprev = X, y(nx), d(nx), g(nx), rhs = VectorXd::Zero(nx+nf), p(nx);
+  const double theta = (1-std::sqrt(1/args_.kappa))/(1+std::sqrt(1/args_.kappa));
+
+  double prev_val = 0;
+  energy_->Val(&xk[0], &prev_val);
+  if ( std::isinf(prev_val) ) {
+    cerr << "[error] AQP needs an injective initial guess\n";
+    return __LINE__;
+  }
+  size_t iter = 0;
+  for ( ; iter < args_.maxiter; ++iter) {
+    // momentum, damped so that the extrapolated point stays injective
+    d = xk-xprev;
+    double th = theta;
+    if ( d.squaredNorm() > 0 )
+      th = std::min(th, 0.5*max_step_(&xk[0], &d[0]));
+    y = xk+th*d;
+    double yval = 0;
+    energy_->Val(&y[0], &yval);
+
+    g.setZero();
+    energy_->Gra(&y[0], &g[0]);
+    rhs.head(nx) = -g;
+    p = kkt_.solve(rhs).head(nx);
+
+    double t = 0, new_val = yval;
+    if ( line_search(&y[0], p, &g[0], yval, &t, &new_val) ) {
+      cout << "\t@line search failed at iteration " << iter << endl;
+      break;
+    }
+    xprev = xk;
+    xk = y+t*p;
+    cout << "\t@iter " << iter << " energy: " << new_val << " step: " << t << endl;
+
+    const double decrease = prev_val-new_val;
+    if ( decrease < 0 ) {
+      // restart the momentum when it overshoots
+      xprev = xk;
+    } else if ( decrease <= args_.tolerance*prev_val ) {
+      prev_val = new_val;
+      ++iter;
+      break;
+    }
+    prev_val = new_val;
+  }
+  cout << "[info] AQP stopped after " << iter << " iterations, energy: " << prev_val << endl;
+  X = xk;
+  return 0;
+}
+
+//--------------------------------------------------------------------------
+//- drivers
+//--------------------------------------------------------------------------
+
+int aqp_param(const mati_t &tris, const matd_t &nods, const vector<size_t> &fixed,
+              const aqp_args &args, matd_t &uv) {
+  ASSERT(uv.size(1) == 2 && uv.size(2) == nods.size(2));
+  auto iso = make_shared<two_dim_iso_energy>(tris, nods);
+  auto proxy = make_shared<two_dim_arap_energy>(tris, nods);
+  // pin one vertex to remove the translation if nothing is fixed
+  const vector<size_t> pinned = fixed.empty() ? vector<size_t>{tris(0, 0)} : fixed;
+  auto cons = make_shared<pos_cons>(2, nods.size(2), pinned, &uv[0]);
+  aqp_solver solver(iso, proxy, cons,
+                    [iso](const double *x, const double *p) { return iso->MaxStep(x, p); }, args);
+  if ( solver.prefactorize() )
+    return __LINE__;
+  return solver.solve(&uv[0]);
+}
+
+int aqp_tet_deform(const mati_t &tets, const matd_t &rest, const vector<size_t> &fixed,
+                   const aqp_args &args, matd_t &x) {
+  ASSERT(x.size(1) == 3 && x.size(2) == rest.size(2));
+  auto iso = make_shared<tet_iso_energy>(tets, rest);
+  auto proxy = make_shared<tet_arap_energy>(tets, rest);
+  const vector<size_t> pinned = fixed.empty() ? vector<size_t>{tets(0, 0)} : fixed;
+  auto cons = make_shared<pos_cons>(3, rest.size(2), pinned, &x[0]);
+  aqp_solver solver(iso, proxy, cons,
+                    [iso](const double *x, const double *p) { return iso->MaxStep(x, p); }, args);
+  if ( solver.prefactorize() )
+    return __LINE__;
+  return solver.solve(&x[0]);
+}
+
 }
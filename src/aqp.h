@@ -1,8 +1,69 @@
 #ifndef AQP_H
 #define AQP_H
 
+#include <memory>
+#include <functional>
+#include <vector>
+#include <zjucad/matrix/matrix.h>
+#include <Eigen/Sparse>
+#include <Eigen/UmfPackSupport>
+
 namespace riemann {
 
+using mati_t=zjucad::matrix::matrix<size_t>;
+using matd_t=zjucad::matrix::matrix<double>;
+
+template <typename T>
+class Functional;
+template <typename T>
+class Constraint;
+
+struct aqp_args {
+  size_t maxiter;
+  double tolerance;   // relative energy decrease to stop
+  double kappa;       // condition estimate, sets the momentum
+  double shrink;      // backtracking factor of the line search
+};
+
+/// @brief Accelerated Quadratic Proxy [Kovalsky et al. 2016]. Each
+/// step minimizes the energy's linearization plus a fixed quadratic
+/// proxy under linear equality constraints, so the KKT matrix is
+/// factorized only once. Iterates are extrapolated Nesterov-style and
+/// the line search never leaves the injective region reported by
+/// max_step.
+class aqp_solver
+{
+public:
+  /// largest t such that x+t*p stays injective, +inf if unbounded
+  typedef std::function<double(const double *x, const double *p)> max_step_t;
+  aqp_solver(const std::shared_ptr<Functional<double>> &energy,
+             const std::shared_ptr<Functional<double>> &proxy,
+             const std::shared_ptr<Constraint<double>> &cons,
+             const max_step_t &max_step,
+             const aqp_args &args);
+  int prefactorize();
+  int solve(double *x) const;
+private:
+  int line_search(const double *y, const Eigen::VectorXd &p, const double *gra,
+                  const double val, double *t, double *new_val) const;
+  const std::shared_ptr<Functional<double>> energy_, proxy_;
+  const std::shared_ptr<Constraint<double>> cons_;
+  const max_step_t max_step_;
+  const aqp_args args_;
+  Eigen::UmfPackLU<Eigen::SparseMatrix<double>> kkt_;
+};
+
+/// symmetric Dirichlet parameterization of a disk-like triangle mesh,
+/// uv (2 x #vert) must be injective on input, e.g. from Tutte or LSCM;
+/// fixed vertices keep their initial uv
+int aqp_param(const mati_t &tris, const matd_t &nods, const std::vector<size_t> &fixed,
+              const aqp_args &args, matd_t &uv);
+
+/// symmetric Dirichlet deformation of a tet mesh relative to rest,
+/// x must have positive volumes, fixed vertices keep their position
+int aqp_tet_deform(const mati_t &tets, const matd_t &rest, const std::vector<size_t> &fixed,
+                   const aqp_args &args, matd_t &x);
+
 }
 
 #endif
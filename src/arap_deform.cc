@@ -1,11 +1,16 @@
 #include "arap_deform.h"
 
+#include <limits>
 #include <zjucad/matrix/matrix.h>
 #include <jtflib/mesh/mesh.h>
 #include <jtflib/mesh/util.h>
 #include <hjlib/math/blas_lapack.h>
 #include <zjucad/matrix/lapack.h>
 
+#include "batch_svd.h"
+#include "anderson.h"
+#include "mesh_topology.h"
+
 using namespace std;
 using namespace Eigen;
 using namespace zjucad::matrix;
@@ -102,15 +107,16 @@ class one_ring_arap_energy : public arap_energy
 public:
   typedef zjucad::matrix::matrix<size_t> mati_t;
   typedef zjucad::matrix::matrix<double> matd_t;
-  one_ring_arap_energy(const mati_t &tris, const matd_t &nods, const double w)
-    : tris_(tris), nods_(nods), w_(w) {
-    e2c_.reset(edge2cell_adjacent::create(tris_, false));
-    wij_ = zeros<double>(e2c_->edges_.size(), 1);
-    for (size_t i = 0; i < e2c_->edges_.size(); ++i) {
-      size_t pi = e2c_->edges_[i].first;
-      size_t qi = e2c_->edges_[i].second;
-      pair<size_t, size_t> face = e2c_->query(pi, qi);
-      const size_t f[] = {face.first, face.second};
+  one_ring_arap_energy(const mati_t &tris, const matd_t &nods, const double w,
+                       const shared_ptr<const riemann::mesh_topology> &topo)
+    : tris_(tris), nods_(nods), w_(w), topo_(topo) {
+    const mati_t &edges = topo_->edges(), &e2c = topo_->facet2cell();
+    wij_ = zeros<double>(edges.size(2), 1);
+#pragma omp parallel for
+    for (size_t i = 0; i < edges.size(2); ++i) {
+      size_t pi = edges(0, i);
+      size_t qi = edges(1, i);
+      const size_t f[] = {e2c(0, i), e2c(1, i)};
       for (size_t j = 0; j < 2; ++j) {
         if ( f[j] == -1 )
           continue;
@@ -118,11 +124,7 @@ public:
         wij_[i] += 0.5 * cal_cot_val(&nods_(0, pi), &nods_(0, ri), &nods_(0, qi));
       }
     }
-    rot_.resize(nods_.size(2));
-    shared_ptr<one_ring_point_at_point> p2p(one_ring_point_at_point::create(tris_));
-    p2p_.resize(nods_.size(2));
-    for (auto &it : p2p->p2p_)
-      p2p_[it.first] = it.second;
+    rot_.assign(nods_.size(2), Matrix3d::Zero());
   }
   size_t dim() const {
     return nods_.size();
@@ -130,9 +132,10 @@ public:
   int val(const double *x, double *value) const {
     Map<const MatrixXd> X(x, 3, dim()/3);
     Map<const MatrixXd> X0(&nods_[0], 3, dim()/3);
-    for (size_t i = 0; i < e2c_->edges_.size(); ++i) {
-      size_t pi = e2c_->edges_[i].first;
-      size_t qi = e2c_->edges_[i].second;
+    const mati_t &edges = topo_->edges();
+    for (size_t i = 0; i < edges.size(2); ++i) {
+      size_t pi = edges(0, i);
+      size_t qi = edges(1, i);
       Vector3d eij = X.col(pi)-X.col(qi);
       Vector3d reij = X0.col(pi)-X0.col(qi);
       *value += w_*(wij_[i]*(eij-rot_[pi]*reij).squaredNorm()+
@@ -145,10 +148,10 @@ public:
     Map<const MatrixXd> X(x, 3, dim()/3);
     Map<const MatrixXd> X0(&nods_[0], 3, dim()/3);
     Map<MatrixXd> G(jac, 3, dim()/3);
-    size_t i = 0;
-    for (auto it : e2c_->edges_) {
-      size_t pi = it.first;
-      size_t qi = it.second;
+    const mati_t &edges = topo_->edges();
+    for (size_t i = 0; i < edges.size(2); ++i) {
+      size_t pi = edges(0, i);
+      size_t qi = edges(1, i);
       Vector3d eij = X.col(pi)-X.col(qi);
       Vector3d reij = X0.col(pi)-X0.col(qi);
       Vector3d dyi = 2*w_*wij_[i]*(eij-rot_[pi]*reij);
@@ -157,22 +160,20 @@ public:
       G.col(qi) -= dyi;
       G.col(qi) += dyj;
       G.col(pi) -= dyj;
-      ++i;
     }
     return 0;
   }
   int hes(const double *x, SparseMatrix<double> *H) const {
     vector<Triplet<double>> trips;
-    size_t i = 0;
-    for (auto &it : e2c_->edges_) {
-      size_t pi = it.first;
-      size_t qi = it.second;
+    const mati_t &edges = topo_->edges();
+    for (size_t i = 0; i < edges.size(2); ++i) {
+      size_t pi = edges(0, i);
+      size_t qi = edges(1, i);
       double ele = 4*w_*wij_[i];
       add_diag_block(pi, pi, ele, &trips);
       add_diag_block(qi, qi, ele, &trips);
       add_diag_block(pi, qi, -ele, &trips);
       add_diag_block(qi, pi, -ele, &trips);
-      ++i;
     }
     H->resize(dim(), dim());
     H->reserve(trips.size());
@@ -182,28 +183,28 @@ public:
   int eval_rotation(const double *x) {
     Map<const MatrixXd> X(x, 3, dim()/3);
     Map<const MatrixXd> X0(&nods_[0], 3, dim()/3);
+    const vector<size_t> &ptr = topo_->vv_ptr(), &adj = topo_->vv_adj(), &eid = topo_->vv_edge();
 #pragma omp parallel for
-    for (size_t pi = 0; pi < p2p_.size(); ++pi) {
+    for (size_t pi = 0; pi < topo_->vert_num(); ++pi) {
       rot_[pi] = Matrix3d::Zero();
-      for (auto &qi : p2p_[pi]) {
-        size_t eid = e2c_->get_edge_idx(pi, qi);
+      for (size_t k = ptr[pi]; k < ptr[pi+1]; ++k) {
+        const size_t qi = adj[k];
         Vector3d eij = X.col(pi)-X.col(qi);
         Vector3d reij = X0.col(pi)-X0.col(qi);
-        rot_[pi] += wij_[eid]*reij*eij.transpose();
+        // transposed covariance, its U*V^T is V*U^T of the original
+        rot_[pi] += wij_[eid[k]]*eij*reij.transpose();
       }
-      JacobiSVD<Matrix3d> sol(rot_[pi], ComputeFullU|ComputeFullV);
-      rot_[pi] = sol.matrixV()*sol.matrixU().transpose();
     }
+    riemann::batch_rotation3x3(rot_[0].data(), rot_.size(), rot_[0].data());
     return 0;
   }
 private:
   const mati_t tris_;
   const matd_t nods_;
   const double w_;
+  const shared_ptr<const riemann::mesh_topology> topo_;
   matd_t wij_;
   vector<Matrix3d> rot_;
-  shared_ptr<edge2cell_adjacent> e2c_;
-  vector<vector<size_t>> p2p_;
 };
 
 class tri_centric_arap_energy : public arap_energy
@@ -301,19 +302,22 @@ public:
     itr_matrix<const double *> X(3, dim()/3, x);
     matd_t def_normal;
     jtf::mesh::cal_face_normal(tris_, X, def_normal, true);
-//#pragma omp parallel for
-    for (size_t i = 0; i < tris_.size(2); ++i) {
-      matd_t vt = X(colon(), tris_(colon(), i));
-      Map<const VectorXd> U(vt.begin(), 9);
-      VectorXd def_grad = G_[i]*U;
-      Map<Matrix3d> dg(def_grad.data());
-//      cout << dg << endl;
-//      getchar();
-      JacobiSVD<Matrix3d> svd(dg, ComputeFullU|ComputeFullV);
-//      cout << sol.singularValues().transpose() << endl;
-//      getchar();
-      Matrix3d S = svd.matrixU();
-      Matrix3d T = svd.matrixV();
+    const size_t nf = tris_.size(2);
+    vector<double> dg(9*nf), su(9*nf), sv(9*nf), sig(3*nf);
+#pragma omp parallel for
+    for (size_t i = 0; i < nf; ++i) {
+      const size_t idx[3] = {tris_(0, i), tris_(1, i), tris_(2, i)};
+      Matrix<double, 9, 1> U;
+      for (size_t j = 0; j < 3; ++j)
+        U.segment<3>(3*j) = Map<const Vector3d>(x+3*idx[j]);
+      Map<Matrix<double, 9, 1>> def_grad(&dg[9*i]);
+      def_grad = G_[i]*U;
+    }
+    riemann::batch_svd3x3(&dg[0], nf, &su[0], &sig[0], &sv[0]);
+#pragma omp parallel for
+    for (size_t i = 0; i < nf; ++i) {
+      Matrix3d S = Map<const Matrix3d>(&su[9*i]);
+      Matrix3d T = Map<const Matrix3d>(&sv[9*i]);
       S.col(2) = Vector3d(normal_(0, i), normal_(1, i), normal_(2, i));
       T.col(2) = Vector3d(def_normal(0, i), def_normal(1, i), def_normal(2, i));
       R_[i] = S*T.transpose();
@@ -337,10 +341,10 @@ private:
 };
 
 arap_deform::arap_deform(const mati_t &tris, const matd_t &nods)
-  : tris_(tris), nods_(nods) {}
+  : tris_(tris), nods_(nods), topo_(riemann::mesh_topology::create(tris)) {}
 
 int arap_deform::pre_compute(const vector<size_t> &idx) {
-  e_.reset(new one_ring_arap_energy(tris_, nods_, 1.0));
+  e_.reset(new one_ring_arap_energy(tris_, nods_, 1.0, topo_));
 //  e_.reset(new tri_centric_arap_energy(tris_, nods_, 1.0));
   e_->hes(nullptr, &L_);
 
@@ -368,16 +372,31 @@ int arap_deform::pre_compute(const vector<size_t> &idx) {
   return 0;
 }
 
-int arap_deform::deformation(double *x) {
+int arap_deform::deformation(double *x, const size_t aa_window) {
   Map<VectorXd> X(x, e_->dim());
   const size_t max_iter = 20000;
-  VectorXd Xstar = X;
+  VectorXd Xstar = X, Gx = X;
   VectorXd Dx(e_->dim());
-  for (size_t iter = 0; iter < max_iter; ++iter) {
+  riemann::anderson_acceleration aa;
+  aa.init(aa_window, Xstar);
+  double prev_value = numeric_limits<double>::max();
+  size_t iter = 0, nbr_reject = 0;
+  for ( ; iter < max_iter; ++iter) {
     e_->eval_rotation(Xstar.data());
-    if ( iter % 100 == 0 ) {
-      double value = 0;
+    double value = 0;
+    if ( aa_window > 0 || iter % 100 == 0 )
       e_->val(Xstar.data(), &value);
+    // fall back to the plain local/global step if extrapolation
+    // increased the energy
+    if ( aa_window > 0 && iter > 0 && value > prev_value ) {
+      Xstar = Gx;
+      aa.replace(Xstar);
+      e_->eval_rotation(Xstar.data());
+      e_->val(Xstar.data(), &value);
+      ++nbr_reject;
+    }
+    prev_value = value;
+    if ( iter % 100 == 0 ) {
       cout << "[info] iteration " << iter << endl;
       cout << "[info] energy value: " << value << endl << endl;
     }
@@ -394,13 +413,17 @@ int arap_deform::deformation(double *x) {
     else
       Dx = dx;
     double xstar_norm = Xstar.norm();
-    Xstar += Dx;
+    Gx = Xstar+Dx;
     // convergence test
     if ( Dx.norm() <= 1e-12 * xstar_norm ) {
       printf("# INFO: converged after %zu iteration\n", iter);
+      Xstar = Gx;
       break;
     }
+    Xstar = aa.compute(Gx);
   }
+  printf("# INFO: %zu iterations, anderson window %zu, %zu rejected steps\n",
+         iter, aa_window, nbr_reject);
   X = Xstar;
   return 0;
 }
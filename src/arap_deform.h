@@ -5,6 +5,11 @@
 #include <Eigen/Sparse>
 #include <zjucad/matrix/matrix.h>
 #include <unordered_set>
+#include <memory>
+
+namespace riemann {
+class mesh_topology;
+}
 
 namespace core {
 
@@ -17,10 +22,12 @@ public:
   typedef zjucad::matrix::matrix<double> matd_t;
   arap_deform(const mati_t &tris, const matd_t &nods);
   int pre_compute(const std::vector<size_t> &idx);
-  int deformation(double *x);
+  /// aa_window is the Anderson acceleration history, 0 to disable
+  int deformation(double *x, const size_t aa_window=5);
 private:
   const mati_t tris_;
   const matd_t nods_;
+  const std::shared_ptr<const riemann::mesh_topology> topo_;
 
   std::unordered_set<size_t> fixed_dofs_;
   std::vector<size_t> g2l_;
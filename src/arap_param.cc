@@ -1,12 +1,14 @@
 #include "arap_param.h"
 
 #include <iostream>
+#include <limits>
 #include <zjucad/matrix/itr_matrix.h>
 #include <Eigen/SVD>
 
 #include "def.h"
 #include "geometry_extend.h"
 #include "util.h"
+#include "anderson.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -110,18 +112,31 @@ int arap_param_solver::precompute() {
   return 0;
 }
 
-int arap_param_solver::solve(double *x0) const {
+int arap_param_solver::solve(double *x0, const size_t aa_window) const {
   Map<VectorXd> x(x0, arap_->Nx());
-  VectorXd dx(arap_->Nx());
-  for (size_t iter = 0; iter < 2000; ++iter) {
-    double value = 0; {
+  VectorXd dx(arap_->Nx()), gx = x;
+  shared_ptr<arap_param_energy> arap = dynamic_pointer_cast<arap_param_energy>(arap_);
+  anderson_acceleration aa;
+  aa.init(aa_window, x);
+  double prev_value = numeric_limits<double>::max();
+  size_t iter = 0, nbr_reject = 0;
+  for ( ; iter < 2000; ++iter) {
+    // local solve
+    arap->LocalSolve(&x[0]);
+    double value = 0;
+    arap_->Val(&x[0], &value);
+    // safeguard, restart from the last plain step if energy went up
+    if ( aa_window > 0 && iter > 0 && value > prev_value ) {
+      x = gx;
+      aa.replace(x);
+      arap->LocalSolve(&x[0]);
       arap_->Val(&x[0], &value);
-      if ( iter % 10 == 0 ) {
-        cout << "\t@iter " << iter << " energy value: " << value << endl;
-      }
+      ++nbr_reject;
+    }
+    prev_value = value;
+    if ( iter % 10 == 0 ) {
+      cout << "\t@iter " << iter << " energy value: " << value << endl;
     }
-    // local solve
-    dynamic_pointer_cast<arap_param_energy>(arap_)->LocalSolve(&x[0]);
     // global solve
     VectorXd g = VectorXd::Zero(arap_->Nx()); {
       arap_->Gra(&x[0], &g[0]);
@@ -134,8 +149,11 @@ int arap_param_solver::solve(double *x0) const {
     }
     dx = solver_.solve(g);
     ASSERT(solver_.info() == Success);
-    x += dx;
+    gx = x+dx;
+    x = aa.compute(gx);
   }
+  cout << "\t@anderson window " << aa_window << ": " << iter
+       << " iterations, " << nbr_reject << " rejected steps\n";
   return 0;
 }
 
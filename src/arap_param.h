@@ -18,7 +18,8 @@ class arap_param_solver
 public:
   arap_param_solver(const mati_t &tris, const matd_t &nods);
   int precompute();
-  int solve(double *x0) const;
+  /// aa_window is the Anderson acceleration history, 0 to disable
+  int solve(double *x0, const size_t aa_window=5) const;
 private:
   std::shared_ptr<Functional<double>> arap_;
   cscd_t LHS_;
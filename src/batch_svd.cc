@@ -0,0 +1,170 @@
+#include "batch_svd.h"
+
+#include <cmath>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#  define USE_AVX_IMPLEMENTATION
+#  define SVD_LANES 8
+#elif defined(__SSE__)
+#  include <immintrin.h>
+#  define USE_SSE_IMPLEMENTATION
+#  define SVD_LANES 4
+#else
+#  define USE_SCALAR_IMPLEMENTATION
+#  define SVD_LANES 1
+#endif
+#define COMPUTE_U_AS_MATRIX
+#define COMPUTE_V_AS_MATRIX
+#include "igl/Singular_Value_Decomposition_Preamble.hpp"
+
+using namespace std;
+using namespace Eigen;
+
+namespace riemann {
+
+#if defined(USE_AVX_IMPLEMENTATION)
+#  define SVD_LOAD(V, S, a)  V=_mm256_loadu_ps(a);
+#  define SVD_STORE(a, V, S) _mm256_storeu_ps(a, V);
+#elif defined(USE_SSE_IMPLEMENTATION)
+#  define SVD_LOAD(V, S, a)  V=_mm_loadu_ps(a);
+#  define SVD_STORE(a, V, S) _mm_storeu_ps(a, V);
+#else
+#  define SVD_LOAD(V, S, a)  S.f=a[0];
+#  define SVD_STORE(a, V, S) a[0]=S.f;
+#endif
+
+/// entries are column-major and lane-interleaved, a[i+3*j][k] = A_k(i, j)
+static void svd3x3_lanes(float a[9][SVD_LANES], float u[9][SVD_LANES],
+                         float s[3][SVD_LANES], float v[9][SVD_LANES]) {
+#include "igl/Singular_Value_Decomposition_Kernel_Declarations.hpp"
+
+  SVD_LOAD(Va11, Sa11, a[0]) SVD_LOAD(Va21, Sa21, a[1]) SVD_LOAD(Va31, Sa31, a[2])
+  SVD_LOAD(Va12, Sa12, a[3]) SVD_LOAD(Va22, Sa22, a[4]) SVD_LOAD(Va32, Sa32, a[5])
+  SVD_LOAD(Va13, Sa13, a[6]) SVD_LOAD(Va23, Sa23, a[7]) SVD_LOAD(Va33, Sa33, a[8])
+
+#include "igl/Singular_Value_Decomposition_Main_Kernel_Body.hpp"
+
+  SVD_STORE(u[0], Vu11, Su11) SVD_STORE(u[1], Vu21, Su21) SVD_STORE(u[2], Vu31, Su31)
+  SVD_STORE(u[3], Vu12, Su12) SVD_STORE(u[4], Vu22, Su22) SVD_STORE(u[5], Vu32, Su32)
+  SVD_STORE(u[6], Vu13, Su13) SVD_STORE(u[7], Vu23, Su23) SVD_STORE(u[8], Vu33, Su33)
+
+  SVD_STORE(v[0], Vv11, Sv11) SVD_STORE(v[1], Vv21, Sv21) SVD_STORE(v[2], Vv31, Sv31)
+  SVD_STORE(v[3], Vv12, Sv12) SVD_STORE(v[4], Vv22, Sv22) SVD_STORE(v[5], Vv32, Sv32)
+  SVD_STORE(v[6], Vv13, Sv13) SVD_STORE(v[7], Vv23, Sv23) SVD_STORE(v[8], Vv33, Sv33)
+
+  SVD_STORE(s[0], Va11, Sa11) SVD_STORE(s[1], Va22, Sa22) SVD_STORE(s[2], Va33, Sa33)
+}
+
+/// angle of atan2(y, x), cheap when the rotation is tiny
+static inline double small_atan2(const double y, const double x) {
+  if ( std::fabs(y) < 1e-4*std::fabs(x) ) {
+    const double t = y/x;
+    return (x > 0 ? 0 : (y >= 0 ? M_PI : -M_PI))+t*(1-t*t/3);
+  }
+  return std::atan2(y, x);
+}
+
+static inline void rotate_cols(Matrix3d &M, const int p, const int q, const double c, const double s) {
+  for (int i = 0; i < 3; ++i) {
+    const double mp = M(i, p), mq = M(i, q);
+    M(i, p) = c*mp+s*mq;
+    M(i, q) = -s*mp+c*mq;
+  }
+}
+
+/// two-sided Jacobi sweeps in double precision on B = U^T*A*V, which is
+/// already diagonal up to single precision round-off
+static void jacobi_polish(const double *A, double *U, double *S, double *V) {
+  Map<const Matrix3d> a(A);
+  Map<Matrix3d> u(U), v(V);
+  // re-orthonormalize the single precision factors first
+  Matrix3d Uo = 0.5*u*(3*Matrix3d::Identity()-u.transpose()*u);
+  Matrix3d Vo = 0.5*v*(3*Matrix3d::Identity()-v.transpose()*v);
+  Matrix3d B = Uo.transpose()*a*Vo, Bt;
+  const int pairs[3][2] = {{0, 1}, {0, 2}, {1, 2}};
+  const double eps = 1e-15*B.cwiseAbs().maxCoeff();
+  for (int k = 0; k < 12; ++k) {
+    const int p = pairs[k%3][0], q = pairs[k%3][1];
+    if ( std::fabs(B(p, q)) <= eps && std::fabs(B(q, p)) <= eps ) {
+      if ( k%3 == 2 && std::fabs(B(0, 1))+std::fabs(B(1, 0))+std::fabs(B(0, 2))+std::fabs(B(2, 0)) <= 4*eps )
+        break;
+      continue;
+    }
+    // closed-form 2x2 SVD, M = Rot(phi)*diag(sx, sy)*Rot(theta)
+    const double E = 0.5*(B(p, p)+B(q, q)), F = 0.5*(B(p, p)-B(q, q));
+    const double G = 0.5*(B(q, p)+B(p, q)), H = 0.5*(B(q, p)-B(p, q));
+    const double a1 = small_atan2(G, F), a2 = small_atan2(H, E);
+    const double theta = 0.5*(a2-a1), phi = 0.5*(a2+a1);
+    const double cp = std::cos(phi), sp = std::sin(phi);
+    const double ct = std::cos(theta), st = std::sin(theta);
+    // B <- Rot(phi)^T*B*Rot(theta)^T restricted to rows/cols p, q
+    rotate_cols(B, p, q, ct, -st);
+    Bt = B.transpose();
+    rotate_cols(Bt, p, q, cp, sp);
+    B = Bt.transpose();
+    rotate_cols(Uo, p, q, cp, sp);
+    rotate_cols(Vo, p, q, ct, -st);
+  }
+  u = Uo;
+  v = Vo;
+  S[0] = B(0, 0);
+  S[1] = B(1, 1);
+  S[2] = B(2, 2);
+}
+
+/// one SIMD batch of at most SVD_LANES matrices on the calling thread
+static void svd3x3_batch(const double *A, const size_t n, double *U, double *S, double *V,
+                         const bool polish) {
+  float a[9][SVD_LANES], u[9][SVD_LANES], s[3][SVD_LANES], v[9][SVD_LANES];
+  for (size_t k = 0; k < SVD_LANES; ++k) {
+    for (size_t j = 0; j < 9; ++j)
+      a[j][k] = (k < n) ? static_cast<float>(A[9*k+j]) : 0.0f;
+  }
+  svd3x3_lanes(a, u, s, v);
+  for (size_t k = 0; k < n; ++k) {
+    for (size_t j = 0; j < 9; ++j) {
+      U[9*k+j] = u[j][k];
+      V[9*k+j] = v[j][k];
+    }
+    for (size_t j = 0; j < 3; ++j)
+      S[3*k+j] = s[j][k];
+    if ( polish )
+      jacobi_polish(A+9*k, U+9*k, S+3*k, V+9*k);
+  }
+}
+
+void batch_svd3x3(const double *A, const size_t n, double *U, double *S, double *V,
+                  const bool polish) {
+  const size_t nbr_batch = (n+SVD_LANES-1)/SVD_LANES;
+#pragma omp parallel for
+  for (size_t b = 0; b < nbr_batch; ++b) {
+    const size_t beg = b*SVD_LANES, end = std::min(beg+SVD_LANES, n);
+    svd3x3_batch(A+9*beg, end-beg, U+9*beg, S+3*beg, V+9*beg, polish);
+  }
+}
+
+void batch_rotation3x3(const double *A, const size_t n, double *R, const bool polish) {
+  const size_t nbr_batch = (n+SVD_LANES-1)/SVD_LANES;
+#pragma omp parallel for
+  for (size_t b = 0; b < nbr_batch; ++b) {
+    const size_t beg = b*SVD_LANES, end = std::min(beg+SVD_LANES, n);
+    double U[9*SVD_LANES], S[3*SVD_LANES], V[9*SVD_LANES];
+    svd3x3_batch(A+9*beg, end-beg, U, S, V, polish);
+    for (size_t i = beg; i < end; ++i) {
+      const size_t k = i-beg;
+      Map<Matrix3d>(R+9*i) = Map<const Matrix3d>(U+9*k)*Map<const Matrix3d>(V+9*k).transpose();
+    }
+  }
+}
+
+void rotation3x3(const double *A, double *R, const bool polish) {
+  double U[9], S[3], V[9];
+  svd3x3_batch(A, 1, U, S, V, polish);
+  Map<Matrix3d> r(R);
+  r = Map<const Matrix3d>(U)*Map<const Matrix3d>(V).transpose();
+}
+
+}
@@ -0,0 +1,29 @@
+#ifndef BATCH_SVD_H
+#define BATCH_SVD_H
+
+#include <cstddef>
+
+namespace riemann {
+
+/// @brief SVD of n column-major 3x3 matrices stored contiguously,
+/// A = U*diag(S)*V^T. The matrices are processed in SIMD lanes with
+/// the McAdams kernel bundled in igl/ and spread over threads. U and V
+/// are always rotations and S is sorted by magnitude in descending
+/// order, so S[2] is negative when det(A) < 0. The kernel runs in
+/// single precision; with polish on, a few Jacobi rotations in double
+/// precision brings the result back to double accuracy.
+void batch_svd3x3(const double *A, const size_t n, double *U, double *S, double *V,
+                  const bool polish=true);
+
+/// @brief closest rotation U*V^T of each matrix, never a reflection.
+/// R may alias A.
+void batch_rotation3x3(const double *A, const size_t n, double *R,
+                       const bool polish=true);
+
+/// @brief the same for a single matrix, without a parallel region, for
+/// callers that are already inside one
+void rotation3x3(const double *A, double *R, const bool polish=true);
+
+}
+
+#endif
@@ -7,6 +7,8 @@
 
 #include "config.h"
 #include "timer.h"
+#include "batch_svd.h"
+#include "anderson.h"
 
 using namespace std;
 using namespace Eigen;
@@ -199,16 +201,30 @@ int bd_solver::alter_solve(double *initX) const {
   const size_t cdim = linc_->nf();
   VectorXd z(lift_dim_), Pz(lift_dim_), n(lift_dim_), u(dim_+cdim), rhs(dim_+cdim);
   linc_->rhs(&rhs[dim_]);
-  VectorXd post_step(lift_dim_);
+  VectorXd post_step(lift_dim_), gx = X;
+  anderson_acceleration aa;
+  aa.init(args_.aa_window, X);
+  size_t iter = 0, nbr_reject = 0;
   // solve KKT
   double prev_err_norm = 1;
   high_resolution_timer clk;
   clk.start();
-  for (size_t iter = 0; iter < args_.maxiter; ++iter) {
+  for ( ; iter < args_.maxiter; ++iter) {
     z = T_*X;
     euclidean_proj(&z[0], &Pz[0]);
     n = z-Pz;
     double curr_err_norm = n.norm();
+    // the distance to the feasible set never grows with plain
+    // alternating projections, restart when extrapolation breaks it
+    if ( args_.aa_window > 0 && iter > 0 && curr_err_norm > prev_err_norm ) {
+      X = gx;
+      aa.replace(X);
+      z = T_*X;
+      euclidean_proj(&z[0], &Pz[0]);
+      n = z-Pz;
+      curr_err_norm = n.norm();
+      ++nbr_reject;
+    }
     if ( curr_err_norm < args_.tolerance ) {
       cout << "\t@CONVERGED after " << iter << " iterations\n";
       break;
@@ -223,14 +239,17 @@ int bd_solver::alter_solve(double *initX) const {
     rhs.head(dim_) = T_.transpose()*Pz;
     u = ldlt_solver.solve(rhs);
     ASSERT(ldlt_solver.info() == Success);
-    X = u.head(dim_);
-    post_step = T_*X-Pz;
+    gx = u.head(dim_);
+    post_step = T_*gx-Pz;
     if ( iter % 1 == 0 ) {
       cout << "\t@prev step size: " << n.norm() << endl;
       cout << "\t@post step size: " << post_step.norm() << endl;
       cout << "\t@turning angle: " << acos(post_step.dot(n)/(n.norm()*post_step.norm()))/M_PI*180 << "\n\n";
     }
+    X = aa.compute(gx);
   }
+  cout << "[info] anderson window " << args_.aa_window << ": " << iter
+       << " iterations, " << nbr_reject << " rejected steps\n";
   return 0;
 }
 
@@ -274,17 +293,15 @@ int bd_solver::alter_solve_chebyshev(double *initX) const {
 }
 
 int bd_solver::euclidean_proj(const double *Tx, double *PTx) const {
+  const size_t nt = tets_.size(2);
+  // U and V come out as rotations with the sign of det(df) on diag[2]
+  vector<double> su(9*nt), sv(9*nt), sig(3*nt);
+  batch_svd3x3(Tx, nt, &su[0], &sig[0], &sv[0]);
 #pragma omp parallel for
-  for (size_t i = 0; i < tets_.size(2); ++i) {
+  for (size_t i = 0; i < nt; ++i) {
     Map<const Matrix3d> df(Tx+9*i);
-    JacobiSVD<Matrix3d> svd(df, ComputeFullU|ComputeFullV);
-    Matrix3d U = svd.matrixU(), V = svd.matrixV();
-    Vector3d diag = svd.singularValues();
-    double detUV = U.determinant()*V.determinant();
-    if ( detUV < 0 ) {
-      diag[2] *= -1;
-      U.col(2) *= -1;
-    }
+    Map<const Matrix3d> U(&su[9*i]), V(&sv[9*i]);
+    Vector3d diag = Map<const Vector3d>(&sig[3*i]);
     if ( diag[0] <= args_.K*diag[2] ) {
       Map<Matrix3d>(PTx+9*i) = df;
       continue;
@@ -316,13 +333,13 @@ int bd_solver::euclidean_proj(const double *Tx, double *PTx) const {
 int bd_solver::calc_df_cond_number(const double *x, matd_t &cond) const {
   Map<const VectorXd> X(x, dim_);
   VectorXd z = T_*X;
-  cond = zeros<double>(tets_.size(2), 1);
+  const size_t nt = tets_.size(2);
+  cond = zeros<double>(nt, 1);
+  vector<double> su(9*nt), sv(9*nt), sig(3*nt);
+  batch_svd3x3(z.data(), nt, &su[0], &sig[0], &sv[0]);
 #pragma omp parallel for
-  for (size_t i = 0; i < tets_.size(2); ++i) {
-    Map<const Matrix3d> df(z.data()+9*i);
-    JacobiSVD<Matrix3d> svd(df, ComputeFullU|ComputeFullV);
-    cond[i] = svd.singularValues()[0]/svd.singularValues()[2];
-  }
+  for (size_t i = 0; i < nt; ++i)
+    cond[i] = sig[3*i+0]/std::fabs(sig[3*i+2]);
   return 0;
 }
 
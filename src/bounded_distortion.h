@@ -21,6 +21,7 @@ struct bd_args {
   double sr;
   size_t maxiter;
   double tolerance;
+  size_t aa_window;
 };
 
 class bd_solver
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <numeric>
 #include <hjlib/math/blas_lapack.h>
 #include <zjucad/matrix/itr_matrix.h>
 #include <zjucad/matrix/lapack.h>
@@ -10,6 +11,7 @@
 #include "grad_operator.h"
 #include "util.h"
 #include "vtk.h"
+#include "cotmatrix.h"
 
 using namespace std;
 using namespace Eigen;
@@ -53,53 +55,56 @@ static inline Vector4d quat_prod(const Vector4d &a, const Vector4d &b) {
 
 template <size_t dim>
 static void mass_matrix(const mati_t &tets, const matd_t &nods, SparseMatrix<double> *M) {
-  vector<Triplet<double>> trips;
-  for (size_t i = 0; i < tets.size(2); ++i) {
-    matd_t ed = nods(colon(), tets(colon(1, 3), i))-nods(colon(), tets(0, i))*ones<double>(1, 3);
-    double vol = fabs(det(ed))/6.0;
-    add_diag_block<double, dim>(tets(0, i), tets(0, i), vol/4.0, &trips);
-    add_diag_block<double, dim>(tets(1, i), tets(1, i), vol/4.0, &trips);
-    add_diag_block<double, dim>(tets(2, i), tets(2, i), vol/4.0, &trips);
-    add_diag_block<double, dim>(tets(3, i), tets(3, i), vol/4.0, &trips);
-  }
-  const size_t n = nods.size(2);
-  M->resize(dim*n, dim*n);
-  M->setFromTriplets(trips.begin(), trips.end());
+  massmatrix(tets, nods, dim, M, MASS_LUMPED);
 }
 
+/// stiffness matrix, i.e. the negative cotangent Laplacian
 template <size_t dim>
 static void laplacian_matrix(const mati_t &tets, const matd_t &nods, SparseMatrix<double> *L) {
-  vector<Triplet<double>> trips;
-  for (size_t i = 0; i < tets.size(2); ++i) {
-    matd_t v = nods(colon(), tets(colon(), i));
-    matd_t g = zeros<double>(3, 4);
-    calc_tet_linear_basis_grad(&v[0], &g[0]);
-    matd_t ed = v(colon(), colon(1, 3))-v(colon(), 0)*ones<double>(1, 3);
-    double vol = fabs(det(ed))/6.0;
-    for (size_t p = 0; p < 4; ++p) {
-      for (size_t q = 0; q < 4; ++q) {
-        double val = dot(g(colon(), p), g(colon(), q))*vol;
-        add_diag_block<double, dim>(tets(p, i), tets(q, i), val, &trips);
-      }
-    }
-  }
-  const size_t n = nods.size(2);
-  L->resize(dim*n, dim*n);
-  L->setFromTriplets(trips.begin(), trips.end());
+  cotmatrix(tets, nods, dim, L);
+  *L *= -1.0;
 }
 
 //==============================================================================
 conformal_volume::conformal_volume(const mati_t &tets, const matd_t &verts)
-  : tets_(tets), verts_(verts) {
-  u_.setZero(verts_.size(2));
-  gradu_.resize(NoChange, tets_.size(2));
+  : tets_(tets), verts_(verts), eig_("conformal eigen"), eig_ready_(false), solver_("conformal poisson") {
+  const size_t nt = tets_.size(2), nv = verts_.size(2);
+  u_.setZero(nv);
+  gradu_.resize(NoChange, nt);
   gradu_.setZero();
-  vol_ = zeros<double>(tets_.size(2));
+  vol_ = zeros<double>(nt);
+  grad_.resize(NoChange, 4*nt);
 #pragma omp parallel for
-  for (size_t i = 0; i < tets_.size(2); ++i) {
+  for (size_t i = 0; i < nt; ++i) {
     matd_t e = verts_(colon(1, 3), tets_(colon(1, 3), i))-verts_(colon(1, 3), tets_(0, i))*ones<double>(1, 3);
     vol_[i] = fabs(det(e))/6.0;
+    matd_t v = verts_(colon(1, 3), tets_(colon(), i));
+    calc_tet_linear_basis_grad(&v[0], &grad_(0, 4*i));
+  }
+  // tets_ is column major, entry k is corner k%4 of tet k/4
+  inc_ptr_.assign(nv+1, 0);
+  for (size_t k = 0; k < tets_.size(); ++k)
+    ++inc_ptr_[tets_[k]+1];
+  std::partial_sum(inc_ptr_.begin(), inc_ptr_.end(), inc_ptr_.begin());
+  inc_.resize(tets_.size());
+  vector<size_t> pos(inc_ptr_.begin(), inc_ptr_.end()-1);
+  for (size_t k = 0; k < tets_.size(); ++k)
+    inc_[pos[tets_[k]]++] = k;
+
+  laplacian_matrix<4>(tets_, verts_(colon(1, 3), colon()), &L_);
+  g2l_.resize(L_.cols());
+  size_t cnt = 0;
+  for (size_t i = 0; i < g2l_.size(); ++i) {
+    if ( i >= 0 && i < 4 )
+      g2l_[i] = -1;
+    else
+      g2l_[i] = cnt++;
   }
+  Lr_ = L_;
+  rm_spmat_col_row(Lr_, g2l_);
+  solver_.solver().setMode(SimplicialCholeskyLLT);
+  solver_.factorize(Lr_);
+  ASSERT(solver_.info() == Success);
 }
 
 void conformal_volume::set_charge(const double *pos, const double intensity) {
@@ -120,129 +125,215 @@ void conformal_volume::set_charge(const double *pos, const double intensity) {
   gradu_.bottomLeftCorner(3, gradu_.cols()) += gu;
 }
 
+void conformal_volume::set_charge_sites(const matd_t &sites, const double tol) {
+  ASSERT(sites.size(1) == 3);
+  const size_t nv = verts_.size(2), nt = tets_.size(2), ns = sites.size(2);
+  // unit charge response without the intensity term
+  MatrixXd Phi(nv, ns);
+#pragma omp parallel for
+  for (size_t i = 0; i < nv; ++i) {
+    for (size_t s = 0; s < ns; ++s) {
+      const double dx = verts_(1, i)-sites(0, s), dy = verts_(2, i)-sites(1, s), dz = verts_(3, i)-sites(2, s);
+      Phi(i, s) = -log(dx*dx+dy*dy+dz*dz);
+    }
+  }
+  if ( tol <= 0 ) {
+    Us_.swap(Phi);
+    Cs_ = MatrixXd::Identity(ns, ns);
+  } else {
+    // Phi = Us*Cs from the eigen decomposition of its Gram matrix
+    SelfAdjointEigenSolver<MatrixXd> eig(Phi.transpose()*Phi);
+    const VectorXd &d = eig.eigenvalues();
+    size_t r = 0;
+    for ( ; r < ns && d[ns-1-r] > tol*tol*d[ns-1]; ++r);
+    const VectorXd sv = d.tail(r).cwiseSqrt();
+    const MatrixXd V = eig.eigenvectors().rightCols(r);
+    Us_ = Phi*V*sv.cwiseInverse().asDiagonal();
+    Cs_ = sv.asDiagonal()*V.transpose();
+  }
+  GUs_.setZero(3*nt, Us_.cols());
+#pragma omp parallel for
+  for (size_t i = 0; i < nt; ++i)
+    for (size_t j = 0; j < 4; ++j)
+      GUs_.middleRows<3>(3*i) += grad_.col(4*i+j)*Us_.row(tets_(j, i));
+  printf("[info] cached %zu charge sites in a basis of rank %zu\n", ns, (size_t)Cs_.rows());
+}
+
+void conformal_volume::set_charge_intensity(const VectorXd &intensity) {
+  ASSERT(intensity.size() == Cs_.cols());
+  VectorXd active = VectorXd::Zero(intensity.size());
+  double shift = 0;
+  for (size_t s = 0; s < intensity.size(); ++s) {
+    if ( intensity[s] > 0 ) {
+      active[s] = 1;
+      shift += 2*log(intensity[s]);
+    }
+  }
+  const VectorXd c = Cs_*active, g = GUs_*c;
+  u_ = Us_*c;
+  u_.array() += shift;
+  gradu_.row(0).setZero();
+  gradu_.bottomRows(3) = Map<const Matrix3Xd>(g.data(), 3, tets_.size(2));
+}
+
 void conformal_volume::calc_grad_u(const VectorXd &u, Matrix3Xd &grad) {
   grad.resize(NoChange, tets_.size(2));
-  itr_matrix<const double *> U(u.size(), 1, u.data());
-  itr_matrix<double *> G(grad.rows(), grad.cols(), grad.data());
 #pragma omp parallel for
   for (size_t i = 0; i < tets_.size(2); ++i) {
-    matd_t v = verts_(colon(1, 3), tets_(colon(), i));
-    matd_t g = zeros<double>(3, 4);
-    calc_tet_linear_basis_grad(&v[0], &g[0]);
-    G(colon(), i) = g*U(tets_(colon(), i));
+    grad.col(i).setZero();
+    for (size_t j = 0; j < 4; ++j)
+      grad.col(i) += u[tets_(j, i)]*grad_.col(4*i+j);
   }
 }
 
-void conformal_volume::solve_eigen_prob() {
-  SparseMatrix<double> E;
-  laplacian_matrix<4>(tets_, verts_(colon(1, 3), colon()), &L_);
-  // get sqrM
-  VectorXd sqrinvM = VectorXd::Zero(4*verts_.size(2)); {
-    for (size_t i = 0; i < tets_.size(2); ++i)
-      for (size_t j = 0; j < 4; ++j)
-        sqrinvM.segment<4>(4*tets_(j, i)) += vol_[i]/4.0*Vector4d::Ones();
-    sqrinvM = (sqrinvM.cwiseSqrt().cwiseInverse()).eval();
+void conformal_volume::build_eigen_pattern() {
+  const size_t nt = tets_.size(2), n = 4*verts_.size(2);
+  vector<Triplet<double>> trips;
+  trips.reserve(L_.nonZeros()+256*nt);
+  for (size_t j = 0; j < L_.outerSize(); ++j)
+    for (SparseMatrix<double>::InnerIterator it(L_, j); it; ++it)
+      trips.push_back(Triplet<double>(it.row(), it.col(), 0));
+  for (size_t i = 0; i < nt; ++i)
+    for (size_t a = 0; a < 4; ++a)
+      for (size_t b = 0; b < 4; ++b)
+        for (size_t c = 0; c < 4; ++c)
+          for (size_t r = 0; r < 4; ++r)
+            trips.push_back(Triplet<double>(4*tets_(a, i)+r, 4*tets_(b, i)+c, 0));
+  E_.resize(n, n);
+  E_.setFromTriplets(trips.begin(), trips.end());
+  E_.makeCompressed();
+
+  const int *outer = E_.outerIndexPtr(), *inner = E_.innerIndexPtr();
+  lval_.assign(E_.nonZeros(), 0);
+  for (size_t j = 0; j < L_.outerSize(); ++j) {
+    for (SparseMatrix<double>::InnerIterator it(L_, j); it; ++it) {
+      const int *pos = std::lower_bound(inner+outer[j], inner+outer[j+1], (int)it.row());
+      lval_[pos-inner] += it.value();
+    }
   }
-  // assemble B
-  SparseMatrix<double> B(4*verts_.size(2), 4*verts_.size(2)); {
-    vector<Triplet<double>> trips;
-    for (size_t i = 0; i < tets_.size(2); ++i) {
-      matd_t v = verts_(colon(1, 3), tets_(colon(), i));
-      Matrix<double, 3, 4> g = Matrix<double, 3, 4>::Zero();
-      calc_tet_linear_basis_grad(&v[0], g.data());
-      for (size_t p = 0; p < 4; ++p) {
-        for (size_t q = 0; q < 4; ++q) {
-          Vector4d XG = 1.0/12*(quat_prod(Vector4d(0, 1, 0, 0), gradu_.col(i))*3*vol_[i]*g.col(q).dot(Vector3d(1, 0, 0))
-                                +quat_prod(Vector4d(0, 0, 1, 0), gradu_.col(i))*3*vol_[i]*g.col(q).dot(Vector3d(0, 1, 0))
-                                +quat_prod(Vector4d(0, 0, 0, 1), gradu_.col(i))*3*vol_[i]*g.col(q).dot(Vector3d(0, 0, 1)));
-          Matrix4d mat = Matrix4d::Zero();
-          conv_quat_to_mat(XG.data(), mat.data());
-          insert_block(4*tets_(p, i), 4*tets_(q, i), mat.data(), 4, 4, &trips);
+  // the 4 rows of a block column are consecutive, one slot per column
+  kslot_.resize(64*nt);
+#pragma omp parallel for
+  for (size_t i = 0; i < nt; ++i) {
+    for (size_t a = 0; a < 4; ++a) {
+      for (size_t b = 0; b < 4; ++b) {
+        for (size_t c = 0; c < 4; ++c) {
+          const int col = 4*tets_(b, i)+c;
+          const int *pos = std::lower_bound(inner+outer[col], inner+outer[col+1], (int)(4*tets_(a, i)));
+          kslot_[64*i+16*a+4*b+c] = pos-inner;
         }
       }
     }
-    B.setFromTriplets(trips.begin(), trips.end());
   }
-  // assemble weighted M
-  SparseMatrix<double> gM(4*verts_.size(2), 4*verts_.size(2)); {
-    vector<Triplet<double>> trips;
-    for (size_t i = 0; i < tets_.size(2); ++i) {
-      double w = 0.75*gradu_.col(i).squaredNorm();
-      for (size_t p = 0; p < 4; ++p) {
-        for (size_t q = 0; q < 4; ++q) {
-          double m = (p == q) ? vol_[i]/10 : vol_[i]/20;
-          add_diag_block<double, 4>(tets_(p, i), tets_(q, i), w*m, &trips);
-        }
+  // lumped mass of each quaternion component
+  Mv_ = VectorXd::Zero(n);
+  for (size_t i = 0; i < nt; ++i)
+    for (size_t j = 0; j < 4; ++j)
+      Mv_.segment<4>(4*tets_(j, i)) += vol_[i]/4.0*Vector4d::Ones();
+}
+
+/// E = L+0.5*(B+B^T)+gM in the fixed pattern
+void conformal_volume::assemble_eigen_prob() {
+  const size_t nt = tets_.size(2);
+  // the block (p, q) of B only depends on q
+  Matrix4Xd xg(4, 4*nt);
+  VectorXd w(nt);
+#pragma omp parallel for
+  for (size_t i = 0; i < nt; ++i) {
+    for (size_t q = 0; q < 4; ++q) {
+      const Vector4d gq(0, grad_(0, 4*i+q), grad_(1, 4*i+q), grad_(2, 4*i+q));
+      xg.col(4*i+q) = vol_[i]/4*quat_prod(gq, gradu_.col(i));
+    }
+    w[i] = 0.75*gradu_.col(i).squaredNorm();
+  }
+  double *val = E_.valuePtr();
+  std::copy(lval_.begin(), lval_.end(), val);
+  // a thread owns the columns of one vertex and pulls from its tets
+#pragma omp parallel for
+  for (size_t v = 0; v < verts_.size(2); ++v) {
+    for (size_t k = inc_ptr_[v]; k < inc_ptr_[v+1]; ++k) {
+      const size_t i = inc_[k]/4, b = inc_[k]%4;
+      Matrix4d mb, ma;
+      conv_quat_to_mat(&xg(0, 4*i+b), mb.data());
+      for (size_t a = 0; a < 4; ++a) {
+        conv_quat_to_mat(&xg(0, 4*i+a), ma.data());
+        Matrix4d blk = 0.5*(mb+ma.transpose());
+        blk.diagonal().array() += w[i]*((a == b) ? vol_[i]/10 : vol_[i]/20);
+        for (size_t c = 0; c < 4; ++c)
+          for (size_t r = 0; r < 4; ++r)
+            val[kslot_[64*i+16*a+4*b+c]+r] += blk(r, c);
       }
     }
-    gM.setFromTriplets(trips.begin(), trips.end());
   }
-  SparseMatrix<double> BT = B.transpose();
-  E = L_+0.5*(B+BT)+gM;
-  SparseMatrix<double> LHS = sqrinvM.asDiagonal()*E*sqrinvM.asDiagonal();
+}
 
-  // inverse power iteration
-  SimplicialCholesky<SparseMatrix<double>> solver;
-  solver.compute(LHS);
-  ASSERT(solver.info() == Success);
-  VectorXd eigvec = VectorXd::Ones(LHS.cols());
-  eigvec /= eigvec.norm();
-  for (size_t iter = 0; iter < 3; ++iter) {
-    eigvec = (solver.solve(eigvec)).eval();
-    ASSERT(solver.info() == Success);
-    eigvec /= eigvec.norm();
+int conformal_volume::solve_eigen_prob() {
+  if ( E_.nonZeros() == 0 )
+    build_eigen_pattern();
+  assemble_eigen_prob();
+  // generalized problem E*lambda = gamma*M*lambda, after an edit LOBPCG
+  // starts from the last field with the last factorization
+  if ( !eig_ready_ ) {
+    eigen_args args;
+    args.method = EIG_LOBPCG;
+    args.maxiter = 30;
+    args.verbose = false;
+    ASSERT(eig_.compute(E_, &Mv_, args) == 0);
+    eig_ready_ = true;
+  } else {
+    ASSERT(eig_.update(E_) == 0);
+  }
+  // the best estimate is kept if even a fresh factorization falls short
+  int rtn = 0;
+  if ( eig_.solve() ) {
+    ASSERT(eig_.factorize() == 0);
+    if ( eig_.solve() ) {
+      cerr << "[Error] eigen solve did not converge after refactorization\n";
+      rtn = __LINE__;
+    }
   }
-  lambda_ = sqrinvM.asDiagonal()*eigvec;
+  lambda_ = eig_.eigenvectors().col(0);
+  return rtn;
 }
 
 void conformal_volume::solve_poisson_prob(double *x) {
-  Map<VectorXd> X(x, 4*verts_.size(2));
-  VectorXd rhs = VectorXd::Zero(4*verts_.size(2)); { // calculate the divergence
-    Matrix4Xd q;
-    q.resize(NoChange, verts_.size(2));
-    q.setZero();
-    for (size_t i = 0; i < q.cols(); ++i) {
-      q.col(i) = exp(0.5*u_(i))*lambda_.segment<4>(4*i)/lambda_.segment<4>(4*i).squaredNorm();
-    }
-    for (size_t i = 0; i < tets_.size(2); ++i) {
-      matd_t v = verts_(colon(1, 3), tets_(colon(), i));
-      Matrix<double, 3, 4> g = Matrix<double, 3, 4>::Zero();
-      calc_tet_linear_basis_grad(&v[0], g.data());
-      Vector4d qiqm, qjqm, qkqm;
-      qiqm = qjqm = qkqm = Vector4d::Zero();
-      for (size_t m = 0; m < 4; ++m) {
-        for (size_t n = 0; n < 4; ++n) {
-          double fac = (m == n) ? vol_[i]/10.0 : vol_[i]/20.0;
-          qiqm += fac*quat_prod(quat_prod(conjugate(q.col(tets_(m, i))), Vector4d(0, 1, 0, 0)), q.col(tets_(n, i)));
-          qjqm += fac*quat_prod(quat_prod(conjugate(q.col(tets_(m, i))), Vector4d(0, 0, 1, 0)), q.col(tets_(n, i)));
-          qkqm += fac*quat_prod(quat_prod(conjugate(q.col(tets_(m, i))), Vector4d(0, 0, 0, 1)), q.col(tets_(n, i)));
-        }
-      }
-      for (size_t j = 0; j < 4; ++j) {
-        rhs.segment<4>(4*tets_(j, i)) +=
-            g.col(j).dot(Vector3d(1, 0, 0))*qiqm+g.col(j).dot(Vector3d(0, 1, 0))*qjqm+g.col(j).dot(Vector3d(0, 0, 1))*qkqm;
+  const size_t nv = verts_.size(2), nt = tets_.size(2);
+  Map<VectorXd> X(x, 4*nv);
+  // calculate the divergence
+  Matrix4Xd q(4, nv);
+#pragma omp parallel for
+  for (size_t i = 0; i < nv; ++i)
+    q.col(i) = exp(0.5*u_(i))*lambda_.segment<4>(4*i)/lambda_.segment<4>(4*i).squaredNorm();
+  Matrix4Xd flux(4, 4*nt);
+#pragma omp parallel for
+  for (size_t i = 0; i < nt; ++i) {
+    Vector4d qiqm, qjqm, qkqm;
+    qiqm = qjqm = qkqm = Vector4d::Zero();
+    for (size_t m = 0; m < 4; ++m) {
+      for (size_t n = 0; n < 4; ++n) {
+        double fac = (m == n) ? vol_[i]/10.0 : vol_[i]/20.0;
+        qiqm += fac*quat_prod(quat_prod(conjugate(q.col(tets_(m, i))), Vector4d(0, 1, 0, 0)), q.col(tets_(n, i)));
+        qjqm += fac*quat_prod(quat_prod(conjugate(q.col(tets_(m, i))), Vector4d(0, 0, 1, 0)), q.col(tets_(n, i)));
+        qkqm += fac*quat_prod(quat_prod(conjugate(q.col(tets_(m, i))), Vector4d(0, 0, 0, 1)), q.col(tets_(n, i)));
       }
     }
+    for (size_t j = 0; j < 4; ++j)
+      flux.col(4*i+j) = grad_(0, 4*i+j)*qiqm+grad_(1, 4*i+j)*qjqm+grad_(2, 4*i+j)*qkqm;
   }
-  SimplicialCholesky<SparseMatrix<double>> solver;
-  solver.setMode(SimplicialCholeskyLLT);
-  vector<size_t> g2l(L_.cols());
-  size_t cnt = 0;
-  for (size_t i = 0; i < g2l.size(); ++i) {
-    if ( i >= 0 && i < 4 )
-      g2l[i] = -1;
-    else
-      g2l[i] = cnt++;
+  VectorXd rhs(4*nv);
+#pragma omp parallel for
+  for (size_t v = 0; v < nv; ++v) {
+    Vector4d sum = Vector4d::Zero();
+    for (size_t k = inc_ptr_[v]; k < inc_ptr_[v+1]; ++k)
+      sum += flux.col(inc_[k]);
+    rhs.segment<4>(4*v) = sum;
   }
   rhs = rhs-L_*X;
-  rm_spmat_col_row(L_, g2l);
-  rm_vector_row(rhs, g2l);
-  solver.compute(L_);
-  ASSERT(solver.info() == Success);
-  VectorXd dx = solver.solve(rhs);
-  ASSERT(solver.info() == Success);
-  VectorXd DX = VectorXd::Zero(4*verts_.size(2));
-  rc_vector_row(dx, g2l, DX);
+  rm_vector_row(rhs, g2l_);
+  VectorXd dx = solver_.solve(rhs);
+  ASSERT(solver_.info() == Success);
+  VectorXd DX = VectorXd::Zero(4*nv);
+  rc_vector_row(dx, g2l_, DX);
   X += DX;
   X /= X.lpNorm<Infinity>();
 }
@@ -275,12 +366,13 @@ void conformal_volume::debug_laplacian() {
     else
       g2l[i] = cnt++;
   }
-  laplacian_matrix<1>(tets_, verts_(colon(1, 3), colon()), &L_);
-  VectorXd rhs = VectorXd::Zero(u_.size())-L_*u_;
-  rm_spmat_col_row(L_, g2l);
+  SparseMatrix<double> L;
+  laplacian_matrix<1>(tets_, verts_(colon(1, 3), colon()), &L);
+  VectorXd rhs = VectorXd::Zero(u_.size())-L*u_;
+  rm_spmat_col_row(L, g2l);
   rm_vector_row(rhs, g2l);
   SimplicialCholesky<SparseMatrix<double>> solver;
-  solver.compute(L_);
+  solver.compute(L);
   ASSERT(solver.info() == Eigen::Success);
   VectorXd du = solver.solve(rhs);
   ASSERT(solver.info() == Eigen::Success);
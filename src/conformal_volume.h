@@ -1,26 +1,51 @@
 #ifndef CONFORMAL_VOLUME_H
 #define CONFORMAL_VOLUME_H
 
+#include <vector>
 #include <Eigen/Sparse>
 #include <zjucad/matrix/matrix.h>
 
+#include "sparse_eigen.h"
+#include "sparse_solver.h"
+
 namespace riemann {
 
 using mati_t=zjucad::matrix::matrix<size_t>;
 using matd_t=zjucad::matrix::matrix<double>;
 
+/**
+ * @brief conformal deformation of a tet mesh driven by point charges.
+ *
+ * For repeated edits the responses of unit charges at candidate sites
+ * can be cached once by set_charge_sites(), optionally compressed to a
+ * low-rank basis, after which set_charge_intensity() builds u and its
+ * gradient as a dense combination. The per-tet geometry, the pattern
+ * of the eigenproblem, the last eigenvector and the factorization of
+ * the pinned Laplacian are kept between solves.
+ */
 class conformal_volume
 {
 public:
   conformal_volume(const mati_t &tets, const matd_t &verts);
   void set_charge(const double *pos, const double intensity);
-  void solve_eigen_prob();
+  /// sites is 3 x #site, singular values below tol times the largest
+  /// are dropped from the basis
+  void set_charge_sites(const matd_t &sites, const double tol=0);
+  size_t charge_basis_rank() const { return Cs_.rows(); }
+  /// replaces u by the charges of the given intensity at the cached
+  /// sites, zero for sites without a charge
+  void set_charge_intensity(const Eigen::VectorXd &intensity);
+  /// nonzero if LOBPCG did not converge even after refactorization,
+  /// the last estimate is kept in either case
+  int solve_eigen_prob();
   void solve_poisson_prob(double *x);
   // DEBUG
   void draw_gradient(const char *filename);
   void debug_laplacian();
 private:
   void calc_grad_u(const Eigen::VectorXd &u, Eigen::Matrix3Xd &grad);
+  void build_eigen_pattern();
+  void assemble_eigen_prob();
 public:
   const mati_t &tets_;
   const matd_t &verts_;
@@ -31,6 +56,26 @@ public:
   Eigen::Matrix4Xd gradu_;
 
   Eigen::SparseMatrix<double> L_, M_, B_;
+  shift_invert_eigensolver eig_;
+private:
+  // gradients of the linear basis, 4 columns per tet
+  Eigen::Matrix3Xd grad_;
+  // tets around each vertex as 4*tet+corner
+  std::vector<size_t> inc_ptr_, inc_;
+  // cached charge responses: u = Us_*Cs_*active+const, its gradient
+  // GUs_*Cs_*active with 3 rows per tet
+  Eigen::MatrixXd Us_, GUs_, Cs_;
+  // fixed pattern of the eigenproblem, the Laplacian values in it and
+  // one slot per tet block column
+  Eigen::SparseMatrix<double> E_;
+  Eigen::VectorXd Mv_;
+  std::vector<double> lval_;
+  std::vector<int> kslot_;
+  bool eig_ready_;
+  // the Laplacian with the first vertex pinned, factorized once
+  Eigen::SparseMatrix<double> Lr_;
+  std::vector<size_t> g2l_;
+  reusable_factorization<Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>>> solver_;
 };
 
 }
@@ -1,8 +1,10 @@
 #include "cotmatrix.h"
 
-#include <set>
+#include <Eigen/Dense>
 
 #include "util.h"
+#include "config.h"
+#include "mesh_topology.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -13,66 +15,201 @@ namespace riemann {
 /**
  * Discrete Laplace-Beltrami Operator for Triangle Mesh
  * (\triangle f)(v_i) = \sum_{j \in \mathcal{N}_i} w_{ij}(f(v_j)-f(v_i))
+ *
+ * Every operator is a weight per edge plus a weight per vertex. Cells
+ * evaluate their local weights independently, edges and vertices then
+ * gather them through the topology, so no step needs a lock.
  */
 
-template <typename T>
-void compute_vert_valence(const matrix<size_t> &cell,
-                          const matrix<double> &nods,
-                          const size_t dim,
-                          Matrix<T, -1, 1> &valence) {
-  set<pair<size_t, size_t>> vis;
-  valence.setZero(dim*nods.size(2), 1);
-  Matrix<T, -1, 1> ones;
-  ones.setOnes(dim, 1);
-  for (size_t i = 0; i < cell.size(2); ++i) {
-    for (size_t j = 0; j < 3; ++j) {
-      size_t vp = cell(j, i);
-      size_t vq = cell((j+1)%3, i);
-      auto edge = (vp < vq ? make_pair(vp, vq) : make_pair(vq, vp));
-      if ( vis.find(edge) != vis.end() )
-        continue;
-      vis.insert(edge);
-      valence.segment(dim*vp, dim) += ones;
-      valence.segment(dim*vq, dim) += ones;
+/// half cotangent of the angle opposite to each local edge, returns the area
+static double tri_cot_kernel(const double *const x[3], double *we) {
+  for (size_t j = 0; j < 3; ++j)
+    we[j] = 0.5*cal_cot_val(x[j], x[(j+2)%3], x[(j+1)%3]);
+  Map<const Vector3d> a(x[0]), b(x[1]), c(x[2]);
+  return 0.5*(b-a).cross(c-a).norm();
+}
+
+/// -vol*dot(grad phi_a, grad phi_b) for each local edge, returns the volume
+static double tet_cot_kernel(const double *const x[4], double *we) {
+  Matrix3d Ds;
+  for (size_t j = 0; j < 3; ++j)
+    Ds.col(j) = Map<const Vector3d>(x[j+1])-Map<const Vector3d>(x[0]);
+  const double vol = fabs(Ds.determinant())/6.0;
+  Matrix<double, 3, 4> g;
+  g.rightCols<3>() = Ds.inverse().transpose();
+  g.col(0) = -g.rightCols<3>().rowwise().sum();
+  for (size_t j = 0; j < 6; ++j) {
+    const size_t *e = mesh_topology::local_edge(4, j);
+    we[j] = -vol*g.col(e[0]).dot(g.col(e[1]));
+  }
+  return vol;
+}
+
+static double cell_measure(const double *const x[], const size_t n) {
+  double we[6];
+  return n == 3 ? tri_cot_kernel(x, we) : tet_cot_kernel(x, we);
+}
+
+static inline size_t local_edge_num(const size_t n) {
+  return n == 3 ? 3 : 6;
+}
+
+/// kernel(x, we, wv) fills the local edge and vertex weights of a cell
+template <class Kernel>
+static void eval_cells(const mesh_topology &topo, const matd_t &nods, Kernel &&kernel,
+                       vector<double> &we, vector<double> &wv) {
+  const size_t n = topo.simplex_size(), ne = local_edge_num(n), nc = topo.cell_num();
+  const mati_t &cell = topo.cells();
+  we.resize(ne*nc);
+  wv.resize(n*nc);
+#pragma omp parallel for
+  for (size_t i = 0; i < nc; ++i) {
+    const double *x[4];
+    for (size_t j = 0; j < n; ++j)
+      x[j] = &nods(0, cell(j, i));
+    kernel(x, &we[ne*i], &wv[n*i]);
+  }
+}
+
+/// sums the local edge weights of all cells around each edge
+static void gather_edges(const mesh_topology &topo, const vector<double> &we, vector<double> &w) {
+  const size_t ne = local_edge_num(topo.simplex_size());
+  const vector<size_t> &ptr = topo.ec_ptr(), &adj = topo.ec_adj();
+  const mati_t &cell_edge = topo.cell_edges();
+  w.resize(topo.edge_num());
+#pragma omp parallel for
+  for (size_t e = 0; e < w.size(); ++e) {
+    double sum = 0;
+    for (size_t p = ptr[e]; p < ptr[e+1]; ++p) {
+      const size_t c = adj[p];
+      for (size_t j = 0; j < ne; ++j)
+        if ( cell_edge(j, c) == e )
+          sum += we[ne*c+j];
+    }
+    w[e] = sum;
+  }
+}
+
+/// sums the local vertex weights of all cells around each vertex
+static void gather_verts(const mesh_topology &topo, const vector<double> &wv, vector<double> &d) {
+  const size_t n = topo.simplex_size();
+  const vector<size_t> &ptr = topo.vc_ptr(), &adj = topo.vc_adj();
+  const mati_t &cell = topo.cells();
+  d.resize(topo.vert_num());
+#pragma omp parallel for
+  for (size_t v = 0; v < d.size(); ++v) {
+    double sum = 0;
+    for (size_t p = ptr[v]; p < ptr[v+1]; ++p) {
+      const size_t c = adj[p];
+      for (size_t j = 0; j < n; ++j)
+        if ( cell(j, c) == v )
+          sum += wv[n*c+j];
     }
+    d[v] = sum;
+  }
+}
+
+/// diagonal entries making every row sum to zero
+static void laplacian_diag(const mesh_topology &topo, const vector<double> &w, vector<double> &d) {
+  const vector<size_t> &ptr = topo.vv_ptr(), &eid = topo.vv_edge();
+  d.resize(topo.vert_num());
+#pragma omp parallel for
+  for (size_t v = 0; v < d.size(); ++v) {
+    double sum = 0;
+    for (size_t p = ptr[v]; p < ptr[v+1]; ++p)
+      sum += w[eid[p]];
+    d[v] = -sum;
   }
 }
 
 /**
- * @brief w_{ij} = \frac{1}{2}(cot \alpha_{ij} + cot \beta_{ij})
+ * @brief writes the dim-blocked matrix with off-diagonal w(edge) and
+ * diagonal d(vert) straight into compressed column storage. Column
+ * dim*v+k holds the one-ring of v, so its size and offset are known
+ * from the topology and all columns are filled concurrently.
  */
-void cotmatrix(const matrix<size_t> &cell,
-               const matrix<double> &nods,
-               const size_t dim,
-               SparseMatrix<double> *L,
-               bool normalized) {
-  const size_t edge[3][2] = {{1, 2}, {2, 0}, {0, 1}};
-  std::vector<Triplet<double>> trips;
-
-  for (size_t i = 0; i < cell.size(2); ++i) {
-    matrix<double> vert = nods(colon(), cell(colon(), i));
-    matrix<double> half_cot_val(3);
-    half_cot_val[0] = 0.5*cal_cot_val(&vert(0, 1), &vert(0, 0), &vert(0, 2));
-    half_cot_val[1] = 0.5*cal_cot_val(&vert(0, 0), &vert(0, 1), &vert(0, 2));
-    half_cot_val[2] = 0.5*cal_cot_val(&vert(0, 0), &vert(0, 2), &vert(0, 1));
-
-    for (size_t k = 0; k < 3; ++k) {
-      size_t src = cell(edge[k][0], i);
-      size_t des = cell(edge[k][1], i);
-      runtime_dim_add_diag_block(dim, src, src, -half_cot_val[k], &trips);
-      runtime_dim_add_diag_block(dim, des, des, -half_cot_val[k], &trips);
-      runtime_dim_add_diag_block(dim, src, des, half_cot_val[k], &trips);
-      runtime_dim_add_diag_block(dim, des, src, half_cot_val[k], &trips);
+static void assemble_csc(const mesh_topology &topo, const size_t nv, const size_t dim,
+                         const vector<double> &w, const vector<double> &d,
+                         SparseMatrix<double> *A) {
+  const vector<size_t> &ptr = topo.vv_ptr(), &adj = topo.vv_adj(), &eid = topo.vv_edge();
+  const size_t nt = topo.vert_num();
+  ASSERT(nt <= nv);
+  const size_t nnz = dim*(ptr[nt]+nt);
+  A->resize(dim*nv, dim*nv);
+  A->resizeNonZeros(nnz);
+  int *outer = A->outerIndexPtr(), *inner = A->innerIndexPtr();
+  double *val = A->valuePtr();
+#pragma omp parallel for
+  for (size_t v = 0; v < nt; ++v) {
+    const size_t cnt = ptr[v+1]-ptr[v]+1;
+    for (size_t k = 0; k < dim; ++k) {
+      size_t pos = dim*(ptr[v]+v)+k*cnt;
+      outer[dim*v+k] = pos;
+      bool has_diag = false;
+      for (size_t p = ptr[v]; p < ptr[v+1]; ++p) {
+        if ( !has_diag && adj[p] > v ) {
+          inner[pos] = dim*v+k;
+          val[pos++] = d[v];
+          has_diag = true;
+        }
+        inner[pos] = dim*adj[p]+k;
+        val[pos++] = w[eid[p]];
+      }
+      if ( !has_diag ) {
+        inner[pos] = dim*v+k;
+        val[pos] = d[v];
+      }
     }
   }
-  const size_t lap_size = dim*nods.size(2);
-  L->resize(lap_size, lap_size);
-  L->reserve(trips.size());
-  L->setFromTriplets(trips.begin(), trips.end());
+  for (size_t c = dim*nt; c <= dim*nv; ++c)
+    outer[c] = nnz;
+}
 
-  if ( normalized ) {
+/// D^{-1}A with D the magnitude of the diagonal
+static void normalize_rows(const size_t dim, const vector<double> &d, SparseMatrix<double> *A) {
+  const int *inner = A->innerIndexPtr();
+  double *val = A->valuePtr();
+#pragma omp parallel for
+  for (size_t k = 0; k < A->nonZeros(); ++k) {
+    const double dv = fabs(d[inner[k]/dim]);
+    if ( dv != 0.0 )
+      val[k] /= dv;
+  }
+}
 
+static shared_ptr<const mesh_topology> get_topology(const matrix<size_t> &cell,
+                                                    const shared_ptr<const mesh_topology> &topo) {
+  if ( topo.get() != nullptr ) {
+    ASSERT(topo->cell_num() == cell.size(2) && topo->simplex_size() == cell.size(1));
+    return topo;
   }
+  return mesh_topology::create(cell);
+}
+
+/**
+ * @brief w_{ij} = \frac{1}{2}(cot \alpha_{ij} + cot \beta_{ij}), for
+ * tets the sum of -vol*dot(grad phi_i, grad phi_j) over the one-ring
+ */
+void cotmatrix(const matrix<size_t> &cell,
+               const matrix<double> &nods,
+               const size_t dim,
+               SparseMatrix<double> *L,
+               bool normalized,
+               shared_ptr<const mesh_topology> topo) {
+  topo = get_topology(cell, topo);
+  const size_t n = topo->simplex_size();
+  vector<double> we, wv, w, d;
+  eval_cells(*topo, nods, [n](const double *const x[], double *e, double *) {
+      if ( n == 3 )
+        tri_cot_kernel(x, e);
+      else
+        tet_cot_kernel(x, e);
+    }, we, wv);
+  gather_edges(*topo, we, w);
+  laplacian_diag(*topo, w, d);
+  assemble_csc(*topo, nods.size(2), dim, w, d, L);
+  if ( normalized )
+    normalize_rows(dim, d, L);
 }
 
 /**
@@ -82,34 +219,61 @@ void unimatrix(const matrix<size_t> &cell,
                const matrix<double> &nods,
                const size_t dim,
                SparseMatrix<double> *L,
-               bool normalized) {
-  vector<Triplet<double>> trips;
-  set<pair<size_t, size_t>> vis;
-
-  for (size_t i = 0; i < cell.size(2); ++i) {
-    for (size_t j = 0; j < 3; ++j) {
-      size_t src = cell(j, i);
-      size_t des = cell((j+1)%3, i);
-      auto edge = (src < des ? make_pair(src, des) : make_pair(des, src));
-      if ( vis.find(edge) != vis.end() )
-        continue;
-      vis.insert(edge);
-      runtime_dim_add_diag_block(dim, src, src, -1.0, &trips);
-      runtime_dim_add_diag_block(dim, des, des, -1.0, &trips);
-      runtime_dim_add_diag_block(dim, src, des, 1.0, &trips);
-      runtime_dim_add_diag_block(dim, des, src, 1.0, &trips);
+               bool normalized,
+               shared_ptr<const mesh_topology> topo) {
+  topo = get_topology(cell, topo);
+  vector<double> w(topo->edge_num(), 1.0), d;
+  laplacian_diag(*topo, w, d);
+  assemble_csc(*topo, nods.size(2), dim, w, d, L);
+  // the diagonal is minus the valence
+  if ( normalized )
+    normalize_rows(dim, d, L);
+}
+
+/**
+ * @brief lumped: |cell|/n on the diagonal; consistent: |cell|/(n(n+1))
+ * off the diagonal and twice that on it, n being the simplex size
+ */
+void massmatrix(const matrix<size_t> &cell,
+                const matrix<double> &nods,
+                const size_t dim,
+                SparseMatrix<double> *M,
+                const mass_type type,
+                shared_ptr<const mesh_topology> topo) {
+  topo = get_topology(cell, topo);
+  const size_t n = topo->simplex_size(), ne = local_edge_num(n);
+  vector<double> we, wv, w, d;
+  if ( type == MASS_LUMPED ) {
+    eval_cells(*topo, nods, [n](const double *const x[], double *, double *v) {
+        const double m = cell_measure(x, n)/n;
+        for (size_t j = 0; j < n; ++j)
+          v[j] = m;
+      }, we, wv);
+    gather_verts(*topo, wv, d);
+    const size_t nv = nods.size(2);
+    M->resize(dim*nv, dim*nv);
+    M->resizeNonZeros(dim*d.size());
+    int *outer = M->outerIndexPtr(), *inner = M->innerIndexPtr();
+    double *val = M->valuePtr();
+#pragma omp parallel for
+    for (size_t i = 0; i < dim*d.size(); ++i) {
+      outer[i] = inner[i] = i;
+      val[i] = d[i/dim];
     }
+    for (size_t c = dim*d.size(); c <= dim*nv; ++c)
+      outer[c] = dim*d.size();
+    return;
   }
-  const size_t lap_size = dim * nods.size(2);
-  L->resize(lap_size, lap_size);
-  L->reserve(trips.size());
-  L->setFromTriplets(trips.begin(), trips.end());
-
-  if ( normalized ) {
-    VectorXd valence;
-    compute_vert_valence(cell, nods, dim, valence);
-    *L = (valence.asDiagonal().inverse()*(*L)).eval();
-  }
+  eval_cells(*topo, nods, [n, ne](const double *const x[], double *e, double *v) {
+      const double m = cell_measure(x, n)/(n*(n+1));
+      for (size_t j = 0; j < ne; ++j)
+        e[j] = m;
+      for (size_t j = 0; j < n; ++j)
+        v[j] = 2*m;
+    }, we, wv);
+  gather_edges(*topo, we, w);
+  gather_verts(*topo, wv, d);
+  assemble_csc(*topo, nods.size(2), dim, w, d, M);
 }
 
 }
@@ -1,22 +1,45 @@
 #ifndef COTMATRIX_H
 #define COTMATRIX_H
 
+#include <memory>
 #include <zjucad/matrix/matrix.h>
 #include <Eigen/Sparse>
 
 namespace riemann {
 
+class mesh_topology;
+
+/// The operators below take triangle (3 x #face) or tet (4 x #tet)
+/// cells and are assembled in parallel directly into compressed column
+/// storage, one dim x dim identity block per vertex pair. The sparsity
+/// pattern comes from topo, which is built on the fly when not given.
+/// normalized scales each row by the inverse of its diagonal magnitude.
+
 void cotmatrix(const zjucad::matrix::matrix<size_t> &cell,
                const zjucad::matrix::matrix<double> &nods,
                const size_t dim,
                Eigen::SparseMatrix<double> *L,
-               bool normalized=false);
+               bool normalized=false,
+               std::shared_ptr<const mesh_topology> topo=nullptr);
 
 void unimatrix(const zjucad::matrix::matrix<size_t> &cell,
                const zjucad::matrix::matrix<double> &nods,
                const size_t dim,
                Eigen::SparseMatrix<double> *L,
-               bool normalized=false);
+               bool normalized=false,
+               std::shared_ptr<const mesh_topology> topo=nullptr);
+
+enum mass_type {
+  MASS_LUMPED,
+  MASS_CONSISTENT
+};
+
+void massmatrix(const zjucad::matrix::matrix<size_t> &cell,
+                const zjucad::matrix::matrix<double> &nods,
+                const size_t dim,
+                Eigen::SparseMatrix<double> *M,
+                const mass_type type=MASS_LUMPED,
+                std::shared_ptr<const mesh_topology> topo=nullptr);
 
 }
 #endif
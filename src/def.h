@@ -6,6 +6,10 @@
 
 namespace riemann {
 
+inline size_t hash_combine(const size_t seed, const size_t v) {
+  return seed^(v+0x9e3779b97f4a7c15ULL+(seed << 6)+(seed >> 2));
+}
+
 template <typename T>
 class Functional
 {
@@ -15,6 +19,13 @@ public:
   virtual int Val(const T *x, T *val) const = 0;
   virtual int Gra(const T *x, T *gra) const = 0;
   virtual int Hes(const T *x, std::vector<Eigen::Triplet<T>> *hes) const = 0;
+  // fixed-sparsity assembly: number of entries pushed by Hes() and
+  // their values in exactly the same order, non-zero return if not supported
+  virtual int HesNnz(size_t *nnz) const { return __LINE__; }
+  virtual int HesVal(const T *x, T *val) const { return __LINE__; }
+  // identifies that pattern, it must change whenever Hes() would push
+  // entries at other positions, by default the object itself
+  virtual size_t HesPattern() const { return reinterpret_cast<size_t>(this); }
   virtual void ResetWeight(const double w) {}
   virtual int operator ()(const T *x, T *val, T *gra, const T step, bool graON) { // for LBFGS
     this->Val(x, val);
@@ -33,6 +44,10 @@ public:
   virtual size_t Nf() const = 0;
   virtual int Val(const T *x, T *val) const = 0;
   virtual int Jac(const T *x, const size_t off, std::vector<Eigen::Triplet<T>> *jac) const = 0;
+  // same protocol as Functional::HesNnz/HesVal for the jacobian
+  virtual int JacNnz(size_t *nnz) const { return __LINE__; }
+  virtual int JacVal(const T *x, T *val) const { return __LINE__; }
+  virtual size_t JacPattern() const { return reinterpret_cast<size_t>(this); }
   virtual int Hes(const T *x, const size_t off, std::vector<std::vector<Eigen::Triplet<T>>> *hes) const {
     return __LINE__;
   }
@@ -98,6 +113,36 @@ public:
     }
     return 0;
   }
+  int HesNnz(size_t *nnz) const {
+    *nnz = 0;
+    for (auto &e : buffer_) {
+      if ( e.get() ) {
+        size_t n = 0;
+        if ( e->HesNnz(&n) )
+          return __LINE__;
+        *nnz += n;
+      }
+    }
+    return 0;
+  }
+  int HesVal(const T *x, T *val) const {
+    size_t offset = 0;
+    for (auto &e : buffer_) {
+      if ( e.get() ) {
+        size_t n = 0;
+        if ( e->HesNnz(&n) || (n > 0 && e->HesVal(x, val+offset)) )
+          return __LINE__;
+        offset += n;
+      }
+    }
+    return 0;
+  }
+  size_t HesPattern() const {
+    size_t key = 0;
+    for (auto &e : buffer_)
+      key = hash_combine(key, e.get() ? e->HesPattern() : 0);
+    return key;
+  }
 protected:
   const std::vector<std::shared_ptr<Functional<T>>> &buffer_;
   size_t dim_;
@@ -176,6 +221,36 @@ public:
     }
     return 0;
   }
+  int JacNnz(size_t *nnz) const {
+    *nnz = 0;
+    for (auto &c : buffer_) {
+      if ( c.get() ) {
+        size_t n = 0;
+        if ( c->JacNnz(&n) )
+          return __LINE__;
+        *nnz += n;
+      }
+    }
+    return 0;
+  }
+  int JacVal(const T *x, T *val) const {
+    size_t offset = 0;
+    for (auto &c : buffer_) {
+      if ( c.get() ) {
+        size_t n = 0;
+        if ( c->JacNnz(&n) || (n > 0 && c->JacVal(x, val+offset)) )
+          return __LINE__;
+        offset += n;
+      }
+    }
+    return 0;
+  }
+  size_t JacPattern() const {
+    size_t key = 0;
+    for (auto &c : buffer_)
+      key = hash_combine(key, c.get() ? c->JacPattern() : 0);
+    return key;
+  }
   int Hes(const T *x, const size_t off, std::vector<std::vector<Eigen::Triplet<T>>> *hes) const {
     if ( hes->size() != fdim_ )
       hes->resize(fdim_);
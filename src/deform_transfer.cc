@@ -8,12 +8,20 @@
 #include <Eigen/Geometry>
 #include <Eigen/UmfPackSupport>
 #include <jtflib/mesh/util.h>
+#include <numeric>
+#include <algorithm>
+#include <omp.h>
 
 #include "def.h"
 #include "util.h"
 #include "vtk.h"
 #include "nanoflann.hpp"
 #include "cotmatrix.h"
+#include "timer.h"
+#include "mesh_cache.h"
+#include "sparse_assembler.h"
+#include "mesh_topology.h"
+#include "sparse_solver.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -76,18 +84,21 @@ public:
   typedef zjucad::matrix::matrix<double> matd_t;
   dt_deform_energy(const mati_t &tar_cell, const matd_t &tar_nods,
                    const MatrixXd &Sinv, const MatrixXd &Tinv,
-                   const set<tuple<size_t, size_t>> &mapping, double w)
+                   const vector<tuple<size_t, size_t>> &mapping, double w)
     : tris_(tar_cell),
       nods_(tar_nods),
       Sinv_(Sinv),
       Tinv_(Tinv),
       mapping_(mapping),
       w_(w) {
-    unordered_set<size_t> cons_;
+    // the hessian does not depend on the source pose, but the
+    // kernels still expect a valid pointer to the gradient
+    src_grad_ = MatrixXd::Zero(Sinv_.rows(), Sinv_.cols());
+    vector<char> cons(tris_.size(2), 0);
     for (auto &e : mapping_)
-      cons_.insert(std::get<1>(e));
+      cons[std::get<1>(e)] = 1;
     for (size_t i = 0; i < tris_.size(2); ++i) {
-      if ( cons_.find(i) == cons_.end() )
+      if ( !cons[i] )
         uncons_face_.push_back(i);
     }
   }
@@ -114,6 +125,9 @@ public:
     return 0;
   }
   int Gra(const double *x, double *gra) const {
+    return Gra(x, src_grad_, gra);
+  }
+  int Gra(const double *x, const MatrixXd &src_grad, double *gra) const {
     RETURN_WITH_COND_TRUE(w_ == 0.0);
     itr_matrix<const double *> X(3, Nx()/3, x);
     itr_matrix<double *> G(3, Nx()/3, gra);
@@ -122,7 +136,7 @@ public:
       const size_t tar_fa = std::get<1>(e);
       matd_t vert = X(colon(), tris_(colon(), tar_fa));
       matd_t g = zeros<double>(3, 4);
-      unit_deform_energy_jac_(&g[0], &vert[0], &Tinv_(0, 3*tar_fa), &src_grad_(0, 3*src_fa));
+      unit_deform_energy_jac_(&g[0], &vert[0], &Tinv_(0, 3*tar_fa), &src_grad(0, 3*src_fa));
       G(colon(), tris_(colon(), tar_fa)) += w_*g;
     }
     for (auto &free_fa : uncons_face_) {
@@ -163,13 +177,47 @@ public:
     }
     return 0;
   }
+  int HesNnz(size_t *nnz) const {
+    if ( w_ == 0.0 ) {
+      *nnz = 0;
+      return 0;
+    }
+    if ( hes_ptr_.empty() ) {
+      calc_elem_nnz_ptr(mapping_.size()+uncons_face_.size(), [&](const size_t i) -> size_t {
+          matd_t H = ElemHes(i);
+          return std::count_if(H.begin(), H.end(), [](const double h) { return h != 0.0; });
+        }, hes_ptr_);
+    }
+    *nnz = hes_ptr_.back();
+    return 0;
+  }
+  int HesVal(const double *x, double *val) const {
+    RETURN_WITH_COND_TRUE(w_ == 0.0);
+#pragma omp parallel for
+    for (size_t i = 0; i < hes_ptr_.size()-1; ++i) {
+      matd_t H = ElemHes(i);
+      size_t cnt = hes_ptr_[i];
+      for (size_t p = 0; p < 12; ++p) {
+        for (size_t q = 0; q < 12; ++q) {
+          if ( H(p, q) != 0.0 )
+            val[cnt++] = w_*H(p, q);
+        }
+      }
+    }
+    return 0;
+  }
   void UpdateSourceGrad(const mati_t &src_tris, const matd_t &src_def) {
-    src_grad_.resize(3, 3*src_tris.size(2));
+    CalcSourceGrad(src_tris, src_def, src_grad_);
+  }
+  /// the Hessian is independent of the source pose, only the
+  /// gradient term changes, so poses can share one energy object
+  void CalcSourceGrad(const mati_t &src_tris, const matd_t &src_def, MatrixXd &src_grad) const {
+    src_grad.resize(3, 3*src_tris.size(2));
 #pragma omp parallel for
     for (size_t i = 0; i < src_tris.size(2); ++i) {
       matd_t base = src_def(colon(), src_tris(colon(1, 3), i))
           - src_def(colon(), src_tris(0, i))*ones<double>(1, 3);
-      src_grad_.block<3, 3>(0, 3*i) = Map<const Matrix3d>(&base[0])*Sinv_.block<3, 3>(0, 3*i);
+      src_grad.block<3, 3>(0, 3*i) = Map<const Matrix3d>(&base[0])*Sinv_.block<3, 3>(0, 3*i);
     }
   }
   void ResetWeight(const double w) {
@@ -180,10 +228,23 @@ private:
   const matd_t &nods_;
   const MatrixXd &Sinv_;
   const MatrixXd &Tinv_;
-  const set<tuple<size_t, size_t>> &mapping_;
+  /// element hessians in the order of Hes(), corresponded faces first
+  matd_t ElemHes(const size_t i) const {
+    matd_t H = zeros<double>(12, 12);
+    if ( i < mapping_.size() ) {
+      const size_t src_fa = std::get<0>(mapping_[i]);
+      const size_t tar_fa = std::get<1>(mapping_[i]);
+      unit_deform_energy_hes_(&H[0], NULL, &Tinv_(0, 3*tar_fa), &src_grad_(0, 3*src_fa));
+    } else {
+      unit_identity_energy_hes_(&H[0], NULL, &Tinv_(0, 3*uncons_face_[i-mapping_.size()]));
+    }
+    return H;
+  }
+  const vector<tuple<size_t, size_t>> &mapping_;
   vector<size_t> uncons_face_;
   double w_;
   MatrixXd src_grad_;
+  mutable vector<size_t> hes_ptr_;
 };
 
 class dt_smooth_energy : public Functional<double>
@@ -192,22 +253,19 @@ public:
   typedef zjucad::matrix::matrix<size_t> mati_t;
   typedef zjucad::matrix::matrix<double> matd_t;
   dt_smooth_energy(const mati_t &src_cell, const matd_t &src_nods,
-                   const MatrixXd &Sinv, const double w)
-    : tris_(src_cell), nods_(src_nods), Sinv_(Sinv), w_(w) {
-    mati_t tris = tris_(colon(0, 2), colon());
-    e2c_.reset(edge2cell_adjacent::create(tris, false));
-  }
+                   const MatrixXd &Sinv, const double w,
+                   const shared_ptr<const mesh_topology> &topo)
+    : tris_(src_cell), nods_(src_nods), w_(w), topo_(topo), Sinv_(Sinv) {}
   size_t Nx() const {
     return nods_.size();
   }
   int Val(const double *x, double *val) const {
     RETURN_WITH_COND_TRUE(w_ == 0.0);
     itr_matrix<const double *> X(3, Nx()/3, x);
-    for (auto &e : e2c_->edges_) {
-      pair<size_t, size_t> face = e2c_->query(e.first, e.second);
-      if ( e2c_->is_boundary_edge(face) )
+    for (size_t i = 0; i < topo_->facet_num(); ++i) {
+      if ( topo_->is_boundary_facet(i) )
         continue;
-      const size_t fa[2] = {face.first, face.second};
+      const size_t fa[2] = {topo_->facet2cell()(0, i), topo_->facet2cell()(1, i)};
       matd_t vert(3, 8);
       vert(colon(), colon(0, 3)) = X(colon(), tris_(colon(), fa[0]));
       vert(colon(), colon(4, 7)) = X(colon(), tris_(colon(), fa[1]));
@@ -221,11 +279,10 @@ public:
     RETURN_WITH_COND_TRUE(w_ == 0.0);
     itr_matrix<const double *> X(3, Nx()/3, x);
     itr_matrix<double *> grad(3, Nx()/3, gra);
-    for (auto &e : e2c_->edges_) {
-      pair<size_t, size_t> face = e2c_->query(e.first, e.second);
-      if ( e2c_->is_boundary_edge(face) )
+    for (size_t i = 0; i < topo_->facet_num(); ++i) {
+      if ( topo_->is_boundary_facet(i) )
         continue;
-      const size_t fa[2] = {face.first, face.second};
+      const size_t fa[2] = {topo_->facet2cell()(0, i), topo_->facet2cell()(1, i)};
       matd_t vert(3, 8);
       vert(colon(), colon(0, 3)) = X(colon(), tris_(colon(), fa[0]));
       vert(colon(), colon(4, 7)) = X(colon(), tris_(colon(), fa[1]));
@@ -239,11 +296,10 @@ public:
   }
   int Hes(const double *x, vector<Triplet<double>> *hes) const {
     RETURN_WITH_COND_TRUE(w_ == 0.0);
-    for (auto &e : e2c_->edges_) {
-      pair<size_t, size_t> face = e2c_->query(e.first, e.second);
-      if ( e2c_->is_boundary_edge(face) )
+    for (size_t i = 0; i < topo_->facet_num(); ++i) {
+      if ( topo_->is_boundary_facet(i) )
         continue;
-      const size_t fa[2] = {face.first, face.second};
+      const size_t fa[2] = {topo_->facet2cell()(0, i), topo_->facet2cell()(1, i)};
       matd_t H = zeros<double>(24, 24);
       unit_smooth_energy_hes_(&H[0], NULL, &Sinv_(0, 3*fa[0]), &Sinv_(0, 3*fa[1]));
       for (size_t p = 0; p < 24; ++p) {
@@ -257,15 +313,58 @@ public:
     }
     return 0;
   }
+  int HesNnz(size_t *nnz) const {
+    if ( w_ == 0.0 ) {
+      *nnz = 0;
+      return 0;
+    }
+    if ( hes_ptr_.empty() ) {
+      calc_elem_nnz_ptr(topo_->facet_num(), [&](const size_t i) -> size_t {
+          matd_t H;
+          if ( ElemHes(i, H) )
+            return 0;
+          return std::count_if(H.begin(), H.end(), [](const double h) { return h != 0.0; });
+        }, hes_ptr_);
+    }
+    *nnz = hes_ptr_.back();
+    return 0;
+  }
+  int HesVal(const double *x, double *val) const {
+    RETURN_WITH_COND_TRUE(w_ == 0.0);
+#pragma omp parallel for
+    for (size_t i = 0; i < topo_->facet_num(); ++i) {
+      matd_t H;
+      if ( ElemHes(i, H) )
+        continue;
+      size_t cnt = hes_ptr_[i];
+      for (size_t p = 0; p < 24; ++p) {
+        for (size_t q = 0; q < 24; ++q) {
+          if ( H(p, q) != 0.0 )
+            val[cnt++] = w_*H(p, q);
+        }
+      }
+    }
+    return 0;
+  }
   void ResetWeight(const double w) {
     w_ = w;
   }
 private:
+  /// non-zero for boundary edges, which contribute nothing
+  int ElemHes(const size_t i, matd_t &H) const {
+    if ( topo_->is_boundary_facet(i) )
+      return __LINE__;
+    const size_t fa[2] = {topo_->facet2cell()(0, i), topo_->facet2cell()(1, i)};
+    H = zeros<double>(24, 24);
+    unit_smooth_energy_hes_(&H[0], NULL, &Sinv_(0, 3*fa[0]), &Sinv_(0, 3*fa[1]));
+    return 0;
+  }
   const mati_t &tris_;
   const matd_t &nods_;
   double w_;
-  shared_ptr<edge2cell_adjacent> e2c_;
+  const shared_ptr<const mesh_topology> topo_;
   const MatrixXd &Sinv_;
+  mutable vector<size_t> hes_ptr_;
 };
 
 class dt_identity_energy : public Functional<double>
@@ -304,17 +403,40 @@ public:
   }
   int Hes(const double *x, vector<Triplet<double>> *hes) const {
     RETURN_WITH_COND_TRUE(w_ == 0.0);
+    matd_t H(12, 12);
     for (size_t i = 0; i < tris_.size(2); ++i) {
-      matd_t H = zeros<double>(12, 12);
-      unit_identity_energy_hes_(&H[0], NULL, &Sinv_(0, 3*i));
-      for (size_t p = 0; p < 12; ++p) {
-        for (size_t q = 0; q < 12; ++q) {
-          const size_t I = 3*tris_(p/3, i)+p%3;
-          const size_t J = 3*tris_(q/3, i)+q%3;
-          if ( H(p, q) != 0.0 )
-            hes->push_back(Triplet<double>(I, J, w_*H(p, q)));
-        }
-      }
+      elem_hes(i, H);
+      for_each_elem_nz(&H[0], 12, [&](const size_t p, const size_t q, const double h) {
+          hes->push_back(Triplet<double>(3*tris_(p/3, i)+p%3, 3*tris_(q/3, i)+q%3, w_*h));
+        });
+    }
+    return 0;
+  }
+  int HesNnz(size_t *nnz) const {
+    if ( w_ == 0.0 ) {
+      *nnz = 0;
+      return 0;
+    }
+    if ( hes_ptr_.empty() ) {
+      calc_elem_nnz_ptr(tris_.size(2), [&](const size_t i) -> size_t {
+          matd_t H(12, 12);
+          elem_hes(i, H);
+          return for_each_elem_nz(&H[0], 12, [](const size_t, const size_t, const double) {});
+        }, hes_ptr_);
+    }
+    *nnz = hes_ptr_.back();
+    return 0;
+  }
+  int HesVal(const double *x, double *val) const {
+    RETURN_WITH_COND_TRUE(w_ == 0.0);
+#pragma omp parallel for
+    for (size_t i = 0; i < tris_.size(2); ++i) {
+      matd_t H(12, 12);
+      elem_hes(i, H);
+      double *v = val+hes_ptr_[i];
+      for_each_elem_nz(&H[0], 12, [&](const size_t, const size_t, const double h) {
+          *v++ = w_*h;
+        });
     }
     return 0;
   }
@@ -322,10 +444,17 @@ public:
     w_ = w;
   }
 private:
+  // the element hessian is constant, it only depends on the rest shape
+  void elem_hes(const size_t i, matd_t &H) const {
+    H = zeros<double>(12, 12);
+    unit_identity_energy_hes_(&H[0], NULL, &Sinv_(0, 3*i));
+  }
+
   const mati_t &tris_;
   const matd_t &nods_;
   double w_;
   const MatrixXd &Sinv_;
+  mutable vector<size_t> hes_ptr_;
 };
 
 class dt_distance_energy : public Functional<double>
@@ -373,6 +502,15 @@ public:
       hes->push_back(Triplet<double>(i, i, 2*w_));
     return 0;
   }
+  int HesNnz(size_t *nnz) const {
+    *nnz = (w_ == 0.0) ? 0 : 3*nbr_src_vert_+1;
+    return 0;
+  }
+  int HesVal(const double *x, double *val) const {
+    RETURN_WITH_COND_TRUE(w_ == 0.0);
+    std::fill(val, val+3*nbr_src_vert_+1, 2*w_);
+    return 0;
+  }
   void ResetWeight(const double w) {
     w_ = w;
   }
@@ -420,7 +558,7 @@ private:
 int deform_transfer::debug_energies() const {
   cout << "[info] debug energy functional\n";
   shared_ptr<Functional<double>> e0
-      = std::make_shared<dt_smooth_energy>(src_tris_, src_ref_nods_, Sinv_, 1.0);
+      = std::make_shared<dt_smooth_energy>(src_tris_, src_ref_nods_, Sinv_, 1.0, src_topo_);
   shared_ptr<Functional<double>> e1
       = std::make_shared<dt_identity_energy>(src_tris_, src_ref_nods_, Sinv_, 1.0);
   {
@@ -499,7 +637,7 @@ deform_transfer::deform_transfer() {}
 int deform_transfer::load_reference_source_mesh(const char *filename) {
   mati_t tris;
   matd_t nods;
-  int rtn = jtf::mesh::load_obj(filename, tris, nods);
+  int rtn = load_obj_cached(filename, tris, nods);
   append_fourth_vert(tris, nods, src_tris_, src_ref_nods_);
   return rtn;
 }
@@ -507,17 +645,21 @@ int deform_transfer::load_reference_source_mesh(const char *filename) {
 int deform_transfer::load_reference_target_mesh(const char *filename) {
   mati_t tris;
   matd_t nods;
-  int rtn = jtf::mesh::load_obj(filename, tris, nods);
+  int rtn = load_obj_cached(filename, tris, nods);
   append_fourth_vert(tris, nods, tar_tris_, tar_ref_nods_);
   return rtn;
 }
 
 /// can be invoked multiple times
 int deform_transfer::load_deformed_source_mesh(const char *filename) {
-  mati_t tris;
-  matd_t nods;
-  int rtn = jtf::mesh::load_obj(filename, tris, nods);
-  append_fourth_vert(tris, nods, src_tris_, src_def_nods_);
+  return load_source_pose(filename, src_def_nods_);
+}
+
+int deform_transfer::load_source_pose(const char *filename, matd_t &nods) const {
+  mati_t tris, tets;
+  matd_t verts;
+  int rtn = load_obj_cached(filename, tris, verts);
+  append_fourth_vert(tris, verts, tets, nods);
   return rtn;
 }
 
@@ -617,6 +759,10 @@ int deform_transfer::see_corres_mesh(const char *filename) const {
 
 int deform_transfer::init() {
   cout << "[info] initialization\n";
+  {
+    mati_t tris = src_tris_(colon(0, 2), colon());
+    src_topo_ = mesh_topology::create(tris);
+  }
   // calculate Sinv
   Sinv_.resize(3, 3*src_tris_.size(2));
 #pragma omp parallel for
@@ -675,7 +821,7 @@ int deform_transfer::solve_corres_first_phase() {
   // assemble energy
   vector<double> w{2.0, 0.001, 0.0};
   buff_.resize(3);
-  buff_[SMOOTH] = std::make_shared<dt_smooth_energy>(src_tris_, src_ref_nods_, Sinv_, w[SMOOTH]);
+  buff_[SMOOTH] = std::make_shared<dt_smooth_energy>(src_tris_, src_ref_nods_, Sinv_, w[SMOOTH], src_topo_);
   buff_[IDENTITY] = std::make_shared<dt_identity_energy>(src_tris_, src_ref_nods_, Sinv_, w[IDENTITY]);
   buff_[DISTANCE] = std::make_shared<dt_distance_energy>(src_tris_, src_ref_nods_, tar_tris_, tar_ref_nods_, w[DISTANCE]);
   try {
@@ -744,7 +890,8 @@ int deform_transfer::solve_corres_second_phase() {
 
   const size_t dim = corre_e_->Nx();
   Map<VectorXd> x(&src_cor_nods_[0], dim);
-  SimplicialCholesky<SparseMatrix<double>> sol;
+  reusable_factorization<SimplicialCholesky<SparseMatrix<double>>> sol("correspondence hessian");
+  fixed_pattern_assembler<double> hes_asm;
 
   for (size_t iter = 0; iter < 4; ++iter) {
     cout << "[info] iter " << iter << endl;
@@ -755,11 +902,8 @@ int deform_transfer::solve_corres_second_phase() {
     std::dynamic_pointer_cast<dt_distance_energy>(buff_[DISTANCE])
         ->UpdateClosetPoints(&x[0]);
 
-    vector<Triplet<double>> trips;
-    corre_e_->Hes(&x[0], &trips);
-    SparseMatrix<double> H(dim, dim);
-    H.reserve(trips.size());
-    H.setFromTriplets(trips.begin(), trips.end());
+    hes_asm.assemble(*corre_e_, &x[0]);
+    SparseMatrix<double> H = hes_asm.matrix();
 
     VectorXd rhs = VectorXd::Zero(dim);
     corre_e_->Gra(&x[0], rhs.data());
@@ -770,7 +914,7 @@ int deform_transfer::solve_corres_second_phase() {
       rm_vector_row(rhs, g2l_);
     }
 
-    sol.compute(H);
+    sol.factorize(H);
     ASSERT(sol.info() == Success);
     VectorXd dx = sol.solve(rhs);
     ASSERT(sol.info() == Success);
@@ -783,6 +927,7 @@ int deform_transfer::solve_corres_second_phase() {
     }
     x += Dx;
   }
+  sol.report();
   cout << "[info] second phase completed\n";
   return 0;
 }
@@ -802,6 +947,20 @@ double deform_transfer::calc_threshold(const mati_t &tris, const matd_t &nods) c
   return std::sqrt(4*(dx*dy+dy*dz+dz*dx)/tris.size(2));
 }
 
+void deform_transfer::merge_triangle_corres(vector<vector<tuple<size_t, size_t>>> &buffer) {
+  size_t nbr = tri_map_.size();
+  for (auto &b : buffer)
+    nbr += b.size();
+  tri_map_.reserve(nbr);
+  for (auto &b : buffer) {
+    tri_map_.insert(tri_map_.end(), b.begin(), b.end());
+    vector<tuple<size_t, size_t>>().swap(b);
+  }
+  // sorted and unique, same as iterating an ordered set
+  std::sort(tri_map_.begin(), tri_map_.end());
+  tri_map_.erase(std::unique(tri_map_.begin(), tri_map_.end()), tri_map_.end());
+}
+
 int deform_transfer::compute_triangle_corres() {
   cout << "[info] computing triangle correspondence...\n";
   typedef KDTreeEigenMatrixAdaptor<MatrixXd> kd_tree_t;
@@ -821,38 +980,41 @@ int deform_transfer::compute_triangle_corres() {
   const double tar_threshold = calc_threshold(tar_tris_, tar_ref_nods_);
   const double search_radius = std::pow(std::max(src_threshold, tar_threshold), 2);
   cout << "\t@search radius: " << search_radius << endl;
+  // per-thread buffers, merged once at the end
+  vector<vector<tuple<size_t, size_t>>> buffer(omp_get_max_threads());
   {
     MatrixXd pts = Map<const MatrixXd>(&tar_cent[0], tar_cent.size(1), tar_cent.size(2)).transpose();
     kd_tree_t kdt(3, pts, 10);
     kdt.index->buildIndex();
-//#pragma omp parallel for
+#pragma omp parallel for schedule(dynamic, 256)
     for (size_t i = 0; i < src_cent.size(2); ++i) {
+      vector<tuple<size_t, size_t>> &local = buffer[omp_get_thread_num()];
       vector<pair<long, double>> matches;
       SearchParams params;
       kdt.index->radiusSearch(&src_cent(0, i), search_radius, matches, params);
       for (auto &fa : matches) {
         if ( dot(src_normal(colon(), i), tar_normal(colon(), fa.first)) > 0.0 )
-//#pragma omp critical
-          tri_map_.insert(std::make_tuple(i, fa.first));
+          local.push_back(std::make_tuple(i, fa.first));
       }
     }
   }
   {
-    MatrixXd pts = Map<const MatrixXd>(&src_cent[0], src_cent.size(1), tar_cent.size(2)).transpose();
+    MatrixXd pts = Map<const MatrixXd>(&src_cent[0], src_cent.size(1), src_cent.size(2)).transpose();
     kd_tree_t kdt(3, pts, 10);
     kdt.index->buildIndex();
-//#pragma omp parallel for
+#pragma omp parallel for schedule(dynamic, 256)
     for (size_t i = 0; i < tar_cent.size(2); ++i) {
+      vector<tuple<size_t, size_t>> &local = buffer[omp_get_thread_num()];
       vector<pair<long, double>> matches;
       SearchParams params;
       kdt.index->radiusSearch(&tar_cent(0, i), search_radius, matches, params);
       for (auto &fa : matches) {
         if ( dot(src_normal(colon(), fa.first), tar_normal(colon(), i)) > 0.0 )
-//#pragma omp critical
-          tri_map_.insert(std::make_tuple(fa.first, i));
+          local.push_back(std::make_tuple(fa.first, i));
       }
     }
   }
+  merge_triangle_corres(buffer);
   cout << "\t@number of face corres: " << tri_map_.size() << endl;
   cout << "[info] ...complete\n";
   return 0;
@@ -869,10 +1031,14 @@ int deform_transfer::load_triangle_corres(const char *filename) {
   cout << "[info] number of triangle corrs: " << nbr << endl;
   size_t src, tar;
   double dist;
+  vector<vector<tuple<size_t, size_t>>> buffer(1);
+  buffer[0].reserve(nbr);
   for (size_t i = 0; i < nbr; ++i) {
     state = fscanf(fp, "%zu, %zu, %lf", &src, &tar, &dist);
-    tri_map_.insert(std::make_tuple(src, tar));
+    buffer[0].push_back(std::make_tuple(src, tar));
   }
+  fclose(fp);
+  merge_triangle_corres(buffer);
   return 0;
 }
 
@@ -880,51 +1046,140 @@ int deform_transfer::deformation_transfer_precompute() {
   cout << "[info] precomputation for deformation transfer...";
   tar_def_nods_ = tar_ref_nods_;
   deform_e_ = std::make_shared<dt_deform_energy>(tar_tris_, tar_ref_nods_, Sinv_, Tinv_, tri_map_, 1.0);
+  // the factorization belongs to the previous energy
+  dt_sol_.reset();
   cout << "complete\n";
   return 0;
 }
 
-int deform_transfer::deformation_transfer() {
-  cout << "[info] deformation transfer begin...";
-  std::dynamic_pointer_cast<dt_deform_energy>(deform_e_)
-      ->UpdateSourceGrad(src_tris_, src_def_nods_);
-
+int deform_transfer::deformation_transfer_prefactorize() {
+  cout << "[info] prefactorizing deformation transfer system...";
+  high_resolution_timer clk;
+  clk.start();
   const size_t dim = deform_e_->Nx();
-  Map<VectorXd> x(&tar_def_nods_[0], dim);
+  Map<const VectorXd> x(&tar_ref_nods_[0], dim);
 
+  // the energy is quadratic and its hessian only depends on
+  // the target reference and the triangle correspondence
   vector<Triplet<double>> trips;
   deform_e_->Hes(&x[0], &trips);
   SparseMatrix<double> H(dim, dim);
   H.reserve(trips.size());
   H.setFromTriplets(trips.begin(), trips.end());
 
+  if ( !dt_fix_dof_.empty() )
+    rm_spmat_col_row(H, dt_g2l_);
+
+  dt_sol_ = std::make_shared<SimplicialCholesky<SparseMatrix<double>>>();
+  dt_sol_->compute(H);
+  ASSERT(dt_sol_->info() == Success);
+  clk.stop();
+  cout << "complete, " << clk.period() << " msec\n";
+  return 0;
+}
+
+int deform_transfer::transfer_single_pose(const matd_t &src_def, matd_t &tar_def) const {
+  shared_ptr<dt_deform_energy> energy = std::dynamic_pointer_cast<dt_deform_energy>(deform_e_);
+  MatrixXd src_grad;
+  energy->CalcSourceGrad(src_tris_, src_def, src_grad);
+
+  // one newton step from the reference is exact for the quadratic energy
+  const size_t dim = energy->Nx();
+  tar_def = tar_ref_nods_;
+  Map<VectorXd> x(&tar_def[0], dim);
+
   VectorXd rhs = VectorXd::Zero(dim);
-  deform_e_->Gra(&x[0], rhs.data());
+  energy->Gra(&x[0], src_grad, rhs.data());
   rhs = -rhs;
-
-  if ( !dt_fix_dof_.empty() ) {
-    rm_spmat_col_row(H, dt_g2l_);
+  if ( !dt_fix_dof_.empty() )
     rm_vector_row(rhs, dt_g2l_);
-  }
 
-  SimplicialCholesky<SparseMatrix<double>> sol;
-  sol.compute(H);
-  ASSERT(sol.info() == Success);
-  VectorXd dx = sol.solve(rhs);
-  ASSERT(sol.info() == Success);
+  VectorXd dx = dt_sol_->solve(rhs);
+  if ( dt_sol_->info() != Success )
+    return __LINE__;
 
-  VectorXd Dx = VectorXd::Zero(deform_e_->Nx());
+  VectorXd Dx = VectorXd::Zero(dim);
   if ( !dt_fix_dof_.empty() )
     rc_vector_row(dx, dt_g2l_, Dx);
   else
     Dx = dx;
 
   x += Dx;
+  return 0;
+}
+
+int deform_transfer::deformation_transfer() {
+  if ( dt_sol_.get() == nullptr )
+    deformation_transfer_prefactorize();
+
+  cout << "[info] deformation transfer begin...";
+  std::dynamic_pointer_cast<dt_deform_energy>(deform_e_)
+      ->UpdateSourceGrad(src_tris_, src_def_nods_);
+
+  int rtn = transfer_single_pose(src_def_nods_, tar_def_nods_);
+  ASSERT(rtn == 0);
 
   cout << "complete\n";
   return 0;
 }
 
+int deform_transfer::deformation_transfer_sequence(const vector<string> &src_def_files,
+                                                   const vector<string> &tar_def_files,
+                                                   const bool parallel) {
+  if ( src_def_files.size() != tar_def_files.size() ) {
+    cerr << "[error] numbers of input and output poses mismatch\n";
+    return __LINE__;
+  }
+  if ( dt_sol_.get() == nullptr )
+    deformation_transfer_prefactorize();
+
+  const size_t nbr_pose = src_def_files.size();
+  cout << "[info] transfer " << nbr_pose << " poses\n";
+  vector<double> latency(nbr_pose, 0);
+  vector<int> state(nbr_pose, 0);
+  high_resolution_timer total;
+  total.start();
+  // nested parallel regions inside are serialized by default
+#pragma omp parallel for schedule(dynamic) if(parallel)
+  for (size_t i = 0; i < nbr_pose; ++i) {
+    high_resolution_timer clk;
+    clk.start();
+    matd_t src_def, tar_def;
+    if ( load_source_pose(src_def_files[i].c_str(), src_def) ) {
+      state[i] = __LINE__;
+      continue;
+    }
+    if ( transfer_single_pose(src_def, tar_def) ) {
+      state[i] = __LINE__;
+      continue;
+    }
+    mati_t tris;
+    matd_t nods;
+    remove_fourth_vert(tar_tris_, tar_def, tris, nods);
+    state[i] = jtf::mesh::save_obj(tar_def_files[i].c_str(), tris, nods);
+    clk.stop();
+    latency[i] = clk.period();
+  }
+  total.stop();
+
+  size_t nbr_fail = 0;
+  for (size_t i = 0; i < nbr_pose; ++i) {
+    if ( state[i] ) {
+      ++nbr_fail;
+      cerr << "[error] failed to transfer " << src_def_files[i] << endl;
+      continue;
+    }
+    cout << "\t@pose " << i << ": " << latency[i] << " msec\n";
+  }
+  if ( nbr_pose > nbr_fail ) {
+    cout << "\t@average latency: "
+         << std::accumulate(latency.begin(), latency.end(), 0.0)/(nbr_pose-nbr_fail) << " msec\n";
+  }
+  cout << "\t@total wall time: " << total.period() << " msec\n";
+  cout << "[info] ...complete\n";
+  return nbr_fail == 0 ? 0 : __LINE__;
+}
+
 int deform_transfer::calc_harmonic_fields(const mati_t &tris, const matd_t &nods, MatrixXd &cell_hf, bool source) {
   mati_t _tris = tris(colon(0, 2), colon());
   matd_t _nods = nods(colon(), colon(0, max(_tris)));
@@ -1027,7 +1282,9 @@ int deform_transfer::solve_corres_harmonic() {
   kd_tree_t kdt(src_cell_hf.cols(), src_cell_hf, 10);
   kdt.index->buildIndex();
   const size_t num_results = 3;
-//#pragma omp parallel for
+  vector<vector<tuple<size_t, size_t>>> buffer(1);
+  buffer[0].resize(tar_cell_hf.rows());
+#pragma omp parallel for
   for (size_t i = 0; i < tar_cell_hf.rows(); ++i) {
     vector<size_t> ret_idx(num_results);
     vector<double> sqr_dist(num_results);
@@ -1035,9 +1292,9 @@ int deform_transfer::solve_corres_harmonic() {
     result.init(&ret_idx[0], &sqr_dist[0]);
     VectorXd x = tar_cell_hf.row(i);
     kdt.index->findNeighbors(result, x.data(), SearchParams(10));
-//#pragma omp single
-    tri_map_.insert(std::make_tuple(ret_idx[0], i));
+    buffer[0][i] = std::make_tuple(ret_idx[0], i);
   }
+  merge_triangle_corres(buffer);
   cout << "[info] number of correospondence: " << tri_map_.size() << endl;
   cout << "[info] ...complete\n";
   return 0;
@@ -4,12 +4,16 @@
 #include <zjucad/matrix/matrix.h>
 #include <Eigen/Sparse>
 #include <unordered_set>
-#include <set>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <memory>
 
 namespace riemann {
 
 template <typename T>
 class Functional;
+class mesh_topology;
 
 class deform_transfer
 {
@@ -42,7 +46,12 @@ public:
   int solve_corres_harmonic();
   // deformation solver
   int deformation_transfer_precompute();
+  int deformation_transfer_prefactorize();
   int deformation_transfer();
+  // transfer a sequence of source poses with one factorization
+  int deformation_transfer_sequence(const std::vector<std::string> &src_def_files,
+                                    const std::vector<std::string> &tar_def_files,
+                                    const bool parallel=true);
   // debug
   int see_source_markers(const char *filename) const;
   int see_target_markers(const char *filename) const;
@@ -52,6 +61,9 @@ public:
   int debug_energies() const;
 public:
   int load_triangle_corres(const char *filename);
+  void merge_triangle_corres(std::vector<std::vector<std::tuple<size_t, size_t>>> &buffer);
+  int load_source_pose(const char *filename, matd_t &nods) const;
+  int transfer_single_pose(const matd_t &src_def, matd_t &tar_def) const;
   void append_fourth_vert(const mati_t &tri_cell, const matd_t &tri_nods, mati_t &tet_cell, matd_t &tet_nods) const;
   void remove_fourth_vert(const mati_t &tet_cell, const matd_t &tet_nods, mati_t &tri_cell, matd_t &tri_nods) const;
   double calc_threshold(const mati_t &tris, const matd_t &nods) const;
@@ -60,6 +72,7 @@ public:
   int see_face_scalar_fields(const char *filename, const mati_t &tris, const matd_t &nods, const Eigen::MatrixXd &cell_dat) const;
 
   mati_t src_tris_, tar_tris_;
+  std::shared_ptr<const mesh_topology> src_topo_;
   matd_t src_ref_nods_, tar_ref_nods_;
   matd_t src_cor_nods_;
   matd_t src_def_nods_, tar_def_nods_;
@@ -72,10 +85,12 @@ public:
   std::unordered_set<size_t> fix_dof_;
   std::vector<size_t> g2l_;
 
-  std::set<std::tuple<size_t, size_t>> tri_map_;
+  // sorted and deduplicated (source face, target face) pairs
+  std::vector<std::tuple<size_t, size_t>> tri_map_;
   std::shared_ptr<riemann::Functional<double>> deform_e_;
   std::unordered_set<size_t> dt_fix_dof_;
   std::vector<size_t> dt_g2l_;
+  std::shared_ptr<Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>>> dt_sol_;
 };
 
 }
@@ -1,6 +1,7 @@
 #include "diffuse_dihedral_rot.h"
 
-#include <stack>
+#include <algorithm>
+#include <numeric>
 #include <Eigen/Dense>
 #include <Eigen/SVD>
 #include <Eigen/Geometry>
@@ -9,6 +10,8 @@
 #include "dual_graph.h"
 #include "config.h"
 #include "util.h"
+#include "batch_svd.h"
+#include "mesh_topology.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -30,22 +33,19 @@ static Matrix3d calc_triangle_rotation(const double *rest, const double *defo) {
   Matrix3d Dm, Ds;
   Dm.col(0) = X.col(1)-X.col(0); Dm.col(1) = X.col(2)-X.col(0); Dm.col(2) = Dm.col(0).cross(Dm.col(1)).normalized();
   Ds.col(0) = Y.col(1)-Y.col(0); Ds.col(1) = Y.col(2)-Y.col(0); Ds.col(2) = Ds.col(0).cross(Ds.col(1)).normalized();
-  Matrix3d G = Ds*Dm.inverse();
-  JacobiSVD<Matrix3d> svd(G,  ComputeFullU|ComputeFullV);
-  return svd.matrixU()*svd.matrixV().transpose();
+  Matrix3d G = Ds*Dm.inverse(), R;
+  rotation3x3(G.data(), R.data());
+  return R;
 }
 
-static void get_edge_diam_elem(const size_t left, const size_t right, const mati_t &tris, mati_t &diam) {
-  // left and right should be adjacent
-  diam.resize(4, 1); {
-    mati_t tri0 = tris(colon(), left), tri1 = tris(colon(), right);
-    vector<size_t> buffer;
-    if ( find(tri1.begin(), tri1.end(), tri0[0]) != tri1.end() ) buffer.push_back(tri0[0]);
-    if ( find(tri1.begin(), tri1.end(), tri0[1]) != tri1.end() ) buffer.push_back(tri0[1]);
-    if ( find(tri1.begin(), tri1.end(), tri0[2]) != tri1.end() ) buffer.push_back(tri0[2]);
-    ASSERT(buffer.size() == 2);
-    diam[1] = buffer[0]; diam[2] = buffer[1];
-  }
+/// e is the edge shared by the adjacent faces left and right
+static void get_edge_diam_elem(const mesh_topology &topo, const size_t left, const size_t right,
+                               const size_t e, mati_t &diam) {
+  const mati_t &tris = topo.cells();
+  ASSERT(e != -1);
+  diam.resize(4, 1);
+  diam[1] = topo.edges()(0, e);
+  diam[2] = topo.edges()(1, e);
   bool need_swap = true;
   for (size_t k = 0; k < 3; ++k) {
     if ( diam[1] == tris(k, left) ) {
@@ -79,17 +79,61 @@ static void tri2tet(const mati_t &tris, const matd_t &tri_nods, mati_t &tets, ma
   }
 }
 
-static void apply_gs_iteration(const SparseMatrix<double, RowMajor> &LHS, const VectorXd &rhs, VectorXd &x) {
-  for (size_t i = 0; i < LHS.outerSize(); ++i) {
-    double temp = rhs[i], diag = 1.0;
-    for (SparseMatrix<double, RowMajor>::InnerIterator it(LHS, i); it; ++it) {
-      if ( i == it.col() )
-        diag = it.value();
-      else
-        temp -= it.value()*x[it.col()];
+/// greedy coloring of the graph of a symmetric matrix, the rows of one
+/// color are listed in row[ptr[c]...ptr[c+1]) and are mutually decoupled
+static void color_rows(const SparseMatrix<double> &A, vector<size_t> &ptr, vector<size_t> &row) {
+  const size_t n = A.outerSize();
+  vector<size_t> color(n, -1), mark;
+  size_t nc = 0;
+  for (size_t i = 0; i < n; ++i) {
+    for (SparseMatrix<double>::InnerIterator it(A, i); it; ++it) {
+      const size_t c = color[it.index()];
+      if ( it.index() != i && c != -1 )
+        mark[c] = i;
+    }
+    size_t c = 0;
+    while ( c < nc && mark[c] == i )
+      ++c;
+    if ( c == nc ) {
+      mark.push_back(-1);
+      ++nc;
+    }
+    color[i] = c;
+  }
+  ptr.assign(nc+1, 0);
+  for (size_t i = 0; i < n; ++i)
+    ++ptr[color[i]+1];
+  std::partial_sum(ptr.begin(), ptr.end(), ptr.begin());
+  row.resize(n);
+  vector<size_t> pos(ptr.begin(), ptr.end()-1);
+  for (size_t i = 0; i < n; ++i)
+    row[pos[color[i]]++] = i;
+}
+
+/// one multicolor SOR sweep, column i of the symmetric A is its row i.
+/// returns the squared residual of every row taken right before its
+/// update, a one-sweep-lagged estimate that comes without an extra SpMV
+static double apply_colored_sor(const SparseMatrix<double> &A, const VectorXd &rhs,
+                                const vector<size_t> &ptr, const vector<size_t> &row,
+                                const double omega, VectorXd &x) {
+  double res2 = 0;
+  for (size_t c = 0; c+1 < ptr.size(); ++c) {
+#pragma omp parallel for reduction(+:res2)
+    for (size_t k = ptr[c]; k < ptr[c+1]; ++k) {
+      const size_t i = row[k];
+      double temp = rhs[i], diag = 1.0;
+      for (SparseMatrix<double>::InnerIterator it(A, i); it; ++it) {
+        if ( i == it.index() )
+          diag = it.value();
+        else
+          temp -= it.value()*x[it.index()];
+      }
+      const double r = temp-diag*x[i];
+      res2 += r*r;
+      x[i] += omega*(temp/diag-x[i]);
     }
-    x[i] = temp/diag;
   }
+  return res2;
 }
 
 class diffuse_arap_energy : public Functional<double>
@@ -165,144 +209,182 @@ private:
   vector<Matrix3d> D_;
 };
 //==============================================================================
+void diffuse_arap_encoder::update_topology(const mati_t &tris) {
+  // frames of an animation share the connectivity, build it only once
+  if ( topo_.get() == nullptr || topo_->cells().size() != tris.size() ||
+       !std::equal(tris.begin(), tris.end(), topo_->cells().begin()) )
+    topo_ = mesh_topology::create(tris);
+}
+
 void diffuse_arap_encoder::calc_delta_angle(const mati_t &tris, const matd_t &prev, const matd_t &curr,
                                             const tree_t &g, const size_t root_face, const size_t leaf_face,
                                             matd_t &root_curr, matd_t &leaf_curr, vector<double> &da) {
-  stack<size_t> q;
-  unordered_set<size_t> vis;
-  q.push(root_face);
-  while ( !q.empty() ) {
-    const size_t curr_face = q.top();
-    q.pop();
-    if ( vis.find(curr_face) != vis.end() ) {
-      cout << "[Error] not a tree\n";
-      ASSERT(0);
-    }
-    vis.insert(curr_face);
-    for (size_t e = g.first[curr_face]; e != -1; e = g.next[e]) {
-      const size_t next_face = g.v[e];
-      if ( vis.find(next_face) != vis.end() )
-        continue;
-      mati_t diam;
-      get_edge_diam_elem(curr_face, next_face, tris, diam);
-      matd_t prev_diam = prev(colon(), diam), curr_diam = curr(colon(), diam);
-      double prev_theta = 0, curr_theta = 0;
-      calc_dihedral_angle_(&prev_theta, &prev_diam[0]);
-      calc_dihedral_angle_(&curr_theta, &curr_diam[0]);
-      da.push_back(curr_theta-prev_theta);
-      q.push(next_face);
-    }
+  update_topology(tris);
+  tree_order_t order;
+  if ( get_preorder(*topo_, g, root_face, order) )
+    ASSERT(0);
+  calc_delta_angle(tris, prev, curr, order, leaf_face, root_curr, leaf_curr, da);
+}
+
+void diffuse_arap_encoder::calc_delta_angle(const mati_t &tris, const matd_t &prev, const matd_t &curr,
+                                            const tree_order_t &order, const size_t leaf_face,
+                                            matd_t &root_curr, matd_t &leaf_curr, vector<double> &da) {
+  update_topology(tris);
+  const size_t n = order.face.size();
+  ASSERT(n == tris.size(2));
+  da.resize(n-1);
+  // every tree edge is measured on its own
+#pragma omp parallel for
+  for (size_t k = 1; k < n; ++k) {
+    mati_t diam;
+    get_edge_diam_elem(*topo_, order.parent[k], order.face[k], order.edge[k], diam);
+    matd_t prev_diam = prev(colon(), diam), curr_diam = curr(colon(), diam);
+    double prev_theta = 0, curr_theta = 0;
+    calc_dihedral_angle_(&prev_theta, &prev_diam[0]);
+    calc_dihedral_angle_(&curr_theta, &curr_diam[0]);
+    da[k-1] = curr_theta-prev_theta;
   }
-  ASSERT(da.size() == tris.size(2)-1);
-  root_curr = curr(colon(), tris(colon(), root_face));
+  root_curr = curr(colon(), tris(colon(), order.face[0]));
   leaf_curr = curr(colon(), tris(colon(), leaf_face));
 }
 //==============================================================================
 diffuse_arap_decoder::diffuse_arap_decoder(const mati_t &tris, const matd_t &nods)
-  : tris_(tris), nods_(nods) {
+  : tris_(tris), nods_(nods), topo_(mesh_topology::create(tris)), dirty_(true),
+    direct_("arap decoder"), omega_(1.0), gs_tol_(1e-8), gs_maxits_(1000) {
   energy_ = make_shared<diffuse_arap_energy>(tris, nods);
   dim_ = energy_->Nx();
   X_ = VectorXd::Zero(dim_);
   R_.resize(tris.size(2));
+  direct_.solver().setMode(SimplicialCholeskyLLT);
 }
 
 /// estimate rotation from rest pose
 int diffuse_arap_decoder::estimate_rotation(const matd_t &prev, const tree_t &g, const size_t root_face,
                                             const matd_t &root_curr, const vector<double> &da) {
+  tree_order_t order;
+  if ( get_preorder(*topo_, g, root_face, order) )
+    return __LINE__;
+  return estimate_rotation(prev, order, root_curr, da);
+}
+
+/**
+ * Rotating the hinge axis with the parent gives
+ * R_child = AngleAxis(R_parent*a, t)*R_parent = R_parent*AngleAxis(a, t),
+ * so the local factors are evaluated in parallel and only the chain of
+ * 3x3 products follows the pre-order.
+ */
+int diffuse_arap_decoder::estimate_rotation(const matd_t &prev, const tree_order_t &order,
+                                            const matd_t &root_curr, const vector<double> &da) {
+  const size_t n = order.face.size();
+  if ( n != tris_.size(2) || da.size()+1 != n ) {
+    cerr << "[Error] tree does not match the mesh\n";
+    return __LINE__;
+  }
+  const size_t root_face = order.face[0];
   matd_t root_rest = nods_(colon(), tris_(colon(), root_face));
   R_[root_face] = calc_triangle_rotation(&root_rest[0], &root_curr[0]);
 
-  stack<size_t> q;
-  unordered_set<size_t> vis;
-  q.push(root_face);
-  size_t cnt = 0;
-  while ( !q.empty() ) {
-    const size_t curr_face = q.top();
-    q.pop();
-    if ( vis.find(curr_face) != vis.end() ) {
-      cerr << "[Error] not a tree\n";
-      ASSERT(0);
-    }
-    vis.insert(curr_face);
-    for (size_t e = g.first[curr_face]; e != -1; e = g.next[e]) {
-      const size_t next_face = g.v[e];
-      if ( vis.find(next_face) != vis.end() )
-        continue;
-      mati_t diam;
-      get_edge_diam_elem(curr_face, next_face, tris_, diam);
-      matd_t prev_diam = prev(colon(), diam), rest_diam = nods_(colon(), diam);
-      double prev_angle = 0, rest_angle = 0;
-      calc_dihedral_angle_(&prev_angle, &prev_diam[0]);
-      calc_dihedral_angle_(&rest_angle, &rest_diam[0]);
-      // make sure that the current face is on the left of the axis
-      bool need_swap = false;
-      for (size_t k = 0; k < 3; ++k) {
-        if ( diam[1] == tris_(k, curr_face) ) {
-          if ( diam[2] == tris_((k+1)%3, curr_face) ) {
-            need_swap = true;
-            break;
-          }
+  vector<Matrix3d> Q(n);
+#pragma omp parallel for
+  for (size_t k = 1; k < n; ++k) {
+    const size_t curr_face = order.parent[k];
+    mati_t diam;
+    get_edge_diam_elem(*topo_, curr_face, order.face[k], order.edge[k], diam);
+    matd_t prev_diam = prev(colon(), diam), rest_diam = nods_(colon(), diam);
+    double prev_angle = 0, rest_angle = 0;
+    calc_dihedral_angle_(&prev_angle, &prev_diam[0]);
+    calc_dihedral_angle_(&rest_angle, &rest_diam[0]);
+    // make sure that the current face is on the left of the axis
+    bool need_swap = false;
+    for (size_t j = 0; j < 3; ++j) {
+      if ( diam[1] == tris_(j, curr_face) ) {
+        if ( diam[2] == tris_((j+1)%3, curr_face) ) {
+          need_swap = true;
+          break;
         }
       }
-      matd_t axis = itr_matrix<const double *>(3, 3, R_[curr_face].data())*(nods_(colon(), diam[1])-nods_(colon(), diam[2]));
-      axis *= need_swap ? -1 : 1;
-      double curr_angle = prev_angle+da[cnt++];
-      R_[next_face] = axis_angle_rot_mat(&axis[0], curr_angle-rest_angle)*R_[curr_face];
-      q.push(next_face);
     }
+    matd_t axis = nods_(colon(), diam[1])-nods_(colon(), diam[2]);
+    axis *= need_swap ? -1 : 1;
+    const double curr_angle = prev_angle+da[k-1];
+    Q[k] = axis_angle_rot_mat(&axis[0], curr_angle-rest_angle);
   }
-  ASSERT(vis.size() == tris_.size(2));
+  for (size_t k = 1; k < n; ++k)
+    R_[order.face[k]] = R_[order.parent[k]]*Q[k];
   energy_->SetRotation(R_);
   return 0;
 }
 
 int diffuse_arap_decoder::pin_down_vert(const size_t id, const double *pos) {
-  fixDoF_.insert(3*id+0);
-  fixDoF_.insert(3*id+1);
-  fixDoF_.insert(3*id+2);
+  for (size_t k = 0; k < 3; ++k) {
+    if ( fixDoF_.insert(3*id+k).second )
+      dirty_ = true;
+  }
   std::copy(pos, pos+3, X_.data()+3*id);
+  return 0;
 }
 
-int diffuse_arap_decoder::solve(matd_t &curr, const string lin_solver) {
-  if ( curr.size(1) != nods_.size(1) || curr.size(2) != nods_.size(2) )
-    curr.resize(nods_.size(1), nods_.size(2));
-  VectorXd g = VectorXd::Zero(dim_); {
-    energy_->Gra(&X_[0], g.data());
-    g *= -1;
-  }
-  SparseMatrix<double> H(dim_, dim_); {
+void diffuse_arap_decoder::set_smoother(const double omega, const double tol, const size_t maxits) {
+  omega_ = omega;
+  gs_tol_ = tol;
+  gs_maxits_ = maxits;
+}
+
+int diffuse_arap_decoder::prepare_system() {
+  if ( !dirty_ )
+    return 0;
+  H_.resize(dim_, dim_); {
     vector<Triplet<double>> trips;
     energy_->Hes(nullptr, &trips);
-    H.setFromTriplets(trips.begin(), trips.end());
+    H_.setFromTriplets(trips.begin(), trips.end());
   }
-  vector<size_t> g2l(dim_);
+  g2l_.resize(dim_);
   size_t cnt = 0;
   for (size_t i = 0; i < dim_; ++i) {
     if ( fixDoF_.find(i) != fixDoF_.end() )
-      g2l[i] = -1;
+      g2l_[i] = -1;
     else
-      g2l[i] = cnt++;
+      g2l_[i] = cnt++;
   }
-  rm_spmat_col_row(H, g2l);
-  rm_vector_row(g, g2l);
-  VectorXd dx = VectorXd::Zero(H.cols());
+  rm_spmat_col_row(H_, g2l_);
+  H_.makeCompressed();
+  color_ptr_.clear();
+  color_row_.clear();
+  dirty_ = false;
+  return 0;
+}
+
+int diffuse_arap_decoder::solve(matd_t &curr, const string lin_solver) {
+  if ( curr.size(1) != nods_.size(1) || curr.size(2) != nods_.size(2) )
+    curr.resize(nods_.size(1), nods_.size(2));
+  if ( prepare_system() )
+    return __LINE__;
+  VectorXd g = VectorXd::Zero(dim_); {
+    energy_->Gra(&X_[0], g.data());
+    g *= -1;
+  }
+  rm_vector_row(g, g2l_);
+  VectorXd dx = VectorXd::Zero(H_.cols());
   if ( lin_solver == "direct" ) {
-    SimplicialCholesky<SparseMatrix<double>> solver;
-    solver.setMode(SimplicialCholeskyLLT);
-    solver.compute(H);
-    ASSERT(solver.info() == Success);
-    dx = solver.solve(g);
-    ASSERT(solver.info() == Success);
+    direct_.factorize(H_);
+    ASSERT(direct_.info() == Success);
+    dx = direct_.solve(g);
+    ASSERT(direct_.info() == Success);
   } else if ( lin_solver == "GS" ) {
-    int iter = 100;
-    while ( iter-- )
-      apply_gs_iteration(H, g, dx);
+    if ( color_ptr_.empty() )
+      color_rows(H_, color_ptr_, color_row_);
+    const double gnorm = g.norm();
+    for (size_t iter = 0; iter < gs_maxits_ && gnorm > 0; ++iter) {
+      const double res2 = apply_colored_sor(H_, g, color_ptr_, color_row_, omega_, dx);
+      if ( std::sqrt(res2) <= gs_tol_*gnorm )
+        break;
+    }
   } else {
     cerr << "[Error] unsupported linear solver\n";
     return __LINE__;
   }
   VectorXd DX = VectorXd::Zero(dim_);
-  rc_vector_row(dx, g2l, DX);
+  rc_vector_row(dx, g2l_, DX);
   X_ += DX;
   std::copy(X_.data(), X_.data()+nods_.size(), &curr[0]);
   return 0;
@@ -2,17 +2,22 @@
 #define DIFFUSE_DIHEDRAL_ROT_H
 
 #include <unordered_set>
+#include <memory>
 #include <zjucad/matrix/matrix.h>
 #include <Eigen/Sparse>
 
+#include "sparse_solver.h"
+
 namespace riemann {
 
 using mati_t=zjucad::matrix::matrix<size_t>;
 using matd_t=zjucad::matrix::matrix<double>;
 
 class diffuse_arap_energy;
-class graph_t;
+class mesh_topology;
+struct graph_t;
 typedef graph_t tree_t;
+struct tree_order_t;
 
 class diffuse_arap_encoder
 {
@@ -20,6 +25,15 @@ public:
   void calc_delta_angle(const mati_t &tris, const matd_t &prev, const matd_t &curr,
                         const tree_t &g, const size_t root_face, const size_t leaf_face,
                         matd_t &root_curr, matd_t &leaf_curr, std::vector<double> &da);
+  /// da[k-1] is the change across the k-th edge of the pre-order, the
+  /// root is order.face[0]
+  void calc_delta_angle(const mati_t &tris, const matd_t &prev, const matd_t &curr,
+                        const tree_order_t &order, const size_t leaf_face,
+                        matd_t &root_curr, matd_t &leaf_curr, std::vector<double> &da);
+private:
+  void update_topology(const mati_t &tris);
+
+  std::shared_ptr<const mesh_topology> topo_;
 };
 
 class diffuse_arap_decoder
@@ -27,16 +41,34 @@ class diffuse_arap_decoder
 public:
   diffuse_arap_decoder(const mati_t &tris, const matd_t &nods);
   int estimate_rotation(const matd_t &prev, const tree_t &g, const size_t root_face, const matd_t &root_nods, const std::vector<double> &da);
+  int estimate_rotation(const matd_t &prev, const tree_order_t &order, const matd_t &root_nods, const std::vector<double> &da);
+  const mesh_topology &topology() const { return *topo_; }
   int pin_down_vert(const size_t id, const double *pos);
+  /// SOR factor (1 for plain Gauss-Seidel), relative residual and sweep limit of "GS"
+  void set_smoother(const double omega, const double tol, const size_t maxits);
+  /// lin_solver is "direct" or "GS", both reuse the system across frames
   int solve(matd_t &curr, const std::string lin_solver);
 private:
+  int prepare_system();
+
   const mati_t &tris_;
   const matd_t &nods_;
+  const std::shared_ptr<const mesh_topology> topo_;
   size_t dim_;
   std::unordered_set<size_t> fixDoF_;
   std::shared_ptr<diffuse_arap_energy> energy_;
   std::vector<Eigen::Matrix3d> R_;
   Eigen::VectorXd X_;
+  // the arap hessian does not depend on the rotations, so the reduced
+  // system only changes with the pinned dofs
+  bool dirty_;
+  std::vector<size_t> g2l_;
+  Eigen::SparseMatrix<double> H_;
+  reusable_factorization<Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>>> direct_;
+  // rows of each color are decoupled and relaxed in parallel
+  std::vector<size_t> color_ptr_, color_row_;
+  double omega_, gs_tol_;
+  size_t gs_maxits_;
 };
 
 }
@@ -1,11 +1,14 @@
 #include "dual_graph.h"
 
+#include <numeric>
+#include <algorithm>
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/graphviz.hpp>
 #include <boost/graph/kruskal_min_spanning_tree.hpp>
 #include <boost/graph/dijkstra_shortest_paths.hpp>
 
 #include "vtk.h"
+#include "mesh_topology.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -168,4 +171,141 @@ int draw_minimum_spanning_tree(const char *file, const mati_t &tris, const matd_
   ofs.close();
   return 0;
 }
+
+//==============================================================================
+static size_t find_root(vector<size_t> &uf, size_t x) {
+  while ( uf[x] != x ) {
+    uf[x] = uf[uf[x]];
+    x = uf[x];
+  }
+  return x;
+}
+
+static void push_tree_edge(graph_t &mst, const size_t p, const size_t q) {
+  mst.u.push_back(p);
+  mst.v.push_back(q);
+  mst.next.push_back(mst.first[p]);
+  mst.first[p] = mst.u.size()-1;
+}
+
+/**
+ * Boruvka: in every round each cell picks its lightest edge leaving its
+ * component in parallel, the picks are reduced per component and the
+ * components are merged, so there are at most log(#cell) rounds
+ */
+int get_minimum_spanning_tree(const mesh_topology &topo, graph_t &mst, const vector<double> *weight) {
+  const size_t nc = topo.cell_num();
+  const vector<size_t> &ptr = topo.cc_ptr(), &adj = topo.cc_adj(), &fac = topo.cc_facet();
+  if ( weight != nullptr && weight->size() != topo.facet_num() ) {
+    cerr << "[Error] one weight per facet is expected\n";
+    return EXIT_FAILURE;
+  }
+  auto lighter = [weight](const size_t f0, const size_t f1) {
+    if ( weight != nullptr && (*weight)[f0] != (*weight)[f1] )
+      return (*weight)[f0] < (*weight)[f1];
+    return f0 < f1;
+  };
+
+  mst.vert_num = nc;
+  mst.u.clear();
+  mst.v.clear();
+  mst.next.clear();
+  mst.first.assign(nc, -1);
+
+  vector<size_t> uf(nc), label(nc), pick(nc), best(nc);
+  std::iota(uf.begin(), uf.end(), 0);
+  std::iota(label.begin(), label.end(), 0);
+  while ( true ) {
+#pragma omp parallel for
+    for (size_t c = 0; c < nc; ++c) {
+      size_t p_best = -1;
+      for (size_t p = ptr[c]; p < ptr[c+1]; ++p) {
+        if ( label[adj[p]] != label[c] && (p_best == -1 || lighter(fac[p], fac[p_best])) )
+          p_best = p;
+      }
+      pick[c] = p_best;
+    }
+    std::fill(best.begin(), best.end(), -1);
+    for (size_t c = 0; c < nc; ++c) {
+      const size_t l = label[c];
+      if ( pick[c] != -1 && (best[l] == -1 || lighter(fac[pick[c]], fac[best[l]])) )
+        best[l] = pick[c];
+    }
+    bool merged = false;
+    for (size_t c = 0; c < nc; ++c) {
+      if ( best[c] == -1 )
+        continue;
+      // cell of the picked slot, recovered from the CSR offset
+      const size_t p = best[c];
+      const size_t from = std::upper_bound(ptr.begin(), ptr.end(), p)-ptr.begin()-1, to = adj[p];
+      const size_t r0 = find_root(uf, from), r1 = find_root(uf, to);
+      if ( r0 == r1 )
+        continue;
+      uf[r0] = r1;
+      push_tree_edge(mst, from, to);
+      push_tree_edge(mst, to, from);
+      merged = true;
+    }
+    if ( !merged )
+      break;
+    for (size_t c = 0; c < nc; ++c)
+      label[c] = find_root(uf, c);
+  }
+  return EXIT_SUCCESS;
+}
+
+size_t get_farest_node(const mesh_topology &topo, const size_t source) {
+  const vector<size_t> &ptr = topo.cc_ptr(), &adj = topo.cc_adj();
+  vector<size_t> dist(topo.cell_num(), -1), queue;
+  queue.reserve(topo.cell_num());
+  queue.push_back(source);
+  dist[source] = 0;
+  for (size_t head = 0; head < queue.size(); ++head) {
+    const size_t c = queue[head];
+    for (size_t p = ptr[c]; p < ptr[c+1]; ++p) {
+      if ( dist[adj[p]] == -1 ) {
+        dist[adj[p]] = dist[c]+1;
+        queue.push_back(adj[p]);
+      }
+    }
+  }
+  cout << "[Info] max dist from root: " << dist[queue.back()] << endl;
+  return queue.back();
+}
+
+int get_preorder(const mesh_topology &topo, const graph_t &tree, const size_t root, tree_order_t &order) {
+  const size_t nc = tree.first.size();
+  order.face.clear();
+  order.parent.clear();
+  order.face.reserve(nc);
+  order.parent.reserve(nc);
+  vector<char> vis(nc, 0);
+  vector<pair<size_t, size_t>> stack(1, make_pair(root, (size_t)-1));
+  while ( !stack.empty() ) {
+    const size_t c = stack.back().first, pa = stack.back().second;
+    stack.pop_back();
+    if ( vis[c] ) {
+      cerr << "[Error] not a tree\n";
+      return __LINE__;
+    }
+    vis[c] = 1;
+    order.face.push_back(c);
+    order.parent.push_back(pa);
+    for (size_t e = tree.first[c]; e != -1; e = tree.next[e]) {
+      if ( !vis[tree.v[e]] )
+        stack.push_back(make_pair(tree.v[e], c));
+    }
+  }
+  if ( order.face.size() != nc ) {
+    cerr << "[Error] the tree does not span the mesh\n";
+    return __LINE__;
+  }
+  order.edge.resize(nc);
+  order.edge[0] = -1;
+#pragma omp parallel for
+  for (size_t k = 1; k < nc; ++k)
+    order.edge[k] = topo.find_facet(order.parent[k], order.face[k]);
+  return 0;
+}
+
 }
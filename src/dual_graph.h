@@ -6,6 +6,8 @@
 
 namespace riemann {
 
+class mesh_topology;
+
 using jtf::mesh::edge2cell_adjacent;
 using boost::adjacency_list;
 using boost::vecS;
@@ -33,5 +35,22 @@ int get_minimum_spanning_tree(const std::shared_ptr<const Graph> &g, graph_t &ms
 int draw_minimum_spanning_tree(const char *file, const mati_t &tris, const matd_t &nods, const graph_t &mst);
 size_t get_farest_node(const std::shared_ptr<const Graph> &g, const size_t source);
 
+/// The overloads below work on the cell-cell CSR of a mesh_topology,
+/// the dual graph without boost. weight holds one value per facet, unit
+/// weights if null; ties are broken by facet id so the tree is unique.
+int get_minimum_spanning_tree(const mesh_topology &topo, graph_t &mst,
+                              const std::vector<double> *weight=nullptr);
+/// BFS, a cell with the largest hop distance from source
+size_t get_farest_node(const mesh_topology &topo, const size_t source);
+
+/// @brief cells of a spanning tree in pre-order: face[0] is the root and
+/// every later face[k] hangs off parent[k] (visited before) through the
+/// shared facet edge[k]. Walking it linearly replaces a traversal with
+/// visited sets.
+struct tree_order_t {
+  std::vector<size_t> face, parent, edge;
+};
+int get_preorder(const mesh_topology &topo, const graph_t &tree, const size_t root, tree_order_t &order);
+
 }
 #endif
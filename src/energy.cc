@@ -1,13 +1,11 @@
 #include "energy.h"
 
-#include <jtflib/mesh/mesh.h>
-
 #include "config.h"
 #include "cotmatrix.h"
+#include "mesh_topology.h"
 
 using namespace std;
 using namespace Eigen;
-using namespace jtf::mesh;
 
 namespace riemann {
 //==============================================================================
@@ -41,10 +39,13 @@ int dirichlet_energy::Hes(const double *x, vector<Triplet<double>> *hes) const {
   return 0;
 }
 //==============================================================================
-param_area::param_area(const mati_t &tris, const matd_t &nods, const double w)
+param_area::param_area(const mati_t &tris, const matd_t &nods, const double w,
+                       shared_ptr<const mesh_topology> topo)
   : dim_(2*nods.size(2)), w_(w) {
+  if ( topo.get() == nullptr )
+    topo = mesh_topology::create(tris);
   mati_t bnd_edge;
-  int no_boundary = GetBoundaryEdge(tris, bnd_edge);
+  int no_boundary = GetBoundaryEdge(*topo, bnd_edge);
   ASSERT(no_boundary == 0);   // check for disk like topology
   vector<Triplet<double>> trips;
   for (size_t i = 0; i < bnd_edge.size(2); ++i) {
@@ -84,15 +85,14 @@ int param_area::Hes(const double *x, vector<Triplet<double>> *hes) const {
   return 0;
 }
 
-int param_area::GetBoundaryEdge(const mati_t &tris, mati_t &bnd_edge) {
+int param_area::GetBoundaryEdge(const mesh_topology &topo, mati_t &bnd_edge) {
   vector<size_t> edge_buffer;
-  shared_ptr<edge2cell_adjacent> e2c(edge2cell_adjacent::create(tris, false));
+  const mati_t &tris = topo.cells();
   for (size_t i = 0; i < tris.size(2); ++i) {
     for (size_t j = 0; j < 3; ++j) {
       size_t pi = tris(j, i);
       size_t qi = tris((j+1)%3, i);
-      pair<size_t, size_t> fa = e2c->query(pi, qi);
-      if ( e2c->is_boundary_edge(fa) ) {
+      if ( topo.is_boundary_facet(topo.cell_edges()(j, i)) ) {
         edge_buffer.push_back(pi);
         edge_buffer.push_back(qi);
       }
@@ -1,6 +1,7 @@
 #include "frame_field_deform.h"
 
 #include <iostream>
+#include <limits>
 #include <fstream>
 #include <jtflib/mesh/io.h>
 #include <jtflib/mesh/util.h>
@@ -13,6 +14,8 @@
 #include "util.h"
 #include "vtk.h"
 #include "cotmatrix.h"
+#include "batch_svd.h"
+#include "anderson.h"
 
 using namespace std;
 using namespace Eigen;
@@ -140,16 +143,9 @@ public:
       curr_pts.col(1) = X.col(tris_(2, i))-X.col(tris_(1, i));
       curr_pts.col(2) = X.col(tris_(0, i))-X.col(tris_(2, i));
 
-      Matrix3d S = curr_pts*wgt.asDiagonal()*rest_pts.transpose();
-      JacobiSVD<Matrix3d> svd(S, ComputeFullU|ComputeFullV);
-      Matrix3d su = svd.matrixU();
-      Matrix3d sv = svd.matrixV();
-      Q_[i] = su*sv.transpose();
-      if ( Q_[i].determinant() < 0 ) {
-        su.col(2) = -su.col(2);
-        Q_[i] = su*sv.transpose();
-      }
+      Q_[i] = curr_pts*wgt.asDiagonal()*rest_pts.transpose();
     }
+    batch_rotation3x3(Q_[0].data(), Q_.size(), Q_[0].data());
     return 0;
   }
   int EvaluateOptimalRotationOther(const double *x) {
@@ -174,14 +170,9 @@ public:
 
       Matrix3d XX = rest_pts-rest_cent*Vector3d::Ones().transpose();
       Matrix3d YY = curr_pts-curr_cent*Vector3d::Ones().transpose();
-      Matrix3d SS = XX*wgt.asDiagonal()*YY.transpose();
-      JacobiSVD<Matrix3d> svd(SS, ComputeFullU|ComputeFullV);
-      Matrix3d su = svd.matrixU();
-      Matrix3d sv = svd.matrixV();
-      Matrix3d I = Matrix3d::Identity();
-      I(2, 2) = (sv*su.transpose()).determinant();
-      Q_[i] = sv*I*su.transpose();
+      Q_[i] = YY*wgt.asDiagonal()*XX.transpose();
     }
+    batch_rotation3x3(Q_[0].data(), Q_.size(), Q_[0].data());
     return 0;
   }
 private:
@@ -239,13 +230,15 @@ frame_field_deform::frame_field_deform()
   : max_iter_(20000),
     tolerance_(1e-12),
     lambda_(0.1),
-    perturb_(0.1) {}
+    perturb_(0.1),
+    aa_window_(5) {}
 
 frame_field_deform::frame_field_deform(const boost::property_tree::ptree &pt) {
   max_iter_  =  pt.get<size_t>("max_iter");
   tolerance_ =  pt.get<double>("tolerance");
   lambda_    =  pt.get<double>("lambda");
   perturb_   =  pt.get<double>("perturb");
+  aa_window_ =  pt.get<size_t>("anderson_window", 5);
 }
 
 int frame_field_deform::load_mesh(const char *file) {
@@ -551,12 +544,28 @@ int frame_field_deform::deform() {
       _nods_(i, j) += (double(rand())/double(RAND_MAX))*10e-4*perturb_;
 
   Map<VectorXd> X(&_nods_[0], _nods_.size());
-  for (size_t iter = 0; iter < max_iter_; ++iter) {
+  VectorXd gx = X;
+  shared_ptr<deform_energy> de = std::dynamic_pointer_cast<deform_energy>(buff_[DEFORM]);
+  anderson_acceleration aa;
+  aa.init(aa_window_, X);
+  double prev_val = numeric_limits<double>::max();
+  size_t iter = 0, nbr_reject = 0;
+  for ( ; iter < max_iter_; ++iter) {
     // query energy value
+    double val = 0;
+    if ( aa_window_ > 0 || iter % 100 == 0 )
+      e_->Val(&X[0], &val);
+    // reject the extrapolated iterate if it increased the energy
+    if ( aa_window_ > 0 && iter > 0 && val > prev_val ) {
+      X = gx;
+      aa.replace(X);
+      de->EvaluateOptimalRotation(&X[0]);
+      e_->Val(&X[0], &val);
+      ++nbr_reject;
+    }
+    prev_val = val;
     if ( iter % 100 == 0 ) {
       cout << "[info] iteration " << iter << endl;
-      double val = 0;
-      e_->Val(&X[0], &val);
       cout << "[info] energy: " << val << "\n";
     }
 
@@ -571,16 +580,20 @@ int frame_field_deform::deform() {
     ASSERT(sol_.info() == Success);
 
     double x0norm = X.norm();
-    X += dx;
-    std::dynamic_pointer_cast<deform_energy>(buff_[DEFORM])
-        ->EvaluateOptimalRotation(&X[0]);
+    gx = X+dx;
 
     // convergence test
     if ( dx.norm() <= tolerance_*x0norm ) {
+      X = gx;
+      de->EvaluateOptimalRotation(&X[0]);
       cout << "[info] converged!\n";
       break;
     }
+    X = aa.compute(gx);
+    de->EvaluateOptimalRotation(&X[0]);
   }
+  cout << "[info] anderson window " << aa_window_ << ": " << iter
+       << " iterations, " << nbr_reject << " rejected steps\n";
   return 0;
 }
 
@@ -65,6 +65,7 @@ private:
   double tolerance_;
   double lambda_;
   double perturb_;
+  size_t aa_window_;
 
   Eigen::MatrixXd D_;
 };
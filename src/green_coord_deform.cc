@@ -4,7 +4,11 @@
 #include <jtflib/mesh/io.h>
 #include <jtflib/mesh/util.h>
 #include <zjucad/matrix/io.h>
-#include <boost/math/special_functions/sign.hpp>
+#include <numeric>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <Eigen/Dense>
 
 #include "config.h"
 #include "vtk.h"
@@ -12,7 +16,6 @@
 using namespace std;
 using namespace zjucad::matrix;
 using namespace Eigen;
-using boost::math::sign;
 
 namespace riemann {
 
@@ -86,41 +89,39 @@ int green_deform_2d::calc_outward_normal() {
   return 0;
 }
 
+/**
+ * every sample point owns one column of coord_, so points are processed
+ * in parallel without synchronization. Rows are the cage vertices (phi)
+ * followed by the cage edges (psi).
+ */
 int green_deform_2d::calc_green_coords() {
-  phi_ = MatrixXd::Zero(cage_nods_.cols(), nods_.cols());
-  psi_ = MatrixXd::Zero(cage_normal_.cols(), nods_.cols());
+  const size_t nv = cage_nods_.cols(), ne = cage_cell_.cols();
+  // per edge quantities independent of the sample point
+  Matrix2Xd a(2, ne), an(2, ne);
+  VectorXd Q(ne), alen(ne);
+#pragma omp parallel for
+  for (size_t i = 0; i < ne; ++i) {
+    a.col(i) = cage_nods_.col(cage_cell_(1, i))-cage_nods_.col(cage_cell_(0, i));
+    Q[i] = a.col(i).squaredNorm();
+    alen[i] = std::sqrt(Q[i]);
+    an.col(i) = alen[i]*cage_normal_.col(i);
+  }
+  coord_ = MatrixXd::Zero(nv+ne, nods_.cols());
 #pragma omp parallel for
   for (size_t pid = 0; pid < nods_.cols(); ++pid) {
-    for (size_t i = 0; i < cage_cell_.cols(); ++i) {
-      Vector2d a = cage_nods_.col(cage_cell_(1, i))-cage_nods_.col(cage_cell_(0, i));
-      Vector2d b = cage_nods_.col(cage_cell_(0, i))-nods_.col(pid);
-      double Q, S, R, BA, SRT, L0, L1, A0, A1, A10, L10, psi_entry, phi_entry1, phi_entry0;
-      Q = a.dot(a);
-      S = b.dot(b);
-      R = 2*a.dot(b);
-      BA = b.dot(a.norm()*cage_normal_.col(i));
-      SRT = sqrt(4*S*Q-R*R);
-      L0 = log(S);
-      L1 = log(S+Q+R);
-      A0 = atan2(R, SRT)/SRT;
-      A1 = atan2(2*Q+R, SRT)/SRT;
-      A10 = A1 - A0;
-      L10 = L1 - L0;
-      psi_entry = -a.norm()/(4*M_PI)*((4*S-R*R/Q)*A10 + R/(2*Q)*L10 + L1 - 2);
-      phi_entry1 = -BA/(2*M_PI)*(L10/(2*Q) - A10*R/Q);
-      phi_entry0 = +BA/(2*M_PI)*(L10/(2*Q) - A10*(2+R/Q));
-#pragma omp critical
-      {
-        psi_(i, pid) += psi_entry;
-        phi_(cage_cell_(1, i), pid) += phi_entry1;
-        phi_(cage_cell_(0, i), pid) += phi_entry0;
-      }
+    double *phi = coord_.col(pid).data(), *psi = phi+nv;
+    for (size_t i = 0; i < ne; ++i) {
+      const Vector2d b = cage_nods_.col(cage_cell_(0, i))-nods_.col(pid);
+      const double S = b.dot(b), R = 2*a.col(i).dot(b), BA = b.dot(an.col(i));
+      const double SRT = sqrt(4*S*Q[i]-R*R);
+      const double L0 = log(S), L1 = log(S+Q[i]+R);
+      const double A10 = (atan2(2*Q[i]+R, SRT)-atan2(R, SRT))/SRT, L10 = L1-L0;
+      psi[i] += -alen[i]/(4*M_PI)*((4*S-R*R/Q[i])*A10 + R/(2*Q[i])*L10 + L1 - 2);
+      phi[cage_cell_(1, i)] += -BA/(2*M_PI)*(L10/(2*Q[i]) - A10*R/Q[i]);
+      phi[cage_cell_(0, i)] += +BA/(2*M_PI)*(L10/(2*Q[i]) - A10*(2+R/Q[i]));
     }
-  }
-  ///> =_=#
-  for (size_t j = 0; j < phi_.cols(); ++j) {
-    double sum = phi_.col(j).sum();
-    phi_.col(j) /= sum;
+    ///> =_=#
+    coord_.col(pid).head(nv) /= coord_.col(pid).head(nv).sum();
   }
   return 0;
 }
@@ -139,7 +140,10 @@ int green_deform_2d::deform() {
   calc_cage_edge_length(curr_len_);
   VectorXd ratio = curr_len_.cwiseQuotient(rest_len_);
   ASSERT(cage_normal_.cols() == ratio.rows());
-  nods_ = cage_nods_*phi_ + (cage_normal_*ratio.asDiagonal())*psi_;
+  // one matrix-matrix product over all points
+  MatrixXd cage(2, coord_.rows());
+  cage << cage_nods_, cage_normal_*ratio.asDiagonal();
+  nods_.noalias() = cage*coord_;
   return 0;
 }
 //==============================================================================
@@ -192,7 +196,12 @@ int green_deform_2d::dump_normal(const char *file) {
   return 0;
 }
 //==============================================================================
-green_deform_3d::green_deform_3d() {}
+green_deform_3d::green_deform_3d()
+  : tile_block_(4096), tile_single_(false), tile_map_(nullptr), tile_len_(0) {}
+
+green_deform_3d::~green_deform_3d() {
+  unmap_tiles();
+}
 
 int green_deform_3d::load_sample_points(const char *file) {
   if ( jtf::mesh::load_obj(file, cell_, nods_) )
@@ -282,61 +291,180 @@ int green_deform_3d::dump_normal(const char *file) {
   return 0;
 }
 //==============================================================================
-double green_deform_3d::GCTriInt(const matd_t &p, const matd_t &v1,
-                                 const matd_t &v2, const matd_t &eta) {
-  double alpha = acos(std::min(1.0, std::max(-1.0, dot(v2-v1, p-v1)/norm(v2-v1)/norm(p-v1))));
-  double beta = acos(std::min(1.0, std::max(-1.0, dot(v1-p, v2-p)/norm(v1-p)/norm(v2-p))));
-  double lambda = dot(p-v1, p-v1)*sin(alpha)*sin(alpha);
-  double c = dot(p-eta, p-eta);
-
-  double theta[2] = {M_PI-alpha, M_PI-alpha-beta};
-  double I[2];
-  double sqrt_c = sqrt(c);
-  double sqrt_lambda = sqrt(lambda);
-  for (int i = 0; i < 2; ++i) {
-    double S = sin(theta[i]);
-    double C = cos(theta[i]);
-    I[i] = -sign(S)/2.0*(2.0*sqrt_c*atan2(sqrt_c*C, sqrt(lambda+S*S*c))
-                         + sqrt_lambda*log(2.0*sqrt_lambda*S*S/((1-C)*(1-C))
-                                           *(1.0-2*c*C/(c+c*C+lambda+sqrt(lambda*lambda+lambda*c*S*S)))));
+static const size_t GC_LANES = 6;
+
+static inline double sgn(const double x) {
+  return (x > 0)-(x < 0);
+}
+
+/**
+ * GCTriInt with eta at the origin for GC_LANES triples (p, v1, v2)
+ * stored as 3 x GC_LANES rows. The angles only enter through their
+ * sines and cosines, which follow from the dot products, so the lanes
+ * need one acos instead of six trigonometric calls.
+ */
+static void gc_tri_int(const double *p, const double *v1, const double *v2, double *res) {
+#pragma omp simd
+  for (size_t l = 0; l < GC_LANES; ++l) {
+    const double px = p[l], py = p[GC_LANES+l], pz = p[2*GC_LANES+l];
+    const double ax = v1[l]-px, ay = v1[GC_LANES+l]-py, az = v1[2*GC_LANES+l]-pz;
+    const double bx = v2[l]-px, by = v2[GC_LANES+l]-py, bz = v2[2*GC_LANES+l]-pz;
+    const double ex = bx-ax, ey = by-ay, ez = bz-az;
+    const double aa = ax*ax+ay*ay+az*az, bb = bx*bx+by*by+bz*bz, ee = ex*ex+ey*ey+ez*ez;
+    // alpha at v1 between v2-v1 and p-v1, beta at p between v1-p and v2-p
+    const double ca = std::min(1.0, std::max(-1.0, -(ex*ax+ey*ay+ez*az)/sqrt(ee*aa)));
+    const double cb = std::min(1.0, std::max(-1.0, (ax*bx+ay*by+az*bz)/sqrt(aa*bb)));
+    const double sa = sqrt(1-ca*ca), sb = sqrt(1-cb*cb), beta = acos(cb);
+    const double lambda = aa*sa*sa, c = px*px+py*py+pz*pz;
+    const double sqrt_c = sqrt(c), sqrt_lambda = sqrt(lambda);
+    // theta_0 = pi-alpha, theta_1 = pi-alpha-beta
+    const double S[2] = {sa, sa*cb+ca*sb}, C[2] = {-ca, sa*sb-ca*cb};
+    double I[2];
+    for (int i = 0; i < 2; ++i) {
+      I[i] = -sgn(S[i])/2.0*(2.0*sqrt_c*atan2(sqrt_c*C[i], sqrt(lambda+S[i]*S[i]*c))
+                             + sqrt_lambda*log(2.0*sqrt_lambda*S[i]*S[i]/((1-C[i])*(1-C[i]))
+                                               *(1.0-2*c*C[i]/(c+c*C[i]+lambda+sqrt(lambda*lambda+lambda*c*S[i]*S[i])))));
+    }
+    res[l] = -1.0/(4*M_PI)*fabs(I[0]-I[1]-sqrt_c*beta);
   }
-  return -1.0/(4*M_PI)*fabs(I[0]-I[1]-sqrt_c*beta);
 }
 
-int green_deform_3d::calc_green_coords() {
-  matd_t zero3d = zeros<double>(3, 1);
-  phi_ = zeros<double>(cage_nods_.size(2), nods_.size(2));
-  psi_ = zeros<double>(cage_normal_.size(2), nods_.size(2));
-  for (size_t pid = 0; pid < nods_.size(2); ++pid) {
-    for (size_t i = 0; i < cage_cell_.size(2); ++i) {
-      matd_t VJ = cage_nods_(colon(), cage_cell_(colon(), i))-nods_(colon(), pid)*ones<double>(1, 3);
-      matd_t p = dot(VJ(colon(), 0), cage_normal_(colon(), i))*cage_normal_(colon(), i);
-      matd_t s(3, 1), I(3, 1), II(3, 1), N(3, 3);
-      for (size_t j = 0; j < 3; ++j) {
-        s[j] = sign(dot(cross(VJ(colon(), j)-p, VJ(colon(), (j+1)%3)-p), cage_normal_(colon(), i)));
-        I[j] = GCTriInt(p, VJ(colon(), j), VJ(colon(), (j+1)%3), zero3d);
-        II[j] = GCTriInt(zero3d, VJ(colon(), (j+1)%3), VJ(colon(), j), zero3d);
-        matd_t q = cross(VJ(colon(), (j+1)%3), VJ(colon(), j));
-        N(colon(), j) = q/norm(q);
-      }
-      double I_ = -fabs(dot(s, I));
-      psi_(i, pid) += -I_;
-      matd_t w = I_*cage_normal_(colon(), i) + N * II;
-      if ( norm(w) > 1e-8 ) {
-        for (size_t j = 0; j < 3; ++j)
-          phi_(cage_cell_(j, i), pid) += dot(N(colon(), (j+1)%3), w)/dot(N(colon(), (j+1)%3), VJ(colon(), j));
+/// col receives phi of the cage vertices followed by psi of the cage faces
+void green_deform_3d::calc_point_coords(const size_t pid, double *col) const {
+  const size_t nv = cage_nods_.size(2), nf = cage_cell_.size(2);
+  Map<const Matrix3Xd> V(&cage_nods_[0], 3, nv), normal(&cage_normal_[0], 3, nf);
+  const Vector3d x(&nods_(0, pid));
+  double *phi = col, *psi = col+nv;
+  std::fill(col, col+nv+nf, 0.0);
+  // lanes 0-2: (p, v_j, v_j+1), lanes 3-5: (0, v_j+1, v_j)
+  double P[3*GC_LANES] = {0}, V1[3*GC_LANES], V2[3*GC_LANES], I[GC_LANES];
+  for (size_t i = 0; i < nf; ++i) {
+    const Vector3d n = normal.col(i);
+    Vector3d VJ[3];
+    for (size_t j = 0; j < 3; ++j)
+      VJ[j] = V.col(cage_cell_(j, i))-x;
+    const Vector3d p = VJ[0].dot(n)*n;
+    double s[3];
+    Vector3d N[3];
+    for (size_t j = 0; j < 3; ++j) {
+      const Vector3d &v0 = VJ[j], &v1 = VJ[(j+1)%3];
+      s[j] = sgn((v0-p).cross(v1-p).dot(n));
+      N[j] = v1.cross(v0).normalized();
+      for (size_t d = 0; d < 3; ++d) {
+        P[d*GC_LANES+j] = p[d];
+        V1[d*GC_LANES+j] = v0[d];
+        V2[d*GC_LANES+j] = v1[d];
+        V1[d*GC_LANES+3+j] = v1[d];
+        V2[d*GC_LANES+3+j] = v0[d];
       }
     }
+    gc_tri_int(P, V1, V2, I);
+    const double I_ = -fabs(s[0]*I[0]+s[1]*I[1]+s[2]*I[2]);
+    psi[i] += -I_;
+    const Vector3d w = I_*n+N[0]*I[3]+N[1]*I[4]+N[2]*I[5];
+    if ( w.norm() > 1e-8 ) {
+      for (size_t j = 0; j < 3; ++j)
+        phi[cage_cell_(j, i)] += N[(j+1)%3].dot(w)/N[(j+1)%3].dot(VJ[j]);
+    }
   }
   ///> for translation invariance
+  const double sum = std::accumulate(phi, phi+nv, 0.0);
+  for (size_t j = 0; j < nv; ++j)
+    phi[j] /= sum;
+}
+
+/**
+ * every sample point owns one column of the coordinates, so points are
+ * processed in parallel without synchronization. In tiled mode a block
+ * is computed in memory and then copied into the mapped file.
+ */
+int green_deform_3d::calc_green_coords() {
+  const size_t nc = cage_nods_.size(2)+cage_cell_.size(2), np = nods_.size(2);
+  if ( tile_file_.empty() ) {
+    coord_.resize(nc, np);
 #pragma omp parallel for
-  for (size_t j = 0; j < phi_.size(2); ++j) {
-    double col_sum = sum(phi_(colon(), j));
-    phi_(colon(), j) /= col_sum;
+    for (size_t pid = 0; pid < np; ++pid)
+      calc_point_coords(pid, coord_.col(pid).data());
+    return 0;
   }
+
+  coord_.resize(0, 0);
+  if ( map_tiles(true) )
+    return __LINE__;
+  MatrixXd buf(nc, tile_block_);
+  for (size_t beg = 0; beg < np; beg += tile_block_) {
+    const size_t len = std::min(tile_block_, np-beg);
+#pragma omp parallel for
+    for (size_t j = 0; j < len; ++j)
+      calc_point_coords(beg+j, buf.col(j).data());
+    char *dst = tile_map_+tile_elem()*nc*beg;
+    if ( tile_single_ )
+      Map<MatrixXf>((float *)dst, nc, len) = buf.leftCols(len).cast<float>();
+    else
+      Map<MatrixXd>((double *)dst, nc, len) = buf.leftCols(len);
+    // hand the written block to the page cache
+    release_pages(dst, dst+tile_elem()*nc*len, true);
+  }
+  cout << "[info] green coordinates stored in " << tile_file_ << ", "
+       << tile_elem()*nc*np/(1024.0*1024.0) << " MB\n";
   return 0;
 }
 
+int green_deform_3d::set_tiled(const char *file, const size_t block, const bool single) {
+  unmap_tiles();
+  if ( file == nullptr ) {
+    tile_file_.clear();
+    return 0;
+  }
+  if ( block == 0 )
+    return __LINE__;
+  tile_file_ = file;
+  tile_block_ = block;
+  tile_single_ = single;
+  return 0;
+}
+
+int green_deform_3d::map_tiles(const bool create) {
+  unmap_tiles();
+  const size_t nc = cage_nods_.size(2)+cage_cell_.size(2);
+  tile_len_ = tile_elem()*nc*nods_.size(2);
+  int fd = create ? ::open(tile_file_.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644) : ::open(tile_file_.c_str(), O_RDONLY);
+  if ( fd < 0 ) {
+    cerr << "[Error] can not open " << tile_file_ << endl;
+    return __LINE__;
+  }
+  if ( create && ftruncate(fd, tile_len_) != 0 ) {
+    ::close(fd);
+    return __LINE__;
+  }
+  void *addr = mmap(nullptr, tile_len_, create ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if ( addr == MAP_FAILED ) {
+    cerr << "[Error] can not map " << tile_file_ << endl;
+    return __LINE__;
+  }
+  tile_map_ = static_cast<char *>(addr);
+  madvise(tile_map_, tile_len_, MADV_SEQUENTIAL);
+  return 0;
+}
+
+void green_deform_3d::unmap_tiles() {
+  if ( tile_map_ )
+    munmap(tile_map_, tile_len_);
+  tile_map_ = nullptr;
+  tile_len_ = 0;
+}
+
+/// drops the pages of [beg, end) from the resident set, written ones are
+/// flushed first; the range is widened to page boundaries
+void green_deform_3d::release_pages(char *beg, char *end, const bool dirty) const {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  char *first = tile_map_+(beg-tile_map_)/page*page;
+  if ( dirty )
+    msync(first, end-first, MS_ASYNC);
+  madvise(first, end-first, MADV_DONTNEED);
+}
+
 int green_deform_3d::move_cage(const size_t id, const double *dx, bool disp) {
   itr_matrix<const double *> X(3, 1, dx);
   if ( disp )
@@ -351,10 +479,31 @@ int green_deform_3d::deform() {
   matd_t s;
   calc_stretch_ratio(s);
   ASSERT(s.size() == cage_normal_.size(2));
-  matd_t stretch_psi = psi_;
-  for (size_t row = 0; row < stretch_psi.size(1); ++row)
-    stretch_psi(row, colon()) *= s[row];
-  nods_ = cage_nods_*phi_ + cage_normal_*stretch_psi;
+  // one matrix-matrix product over all points, or per tile
+  const size_t nc = cage_nods_.size(2)+cage_cell_.size(2), np = nods_.size(2);
+  MatrixXd cage(3, nc);
+  cage << Map<const Matrix3Xd>(&cage_nods_[0], 3, cage_nods_.size(2)),
+      Map<const Matrix3Xd>(&cage_normal_[0], 3, cage_normal_.size(2))*Map<const VectorXd>(&s[0], s.size()).asDiagonal();
+  Map<Matrix3Xd> X(&nods_[0], 3, np);
+  if ( tile_file_.empty() ) {
+    X.noalias() = cage*coord_;
+    return 0;
+  }
+
+  if ( tile_map_ == nullptr && map_tiles(false) )
+    return __LINE__;
+  MatrixXd buf;
+  for (size_t beg = 0; beg < np; beg += tile_block_) {
+    const size_t len = std::min(tile_block_, np-beg);
+    char *src = tile_map_+tile_elem()*nc*beg;
+    if ( tile_single_ ) {
+      buf = Map<const MatrixXf>((const float *)src, nc, len).cast<double>();
+      X.middleCols(beg, len).noalias() = cage*buf;
+    } else {
+      X.middleCols(beg, len).noalias() = cage*Map<const MatrixXd>((const double *)src, nc, len);
+    }
+    release_pages(src, src+tile_elem()*nc*len, false);
+  }
   return 0;
 }
 
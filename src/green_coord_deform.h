@@ -1,6 +1,8 @@
 #ifndef GREEN_COORD_DEFORM_H
 #define GREEN_COORD_DEFORM_H
 
+#include <string>
+#include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include <zjucad/matrix/matrix.h>
 
@@ -46,8 +48,9 @@ private:
 
   Eigen::VectorXd rest_len_;
   Eigen::VectorXd curr_len_;
-  Eigen::MatrixXd phi_;
-  Eigen::MatrixXd psi_;
+  // green coordinates, one column per sample point: phi of the cage
+  // vertices stacked over psi of the cage edges
+  Eigen::MatrixXd coord_;
 };
 
 class green_deform_3d : public green_deform
@@ -56,6 +59,12 @@ public:
   typedef zjucad::matrix::matrix<size_t> mati_t;
   typedef zjucad::matrix::matrix<double> matd_t;
   green_deform_3d();
+  ~green_deform_3d();
+  /// tiled mode: coordinates are computed for block points at a time
+  /// and kept in the memory mapped file instead of memory, as float32
+  /// if single; deform() then consumes them tile by tile. A null file
+  /// switches back to in-core storage. Call before calc_green_coords().
+  int set_tiled(const char *file, const size_t block=4096, const bool single=false);
   int load_sample_points(const char *file);
   int load_cage(const char *file);
   int calc_green_coords();
@@ -68,9 +77,15 @@ protected:
   int calc_outward_normal();
   int calc_stretch_ratio(matd_t &s);
   int calc_cage_edge(matd_t &uv);
-  double GCTriInt(const matd_t &p, const matd_t &v1,
-                  const matd_t &v2, const matd_t &eta);
+  void calc_point_coords(const size_t pid, double *col) const;
+  size_t tile_elem() const { return tile_single_ ? sizeof(float) : sizeof(double); }
+  int map_tiles(const bool create);
+  void unmap_tiles();
+  void release_pages(char *beg, char *end, const bool dirty) const;
 private:
+  green_deform_3d(const green_deform_3d &);
+  green_deform_3d &operator=(const green_deform_3d &);
+
   mati_t cell_;
   matd_t nods_;
 
@@ -81,8 +96,14 @@ private:
   matd_t cage_curr_uv_;
 
   matd_t rest_area_;
-  matd_t phi_;
-  matd_t psi_;
+  // phi of the cage vertices stacked over psi of the cage faces, one
+  // column per sample point; left empty in tiled mode
+  Eigen::MatrixXd coord_;
+  std::string tile_file_;
+  size_t tile_block_;
+  bool tile_single_;
+  char *tile_map_;
+  size_t tile_len_;
 };
 
 }
@@ -2,6 +2,11 @@
 
 #include <random>
 #include <chrono>
+#include <map>
+#include <unordered_set>
+#include <limits>
+#include <numeric>
+#include <algorithm>
 #include <Eigen/UmfPackSupport>
 
 #include "igl/boundary_loop.h"
@@ -54,47 +59,76 @@ void calc_infinitesimal_elem(boundary_loop &loop) {
   }
 }
 
+/// W_k = B_k*dl_k and c_k = p_k.W_k, so (p_i-p_k).W_k = p_i.W_k-c_k
+static void calc_weighted_binormal(const boundary_loop &loop, eigen_matd_t &W, VectorXd &c) {
+  const int bnd_size = loop.bnd.size();
+  W.resize(bnd_size, 3);
+  c.resize(bnd_size);
+  for (int k = 0; k < bnd_size; ++k) {
+    W.row(k) = loop.B.row(k)*loop.dl(k);
+    c[k] = loop.pos.row(k).dot(W.row(k));
+  }
+}
+
 void calc_bnd_indicator(boundary_loop &loop) {
   const int bnd_size = loop.bnd.size();
   loop.sf.setZero(bnd_size);
+  eigen_matd_t W;
+  VectorXd c;
+  calc_weighted_binormal(loop, W, c);
   if ( loop.method == 0 ) {
-    for (int i = 0; i < bnd_size; ++i) {
-      double integral = 0.0;
-      for (int k = 0; k < bnd_size; ++k) {
-        integral += (loop.pos.row(i)-loop.pos.row(k)).dot(loop.B.row(k))*loop.dl(k);
-      }
-      loop.sf(i) = -integral;
-    }
+    const RowVector3d Wsum = W.colwise().sum();
+    const double csum = c.sum();
+    for (int i = 0; i < bnd_size; ++i)
+      loop.sf(i) = -(loop.pos.row(i).dot(Wsum)-csum);
   } else if ( loop.method == 1 ) {
-    MatrixXd L = MatrixXd::Zero(bnd_size, bnd_size);
+    // min |Ls|^2 s.t. As = 0, s_0 = 1, where A_ij = (p_i-p_j).W_j is
+    // dense but A = [P 1][W -c]^T has rank at most 4, so As = 0 reduces
+    // to a few orthonormal constraint rows and the KKT system is sparse
+    MatrixXd U(bnd_size, 4), V(bnd_size, 4);
+    U << loop.pos, VectorXd::Ones(bnd_size);
+    V << W, -c;
+    JacobiSVD<MatrixXd> svd_u(U, ComputeThinV);
+    svd_u.setThreshold(1e-12);
+    const MatrixXd KT = V*svd_u.matrixV().leftCols(svd_u.rank());
+    JacobiSVD<MatrixXd> svd_k(KT, ComputeThinU);
+    svd_k.setThreshold(1e-12);
+    const int nc = svd_k.rank();
+    const MatrixXd CT = svd_k.matrixU().leftCols(nc);
+
+    vector<Triplet<double>> trips;
     for (int i = 0; i < bnd_size; ++i) {
-      L(i, i) = 2.0;
-      L(i, (i+1)%bnd_size) = -1.0;
-      L(i, (i-1+bnd_size)%bnd_size) = -1.0;
+      trips.push_back(Triplet<double>(i, i, 2.0));
+      trips.push_back(Triplet<double>(i, (i+1)%bnd_size, -1.0));
+      trips.push_back(Triplet<double>(i, (i-1+bnd_size)%bnd_size, -1.0));
     }
-    MatrixXd LtL = L.transpose()*L;
-    MatrixXd A = MatrixXd::Zero(bnd_size, bnd_size);
-    for (int i = 0; i < bnd_size; ++i) {
-      for (int j = 0; j < bnd_size; ++j) {
-        A(i, j) = (loop.pos.row(i)-loop.pos.row(j)).dot(loop.B.row(j))*loop.dl(j);
+    SparseMatrix<double> L(bnd_size, bnd_size);
+    L.setFromTriplets(trips.begin(), trips.end());
+    const SparseMatrix<double> LtL = L.transpose()*L;
+
+    const int lhs_size = bnd_size+nc+1;
+    trips.clear();
+    for (int j = 0; j < LtL.outerSize(); ++j)
+      for (SparseMatrix<double>::InnerIterator it(LtL, j); it; ++it)
+        trips.push_back(Triplet<double>(it.row(), it.col(), it.value()));
+    for (int j = 0; j < nc; ++j) {
+      for (int i = 0; i < bnd_size; ++i) {
+        trips.push_back(Triplet<double>(i, bnd_size+j, CT(i, j)));
+        trips.push_back(Triplet<double>(bnd_size+j, i, CT(i, j)));
       }
     }
+    trips.push_back(Triplet<double>(lhs_size-1, 0, 1.0));
+    trips.push_back(Triplet<double>(0, lhs_size-1, 1.0));
+    SparseMatrix<double> LHS(lhs_size, lhs_size);
+    LHS.setFromTriplets(trips.begin(), trips.end());
 
-    const int lhs_size = bnd_size+bnd_size+1;
-    MatrixXd LHS = MatrixXd::Zero(lhs_size, lhs_size);
-    LHS.block(0, 0, bnd_size, bnd_size) = LtL;
-    LHS.block(bnd_size, 0, bnd_size, bnd_size) = A;
-    LHS(bnd_size+bnd_size, 0) = 1.0;
-    LHS.block(0, bnd_size, bnd_size, bnd_size) = A.transpose();
-    LHS(0, bnd_size+bnd_size) = 1.0;
-    ASSERT((LHS.transpose()-LHS).norm() < 1e-16);
-
-    VectorXd rhs = VectorXd::Zero(bnd_size+bnd_size+1);
+    VectorXd rhs = VectorXd::Zero(lhs_size);
     rhs(rhs.size()-1) = 1.0;
 
-    FullPivLU<MatrixXd> solver;
+    UmfPackLU<SparseMatrix<double>> solver;
     solver.compute(LHS);
-    cout << "size: " << LHS.rows() << " rank: " << solver.rank() << endl;
+    cout << "size: " << LHS.rows() << " constraints: " << nc << endl;
+    ASSERT(solver.info() == Success);
     VectorXd x = solver.solve(rhs);
     std::copy(x.data(), x.data()+bnd_size, loop.sf.data());
   } else if ( loop.method == 2 ) {
@@ -105,12 +139,162 @@ void calc_bnd_indicator(boundary_loop &loop) {
   }
 }
 
+//==============================================================================
+far_field_octree::far_field_octree(const eigen_matd_t &pos, const eigen_matd_t &w, const int leaf_size)
+    : nw_(w.cols()), pos_(pos), w_(w) {
+  ASSERT(pos.rows() == w.rows() && pos.cols() == 3);
+  order_.resize(pos.rows());
+  std::iota(order_.begin(), order_.end(), 0);
+  if ( pos.rows() > 0 )
+    build(0, pos.rows(), std::max(leaf_size, 1), 0);
+
+  moment_.setZero(cell_.size(), 10*nw_);
+#pragma omp parallel for
+  for (size_t i = 0; i < cell_.size(); ++i) {
+    for (int j = cell_[i].beg; j < cell_[i].end; ++j) {
+      const int p = order_[j];
+      const Vector3d d = pos_.row(p).transpose()-cell_[i].c;
+      const double dd[6] = {d[0]*d[0], d[1]*d[1], d[2]*d[2], d[0]*d[1], d[0]*d[2], d[1]*d[2]};
+      for (int k = 0; k < nw_; ++k) {
+        double *M = &moment_(i, 10*k);
+        M[0] += w_(p, k);
+        for (int q = 0; q < 3; ++q)
+          M[1+q] += w_(p, k)*d[q];
+        for (int q = 0; q < 6; ++q)
+          M[4+q] += w_(p, k)*dd[q];
+      }
+    }
+  }
+}
+
+int far_field_octree::build(const int beg, const int end, const int leaf_size, const int depth) {
+  const int id = cell_.size();
+  cell_.push_back(cell_t());
+  Vector3d lo = pos_.row(order_[beg]).transpose(), hi = lo;
+  for (int j = beg+1; j < end; ++j) {
+    lo = lo.cwiseMin(pos_.row(order_[j]).transpose());
+    hi = hi.cwiseMax(pos_.row(order_[j]).transpose());
+  }
+  const Vector3d c = 0.5*(lo+hi);
+  double r = 0;
+  for (int j = beg; j < end; ++j)
+    r = std::max(r, (pos_.row(order_[j]).transpose()-c).norm());
+  cell_[id].c = c;
+  cell_[id].r = r;
+  cell_[id].beg = beg;
+  cell_[id].end = end;
+  std::fill(cell_[id].child, cell_[id].child+8, -1);
+  cell_[id].leaf = (end-beg <= leaf_size || depth >= 32 || r == 0);
+  if ( cell_[id].leaf )
+    return id;
+
+  // split into octants, x then y then z
+  int bound[9];
+  bound[0] = beg;
+  bound[8] = end;
+  auto below = [&](const int axis) {
+    return [&, axis](const int p) { return pos_(p, axis) < c[axis]; };
+  };
+  bound[4] = std::partition(&order_[0]+bound[0], &order_[0]+bound[8], below(0))-&order_[0];
+  for (int h = 0; h < 2; ++h)
+    bound[2+4*h] = std::partition(&order_[0]+bound[4*h], &order_[0]+bound[4*h+4], below(1))-&order_[0];
+  for (int q = 0; q < 4; ++q)
+    bound[1+2*q] = std::partition(&order_[0]+bound[2*q], &order_[0]+bound[2*q+2], below(2))-&order_[0];
+  for (int o = 0; o < 8; ++o) {
+    if ( bound[o] < bound[o+1] ) {
+      const int ch = build(bound[o], bound[o+1], leaf_size, depth+1);
+      cell_[id].child[o] = ch;
+    }
+  }
+  return id;
+}
+
+void far_field_octree::eval(const double *x, const double theta, double *res) const {
+  std::fill(res, res+nw_, 0.0);
+  if ( cell_.empty() )
+    return;
+  const Vector3d X(x);
+  int stack[8*33+1], top = 0;
+  stack[top++] = 0;
+  while ( top > 0 ) {
+    const cell_t &cl = cell_[stack[--top]];
+    const Vector3d d = X-cl.c;
+    const double dist = d.norm();
+    if ( cl.r < theta*dist ) {
+      const double inv = 1.0/dist, inv3 = inv*inv*inv, inv5 = inv3*inv*inv;
+      const double dd[6] = {d[0]*d[0], d[1]*d[1], d[2]*d[2], 2*d[0]*d[1], 2*d[0]*d[2], 2*d[1]*d[2]};
+      const double *M = &moment_(&cl-&cell_[0], 0);
+      for (int k = 0; k < nw_; ++k, M += 10) {
+        double quad = 0;
+        for (int q = 0; q < 6; ++q)
+          quad += dd[q]*M[4+q];
+        res[k] += M[0]*inv+(M[1]*d[0]+M[2]*d[1]+M[3]*d[2])*inv3
+            +(3*quad-(M[4]+M[5]+M[6])*dist*dist)*0.5*inv5;
+      }
+    } else if ( cl.leaf ) {
+      for (int j = cl.beg; j < cl.end; ++j) {
+        const int p = order_[j];
+        const double inv = 1.0/(X-pos_.row(p).transpose()).norm();
+        for (int k = 0; k < nw_; ++k)
+          res[k] += w_(p, k)*inv;
+      }
+    } else {
+      for (int o = 0; o < 8; ++o)
+        if ( cl.child[o] != -1 )
+          stack[top++] = cl.child[o];
+    }
+  }
+}
+
+void build_far_field(boundary_loop &loop, const double theta, const int leaf_size) {
+  const int bnd_size = loop.bnd.size();
+  eigen_matd_t W, w;
+  VectorXd c;
+  calc_weighted_binormal(loop, W, c);
+  loop.theta = theta;
+  loop.lin_a.setZero();
+  loop.lin_b = 0;
+  loop.tree.reset();
+  if ( loop.method == 0 ) {
+    loop.lin_a = W.colwise().sum();
+    loop.lin_b = c.sum();
+    w.resize(bnd_size, 2);
+    for (int i = 0; i < bnd_size; ++i) {
+      w(i, 0) = loop.sf(i)*loop.dl(i);
+      w(i, 1) = loop.dl(i);
+    }
+  } else if ( loop.method == 1 ) {
+    ASSERT(loop.sf.size() == bnd_size);
+    loop.lin_a = loop.sf*W;
+    loop.lin_b = loop.sf.dot(c.transpose());
+  } else if ( loop.method == 2 ) {
+    w.resize(bnd_size, 1);
+    for (int i = 0; i < bnd_size; ++i)
+      w(i, 0) = loop.N.row(i).squaredNorm()*loop.dl(i)/(4*M_PI);
+  }
+  if ( w.cols() > 0 )
+    loop.tree = make_shared<far_field_octree>(loop.pos, w, leaf_size);
+  loop.accel = true;
+}
+
 static inline double calc_rbf(const eigen_vecd_t &x, const eigen_vecd_t &c) {
   return 1.0/(x-c).norm();
 }
 
 double indicator_value(const eigen_vecd_t &x, const boundary_loop &loop) {
   double rtn = 0.0;
+  if ( loop.accel ) {
+    rtn = loop.lin_a.dot(x.head<3>())-loop.lin_b;
+    double res[2];
+    if ( loop.method == 0 ) {
+      loop.tree->eval(x.data(), loop.theta, res);
+      rtn += res[0]/res[1];
+    } else if ( loop.method == 2 ) {
+      loop.tree->eval(x.data(), loop.theta, res);
+      rtn = res[0];
+    }
+    return rtn;
+  }
   if ( loop.method == 0 ) {
     double integral = 0.0, correction = 0.0, sum = 0.0;
     // first part
@@ -157,19 +341,20 @@ void structured_grid_sampling(const eigen_matd_t &box, const int res, eigen_matd
   double xmin = box(0, 0), xmax = box(1, 0);
   double ymin = box(0, 1), ymax = box(1, 1);
   double zmin = box(0, 2), zmax = box(1, 2);
-  vector<double> buffer;
   double dx = (xmax-xmin)/res, dy = (ymax-ymin)/res, dz = (zmax-zmin)/res;
+  const int n1 = res+1;
+  pts.resize(n1*n1*n1, 3);
+#pragma omp parallel for
   for (int k = 0; k <= res; ++k) {
     for (int j = 0; j <= res; ++j) {
       for (int i = 0; i <= res; ++i) {
-        buffer.push_back(xmin+i*dx);
-        buffer.push_back(ymin+j*dy);
-        buffer.push_back(zmin+k*dz);
+        const int id = i+n1*(j+n1*k);
+        pts(id, 0) = xmin+i*dx;
+        pts(id, 1) = ymin+j*dy;
+        pts(id, 2) = zmin+k*dz;
       }
     }
   }
-  pts.resize(buffer.size()/3, 3);
-  std::copy(buffer.begin(), buffer.end(), pts.data());
 }
 
 void calc_scalar_field(const boundary_loop &loop, const eigen_matd_t &pts, eigen_vecd_t &sf) {
@@ -180,4 +365,198 @@ void calc_scalar_field(const boundary_loop &loop, const eigen_matd_t &pts, eigen
   }
 }
 
+//==============================================================================
+static inline void lattice_point(const adaptive_grid &grid, const size_t id, double *x) {
+  const size_t n1 = (1 << grid.level)+1;
+  const size_t ijk[3] = {id%n1, id/n1%n1, id/(n1*n1)};
+  for (int d = 0; d < 3; ++d)
+    x[d] = grid.box(0, d)+(grid.box(1, d)-grid.box(0, d))*ijk[d]/(n1-1);
+}
+
+/// corner v of a cell has the offsets (v&1, v>>1&1, v>>2&1) times h
+static inline size_t cell_corner(const adaptive_grid &grid, const size_t id, const size_t h, const int v) {
+  const size_t n1 = (1 << grid.level)+1;
+  return id+h*((v&1)+n1*((v>>1&1)+n1*(v>>2&1)));
+}
+
+void adaptive_grid_sampling(const boundary_loop &loop, const eigen_matd_t &box, const int max_level,
+                            adaptive_grid &grid, const int min_level, const double band, const double iso) {
+  ASSERT(min_level >= 0 && min_level <= max_level && max_level <= 20);
+  grid.box = box;
+  grid.level = max_level;
+  grid.val.clear();
+  grid.cell.clear();
+
+  vector<size_t> curr, next, todo;
+  const size_t n0 = 1 << min_level, h0 = 1 << (max_level-min_level);
+  for (size_t k = 0; k < n0; ++k)
+    for (size_t j = 0; j < n0; ++j)
+      for (size_t i = 0; i < n0; ++i)
+        curr.push_back(grid.lattice_id(i*h0, j*h0, k*h0));
+
+  for (int l = min_level; l <= max_level; ++l) {
+    const size_t h = 1 << (max_level-l);
+    // evaluate the corners not seen at coarser levels
+    todo.clear();
+    for (auto &c : curr)
+      for (int v = 0; v < 8; ++v)
+        todo.push_back(cell_corner(grid, c, h, v));
+    std::sort(todo.begin(), todo.end());
+    todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+    todo.erase(std::remove_if(todo.begin(), todo.end(), [&](const size_t id) { return grid.val.count(id) > 0; }), todo.end());
+    vector<double> value(todo.size());
+#pragma omp parallel for
+    for (size_t p = 0; p < todo.size(); ++p) {
+      eigen_vecd_t x(3);
+      lattice_point(grid, todo[p], x.data());
+      value[p] = indicator_value(x, loop);
+    }
+    for (size_t p = 0; p < todo.size(); ++p)
+      grid.val[todo[p]] = value[p];
+
+    next.clear();
+    for (auto &c : curr) {
+      double fmin = std::numeric_limits<double>::max(), fmax = -fmin, dmin = fmin;
+      for (int v = 0; v < 8; ++v) {
+        const double f = grid.val.at(cell_corner(grid, c, h, v))-iso;
+        fmin = std::min(fmin, f);
+        fmax = std::max(fmax, f);
+        dmin = std::min(dmin, std::fabs(f));
+      }
+      const bool cross = (fmin < 0 && fmax >= 0);
+      if ( l == max_level ) {
+        if ( cross )
+          grid.cell.push_back(c);
+      } else if ( cross || dmin < band*(fmax-fmin) ) {
+        for (int v = 0; v < 8; ++v)
+          next.push_back(cell_corner(grid, c, h/2, v));
+      }
+    }
+    curr.swap(next);
+  }
+
+  // corner tests may skip a thin part of the surface inside a coarse
+  // cell, so follow the surface: a finest cell whose face straddles iso
+  // has a crossed neighbor behind that face
+  const size_t n = 1 << max_level, n1 = n+1;
+  unordered_set<size_t> known(grid.cell.begin(), grid.cell.end());
+  vector<size_t> front = grid.cell;
+  while ( !front.empty() ) {
+    next.clear();
+    for (auto &c : front) {
+      const size_t ijk[3] = {c%n1, c/n1%n1, c/(n1*n1)}, stride[3] = {1, n1, n1*n1};
+      for (int d = 0; d < 3; ++d) {
+        for (int side = 0; side < 2; ++side) {
+          if ( (side == 0 && ijk[d] == 0) || (side == 1 && ijk[d]+1 == n) )
+            continue;
+          bool pos = false, neg = false;
+          for (int v = 0; v < 8; ++v) {
+            if ( (v>>d&1) != side ) continue;
+            (grid.val.at(cell_corner(grid, c, 1, v)) < iso ? neg : pos) = true;
+          }
+          const size_t nb = side ? c+stride[d] : c-stride[d];
+          if ( pos && neg && known.insert(nb).second )
+            next.push_back(nb);
+        }
+      }
+    }
+    todo.clear();
+    for (auto &c : next)
+      for (int v = 0; v < 8; ++v)
+        if ( !grid.val.count(cell_corner(grid, c, 1, v)) )
+          todo.push_back(cell_corner(grid, c, 1, v));
+    std::sort(todo.begin(), todo.end());
+    todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+    vector<double> value(todo.size());
+#pragma omp parallel for
+    for (size_t p = 0; p < todo.size(); ++p) {
+      eigen_vecd_t x(3);
+      lattice_point(grid, todo[p], x.data());
+      value[p] = indicator_value(x, loop);
+    }
+    for (size_t p = 0; p < todo.size(); ++p)
+      grid.val[todo[p]] = value[p];
+    grid.cell.insert(grid.cell.end(), next.begin(), next.end());
+    front.swap(next);
+  }
+  printf("[info] adaptive sampling: %zu evaluations, %zu cells on the surface, %zu for the dense grid\n",
+         grid.val.size(), grid.cell.size(), n1*n1*n1);
+}
+
+void extract_iso_surface(const adaptive_grid &grid, const double iso, eigen_mati_t &tris, eigen_matd_t &nods) {
+  // six positively oriented tetrahedra around the diagonal 0-7 of the
+  // cube, conforming between neighbors since every cube is split alike
+  static const int TET[6][4] = {{0, 1, 3, 7}, {0, 3, 2, 7}, {0, 2, 6, 7},
+                                {0, 6, 4, 7}, {0, 4, 5, 7}, {0, 5, 1, 7}};
+  // even permutations keep the orientation, so the faces below are
+  // oriented by the table alone, without geometric tests
+  static const int EVEN[12][4] = {{0, 1, 2, 3}, {0, 2, 3, 1}, {0, 3, 1, 2}, {1, 0, 3, 2},
+                                  {1, 2, 0, 3}, {1, 3, 2, 0}, {2, 0, 1, 3}, {2, 1, 3, 0},
+                                  {2, 3, 0, 1}, {3, 0, 2, 1}, {3, 1, 0, 2}, {3, 2, 1, 0}};
+  map<pair<size_t, size_t>, int> edge_vert;
+  vector<double> vert;
+  vector<int> face;
+  auto cut = [&](size_t a, size_t b) {
+    if ( a > b ) std::swap(a, b);
+    auto it = edge_vert.find(make_pair(a, b));
+    if ( it != edge_vert.end() )
+      return it->second;
+    double xa[3], xb[3];
+    lattice_point(grid, a, xa);
+    lattice_point(grid, b, xb);
+    const double fa = grid.val.at(a)-iso, fb = grid.val.at(b)-iso;
+    // the indicator is singular on the boundary samples
+    const double t = std::isinf(fa) ? 1.0 : fa/(fa-fb);
+    for (int d = 0; d < 3; ++d)
+      vert.push_back(xa[d]+t*(xb[d]-xa[d]));
+    const int id = vert.size()/3-1;
+    edge_vert.insert(make_pair(make_pair(a, b), id));
+    return id;
+  };
+  auto add_face = [&](const int a, const int b, const int c, const bool flip) {
+    face.push_back(a);
+    face.push_back(flip ? c : b);
+    face.push_back(flip ? b : c);
+  };
+
+  for (auto &c : grid.cell) {
+    for (int t = 0; t < 6; ++t) {
+      size_t id[4];
+      int mask = 0, nin = 0;
+      for (int v = 0; v < 4; ++v) {
+        id[v] = cell_corner(grid, c, 1, TET[t][v]);
+        if ( grid.val.at(id[v]) < iso ) {
+          mask |= 1 << v;
+          ++nin;
+        }
+      }
+      if ( nin == 0 || nin == 4 )
+        continue;
+      if ( nin == 1 || nin == 3 ) {
+        // the lone vertex first, normals leave it when it is below iso
+        const int lone = (nin == 1) ? __builtin_ctz(mask) : __builtin_ctz(~mask & 15);
+        const int *p = EVEN[3*lone];
+        add_face(cut(id[p[0]], id[p[1]]), cut(id[p[0]], id[p[2]]), cut(id[p[0]], id[p[3]]), nin == 3);
+      } else {
+        // the two vertices below iso first
+        const int *p = nullptr;
+        for (int k = 0; k < 12; ++k)
+          if ( (mask>>EVEN[k][0]&1) && (mask>>EVEN[k][1]&1) ) {
+            p = EVEN[k];
+            break;
+          }
+        const int q0 = cut(id[p[0]], id[p[2]]), q1 = cut(id[p[0]], id[p[3]]);
+        const int q2 = cut(id[p[1]], id[p[3]]), q3 = cut(id[p[1]], id[p[2]]);
+        add_face(q0, q1, q2, false);
+        add_face(q0, q2, q3, false);
+      }
+    }
+  }
+  nods.resize(vert.size()/3, 3);
+  std::copy(vert.begin(), vert.end(), nods.data());
+  tris.resize(face.size()/3, 3);
+  std::copy(face.begin(), face.end(), tris.data());
+  printf("[info] iso surface: %zu vertices, %zu triangles\n", (size_t)nods.rows(), (size_t)tris.rows());
+}
+
 }
@@ -1,6 +1,9 @@
 #ifndef HOLE_FILLING_H
 #define HOLE_FILLING_H
 
+#include <memory>
+#include <vector>
+#include <unordered_map>
 #include <Eigen/Dense>
 
 namespace riemann {
@@ -10,6 +13,39 @@ using eigen_matd_t=Eigen::Matrix<double, -1, -1, Eigen::RowMajor>;
 using eigen_veci_t=Eigen::Matrix<int, 1, -1, Eigen::RowMajor>;
 using eigen_vecd_t=Eigen::Matrix<double, 1, -1, Eigen::RowMajor>;
 
+/**
+ * @brief octree over point charges p_i with one or more weight sets w_i
+ * evaluating sum_i w_i/|x-p_i|. A cell of radius r whose center is at
+ * distance d from x is replaced by its expansion up to quadrupoles
+ * once r < theta*d, the relative error of a cell being O(theta^3);
+ * theta = 0 sums every charge exactly.
+ */
+class far_field_octree
+{
+public:
+  /// pos is #point x 3, w is #point x #weight set
+  far_field_octree(const eigen_matd_t &pos, const eigen_matd_t &w, const int leaf_size=16);
+  int weight_num() const { return nw_; }
+  /// res receives one sum per weight set
+  void eval(const double *x, const double theta, double *res) const;
+private:
+  struct cell_t {
+    Eigen::Vector3d c;
+    double r;
+    int beg, end;   // charges in order_
+    int child[8];   // -1 for none
+    bool leaf;
+  };
+  int build(const int beg, const int end, const int leaf_size, const int depth);
+
+  const int nw_;
+  std::vector<cell_t> cell_;
+  std::vector<int> order_;
+  eigen_matd_t pos_, w_;
+  // per cell and weight set: monopole, dipole (3), quadrupole (6)
+  eigen_matd_t moment_;
+};
+
 struct boundary_loop {
   enum type {OFFSET, SCALE};
   eigen_veci_t bnd;
@@ -18,6 +54,13 @@ struct boundary_loop {
   eigen_matd_t T, B, N;
   eigen_vecd_t dl;
   int method;
+  // filled by build_far_field(): the linear part lin_a.x-lin_b of the
+  // indicator and the 1/r sums over the boundary samples
+  bool accel = false;
+  Eigen::RowVector3d lin_a;
+  double lin_b;
+  double theta;
+  std::shared_ptr<const far_field_octree> tree;
 };
 
 void get_boundary_loop(const eigen_mati_t &tris, const eigen_matd_t &nods, boundary_loop &loop);
@@ -25,11 +68,37 @@ void select_method(boundary_loop &loop, boundary_loop::type t);
 void calc_bnd_local_frame(const eigen_mati_t &tris, const eigen_matd_t &nods, boundary_loop &loop);
 void calc_infinitesimal_elem(boundary_loop &loop);
 void calc_bnd_indicator(boundary_loop &loop);
+/// after calc_bnd_indicator, makes indicator_value() cost O(log #bnd)
+/// per point instead of O(#bnd); theta controls the far field accuracy
+void build_far_field(boundary_loop &loop, const double theta=0.3, const int leaf_size=16);
 void uniform_random_sampling(const eigen_matd_t &box, const int num, eigen_matd_t &pts);
 void structured_grid_sampling(const eigen_matd_t &box, const int res, eigen_matd_t &pts);
 double indicator_value(const eigen_vecd_t &x, const boundary_loop &loop);
 void calc_scalar_field(const boundary_loop &loop, const eigen_matd_t &pts, eigen_vecd_t &sf);
 
+/// @brief indicator samples on the lattice of a 2^level grid over box,
+/// kept only where an octree refinement asked for them
+struct adaptive_grid {
+  eigen_matd_t box;
+  int level;
+  // lattice point i+(n+1)*(j+(n+1)*k), n = 2^level, to its value
+  std::unordered_map<size_t, double> val;
+  // min corners of the finest cells crossed by the level set
+  std::vector<size_t> cell;
+  size_t lattice_id(const size_t i, const size_t j, const size_t k) const {
+    const size_t n1 = (1 << level)+1;
+    return i+n1*(j+n1*k);
+  }
+};
+
+/// Starts from the uniform 2^min_level grid and splits a cell only if its
+/// corner values straddle iso or one of them is within band times their
+/// spread of it, down to 2^max_level cells per axis.
+void adaptive_grid_sampling(const boundary_loop &loop, const eigen_matd_t &box, const int max_level,
+                            adaptive_grid &grid, const int min_level=3, const double band=0.5, const double iso=0.0);
+/// marching tetrahedra over the finest cells, normals point to values above iso
+void extract_iso_surface(const adaptive_grid &grid, const double iso, eigen_mati_t &tris, eigen_matd_t &nods);
+
 }
 
 #endif
@@ -1,6 +1,8 @@
 #include "ipopt_solver.h"
 
 #include <iostream>
+#include <numeric>
+#include <algorithm>
 
 #include "config.h"
 #include "def.h"
@@ -10,44 +12,179 @@ using namespace Eigen;
 
 namespace riemann {
 
+bool ipopt_opt_framework::scatter_map::same_positions(const vector<Triplet<Number>> &trips) const {
+  if ( trips.size() != row.size() )
+    return false;
+  for (size_t k = 0; k < trips.size(); ++k) {
+    if ( trips[k].row() != row[k] || trips[k].col() != col[k] )
+      return false;
+  }
+  return true;
+}
+
+int ipopt_opt_framework::scatter_map::build(const vector<Triplet<Number>> &trips,
+                                            const SparseMatrix<Number> &pattern, const bool lower) {
+  const size_t nnz = trips.size();
+  row.resize(nnz);
+  col.resize(nnz);
+  vector<size_t> slot(nnz, -1);
+  const int *outer = pattern.outerIndexPtr(), *inner = pattern.innerIndexPtr();
+  bool outside = false;
+#pragma omp parallel for reduction(||:outside)
+  for (size_t k = 0; k < nnz; ++k) {
+    row[k] = trips[k].row();
+    col[k] = trips[k].col();
+    if ( lower && row[k] < col[k] )
+      continue;
+    const int *it = std::lower_bound(inner+outer[col[k]], inner+outer[col[k]+1], row[k]);
+    if ( it == inner+outer[col[k]+1] || *it != row[k] )
+      outside = true;
+    else
+      slot[k] = it-inner;
+  }
+  if ( outside )
+    return __LINE__;
+  ptr.assign(pattern.nonZeros()+1, 0);
+  for (auto &s : slot)
+    if ( s != -1 )
+      ++ptr[s+1];
+  std::partial_sum(ptr.begin(), ptr.end(), ptr.begin());
+  entry.resize(ptr.back());
+  vector<size_t> pos(ptr.begin(), ptr.end()-1);
+  for (size_t k = 0; k < nnz; ++k)
+    if ( slot[k] != -1 )
+      entry[pos[slot[k]]++] = k;
+  return 0;
+}
+
 ipopt_opt_framework::ipopt_opt_framework(const std::shared_ptr<Functional<Number>> &obj,
                                          const std::shared_ptr<Constraint<Number>> &con,
                                          Number *x0)
-    : obj_(obj), con_(con), x0_(x0), dim_(obj_->Nx())
+    : obj_(obj), con_(con), x0_(x0), dim_(obj_->Nx()),
+      kkey_(obj_->HesPattern()), jkey_(con_.get() ? con_->JacPattern() : 0),
+      k_fresh_(false), c_fresh_(false), j_fresh_(false)
 {
   // obj can not be null, con can (unconstrained problem).
-  K_.resize(dim_, dim_); {
-    vector<Triplet<Number>> trips;
-    obj_->Hes(x0, &trips);
-    K_.setFromTriplets(trips.begin(), trips.end());
-  }
-
-  SparseMatrix<Number> H_(dim_, dim_);
-  H_.setZero();
-
+  // The structure is computed once here, later evaluations only write
+  // values through the scatter maps.
+  vector<Triplet<Number>> ktrips, ctrips, lower;
+  obj_->Hes(x0, &ktrips);
   if ( con_.get() ) {
     J_.resize(con_->Nf(), con_->Nx());
     vector<Triplet<Number>> trips;
     con_->Jac(x0, 0, &trips);
     J_.setFromTriplets(trips.begin(), trips.end());
+    J_.makeCompressed();
+    if ( jmap_.build(trips, J_, false) )
+      ASSERT(0);
 
-    vector<vector<Triplet<Number>>> tripsH;
+    vector<vector<Triplet<Number>>> tripsH(con_->Nf());
     con_->Hes(x0, 0, &tripsH);
-    for (auto &trisI : tripsH) {
-      SparseMatrix<Number> h(dim_, dim_);
-      h.setFromTriplets(trisI.begin(), trisI.end());
-      H_ += h;
+    for (size_t i = 0; i < tripsH.size(); ++i) {
+      for (auto &t : tripsH[i]) {
+        ctrips.push_back(t);
+        cid_.push_back(i);
+      }
+    }
+  }
+
+  for (auto &trips : {&ktrips, &ctrips})
+    for (auto &t : *trips)
+      if ( t.col() <= t.row() )
+        lower.push_back(Triplet<Number>(t.row(), t.col(), 1));
+  lagH_.resize(dim_, dim_);
+  lagH_.setFromTriplets(lower.begin(), lower.end());
+  lagH_.makeCompressed();
+  nnz_lagH_ = lagH_.nonZeros();
+  if ( kmap_.build(ktrips, lagH_, true) || cmap_.build(ctrips, lagH_, true) )
+    ASSERT(0);
+}
+
+void ipopt_opt_framework::touch(const bool new_x) {
+  if ( new_x )
+    k_fresh_ = c_fresh_ = j_fresh_ = false;
+}
+
+bool ipopt_opt_framework::update_objective_hessian(const Number *x) {
+  if ( k_fresh_ )
+    return true;
+  // values straight from HesVal() when supported, else from triplets
+  size_t nnz = 0;
+  bool done = false;
+  const size_t key = obj_->HesPattern();
+  if ( key == kkey_ && !obj_->HesNnz(&nnz) && nnz == kmap_.row.size() ) {
+    kval_.resize(nnz);
+    done = !obj_->HesVal(x, kval_.data());
+  }
+  if ( !done ) {
+    vector<Triplet<Number>> trips;
+    obj_->Hes(x, &trips);
+    if ( !kmap_.same_positions(trips) && kmap_.build(trips, lagH_, true) ) {
+      cerr << "[Error] objective hessian left the initial sparsity pattern\n";
+      return false;
+    }
+    kkey_ = key;
+    kval_.resize(trips.size());
+#pragma omp parallel for
+    for (size_t k = 0; k < trips.size(); ++k)
+      kval_[k] = trips[k].value();
+  }
+  return (k_fresh_ = true);
+}
+
+bool ipopt_opt_framework::update_constraint_hessian(const Number *x) {
+  if ( c_fresh_ )
+    return true;
+  vector<vector<Triplet<Number>>> tripsH(con_->Nf());
+  con_->Hes(x, 0, &tripsH);
+  vector<Triplet<Number>> trips;
+  trips.reserve(cid_.size());
+  vector<size_t> cid;
+  cid.reserve(cid_.size());
+  for (size_t i = 0; i < tripsH.size(); ++i) {
+    for (auto &t : tripsH[i]) {
+      trips.push_back(t);
+      cid.push_back(i);
+    }
+  }
+  if ( cid != cid_ || !cmap_.same_positions(trips) ) {
+    if ( cmap_.build(trips, lagH_, true) ) {
+      cerr << "[Error] constraint hessian left the initial sparsity pattern\n";
+      return false;
     }
+    cid_.swap(cid);
   }
+  cval_.resize(trips.size());
+#pragma omp parallel for
+  for (size_t k = 0; k < trips.size(); ++k)
+    cval_[k] = trips[k].value();
+  return (c_fresh_ = true);
+}
 
-  lagH_ = K_+H_;
-  nnz_lagH_ = 0;
-  for (size_t j = 0; j < lagH_.outerSize(); ++j) {
-    for (SparseMatrix<Number>::InnerIterator it(lagH_, j); it; ++it) {
-      if ( it.col() <= it.row() )
-        ++nnz_lagH_;
+bool ipopt_opt_framework::update_constraint_jacobian(const Number *x) {
+  if ( j_fresh_ )
+    return true;
+  size_t nnz = 0;
+  bool done = false;
+  const size_t key = con_->JacPattern();
+  if ( key == jkey_ && !con_->JacNnz(&nnz) && nnz == jmap_.row.size() ) {
+    jval_.resize(nnz);
+    done = !con_->JacVal(x, jval_.data());
+  }
+  if ( !done ) {
+    vector<Triplet<Number>> trips;
+    con_->Jac(x, 0, &trips);
+    if ( !jmap_.same_positions(trips) && jmap_.build(trips, J_, false) ) {
+      cerr << "[Error] constraint jacobian left the initial sparsity pattern\n";
+      return false;
     }
+    jkey_ = key;
+    jval_.resize(trips.size());
+#pragma omp parallel for
+    for (size_t k = 0; k < trips.size(); ++k)
+      jval_[k] = trips[k].value();
   }
+  return (j_fresh_ = true);
 }
 
 ipopt_opt_framework::~ipopt_opt_framework() {}
@@ -96,6 +233,7 @@ bool ipopt_opt_framework::get_starting_point(Index n, bool init_x, Number* x,
 
 bool ipopt_opt_framework::eval_f(Index n, const Number* x, bool new_x, Number& obj_value)
 {
+  touch(new_x);
   assert(n == obj_->Nx());
 
   obj_value = 0;
@@ -106,6 +244,7 @@ bool ipopt_opt_framework::eval_f(Index n, const Number* x, bool new_x, Number& o
   
 bool ipopt_opt_framework::eval_grad_f(Index n, const Number* x, bool new_x, Number* grad_f)
 {
+  touch(new_x);
   assert(n == obj_->Nx());
 
   std::fill(grad_f, grad_f+n, 0);
@@ -116,6 +255,7 @@ bool ipopt_opt_framework::eval_grad_f(Index n, const Number* x, bool new_x, Numb
 
 bool ipopt_opt_framework::eval_g(Index n, const Number* x, bool new_x, Index m, Number* g)
 {
+  touch(new_x);
   if ( !con_.get() )
     return false;
 
@@ -129,6 +269,7 @@ bool ipopt_opt_framework::eval_jac_g(Index n, const Number* x, bool new_x,
                                      Index m, Index nele_jac, Index* iRow, Index *jCol,
                                      Number* values)
 {
+  touch(new_x);
   if ( !con_.get() )
     return false;
 
@@ -142,20 +283,18 @@ bool ipopt_opt_framework::eval_jac_g(Index n, const Number* x, bool new_x,
       }
     }
   } else {
-    SparseMatrix<Number> J(m, n); {
-      vector<Triplet<Number>> trips;
-      con_->Jac(x, 0, &trips);
-      J.setFromTriplets(trips.begin(), trips.end());
-    }
-    
-    size_t count = 0;
-    for (size_t j = 0; j < J.outerSize(); ++j) {
-      for (SparseMatrix<Number>::InnerIterator it(J, j); it; ++it) {
-        values[count++] = it.value();
-      }
+    if ( !update_constraint_jacobian(x) )
+      return false;
+    const vector<size_t> &ptr = jmap_.ptr, &entry = jmap_.entry;
+#pragma omp parallel for
+    for (size_t s = 0; s < J_.nonZeros(); ++s) {
+      Number sum = 0;
+      for (size_t j = ptr[s]; j < ptr[s+1]; ++j)
+        sum += jval_[entry[j]];
+      values[s] = sum;
     }
   }
-  
+
   return true;
 }
 
@@ -164,53 +303,38 @@ bool ipopt_opt_framework::eval_h(Index n, const Number* x, bool new_x,
                                  bool new_lambda, Index nele_hess, Index* iRow,
                                  Index* jCol, Number* values)
 {
+  touch(new_x);
   if (values == NULL) {
     size_t count = 0;
     for (size_t j = 0; j < lagH_.outerSize(); ++j) {
       for (SparseMatrix<Number>::InnerIterator it(lagH_, j); it; ++it) {
-        if ( it.col() <= it.row() ) {
-          iRow[count] = it.row();
-          jCol[count] = it.col();
-          ++count;
-        }
+        iRow[count] = it.row();
+        jCol[count] = it.col();
+        ++count;
       }
     }
   } else {
-    // query K
-    SparseMatrix<Number> K(n, n); {
-      vector<Triplet<Number>> trips;
-      obj_->Hes(x, &trips);
-      K.setFromTriplets(trips.begin(), trips.end());
-      K *= obj_factor;
-    }
-
-    if ( con_.get () ) {
-      // query H
-      vector<SparseMatrix<Number>> H(m); {
-        vector<vector<Triplet<Number>>> trips(m);
-        con_->Hes(x, 0, &trips);
-        #pragma omp parallel for
-        for (size_t i = 0; i < trips.size(); ++i) {
-          H[i].resize(n, n);
-          H[i].setFromTriplets(trips[i].begin(), trips[i].end());
-          H[i] *= lambda[i];
-        }
-      }
-
-      for (auto &mat : H)
-        K += mat;
-    }
-    
-    size_t count = 0;
-    for (size_t j = 0; j < K.outerSize(); ++j) {
-      for (SparseMatrix<Number>::InnerIterator it(K, j); it; ++it) {
-        if ( it.col() <= it.row() ) {
-          values[count++] = it.value();
+    // element values only change with x, the weights are applied while
+    // gathering them into ipopt's array
+    if ( !update_objective_hessian(x) || (con_.get() && !update_constraint_hessian(x)) )
+      return false;
+    const bool has_con = con_.get() != nullptr;
+#pragma omp parallel for
+    for (size_t s = 0; s < nnz_lagH_; ++s) {
+      Number sum = 0;
+      for (size_t j = kmap_.ptr[s]; j < kmap_.ptr[s+1]; ++j)
+        sum += kval_[kmap_.entry[j]];
+      sum *= obj_factor;
+      if ( has_con ) {
+        for (size_t j = cmap_.ptr[s]; j < cmap_.ptr[s+1]; ++j) {
+          const size_t e = cmap_.entry[j];
+          sum += lambda[cid_[e]]*cval_[e];
         }
       }
+      values[s] = sum;
     }
   }
- 
+
   return true;
 }
 
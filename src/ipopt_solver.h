@@ -3,6 +3,7 @@
 
 #include <IpTNLP.hpp>
 #include <memory>
+#include <vector>
 #include <Eigen/Sparse>
 
 namespace riemann {
@@ -51,12 +52,37 @@ public:
 				 const IpoptData* ip_data,
 				 IpoptCalculatedQuantities* ip_cq);
 protected:
+  /// @brief which element entries, in the order Hes()/Jac() push them,
+  /// are summed into each nonzero of a fixed compressed pattern
+  struct scatter_map {
+    std::vector<int> row, col;
+    std::vector<size_t> ptr, entry;
+    bool same_positions(const std::vector<Eigen::Triplet<Number>> &trips) const;
+    /// entries above the diagonal are dropped if lower, non-zero if an
+    /// entry falls outside the pattern
+    int build(const std::vector<Eigen::Triplet<Number>> &trips,
+              const Eigen::SparseMatrix<Number> &pattern, const bool lower);
+  };
+  bool update_objective_hessian(const Number *x);
+  bool update_constraint_hessian(const Number *x);
+  bool update_constraint_jacobian(const Number *x);
+  void touch(const bool new_x);
+
   const std::shared_ptr<Functional<Number>> &obj_;
   const std::shared_ptr<Constraint<Number>> &con_;
   const size_t dim_;
   Number *x0_;
-  Eigen::SparseMatrix<Number> K_, J_, lagH_;
+  // fixed patterns: the lower triangle of the lagrangian hessian and
+  // the constraint jacobian, their nonzeros are ipopt's value arrays
+  Eigen::SparseMatrix<Number> J_, lagH_;
   size_t nnz_lagH_;
+  scatter_map kmap_, cmap_, jmap_;
+  // HesPattern/JacPattern keys the value-only paths are valid for
+  size_t kkey_, jkey_;
+  std::vector<size_t> cid_;
+  std::vector<Number> kval_, cval_, jval_;
+  // element values at the current x, reset by new_x
+  bool k_fresh_, c_fresh_, j_fresh_;
 };
 
 }
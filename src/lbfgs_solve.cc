@@ -1,92 +1,324 @@
 #include "lbfgs_solve.h"
 
 #include <iostream>
-#include <lbfgs.h>
+#include <cmath>
+#include <limits>
 
 #include "def.h"
 
 using namespace std;
 using namespace alglib;
+using namespace Eigen;
 
 namespace riemann {
 
-static shared_ptr<Functional<double>> g_func;
-static size_t g_count;
-
-// static lbfgsfloatval_t evaluate(void *instance, const lbfgsfloatval_t *x,
-//                                 lbfgsfloatval_t *g, const int n,
-//                                 const lbfgsfloatval_t step) {
-//   double value = 0;
-//   g_func->Val(x, &value);
-//   std::fill(g, g+n, 0);
-//   g_func->Gra(x, g);
-//   return value;
-// }
-
-// static int progress(void *instance,
-//                     const lbfgsfloatval_t *x,
-//                     const lbfgsfloatval_t *g,
-//                     const lbfgsfloatval_t fx,
-//                     const lbfgsfloatval_t xnorm,
-//                     const lbfgsfloatval_t gnorm,
-//                     const lbfgsfloatval_t step,
-//                     int n, int k, int ls) {
-//   if ( k % 100 == 0 )
-//     cout << "\t# iteration " << k << ", energy: " << fx << endl;
-//   //  printf("  fx = %f, x[0] = %f, x[1] = %f\n", fx, x[0], x[1]);
-//   //  printf("  xnorm = %f, gnorm = %f, step = %f\n", xnorm, gnorm, step);
-//   //  printf("\n");
-//   return 0;
-// }
-
-// int lbfgs_solve(const shared_ptr<Functional<double>> &f,
-//                 double *x, const size_t dim,
-//                 const double epsf, const double epsx,
-//                 const size_t maxiter) {
-//   if ( !f.get() ) {
-//     cerr << "[Error] null pointer to functional.\n";
-//     return __LINE__;
-//   }
-//   if ( dim != f->Nx() ) {
-//     cerr << "[Error] variable size not match.\n";
-//     return __LINE__;
-//   }
-  
-//   g_func = f;
-//   g_count = 0;
-//   lbfgsfloatval_t fx;
-//   lbfgs_parameter_t param;
-//   lbfgs_parameter_init(&param);
-//   param.delta = epsf;
-//   param.max_iterations = maxiter;
-
-//   int ret = lbfgs(dim, x, &fx, evaluate, progress, NULL, &param);
-
-//   cout << "\t@LBFGS return value: " << ret << endl;
-//   return 0;
-// }
-
-static void function1_grad(const real_1d_array &x, double &func, real_1d_array &grad, void *ptr) 
-{
-  const size_t dim = g_func->Nx();
-  const double *ptrx = x.getcontent();
-  double *ptrg = grad.getcontent();
-  
-  func = 0;
-  g_func->Val(ptrx, &func);
+// below this size the vector kernels stay serial
+static const size_t PARALLEL_MIN_DIM = 8192;
+
+static double pdot(const double *a, const double *b, const size_t n) {
+  double sum = 0;
+#pragma omp parallel for reduction(+:sum) if(n >= PARALLEL_MIN_DIM)
+  for (size_t i = 0; i < n; ++i)
+    sum += a[i]*b[i];
+  return sum;
+}
+
+/// y += alpha*x
+static void paxpy(const double alpha, const double *x, double *y, const size_t n) {
+#pragma omp parallel for if(n >= PARALLEL_MIN_DIM)
+  for (size_t i = 0; i < n; ++i)
+    y[i] += alpha*x[i];
+}
+
+/// z = x-y
+static void psub(const double *x, const double *y, double *z, const size_t n) {
+#pragma omp parallel for if(n >= PARALLEL_MIN_DIM)
+  for (size_t i = 0; i < n; ++i)
+    z[i] = x[i]-y[i];
+}
+
+/// z = x+t*d
+static void pstep(const double *x, const double t, const double *d, double *z, const size_t n) {
+#pragma omp parallel for if(n >= PARALLEL_MIN_DIM)
+  for (size_t i = 0; i < n; ++i)
+    z[i] = x[i]+t*d[i];
+}
+
+/**
+ * @brief safeguarded step of More and Thuente [1994], updates the
+ * interval [stx, sty] containing a minimizer and returns a new trial
+ * step in stp, as dcstep in MINPACK-2
+ */
+static void mt_step(double &stx, double &fx, double &dx, double &sty, double &fy, double &dy,
+                    double &stp, const double fp, const double dp, bool &brackt,
+                    const double stpmin, const double stpmax) {
+  const double sgnd = dp*(dx/fabs(dx));
+  double stpf = 0;
+  if ( fp > fx ) {
+    // higher function value, the minimum is bracketed
+    const double theta = 3.0*(fx-fp)/(stp-stx)+dx+dp;
+    const double s = max(fabs(theta), max(fabs(dx), fabs(dp)));
+    double gamma = s*sqrt(max(0.0, (theta/s)*(theta/s)-(dx/s)*(dp/s)));
+    if ( stp < stx ) gamma = -gamma;
+    const double p = (gamma-dx)+theta, q = ((gamma-dx)+gamma)+dp, r = p/q;
+    const double stpc = stx+r*(stp-stx);
+    const double stpq = stx+((dx/((fx-fp)/(stp-stx)+dx))/2.0)*(stp-stx);
+    stpf = (fabs(stpc-stx) < fabs(stpq-stx)) ? stpc : stpc+(stpq-stpc)/2.0;
+    brackt = true;
+  } else if ( sgnd < 0.0 ) {
+    // derivatives of opposite sign, the minimum is bracketed
+    const double theta = 3.0*(fx-fp)/(stp-stx)+dx+dp;
+    const double s = max(fabs(theta), max(fabs(dx), fabs(dp)));
+    double gamma = s*sqrt(max(0.0, (theta/s)*(theta/s)-(dx/s)*(dp/s)));
+    if ( stp > stx ) gamma = -gamma;
+    const double p = (gamma-dp)+theta, q = ((gamma-dp)+gamma)+dx, r = p/q;
+    const double stpc = stp+r*(stx-stp);
+    const double stpq = stp+(dp/(dp-dx))*(stx-stp);
+    stpf = (fabs(stpc-stp) > fabs(stpq-stp)) ? stpc : stpq;
+    brackt = true;
+  } else if ( fabs(dp) < fabs(dx) ) {
+    // same sign and the derivative magnitude decreases
+    const double theta = 3.0*(fx-fp)/(stp-stx)+dx+dp;
+    const double s = max(fabs(theta), max(fabs(dx), fabs(dp)));
+    double gamma = s*sqrt(max(0.0, (theta/s)*(theta/s)-(dx/s)*(dp/s)));
+    if ( stp > stx ) gamma = -gamma;
+    const double p = (gamma-dp)+theta, q = (gamma+(dx-dp))+gamma, r = p/q;
+    double stpc;
+    if ( r < 0.0 && gamma != 0.0 )
+      stpc = stp+r*(stx-stp);
+    else
+      stpc = (stp > stx) ? stpmax : stpmin;
+    const double stpq = stp+(dp/(dp-dx))*(stx-stp);
+    if ( brackt ) {
+      stpf = (fabs(stpc-stp) < fabs(stpq-stp)) ? stpc : stpq;
+      if ( stp > stx )
+        stpf = min(stp+0.66*(sty-stp), stpf);
+      else
+        stpf = max(stp+0.66*(sty-stp), stpf);
+    } else {
+      stpf = (fabs(stpc-stp) > fabs(stpq-stp)) ? stpc : stpq;
+      stpf = max(stpmin, min(stpmax, stpf));
+    }
+  } else {
+    // same sign and the derivative magnitude does not decrease
+    if ( brackt ) {
+      const double theta = 3.0*(fp-fy)/(sty-stp)+dy+dp;
+      const double s = max(fabs(theta), max(fabs(dy), fabs(dp)));
+      double gamma = s*sqrt(max(0.0, (theta/s)*(theta/s)-(dy/s)*(dp/s)));
+      if ( stp > sty ) gamma = -gamma;
+      const double p = (gamma-dp)+theta, q = ((gamma-dp)+gamma)+dy, r = p/q;
+      stpf = stp+r*(sty-stp);
+    } else {
+      stpf = (stp > stx) ? stpmax : stpmin;
+    }
+  }
+  if ( fp > fx ) {
+    sty = stp; fy = fp; dy = dp;
+  } else {
+    if ( sgnd < 0.0 ) {
+      sty = stx; fy = fx; dy = dx;
+    }
+    stx = stp; fx = fp; dx = dp;
+  }
+  stp = stpf;
+}
+
+lbfgs_args::lbfgs_args()
+  : history(5), maxiter(0), epsg(1e-10), epsf(0), epsx(0),
+    ftol(1e-4), gtol(0.9), xtol(1e-16), max_linesearch(20), verbose(100) {}
+
+lbfgs_context::lbfgs_context(const lbfgs_args &args)
+  : args_(args), dim_(0), head_(0), pairs_(0), status_(0), iter_(0), nfev_(0), fx_(0) {}
+
+double lbfgs_context::eval(const Functional<double> &f, const double *x, double *g) {
+  double value = 0;
+  f.Val(x, &value);
+#pragma omp parallel for if(dim_ >= PARALLEL_MIN_DIM)
+  for (size_t i = 0; i < dim_; ++i)
+    g[i] = 0;
+  f.Gra(x, g);
+  ++nfev_;
+  return value;
+}
+
+/// x, fx and g_ are at xp_+stp*d_ on return, the start point is xp_
+int lbfgs_context::line_search(const Functional<double> &f, double *x, double *fx, double *stp) {
+  const double xtrapl = 1.1, xtrapu = 4.0;
+  const double stpmin = 1e-20, stpmax = 1e20;
+  const double finit = *fx, ginit = pdot(g_.data(), d_.data(), dim_);
+  if ( ginit >= 0 )
+    return __LINE__;
+  const double gtest = args_.ftol*ginit;
+
+  bool brackt = false;
+  int stage = 1;
+  double width = stpmax-stpmin, width1 = 2*width;
+  double stx = 0, fstx = finit, gstx = ginit;
+  double sty = 0, fsty = finit, gsty = ginit;
+  double stmin = 0, stmax = *stp+xtrapu*(*stp);
+  for (size_t k = 0; k < args_.max_linesearch; ++k) {
+    pstep(xp_.data(), *stp, d_.data(), x, dim_);
+    const double fval = eval(f, x, g_.data());
+    const double gval = pdot(g_.data(), d_.data(), dim_);
+    *fx = fval;
+    if ( !std::isfinite(fval) ) {
+      // back off into the finite region
+      brackt = true;
+      sty = *stp; fsty = numeric_limits<double>::max(); gsty = 0;
+      stmax = *stp;
+      *stp = stx+0.5*(*stp-stx);
+      continue;
+    }
+
+    const double ftest = finit+(*stp)*gtest;
+    if ( stage == 1 && fval <= ftest && gval >= 0 )
+      stage = 2;
+    if ( fval <= ftest && fabs(gval) <= args_.gtol*(-ginit) )
+      return 0;
+    if ( brackt && ((*stp) <= stmin || (*stp) >= stmax) )
+      break;
+    if ( brackt && stmax-stmin <= args_.xtol*stmax )
+      break;
+    if ( *stp == stpmax && fval <= ftest && gval <= gtest )
+      return 0;
+    if ( *stp == stpmin && (fval > ftest || gval >= gtest) )
+      break;
+
+    if ( stage == 1 && fval <= fstx && fval > ftest ) {
+      // modified function with the sufficient decrease line removed
+      double fm = fval-(*stp)*gtest, fxm = fstx-stx*gtest, fym = fsty-sty*gtest;
+      double gm = gval-gtest, gxm = gstx-gtest, gym = gsty-gtest;
+      mt_step(stx, fxm, gxm, sty, fym, gym, *stp, fm, gm, brackt, stmin, stmax);
+      fstx = fxm+stx*gtest; fsty = fym+sty*gtest;
+      gstx = gxm+gtest; gsty = gym+gtest;
+    } else {
+      mt_step(stx, fstx, gstx, sty, fsty, gsty, *stp, fval, gval, brackt, stmin, stmax);
+    }
+
+    if ( brackt ) {
+      if ( fabs(sty-stx) >= 0.66*width1 )
+        *stp = stx+0.5*(sty-stx);
+      width1 = width;
+      width = fabs(sty-stx);
+      stmin = min(stx, sty);
+      stmax = max(stx, sty);
+    } else {
+      stmin = *stp+xtrapl*(*stp-stx);
+      stmax = *stp+xtrapu*(*stp-stx);
+    }
+    *stp = max(stpmin, min(stpmax, *stp));
+    if ( (brackt && ((*stp) <= stmin || (*stp) >= stmax)) ||
+         (brackt && stmax-stmin <= args_.xtol*stmax) )
+      *stp = stx;
+  }
+  // no step met the Wolfe conditions, keep the best one if it decreases
+  if ( stx > 0 && fstx < finit ) {
+    *stp = stx;
+    pstep(xp_.data(), stx, d_.data(), x, dim_);
+    *fx = eval(f, x, g_.data());
+    return 0;
+  }
+  std::copy(xp_.data(), xp_.data()+dim_, x);
+  std::copy(gp_.data(), gp_.data()+dim_, g_.data());
+  *fx = finit;
+  return __LINE__;
+}
+
+/// d_ = -H*g_ from the stored correction pairs
+void lbfgs_context::two_loop() {
+  const size_t m = S_.cols();
+  d_ = -g_;
+  for (size_t k = 0; k < pairs_; ++k) {
+    const size_t j = (head_+m-1-k)%m;
+    alpha_[j] = rho_[j]*pdot(S_.col(j).data(), d_.data(), dim_);
+    paxpy(-alpha_[j], Y_.col(j).data(), d_.data(), dim_);
+  }
+  if ( pairs_ > 0 ) {
+    const size_t j = (head_+m-1)%m;
+    const double yy = pdot(Y_.col(j).data(), Y_.col(j).data(), dim_);
+    d_ *= 1.0/(rho_[j]*yy);
+  }
+  for (size_t k = pairs_; k > 0; --k) {
+    const size_t j = (head_+m-k)%m;
+    const double beta = rho_[j]*pdot(Y_.col(j).data(), d_.data(), dim_);
+    paxpy(alpha_[j]-beta, S_.col(j).data(), d_.data(), dim_);
+  }
+}
+
+int lbfgs_context::minimize(const Functional<double> &f, double *x) {
+  dim_ = f.Nx();
+  const size_t m = std::max<size_t>(args_.history, 1);
+  S_.resize(dim_, m);
+  Y_.resize(dim_, m);
+  rho_.setZero(m);
+  alpha_.setZero(m);
+  g_.resize(dim_); xp_.resize(dim_); gp_.resize(dim_); d_.resize(dim_);
+  head_ = pairs_ = 0;
+  iter_ = nfev_ = 0;
+
+  fx_ = eval(f, x, g_.data());
+  if ( !std::isfinite(fx_) ) {
+    status_ = -1;
+    return __LINE__;
+  }
+  status_ = 0;
+  if ( sqrt(pdot(g_.data(), g_.data(), dim_)) <= args_.epsg ) {
+    status_ = 4;
+    return 0;
+  }
+  d_ = -g_;
+  double stp = 1.0/sqrt(pdot(d_.data(), d_.data(), dim_));
+
+  while ( status_ == 0 ) {
+    std::copy(x, x+dim_, xp_.data());
+    gp_ = g_;
+    const double fp = fx_;
+    if ( line_search(f, x, &fx_, &stp) ) {
+      status_ = -2;
+      break;
+    }
+    ++iter_;
+    if ( args_.verbose && iter_ % args_.verbose == 0 )
+      cout << "\t# iter " << iter_ << ", energy: " << fx_ << endl;
 
-  std::fill(ptrg, ptrg+dim, 0);
-  g_func->Gra(ptrx, ptrg);
+    // new correction pair, formed in place of xp_ and gp_ so the slot at
+    // head_, possibly the oldest live pair, survives a rejected one
+    psub(x, xp_.data(), xp_.data(), dim_);
+    psub(g_.data(), gp_.data(), gp_.data(), dim_);
+    const double ys = pdot(gp_.data(), xp_.data(), dim_);
 
-  if ( g_count % 100 == 0 )
-    cout << "\t# iter " << g_count << ", energy: " << func << endl;
-  ++g_count;
+    const double gnorm = sqrt(pdot(g_.data(), g_.data(), dim_));
+    const double snorm = sqrt(pdot(xp_.data(), xp_.data(), dim_));
+    if ( gnorm <= args_.epsg )
+      status_ = 4;
+    else if ( fabs(fp-fx_) <= args_.epsf*max(max(fabs(fp), fabs(fx_)), 1.0) )
+      status_ = 1;
+    else if ( snorm <= args_.epsx )
+      status_ = 2;
+    else if ( args_.maxiter && iter_ >= args_.maxiter )
+      status_ = 5;
+    if ( status_ )
+      break;
+
+    // skip pairs violating the curvature condition
+    if ( ys > 0 ) {
+      const size_t j = head_;
+      S_.col(j) = xp_;
+      Y_.col(j) = gp_;
+      rho_[j] = 1.0/ys;
+      head_ = (head_+1)%m;
+      pairs_ = std::min(pairs_+1, m);
+    }
+    two_loop();
+    stp = 1.0;
+  }
+  return 0;
 }
 
 int lbfgs_solve(const shared_ptr<Functional<double>> &f,
                 double *X, const size_t dim,
                 const double EpsF, const double EpsX,
-                const size_t maxiter) {
+                const size_t maxiter, const size_t history) {
   if ( !f.get() ) {
     cerr << "[Error] null pointer to functional\n";
     return __LINE__;
@@ -96,27 +328,16 @@ int lbfgs_solve(const shared_ptr<Functional<double>> &f,
     return __LINE__;
   }
 
-  g_func = f;
-  g_count = 0;
-  real_1d_array x;
-  x.setcontent(dim, X);
-  double epsg = 0.0000000001;
-  double epsf = EpsF;
-  double epsx = EpsX;
-  ae_int_t maxits = maxiter;
-  minlbfgsstate state;
-  minlbfgsreport rep;
-
-  minlbfgscreate(1, x, state);
-  minlbfgssetcond(state, epsg, epsf, epsx, maxits);
-  alglib::minlbfgsoptimize(state, function1_grad);
-  minlbfgsresults(state, x, rep);
+  lbfgs_args args;
+  args.epsf = EpsF;
+  args.epsx = EpsX;
+  args.maxiter = maxiter;
+  args.history = history;
+  lbfgs_context ctx(args);
+  ctx.minimize(*f, X);
 
-  const double *ptrx = x.getcontent();
-  std::copy(ptrx, ptrx+dim, X);
-  
-  cout << "\t# LBFGS RETURN: " << int(rep.terminationtype)
-       << ", ITERATIONS: " << int(rep.iterationscount) << endl;
+  cout << "\t# LBFGS RETURN: " << ctx.status()
+       << ", ITERATIONS: " << ctx.iterations() << endl;
   return 0;
 }
 
@@ -140,7 +361,7 @@ int lbfgs_solve(alglib_callback_t cb,
 
   const double *ptrx = x.getcontent();
   std::copy(ptrx, ptrx+dim, X);
-  
+
   cout << "\t# LBFGS RETURN: " << int(rep.terminationtype)
        << ", ITERATIONS: " << int(rep.iterationscount) << endl;
   return 0;
@@ -3,12 +3,54 @@
 
 #include <memory>
 #include <optimization.h>
+#include <Eigen/Dense>
 
 namespace riemann {
 
 template <typename T>
 class Functional;
 
+struct lbfgs_args {
+  size_t history;         // number of correction pairs
+  size_t maxiter;         // 0 for unlimited
+  double epsg, epsf, epsx;  // same meaning as in the alglib conditions below
+  double ftol, gtol, xtol;  // More-Thuente decrease, curvature and interval tolerances
+  size_t max_linesearch;
+  size_t verbose;         // report every verbose iterations, 0 for silence
+  lbfgs_args();
+};
+
+/// @brief state of one native L-BFGS run over a Functional<double>.
+/// Everything lives in the context, so independent contexts may run
+/// concurrently, e.g. one per mesh inside an OpenMP loop. The two-loop
+/// recursion and the vector updates are themselves parallel for large
+/// problems. Steps come from a More-Thuente line search.
+class lbfgs_context
+{
+public:
+  explicit lbfgs_context(const lbfgs_args &args=lbfgs_args());
+  /// termination codes follow alglib, see below
+  int minimize(const Functional<double> &f, double *x);
+  int status() const { return status_; }
+  size_t iterations() const { return iter_; }
+  size_t evaluations() const { return nfev_; }
+  double value() const { return fx_; }
+private:
+  double eval(const Functional<double> &f, const double *x, double *g);
+  int line_search(const Functional<double> &f, double *x, double *fx, double *stp);
+  void two_loop();
+
+  const lbfgs_args args_;
+  size_t dim_;
+  Eigen::MatrixXd S_, Y_;
+  Eigen::VectorXd rho_, alpha_;
+  Eigen::VectorXd g_, xp_, gp_, d_;
+  size_t head_, pairs_;
+  int status_;
+  size_t iter_, nfev_;
+  double fx_;
+};
+
 /*************************************************************************
 This function sets stopping conditions for L-BFGS optimization algorithm.
 
@@ -74,7 +116,7 @@ automatic stopping criterion selection (small EpsX).
 int lbfgs_solve(const std::shared_ptr<Functional<double>> &f,
                 double *X, const size_t dim,
                 const double EpsF = 0, const double EpsX = 0,
-                const size_t maxiter = 0);
+                const size_t maxiter = 0, const size_t history = 5);
 
 using alglib::real_1d_array;
 
@@ -0,0 +1,197 @@
+#include "mesh_cache.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <jtflib/mesh/io.h>
+
+using namespace std;
+using namespace zjucad::matrix;
+
+namespace riemann {
+
+static_assert(sizeof(size_t) == sizeof(uint64_t), "cells are stored as 64-bit indices");
+static_assert(sizeof(mesh_cache_header)%8 == 0, "header breaks array alignment");
+static_assert(sizeof(mesh_cache_field)%8 == 0, "field record breaks array alignment");
+
+static const char MESH_CACHE_MAGIC[8] = {'R', 'M', 'N', 'M', 'E', 'S', 'H', '\0'};
+static const uint32_t MESH_CACHE_VERSION = 1;
+
+static int stat_source(const char *src, uint64_t *size, int64_t *mtime) {
+  struct stat st;
+  if ( stat(src, &st) != 0 )
+    return __LINE__;
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return 0;
+}
+
+mesh_cache::mesh_cache()
+  : addr_(nullptr), len_(0), head_(nullptr) {}
+
+mesh_cache::~mesh_cache() {
+  close();
+}
+
+int mesh_cache::open(const char *file) {
+  close();
+  int fd = ::open(file, O_RDONLY);
+  if ( fd < 0 )
+    return __LINE__;
+  struct stat st;
+  if ( fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(mesh_cache_header) ) {
+    ::close(fd);
+    return __LINE__;
+  }
+  len_ = st.st_size;
+  addr_ = mmap(nullptr, len_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if ( addr_ == MAP_FAILED ) {
+    addr_ = nullptr;
+    return __LINE__;
+  }
+  head_ = static_cast<const mesh_cache_header *>(addr_);
+  if ( memcmp(head_->magic, MESH_CACHE_MAGIC, 8) != 0 || head_->version != MESH_CACHE_VERSION ) {
+    cerr << "[error] " << file << " is not a mesh cache\n";
+    close();
+    return __LINE__;
+  }
+  // walk the blocks and check they all fit in the file
+  const char *ptr = static_cast<const char *>(addr_)+sizeof(mesh_cache_header);
+  const char *end = static_cast<const char *>(addr_)+len_;
+  ptr += sizeof(double)*head_->dim*head_->nbr_vert;
+  ptr += sizeof(size_t)*head_->cell_size*head_->nbr_cell;
+  for (uint32_t i = 0; i < head_->nbr_field && ptr <= end; ++i) {
+    const mesh_cache_field *rec = reinterpret_cast<const mesh_cache_field *>(ptr);
+    if ( ptr+sizeof(mesh_cache_field) > end )
+      break;
+    ptr += sizeof(mesh_cache_field);
+    const size_t n = rec->location == mesh_cache_field::VERT ? head_->nbr_vert : head_->nbr_cell;
+    fields_.push_back(make_pair(rec, reinterpret_cast<const double *>(ptr)));
+    ptr += sizeof(double)*rec->ncomp*n;
+  }
+  if ( ptr > end || fields_.size() != head_->nbr_field ) {
+    cerr << "[error] truncated mesh cache " << file << endl;
+    close();
+    return __LINE__;
+  }
+  madvise(addr_, len_, MADV_SEQUENTIAL);
+  return 0;
+}
+
+void mesh_cache::close() {
+  if ( addr_ )
+    munmap(addr_, len_);
+  addr_ = nullptr;
+  len_ = 0;
+  head_ = nullptr;
+  fields_.clear();
+}
+
+mesh_cache::cmatd_t mesh_cache::nods() const {
+  const double *ptr = reinterpret_cast<const double *>(head_+1);
+  return cmatd_t(head_->dim, head_->nbr_vert, ptr);
+}
+
+mesh_cache::cmati_t mesh_cache::cells() const {
+  const size_t *ptr = reinterpret_cast<const size_t *>(
+      reinterpret_cast<const double *>(head_+1)+head_->dim*head_->nbr_vert);
+  return cmati_t(head_->cell_size, head_->nbr_cell, ptr);
+}
+
+const double *mesh_cache::field(const char *name, size_t *ncomp, size_t *n) const {
+  for (auto &f : fields_) {
+    if ( strncmp(f.first->name, name, sizeof(f.first->name)) == 0 ) {
+      if ( ncomp )
+        *ncomp = f.first->ncomp;
+      if ( n )
+        *n = f.first->location == mesh_cache_field::VERT ? head_->nbr_vert : head_->nbr_cell;
+      return f.second;
+    }
+  }
+  return nullptr;
+}
+
+bool mesh_cache::is_fresh(const char *src) const {
+  uint64_t size; int64_t mtime;
+  if ( !head_ || stat_source(src, &size, &mtime) )
+    return false;
+  return head_->src_size == size && head_->src_mtime == mtime;
+}
+
+string mesh_cache_path(const char *src) {
+  return string(src)+".rmc";
+}
+
+int write_mesh_cache(const char *file, const mati_t &cell, const matd_t &nods,
+                     const vector<mesh_field> &fields, const char *src) {
+  mesh_cache_header head;
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, MESH_CACHE_MAGIC, 8);
+  head.version = MESH_CACHE_VERSION;
+  head.dim = nods.size(1);
+  head.cell_size = cell.size(1);
+  head.nbr_field = fields.size();
+  head.nbr_vert = nods.size(2);
+  head.nbr_cell = cell.size(2);
+  if ( src && stat_source(src, &head.src_size, &head.src_mtime) )
+    return __LINE__;
+
+  FILE *fp = fopen(file, "wb");
+  if ( fp == NULL ) {
+    cerr << "[error] can not open " << file << endl;
+    return __LINE__;
+  }
+  fwrite(&head, sizeof(head), 1, fp);
+  fwrite(&nods[0], sizeof(double), nods.size(), fp);
+  fwrite(&cell[0], sizeof(size_t), cell.size(), fp);
+  for (auto &f : fields) {
+    const size_t n = f.location == mesh_cache_field::VERT ? nods.size(2) : cell.size(2);
+    if ( f.data.size(2) != n || f.name.size() >= sizeof(mesh_cache_field::name) ) {
+      cerr << "[error] invalid field " << f.name << endl;
+      fclose(fp);
+      return __LINE__;
+    }
+    mesh_cache_field rec;
+    memset(&rec, 0, sizeof(rec));
+    strncpy(rec.name, f.name.c_str(), sizeof(rec.name)-1);
+    rec.location = f.location;
+    rec.ncomp = f.data.size(1);
+    fwrite(&rec, sizeof(rec), 1, fp);
+    fwrite(&f.data[0], sizeof(double), f.data.size(), fp);
+  }
+  int rtn = ferror(fp) ? __LINE__ : 0;
+  fclose(fp);
+  return rtn;
+}
+
+static bool load_from_cache(const char *file, mati_t &cell, matd_t &nods) {
+  const string path = mesh_cache_path(file);
+  mesh_cache cache;
+  if ( cache.open(path.c_str()) || !cache.is_fresh(file) )
+    return false;
+  const mesh_cache_header &head = cache.header();
+  nods.resize(head.dim, head.nbr_vert);
+  cell.resize(head.cell_size, head.nbr_cell);
+  memcpy(&nods[0], &cache.nods()[0], sizeof(double)*nods.size());
+  memcpy(&cell[0], &cache.cells()[0], sizeof(size_t)*cell.size());
+  return true;
+}
+
+int load_obj_cached(const char *file, mati_t &cell, matd_t &nods) {
+  if ( load_from_cache(file, cell, nods) )
+    return 0;
+  return jtf::mesh::load_obj(file, cell, nods);
+}
+
+int load_tet_vtk_cached(const char *file, mati_t &tets, matd_t &nods) {
+  if ( load_from_cache(file, tets, nods) )
+    return 0;
+  return jtf::mesh::tet_mesh_read_from_vtk(file, &nods, &tets);
+}
+
+}
@@ -0,0 +1,91 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <zjucad/matrix/matrix.h>
+#include <zjucad/matrix/itr_matrix.h>
+
+namespace riemann {
+
+using mati_t=zjucad::matrix::matrix<size_t>;
+using matd_t=zjucad::matrix::matrix<double>;
+
+/// binary mesh container, every block starts at a multiple of 8 bytes:
+///   header | nods (dim x nbr_vert doubles) | cells (cell_size x nbr_cell
+///   size_t) | nbr_field x { field record | ncomp x n doubles }
+/// Arrays are column-major like matd_t/mati_t so a mapped file can be
+/// viewed in place.
+struct mesh_cache_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t dim;
+  uint32_t cell_size;
+  uint32_t nbr_field;
+  uint64_t nbr_vert;
+  uint64_t nbr_cell;
+  // size and mtime of the mesh it was converted from
+  uint64_t src_size;
+  int64_t  src_mtime;
+};
+
+struct mesh_cache_field
+{
+  enum { VERT = 0, CELL = 1 };
+  char name[48];
+  uint32_t location;
+  uint32_t ncomp;
+};
+
+/// per-vertex or per-cell data written after the cells
+struct mesh_field
+{
+  std::string name;
+  uint32_t location;
+  matd_t data;
+};
+
+/// @brief read-only memory mapping of a cache file
+class mesh_cache
+{
+public:
+  typedef zjucad::matrix::itr_matrix<const double *> cmatd_t;
+  typedef zjucad::matrix::itr_matrix<const size_t *> cmati_t;
+  mesh_cache();
+  ~mesh_cache();
+  int open(const char *file);
+  void close();
+  const mesh_cache_header &header() const { return *head_; }
+  cmatd_t nods() const;
+  cmati_t cells() const;
+  /// returns nullptr if there is no such field
+  const double *field(const char *name, size_t *ncomp=nullptr, size_t *n=nullptr) const;
+  /// whether the mapped cache was converted from the current state of src
+  bool is_fresh(const char *src) const;
+private:
+  mesh_cache(const mesh_cache &);
+  mesh_cache &operator=(const mesh_cache &);
+  void *addr_;
+  size_t len_;
+  const mesh_cache_header *head_;
+  std::vector<std::pair<const mesh_cache_field *, const double *>> fields_;
+};
+
+/// path of the cache file next to a source mesh
+std::string mesh_cache_path(const char *src);
+
+/// src may be null, then the source stamp is left empty
+int write_mesh_cache(const char *file, const mati_t &cell, const matd_t &nods,
+                     const std::vector<mesh_field> &fields=std::vector<mesh_field>(),
+                     const char *src=nullptr);
+
+/// same as jtf::mesh::load_obj and tet_mesh_read_from_vtk, but read
+/// from the cache file instead when a fresh one sits next to file
+int load_obj_cached(const char *file, mati_t &cell, matd_t &nods);
+int load_tet_vtk_cached(const char *file, mati_t &tets, matd_t &nods);
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include "mesh_topology.h"
+
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <Eigen/Dense>
+
+#include "config.h"
+
+using namespace std;
+using namespace zjucad::matrix;
+
+namespace riemann {
+
+static const size_t TRI_EDGE[3][2] = {{0, 1}, {1, 2}, {2, 0}};
+static const size_t TET_EDGE[6][2] = {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 3}, {2, 3}};
+static const size_t TET_FACE[4][3] = {{1, 2, 3}, {0, 2, 3}, {0, 1, 3}, {0, 1, 2}};
+
+const size_t *mesh_topology::local_edge(const size_t simplex_size, const size_t j) {
+  return simplex_size == 3 ? TRI_EDGE[j] : TET_EDGE[j];
+}
+
+namespace {
+/// one appearance of a sub-simplex in a cell, keyed by its sorted vertices
+struct occurrence {
+  size_t key[3];
+  size_t cell, local;
+};
+inline bool same_key(const occurrence &a, const occurrence &b) {
+  return a.key[1] == b.key[1] && a.key[2] == b.key[2];
+}
+}
+
+/// enumerates the k-vertex sub-simplices listed in table (L x k), ids
+/// are assigned bucket by bucket on the smallest vertex so that each
+/// bucket is sorted and numbered independently; ptr/adj receive the
+/// cells containing each sub-simplex
+static void build_sub_simplex(const mati_t &cell, const size_t nv, const size_t *table,
+                              const size_t L, const size_t k, mati_t &simplex, mati_t &cell2sub,
+                              vector<size_t> &ptr, vector<size_t> &adj) {
+  const size_t nc = cell.size(2);
+  auto make_key = [&](const size_t i, const size_t j, occurrence &o) {
+    o.key[0] = o.key[1] = o.key[2] = 0;
+    for (size_t l = 0; l < k; ++l)
+      o.key[l] = cell(table[j*k+l], i);
+    sort(o.key, o.key+k);
+    o.cell = i;
+    o.local = j;
+  };
+
+  // scatter the occurrences straight into their buckets
+  vector<size_t> bucket(nv+1, 0);
+  for (size_t i = 0; i < nc; ++i) {
+    for (size_t j = 0; j < L; ++j) {
+      size_t vmin = cell(table[j*k], i);
+      for (size_t l = 1; l < k; ++l)
+        vmin = min(vmin, cell(table[j*k+l], i));
+      ++bucket[vmin+1];
+    }
+  }
+  partial_sum(bucket.begin(), bucket.end(), bucket.begin());
+  vector<occurrence> occ(nc*L);
+  adj.resize(occ.size()); {
+    vector<size_t> cursor(bucket.begin(), bucket.end()-1);
+    occurrence o;
+    for (size_t i = 0; i < nc; ++i) {
+      for (size_t j = 0; j < L; ++j) {
+        make_key(i, j, o);
+        occ[cursor[o.key[0]]++] = o;
+      }
+    }
+  }
+
+  vector<size_t> uniq(nv+1, 0);
+#pragma omp parallel for schedule(dynamic, 256)
+  for (size_t v = 0; v < nv; ++v) {
+    const auto first = occ.begin()+bucket[v], last = occ.begin()+bucket[v+1];
+    sort(first, last, [](const occurrence &a, const occurrence &b) {
+        if ( a.key[1] != b.key[1] ) return a.key[1] < b.key[1];
+        if ( a.key[2] != b.key[2] ) return a.key[2] < b.key[2];
+        return a.cell < b.cell;
+      });
+    size_t cnt = 0;
+    for (auto it = first; it != last; ++it)
+      if ( it == first || !same_key(*it, *(it-1)) )
+        ++cnt;
+    uniq[v+1] = cnt;
+  }
+  partial_sum(uniq.begin(), uniq.end(), uniq.begin());
+
+  const size_t ns = uniq[nv];
+  simplex.resize(k, ns);
+  cell2sub.resize(L, nc);
+  ptr.resize(ns+1);
+  ptr[ns] = occ.size();
+#pragma omp parallel for schedule(dynamic, 256)
+  for (size_t v = 0; v < nv; ++v) {
+    size_t id = uniq[v]-1;
+    for (size_t p = bucket[v]; p < bucket[v+1]; ++p) {
+      const occurrence &o = occ[p];
+      if ( p == bucket[v] || !same_key(o, occ[p-1]) ) {
+        ptr[++id] = p;
+        for (size_t l = 0; l < k; ++l)
+          simplex(l, id) = o.key[l];
+      }
+      cell2sub(o.local, o.cell) = id;
+      adj[p] = o.cell;
+    }
+  }
+}
+
+mesh_topology::mesh_topology(const mati_t &cell)
+  : cell_(cell) {
+  const size_t n = cell_.size(1), nc = cell_.size(2);
+  ASSERT(n == 3 || n == 4);
+  const size_t nv = nc == 0 ? 0 : *max_element(cell_.begin(), cell_.end())+1;
+
+  // vertex-cell, cells come in increasing order
+  vc_ptr_.assign(nv+1, 0);
+  for (size_t i = 0; i < cell_.size(); ++i)
+    ++vc_ptr_[cell_[i]+1];
+  partial_sum(vc_ptr_.begin(), vc_ptr_.end(), vc_ptr_.begin());
+  vc_adj_.resize(cell_.size()); {
+    vector<size_t> cursor(vc_ptr_.begin(), vc_ptr_.end()-1);
+    for (size_t i = 0; i < nc; ++i)
+      for (size_t j = 0; j < n; ++j)
+        vc_adj_[cursor[cell_(j, i)]++] = i;
+  }
+
+  // edges, and facets which are the same thing on triangle meshes
+  const size_t ne_local = (n == 3) ? 3 : 6;
+  build_sub_simplex(cell_, nv, local_edge(n, 0), ne_local, 2, edges_, cell_edge_, ec_ptr_, ec_adj_);
+  vector<size_t> fc_ptr, fc_adj;
+  if ( n == 3 ) {
+    facets_ = edges_;
+    fc_ptr = ec_ptr_;
+    fc_adj = ec_adj_;
+    // local edge (j+1)%3 is opposite to vertex j
+    cell_facet_.resize(3, nc);
+#pragma omp parallel for
+    for (size_t i = 0; i < nc; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        cell_facet_(j, i) = cell_edge_((j+1)%3, i);
+  } else {
+    build_sub_simplex(cell_, nv, &TET_FACE[0][0], 4, 3, facets_, cell_facet_, fc_ptr, fc_adj);
+  }
+
+  const size_t nf = facets_.size(2);
+  facet2cell_.resize(2, nf);
+  size_t non_manifold = 0;
+#pragma omp parallel for reduction(+:non_manifold)
+  for (size_t f = 0; f < nf; ++f) {
+    const size_t cnt = fc_ptr[f+1]-fc_ptr[f];
+    facet2cell_(0, f) = fc_adj[fc_ptr[f]];
+    facet2cell_(1, f) = cnt > 1 ? fc_adj[fc_ptr[f]+1] : -1;
+    if ( cnt > 2 )
+      ++non_manifold;
+  }
+  if ( non_manifold )
+    cerr << "[warning] " << non_manifold << " non-manifold facets, only two cells are kept\n";
+
+  // vertex-vertex with the id of the connecting edge, gathered from the
+  // incident cells in two passes: count, then fill
+  auto one_ring = [&](const size_t v, vector<pair<size_t, size_t>> &nb) {
+    nb.clear();
+    for (size_t p = vc_ptr_[v]; p < vc_ptr_[v+1]; ++p) {
+      const size_t c = vc_adj_[p];
+      for (size_t j = 0; j < ne_local; ++j) {
+        const size_t eid = cell_edge_(j, c);
+        if ( edges_(0, eid) == v )
+          nb.push_back(make_pair(edges_(1, eid), eid));
+        else if ( edges_(1, eid) == v )
+          nb.push_back(make_pair(edges_(0, eid), eid));
+      }
+    }
+    sort(nb.begin(), nb.end());
+    nb.erase(unique(nb.begin(), nb.end()), nb.end());
+  };
+  vv_ptr_.assign(nv+1, 0);
+#pragma omp parallel
+  {
+    vector<pair<size_t, size_t>> nb;
+#pragma omp for schedule(dynamic, 256)
+    for (size_t v = 0; v < nv; ++v) {
+      one_ring(v, nb);
+      vv_ptr_[v+1] = nb.size();
+    }
+  }
+  partial_sum(vv_ptr_.begin(), vv_ptr_.end(), vv_ptr_.begin());
+  vv_adj_.resize(vv_ptr_[nv]);
+  vv_edge_.resize(vv_ptr_[nv]);
+#pragma omp parallel
+  {
+    vector<pair<size_t, size_t>> nb;
+#pragma omp for schedule(dynamic, 256)
+    for (size_t v = 0; v < nv; ++v) {
+      one_ring(v, nb);
+      for (size_t p = 0; p < nb.size(); ++p) {
+        vv_adj_[vv_ptr_[v]+p] = nb[p].first;
+        vv_edge_[vv_ptr_[v]+p] = nb[p].second;
+      }
+    }
+  }
+
+  // cell-cell through interior facets
+  cc_ptr_.assign(nc+1, 0);
+#pragma omp parallel for
+  for (size_t i = 0; i < nc; ++i) {
+    for (size_t j = 0; j < n; ++j)
+      if ( !is_boundary_facet(cell_facet_(j, i)) )
+        ++cc_ptr_[i+1];
+  }
+  partial_sum(cc_ptr_.begin(), cc_ptr_.end(), cc_ptr_.begin());
+  cc_adj_.resize(cc_ptr_[nc]);
+  cc_facet_.resize(cc_ptr_[nc]);
+#pragma omp parallel
+  {
+    vector<pair<size_t, size_t>> nb;
+#pragma omp for
+    for (size_t i = 0; i < nc; ++i) {
+      nb.clear();
+      for (size_t j = 0; j < n; ++j) {
+        const size_t f = cell_facet_(j, i);
+        if ( is_boundary_facet(f) )
+          continue;
+        nb.push_back(make_pair(facet2cell_(0, f) == i ? facet2cell_(1, f) : facet2cell_(0, f), f));
+      }
+      sort(nb.begin(), nb.end());
+      for (size_t p = 0; p < nb.size(); ++p) {
+        cc_adj_[cc_ptr_[i]+p] = nb[p].first;
+        cc_facet_[cc_ptr_[i]+p] = nb[p].second;
+      }
+    }
+  }
+}
+
+shared_ptr<const mesh_topology> mesh_topology::create(const mati_t &cell) {
+  return shared_ptr<const mesh_topology>(new mesh_topology(cell));
+}
+
+size_t mesh_topology::find_edge(const size_t p, const size_t q) const {
+  if ( p >= vert_num() )
+    return -1;
+  const auto first = vv_adj_.begin()+vv_ptr_[p], last = vv_adj_.begin()+vv_ptr_[p+1];
+  const auto it = lower_bound(first, last, q);
+  return (it != last && *it == q) ? vv_edge_[it-vv_adj_.begin()] : -1;
+}
+
+size_t mesh_topology::find_facet(const size_t c0, const size_t c1) const {
+  for (size_t p = cc_ptr_[c0]; p < cc_ptr_[c0+1]; ++p)
+    if ( cc_adj_[p] == c1 )
+      return cc_facet_[p];
+  return -1;
+}
+
+int mesh_topology::outside_facets(const matd_t &nods, mati_t &surf, vector<size_t> *adj_cell) const {
+  const size_t n = simplex_size();
+  if ( n == 4 && nods.size(2) < vert_num() )
+    return __LINE__;
+  vector<size_t> bnd;
+  for (size_t f = 0; f < facet_num(); ++f)
+    if ( is_boundary_facet(f) )
+      bnd.push_back(f);
+  surf.resize(n-1, bnd.size());
+  if ( adj_cell )
+    adj_cell->resize(bnd.size());
+#pragma omp parallel for
+  for (size_t i = 0; i < bnd.size(); ++i) {
+    const size_t c = facet2cell_(0, bnd[i]);
+    size_t j = 0;
+    while ( cell_facet_(j, c) != bnd[i] )
+      ++j;
+    if ( n == 3 ) {
+      // boundary edges follow the orientation of their triangle
+      surf(0, i) = cell_((j+1)%3, c);
+      surf(1, i) = cell_((j+2)%3, c);
+    } else {
+      // the remaining vertex has to lie behind the face
+      for (size_t l = 0; l < 3; ++l)
+        surf(l, i) = cell_(TET_FACE[j][l], c);
+      Eigen::Map<const Eigen::Vector3d> a(&nods(0, surf(0, i))), b(&nods(0, surf(1, i))),
+          d(&nods(0, surf(2, i))), o(&nods(0, cell_(j, c)));
+      if ( (b-a).cross(d-a).dot(o-a) > 0 )
+        swap(surf(1, i), surf(2, i));
+    }
+    if ( adj_cell )
+      (*adj_cell)[i] = c;
+  }
+  return 0;
+}
+
+void mesh_topology::interior_cell_pairs(mati_t &pairs) const {
+  size_t cnt = 0;
+  for (size_t f = 0; f < facet_num(); ++f)
+    if ( !is_boundary_facet(f) )
+      ++cnt;
+  pairs.resize(2, cnt);
+  for (size_t f = 0, i = 0; f < facet_num(); ++f) {
+    if ( is_boundary_facet(f) )
+      continue;
+    pairs(0, i) = facet2cell_(0, f);
+    pairs(1, i) = facet2cell_(1, f);
+    ++i;
+  }
+}
+
+}
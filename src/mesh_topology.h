@@ -0,0 +1,91 @@
+#ifndef MESH_TOPOLOGY_H
+#define MESH_TOPOLOGY_H
+
+#include <memory>
+#include <vector>
+#include <zjucad/matrix/matrix.h>
+
+namespace riemann {
+
+using mati_t=zjucad::matrix::matrix<size_t>;
+using matd_t=zjucad::matrix::matrix<double>;
+
+/// @brief Immutable adjacency of a triangle or tetrahedral mesh. It is
+/// built once in parallel and shared through shared_ptr by all energies
+/// defined on the same mesh. Every relation is a CSR array with sorted
+/// rows, so inner loops index instead of hashing.
+///
+/// Edges keep sorted end points. Facets are the codimension-one
+/// simplices with sorted vertices: the edges of a triangle mesh (facet
+/// i is then edge i) and the triangles of a tet mesh.
+class mesh_topology
+{
+public:
+  /// cell is 3 x #tri or 4 x #tet
+  static std::shared_ptr<const mesh_topology> create(const mati_t &cell);
+
+  size_t simplex_size() const { return cell_.size(1); }
+  size_t vert_num() const { return vv_ptr_.size()-1; }
+  size_t cell_num() const { return cell_.size(2); }
+  size_t edge_num() const { return edges_.size(2); }
+  size_t facet_num() const { return facets_.size(2); }
+  const mati_t &cells() const { return cell_; }
+
+  /// 2 x #edge, first < second
+  const mati_t &edges() const { return edges_; }
+  /// local edge j of cell i, in the order of local_edge()
+  const mati_t &cell_edges() const { return cell_edge_; }
+  static const size_t *local_edge(const size_t simplex_size, const size_t j);
+
+  /// vertex-vertex: neighbors of v are vv_adj()[vv_ptr()[v]...vv_ptr()[v+1]),
+  /// sorted, and vv_edge() holds the id of the connecting edge
+  const std::vector<size_t> &vv_ptr() const { return vv_ptr_; }
+  const std::vector<size_t> &vv_adj() const { return vv_adj_; }
+  const std::vector<size_t> &vv_edge() const { return vv_edge_; }
+
+  /// vertex-cell, sorted cell ids per vertex
+  const std::vector<size_t> &vc_ptr() const { return vc_ptr_; }
+  const std::vector<size_t> &vc_adj() const { return vc_adj_; }
+
+  /// edge-cell, all cells sharing each edge
+  const std::vector<size_t> &ec_ptr() const { return ec_ptr_; }
+  const std::vector<size_t> &ec_adj() const { return ec_adj_; }
+
+  /// (simplex_size-1) x #facet, sorted vertices
+  const mati_t &facets() const { return facets_; }
+  /// 2 x #facet, the second cell is -1 on the boundary
+  const mati_t &facet2cell() const { return facet2cell_; }
+  /// facet opposite to local vertex j of cell i
+  const mati_t &cell_facets() const { return cell_facet_; }
+  bool is_boundary_facet(const size_t f) const { return facet2cell_(1, f) == -1; }
+
+  /// cell-cell through interior facets, cc_facet() holds the shared facet
+  const std::vector<size_t> &cc_ptr() const { return cc_ptr_; }
+  const std::vector<size_t> &cc_adj() const { return cc_adj_; }
+  const std::vector<size_t> &cc_facet() const { return cc_facet_; }
+
+  /// edge id by binary search in the one-ring of p, -1 if none
+  size_t find_edge(const size_t p, const size_t q) const;
+  /// shared facet of two cells, -1 if they are not adjacent
+  size_t find_facet(const size_t c0, const size_t c1) const;
+
+  /// boundary facets oriented so that their normals point out of the
+  /// volume, adj_cell receives the cell behind each of them
+  int outside_facets(const matd_t &nods, mati_t &surf, std::vector<size_t> *adj_cell=nullptr) const;
+  /// interior facets as 2 x n pairs of the adjacent cells
+  void interior_cell_pairs(mati_t &pairs) const;
+private:
+  explicit mesh_topology(const mati_t &cell);
+
+  const mati_t cell_;
+  mati_t edges_, cell_edge_;
+  mati_t facets_, facet2cell_, cell_facet_;
+  std::vector<size_t> vv_ptr_, vv_adj_, vv_edge_;
+  std::vector<size_t> vc_ptr_, vc_adj_;
+  std::vector<size_t> ec_ptr_, ec_adj_;
+  std::vector<size_t> cc_ptr_, cc_adj_, cc_facet_;
+};
+
+}
+
+#endif
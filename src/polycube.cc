@@ -12,6 +12,10 @@
 
 #include "config.h"
 #include "def.h"
+#include "sparse_assembler.h"
+#include "batch_svd.h"
+#include "mesh_topology.h"
+#include "sparse_solver.h"
 
 using namespace std;
 using namespace Eigen;
@@ -134,30 +138,9 @@ public:
   }
   int Hes(const double *x, vector<Triplet<double>> *hes) const {
     const itr_matrix<const double *> X(3, dim_/3, x);
-    matd_t vert = zeros<double>(3, 3);
-    matd_t H(9, 9), e(9, 1), Hc(9, 9), diag = zeros<double>(9, 9);
+    matd_t H(9, 9);
     for (size_t i = 0; i < surf_.size(2); ++i) {
-      vert = X(colon(), surf_(colon(), i));
-      const double eps = eps_*surf_area_[i];
-#if 1
-      H = zeros<double>(9, 9);
-      for (int k = 0; k < 3; ++k) {
-        area_normal_align_hes(&Hc[0], &vert[0], eps, k);
-        eig(Hc, e);
-        for (int ei = 0; ei < 9; ++ei)
-          diag(ei, ei) = std::max(0.0, e[ei]);
-        H += Hc*diag*trans(Hc);
-      }
-#else
-      Matrix<double, 9, 9> H; Matrix<double, 3, 9> gn;
-      Vector3d n, dia;
-      tri_area_normal_(n.data(), &vert[0]);
-      tri_area_normal_jac_(gn.data(), &vert[0]);
-      dia[0] = eps/std::pow(n[0]*n[0]+eps, 3.0/2);
-      dia[1] = eps/std::pow(n[1]*n[1]+eps, 3.0/2);
-      dia[2] = eps/std::pow(n[2]*n[2]+eps, 3.0/2);
-      H = gn.transpose()*dia.asDiagonal()*gn;
-#endif
+      elem_hes(X, i, H);
       for (size_t p = 0; p < 9; ++p) {
         for (size_t q = 0; q < 9; ++q) {
           const size_t I = 3*surf_(p/3, i)+p%3;
@@ -168,6 +151,23 @@ public:
     }
     return 0;
   }
+  int HesNnz(size_t *nnz) const {
+    *nnz = 81*surf_.size(2);
+    return 0;
+  }
+  int HesVal(const double *x, double *val) const {
+    const itr_matrix<const double *> X(3, dim_/3, x);
+    #pragma omp parallel for
+    for (size_t i = 0; i < surf_.size(2); ++i) {
+      matd_t H(9, 9);
+      elem_hes(X, i, H);
+      double *v = val+81*i;
+      for (size_t p = 0; p < 9; ++p)
+        for (size_t q = 0; q < 9; ++q)
+          *v++ = w_*H(p, q);
+    }
+    return 0;
+  }
   void scaling_args(const double scale_w, const double scale_eps) {
     w_ = w_*scale_w;
     eps_ = std::max(0.01, eps_*scale_eps);
@@ -176,6 +176,22 @@ public:
     return eps_;
   }
 private:
+  // convexified element hessian, negative eigenvalues of each of the
+  // three normal components are clamped to zero
+  void elem_hes(const itr_matrix<const double *> &X, const size_t i, matd_t &H) const {
+    const matd_t vert = X(colon(), surf_(colon(), i));
+    const double eps = eps_*surf_area_[i];
+    matd_t Hc(9, 9), e(9, 1), diag = zeros<double>(9, 9);
+    H = zeros<double>(9, 9);
+    for (int k = 0; k < 3; ++k) {
+      area_normal_align_hes(&Hc[0], &vert[0], eps, k);
+      eig(Hc, e);
+      for (int ei = 0; ei < 9; ++ei)
+        diag(ei, ei) = std::max(0.0, e[ei]);
+      H += Hc*diag*trans(Hc);
+    }
+  }
+
   const mati_t &surf_;
   const size_t dim_;
   matd_t surf_area_;
@@ -229,18 +245,35 @@ public:
     return 0;
   }
   int Hes(const double *x, vector<Triplet<double>> *hes) const {
-    matd_t H = zeros<double>(12, 12);
+    matd_t H(12, 12);
     for (size_t i = 0; i < tets_.size(2); ++i) {
-      tet_distortion_hes_(&H[0], nullptr, &Dm_(0, i), nullptr);
-      for (size_t p = 0; p < 12; ++p) {
-        for (size_t q = 0; q < 12; ++q) {
-          if ( H(p, q) != 0.0 ) {
-            const size_t I = 3*tets_(p/3, i)+p%3;
-            const size_t J = 3*tets_(q/3, i)+q%3;
-            hes->push_back(Triplet<double>(I, J, w_*vol_[i]*H(p, q)));
-          }
-        }
-      }
+      elem_hes(i, H);
+      for_each_elem_nz(&H[0], 12, [&](const size_t p, const size_t q, const double h) {
+          hes->push_back(Triplet<double>(3*tets_(p/3, i)+p%3, 3*tets_(q/3, i)+q%3, w_*vol_[i]*h));
+        });
+    }
+    return 0;
+  }
+  int HesNnz(size_t *nnz) const {
+    if ( hes_ptr_.empty() ) {
+      calc_elem_nnz_ptr(tets_.size(2), [&](const size_t i) -> size_t {
+          matd_t H(12, 12);
+          elem_hes(i, H);
+          return for_each_elem_nz(&H[0], 12, [](const size_t, const size_t, const double) {});
+        }, hes_ptr_);
+    }
+    *nnz = hes_ptr_.back();
+    return 0;
+  }
+  int HesVal(const double *x, double *val) const {
+    #pragma omp parallel for
+    for (size_t i = 0; i < tets_.size(2); ++i) {
+      matd_t H(12, 12);
+      elem_hes(i, H);
+      double *v = val+hes_ptr_[i];
+      for_each_elem_nz(&H[0], 12, [&](const size_t, const size_t, const double h) {
+          *v++ = w_*vol_[i]*h;
+        });
     }
     return 0;
   }
@@ -249,18 +282,22 @@ public:
     #pragma omp parallel for
     for (size_t i = 0; i < tets_.size(2); ++i) {
       matd_t vert = X(colon(), tets_(colon(), i));
-      matd_t F(3, 3), U(3, 3), S(3, 3), VT(3, 3), R(3, 3);
-      calc_def_grad(&vert[0], &Dm_(0, i), &F[0]);
-      svd(F, U, S, VT);
-      R = U*VT;
-      R_(colon(), i) = R(colon());
+      calc_def_grad(&vert[0], &Dm_(0, i), &R_(0, i));
     }
+    batch_rotation3x3(&R_[0], tets_.size(2), &R_[0]);
   }
 private:
+  // the quadratic part of the distortion energy, constant in x and R
+  void elem_hes(const size_t i, matd_t &H) const {
+    H = zeros<double>(12, 12);
+    tet_distortion_hes_(&H[0], nullptr, &Dm_(0, i), nullptr);
+  }
+
   const mati_t &tets_;
   const size_t dim_;
   double w_;
   matd_t Dm_, vol_, R_;
+  mutable vector<size_t> hes_ptr_;
 };
 
 //===============================================================================
@@ -269,9 +306,8 @@ private:
 
 polycube_solver::polycube_solver(const mati_t &tets, const matd_t &nods, ptree &pt)
     : tets_(tets), pt_(pt) {
-  shared_ptr<face2tet_adjacent> f2t(face2tet_adjacent::create(tets));
-  bool check_order = true;
-  jtf::mesh::get_outside_face(*f2t, surf_, check_order, &nods);
+  shared_ptr<const mesh_topology> topo = mesh_topology::create(tets);
+  topo->outside_facets(nods, surf_);
 
   const double eps = pt.get<double>("epsilon.value");
   const double w1 = pt.get<double>("weight.onenorm.value");
@@ -310,7 +346,19 @@ int polycube_solver::deform(matd_t &x) const {
   const auto arap = dynamic_pointer_cast<tet_distortion_energy>(buffer_[1]);
 
   Map<VectorXd> xstar(&x[0], dim);
-  CholmodSimplicialLDLT<SparseMatrix<double>> solver;
+  // the supernodal factorization runs dense BLAS-3 kernels on the
+  // supernodes, so it scales with the threads of the linked BLAS
+  reusable_factorization<CholmodDecomposition<SparseMatrix<double>>> solver("polycube hessian");
+  const string linear_solver = pt_.get<string>("linear_solver.value", "simplicial");
+  if ( linear_solver == "supernodal" ) {
+    solver.solver().setMode(CholmodSupernodalLLt);
+  } else if ( linear_solver == "simplicial" ) {
+    solver.solver().setMode(CholmodSimplicialLDLt);
+  } else {
+    cerr << "[Error] unknown linear solver " << linear_solver << endl;
+    return __LINE__;
+  }
+  fixed_pattern_assembler<double> hes_asm;
 
   const size_t maxits = pt_.get<size_t>("maxits.value");
   matd_t error = zeros<double>(maxits, 1);
@@ -353,13 +401,8 @@ int polycube_solver::deform(matd_t &x) const {
     VectorXd g = VectorXd::Zero(dim); {
       energy_->Gra(&x[0], g.data());
     }
-    SparseMatrix<double> H(dim, dim); {
-      vector<Triplet<double>> trips;
-      energy_->Hes(&x[0], &trips);
-      H.reserve(trips.size());
-      H.setFromTriplets(trips.begin(), trips.end());
-      H.makeCompressed();
-    }
+    hes_asm.assemble(*energy_, &x[0]);
+    const SparseMatrix<double> &H = hes_asm.matrix();
     double vc = 0; {
       area_cons_->Val(&x[0], &vc);
       if ( iter % freq == 0 )
@@ -369,12 +412,14 @@ int polycube_solver::deform(matd_t &x) const {
       area_cons_->Gra(&x[0], gc.data());
     }
 
-    solver.compute(H);
+    solver.factorize(H);
     ASSERT(solver.info() == Success);
-    double lambda = (-gc.dot(solver.solve(g))+vc)/(gc.dot(solver.solve(gc)));
-    VectorXd dx = -solver.solve(g)-lambda*solver.solve(gc);
+    const VectorXd Hg = solver.solve(g), Hgc = solver.solve(gc);
+    double lambda = (-gc.dot(Hg)+vc)/(gc.dot(Hgc));
+    VectorXd dx = -Hg-lambda*Hgc;
     xstar += dx;
   }
+  solver.report();
   
   return 0;
 }
@@ -0,0 +1,242 @@
+#include "proj_newton.h"
+
+#include <iostream>
+#include <numeric>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "sparse_solver.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace riemann {
+
+/// clamps the eigenvalues of the symmetric n x n matrix H from below
+static void project_psd(double *H, const size_t n, const double floor) {
+  Map<MatrixXd> A(H, n, n);
+  SelfAdjointEigenSolver<MatrixXd> eig(0.5*(A+A.transpose()));
+  VectorXd lambda = eig.eigenvalues();
+  if ( lambda.minCoeff() >= floor )
+    return;
+  for (size_t i = 0; i < n; ++i)
+    lambda[i] = std::max(lambda[i], floor);
+  A = eig.eigenvectors()*lambda.asDiagonal()*eig.eigenvectors().transpose();
+}
+
+/**
+ * @brief compressed column pattern of the hessian restricted to the free
+ * dofs, and for every matrix and gradient slot the element entries that
+ * are summed into it, so both are gathered without locks
+ */
+class element_assembly
+{
+public:
+  element_assembly(const element_energy &e, const vector<size_t> &fixed)
+      : ne_(e.Ne()), nd_(e.Nd()) {
+    g2l_.assign(e.Nx(), 0);
+    for (auto &id : fixed)
+      g2l_[id] = -1;
+    nf_ = 0;
+    for (size_t i = 0; i < g2l_.size(); ++i)
+      if ( g2l_[i] != -1 )
+        g2l_[i] = nf_++;
+
+    dof_.resize(nd_*ne_);
+#pragma omp parallel for
+    for (size_t i = 0; i < ne_; ++i)
+      e.Dof(i, &dof_[nd_*i]);
+
+    // matrix pattern
+    vector<Triplet<double>> trips;
+    for (size_t i = 0; i < ne_; ++i) {
+      for (size_t b = 0; b < nd_; ++b) {
+        const size_t c = g2l_[dof_[nd_*i+b]];
+        if ( c == -1 ) continue;
+        for (size_t a = 0; a < nd_; ++a) {
+          const size_t r = g2l_[dof_[nd_*i+a]];
+          if ( r != -1 )
+            trips.push_back(Triplet<double>(r, c, 0));
+        }
+      }
+    }
+    H_.resize(nf_, nf_);
+    H_.setFromTriplets(trips.begin(), trips.end());
+    H_.makeCompressed();
+
+    const int *outer = H_.outerIndexPtr(), *inner = H_.innerIndexPtr();
+    vector<size_t> hslot(nd_*nd_*ne_, -1), gslot(nd_*ne_, -1);
+#pragma omp parallel for
+    for (size_t i = 0; i < ne_; ++i) {
+      for (size_t b = 0; b < nd_; ++b) {
+        const size_t c = g2l_[dof_[nd_*i+b]];
+        if ( c == -1 ) continue;
+        gslot[nd_*i+b] = c;
+        for (size_t a = 0; a < nd_; ++a) {
+          const size_t r = g2l_[dof_[nd_*i+a]];
+          if ( r == -1 ) continue;
+          const int *it = std::lower_bound(inner+outer[c], inner+outer[c+1], (int)r);
+          hslot[nd_*nd_*i+nd_*b+a] = it-inner;
+        }
+      }
+    }
+    invert(hslot, H_.nonZeros(), hptr_, hentry_);
+    invert(gslot, nf_, gptr_, gentry_);
+  }
+  size_t free_num() const {
+    return nf_;
+  }
+  const vector<size_t> &g2l() const {
+    return g2l_;
+  }
+  /// H_ and g (free dofs only) from element hessians He and gradients Ge
+  const SparseMatrix<double> &gather(const vector<double> &He, const vector<double> &Ge, VectorXd &g) {
+    double *val = H_.valuePtr();
+#pragma omp parallel for
+    for (size_t s = 0; s < H_.nonZeros(); ++s) {
+      double sum = 0;
+      for (size_t j = hptr_[s]; j < hptr_[s+1]; ++j)
+        sum += He[hentry_[j]];
+      val[s] = sum;
+    }
+    g.resize(nf_);
+#pragma omp parallel for
+    for (size_t s = 0; s < nf_; ++s) {
+      double sum = 0;
+      for (size_t j = gptr_[s]; j < gptr_[s+1]; ++j)
+        sum += Ge[gentry_[j]];
+      g[s] = sum;
+    }
+    return H_;
+  }
+private:
+  static void invert(const vector<size_t> &slot, const size_t n,
+                     vector<size_t> &ptr, vector<size_t> &entry) {
+    ptr.assign(n+1, 0);
+    for (auto &s : slot)
+      if ( s != -1 )
+        ++ptr[s+1];
+    std::partial_sum(ptr.begin(), ptr.end(), ptr.begin());
+    entry.resize(ptr[n]);
+    vector<size_t> pos(ptr.begin(), ptr.end()-1);
+    for (size_t k = 0; k < slot.size(); ++k)
+      if ( slot[k] != -1 )
+        entry[pos[slot[k]]++] = k;
+  }
+
+  const size_t ne_, nd_;
+  size_t nf_;
+  vector<size_t> g2l_, dof_;
+  SparseMatrix<double> H_;
+  vector<size_t> hptr_, hentry_, gptr_, gentry_;
+};
+
+static double eval_energy(const element_energy &e, const double *x) {
+  double value = 0;
+#pragma omp parallel for reduction(+:value)
+  for (size_t i = 0; i < e.Ne(); ++i)
+    e.Val(x, i, &value);
+  return value;
+}
+
+int proj_newton_solve(const element_energy &e, double *x,
+                      const vector<size_t> &fixed,
+                      const proj_newton_args &args) {
+  const size_t ne = e.Ne(), nd = e.Nd(), dim = e.Nx();
+  element_assembly asm_(e, fixed);
+  const vector<size_t> &g2l = asm_.g2l();
+  reusable_factorization<SimplicialLDLT<SparseMatrix<double>>> solver("projected newton");
+
+  vector<double> He(nd*nd*ne), Ge(nd*ne);
+  VectorXd g, d = VectorXd::Zero(dim), xnew(dim);
+  Map<VectorXd> X(x, dim);
+  double f = eval_energy(e, x);
+  if ( !std::isfinite(f) ) {
+    cerr << "[Error] infeasible initial value for projected newton\n";
+    return __LINE__;
+  }
+
+  size_t iter = 0;
+  for ( ; iter < args.maxiter; ++iter) {
+#pragma omp parallel for
+    for (size_t i = 0; i < ne; ++i) {
+      std::fill(&Ge[nd*i], &Ge[nd*i]+nd, 0);
+      std::fill(&He[nd*nd*i], &He[nd*nd*i]+nd*nd, 0);
+      e.Gra(x, i, &Ge[nd*i]);
+      e.Hes(x, i, &He[nd*nd*i]);
+      project_psd(&He[nd*nd*i], nd, args.eig_floor);
+    }
+    const SparseMatrix<double> &H = asm_.gather(He, Ge, g);
+    solver.factorize(H);
+    if ( solver.info() != Success ) {
+      cerr << "[Error] projected hessian factorization failed\n";
+      return __LINE__;
+    }
+    const VectorXd dl = -solver.solve(g);
+    const double decrement = -g.dot(dl);
+    if ( args.verbose )
+      cout << "\t@iter " << iter << " energy: " << f << ", decrement: " << decrement << endl;
+    if ( decrement <= args.tolerance*std::fabs(f) ) {
+      if ( args.verbose )
+        cout << "\t@converged after " << iter << " iterations\n";
+      break;
+    }
+    for (size_t i = 0; i < dim; ++i)
+      d[i] = (g2l[i] == -1) ? 0.0 : dl[g2l[i]];
+
+    // backtrack from the largest admissible step
+    double t = std::min(1.0, 0.9*e.MaxStep(x, d.data()));
+    double fnew = f;
+    for ( ; t > 1e-16; t *= 0.5) {
+      xnew = X+t*d;
+      fnew = eval_energy(e, xnew.data());
+      if ( std::isfinite(fnew) && fnew < f && fnew <= f-1e-4*t*decrement )
+        break;
+    }
+    if ( t <= 1e-16 ) {
+      if ( args.verbose )
+        cout << "\t@line search stagnated\n";
+      break;
+    }
+    X = xnew;
+    f = fnew;
+  }
+  if ( args.verbose )
+    solver.report();
+  return 0;
+}
+
+double tri_flip_free_step(const mati_t &tris, const double *x, const double *d) {
+  double tmax = std::numeric_limits<double>::infinity();
+#pragma omp parallel for reduction(min:tmax)
+  for (size_t i = 0; i < tris.size(2); ++i) {
+    const size_t p = tris(0, i), q = tris(1, i), r = tris(2, i);
+    const double e1[2] = {x[2*q]-x[2*p], x[2*q+1]-x[2*p+1]};
+    const double e2[2] = {x[2*r]-x[2*p], x[2*r+1]-x[2*p+1]};
+    const double d1[2] = {d[2*q]-d[2*p], d[2*q+1]-d[2*p+1]};
+    const double d2[2] = {d[2*r]-d[2*p], d[2*r+1]-d[2*p+1]};
+    // det(e+t*d) = a*t^2+b*t+c, smallest positive root
+    const double a = d1[0]*d2[1]-d1[1]*d2[0];
+    const double b = e1[0]*d2[1]+d1[0]*e2[1]-e1[1]*d2[0]-d1[1]*e2[0];
+    const double c = e1[0]*e2[1]-e1[1]*e2[0];
+    double t = std::numeric_limits<double>::infinity();
+    if ( std::fabs(a) < 1e-14*(std::fabs(b)+std::fabs(c)) ) {
+      if ( b != 0 && -c/b > 0 )
+        t = -c/b;
+    } else {
+      const double delta = b*b-4*a*c;
+      if ( delta >= 0 ) {
+        const double sq = std::sqrt(delta);
+        // numerically stable pair of roots
+        const double qq = -0.5*(b+(b >= 0 ? sq : -sq));
+        const double t0 = qq/a, t1 = (qq != 0) ? c/qq : t0;
+        if ( t0 > 0 ) t = std::min(t, t0);
+        if ( t1 > 0 ) t = std::min(t, t1);
+      }
+    }
+    tmax = std::min(tmax, t);
+  }
+  return tmax;
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef PROJ_NEWTON_H
+#define PROJ_NEWTON_H
+
+#include <vector>
+#include <limits>
+#include <zjucad/matrix/matrix.h>
+
+namespace riemann {
+
+using mati_t=zjucad::matrix::matrix<size_t>;
+
+/// @brief energy summed over elements which each couple Nd() degrees of
+/// freedom, typically a generated val/jac/hes kernel per simplex.
+/// Element derivatives are dense and ordered as the dofs from Dof().
+class element_energy
+{
+public:
+  virtual ~element_energy() {}
+  virtual size_t Nx() const = 0;
+  virtual size_t Ne() const = 0;
+  virtual size_t Nd() const = 0;
+  virtual void Dof(const size_t i, size_t *dof) const = 0;
+  // the three below add into their output
+  virtual int Val(const double *x, const size_t i, double *val) const = 0;
+  virtual int Gra(const double *x, const size_t i, double *gra) const = 0;
+  /// column major Nd() x Nd()
+  virtual int Hes(const double *x, const size_t i, double *hes) const = 0;
+  /// largest t for which x+t*d stays admissible, e.g. no element flips
+  virtual double MaxStep(const double *x, const double *d) const {
+    return std::numeric_limits<double>::infinity();
+  }
+};
+
+struct proj_newton_args {
+  size_t maxiter;
+  double tolerance;   // stop when the Newton decrement drops below tolerance*|f|
+  double eig_floor;   // element eigenvalues are clamped to at least this
+  bool verbose;
+  proj_newton_args() : maxiter(50), tolerance(1e-8), eig_floor(1e-8), verbose(true) {}
+};
+
+/// @brief Newton's method with every element hessian projected to be
+/// positive definite, so each step is a descent direction even for non
+/// convex energies. The global hessian keeps one sparsity pattern whose
+/// symbolic factorization is reused, and steps never go beyond
+/// MaxStep(). Dofs listed in fixed keep their values.
+int proj_newton_solve(const element_energy &e, double *x,
+                      const std::vector<size_t> &fixed=std::vector<size_t>(),
+                      const proj_newton_args &args=proj_newton_args());
+
+/// largest t in (0, inf] before some triangle of the planar mesh x
+/// (2 x #vert) degenerates when moved along d
+double tri_flip_free_step(const mati_t &tris, const double *x, const double *d);
+
+}
+
+#endif
@@ -4,15 +4,15 @@
 #include <unordered_set>
 #include <zjucad/matrix/itr_matrix.h>
 #include <zjucad/matrix/io.h>
-#include <jtflib/mesh/mesh.h>
 
 #include "def.h"
+#include "sparse_assembler.h"
 #include "config.h"
+#include "mesh_topology.h"
 
 using namespace std;
 using namespace zjucad::matrix;
 using namespace Eigen;
-using jtf::mesh::edge2cell_adjacent;
 
 namespace riemann {
 
@@ -29,43 +29,36 @@ void calc_volume_jac_(double *jac, const double *x);
 
 }
 
-static void get_edge_elem(const mati_t &tris, mati_t &edge) {
-  edge2cell_adjacent *e2c = edge2cell_adjacent::create(tris, false);
-  edge.resize(2, e2c->edges_.size());
-#pragma omp parallel
-  for (size_t i = 0; i < edge.size(2); ++i) {
-    edge(0, i) = e2c->edges_[i].first;
-    edge(1, i) = e2c->edges_[i].second;
-  }
-  delete e2c;
+static void get_edge_elem(const mesh_topology &topo, mati_t &edge) {
+  edge = topo.edges();
 }
 
-static void get_diam_elem(const mati_t &tris, mati_t &diam) {
-  edge2cell_adjacent *ea = edge2cell_adjacent::create(tris, false);
-  mati_t bd_ed_id;
-  get_boundary_edge_idx(*ea, bd_ed_id);
-  diam.resize(4, ea->edges_.size()-bd_ed_id.size());
-  for(size_t ei = 0, di = 0; ei < ea->edges_.size(); ++ei) {
-    pair<size_t, size_t> nb_tr_id = ea->edge2cell_[ei];
-    if( ea->is_boundary_edge(nb_tr_id) ) continue;
-    diam(colon(1, 2), di) = ea->get_edge(ei);
+static void get_diam_elem(const mesh_topology &topo, mati_t &diam) {
+  const mati_t &tris = topo.cells(), &e2c = topo.facet2cell();
+  size_t inner = 0;
+  for (size_t ei = 0; ei < topo.edge_num(); ++ei)
+    inner += !topo.is_boundary_facet(ei);
+  diam.resize(4, inner);
+  for(size_t ei = 0, di = 0; ei < topo.edge_num(); ++ei) {
+    if( topo.is_boundary_facet(ei) ) continue;
+    const size_t nb_tr_id[2] = {e2c(0, ei), e2c(1, ei)};
+    diam(colon(1, 2), di) = topo.edges()(colon(), ei);
     // orient
     bool need_swap = true;
     for(size_t k = 0; k < 3; ++k) {
-      if( diam(1, di) == tris(k, nb_tr_id.first) ) {
-        if( diam(2, di) != tris((k+1)%3, nb_tr_id.first) )
+      if( diam(1, di) == tris(k, nb_tr_id[0]) ) {
+        if( diam(2, di) != tris((k+1)%3, nb_tr_id[0]) )
           need_swap = false;
       }
     }
     if( need_swap )
       swap(diam(1, di), diam(2, di));
-    diam(0, di) = zjucad::matrix::sum(tris(colon(), nb_tr_id.first))
+    diam(0, di) = zjucad::matrix::sum(tris(colon(), nb_tr_id[0]))
         - zjucad::matrix::sum(diam(colon(1, 2), di));
-    diam(3, di) = zjucad::matrix::sum(tris(colon(), nb_tr_id.second))
+    diam(3, di) = zjucad::matrix::sum(tris(colon(), nb_tr_id[1]))
         - zjucad::matrix::sum(diam(colon(1, 2), di));
     ++di;
   }
-  delete ea;
 }
 
 static inline double calc_tri_area(const matd_t &vert) {
@@ -109,10 +102,24 @@ public:
       matd_t grad = zeros<double>(6, 1);
       calc_edge_length_jac_(&grad[0], &vert[0]);
       grad *= w_/len_[i];
-      for (size_t j = 0; j < 6; ++j) {
-        if ( grad[j]*grad[j] != 0.0 )
-          jac->push_back(Triplet<double>(off+i, 3*edges_(j/3, i)+j%3, grad[j]));
-      }
+      for (size_t j = 0; j < 6; ++j)
+        jac->push_back(Triplet<double>(off+i, 3*edges_(j/3, i)+j%3, grad[j]));
+    }
+    return 0;
+  }
+  int JacNnz(size_t *nnz) const {
+    *nnz = 6*edges_.size(2);
+    return 0;
+  }
+  int JacVal(const double *x, double *val) const {
+    itr_matrix<const double *> X(3, Nx()/3, x);
+#pragma omp parallel for
+    for (size_t i = 0; i < edges_.size(2); ++i) {
+      matd_t vert = X(colon(), edges_(colon(), i));
+      std::fill(val+6*i, val+6*i+6, 0.0);
+      calc_edge_length_jac_(val+6*i, &vert[0]);
+      for (size_t j = 0; j < 6; ++j)
+        val[6*i+j] *= w_/len_[i];
     }
     return 0;
   }
@@ -164,10 +171,24 @@ public:
       matd_t grad = zeros<double>(12, 1);
       calc_dihedral_angle_jac_(&grad[0], &vert[0]);
       grad *= w_*len_[i]/sqrt(area_[i]);
-      for (size_t j = 0; j < 12; ++j) {
-        if ( grad[j]*grad[j] != 0.0 )
-          jac->push_back(Triplet<double>(off+i, 3*dias_(j/3, i)+j%3, grad[j]));
-      }
+      for (size_t j = 0; j < 12; ++j)
+        jac->push_back(Triplet<double>(off+i, 3*dias_(j/3, i)+j%3, grad[j]));
+    }
+    return 0;
+  }
+  int JacNnz(size_t *nnz) const {
+    *nnz = 12*dias_.size(2);
+    return 0;
+  }
+  int JacVal(const double *x, double *val) const {
+    itr_matrix<const double *> X(3, Nx()/3, x);
+#pragma omp parallel for
+    for (size_t i = 0; i < dias_.size(2); ++i) {
+      matd_t vert = X(colon(), dias_(colon(), i));
+      std::fill(val+12*i, val+12*i+12, 0.0);
+      calc_dihedral_angle_jac_(val+12*i, &vert[0]);
+      for (size_t j = 0; j < 12; ++j)
+        val[12*i+j] *= w_*len_[i]/sqrt(area_[i]);
     }
     return 0;
   }
@@ -220,6 +241,14 @@ public:
     }
     return 0;
   }
+  int JacNnz(size_t *nnz) const {
+    *nnz = Nf();
+    return 0;
+  }
+  int JacVal(const double *x, double *val) const {
+    std::fill(val, val+Nf(), w_);
+    return 0;
+  }
   void add(const size_t id, const double *coords) {
     pid_.insert(id);
     po_.segment<3>(3*id) = Vector3d(coords);
@@ -237,9 +266,11 @@ private:
 };
 //==============================================================================
 shell_deformer::shell_deformer(const mati_t &tris, const matd_t &nods, shell_args &args)
-  : args_(args) {
-  get_edge_elem(tris, edges_);
-  get_diam_elem(tris, diams_);
+  : args_(args), solver_("shell gauss-newton") {
+  // one topology serves both the stretch and the bending elements
+  shared_ptr<const mesh_topology> topo = mesh_topology::create(tris);
+  get_edge_elem(*topo, edges_);
+  get_diam_elem(*topo, diams_);
   cbf_.resize(3);
   cbf_[0] = make_shared<position_constraint>(nods, args_.wp);
   cbf_[1] = make_shared<stretch_constraint>(edges_, nods, args_.ws);
@@ -267,6 +298,7 @@ int shell_deformer::prepare() {
 int shell_deformer::solve(double *x) {
   Map<VectorXd> X(x, constraint_->Nx());
   VectorXd xstar = X, dx(constraint_->Nx());
+  fixed_pattern_assembler<double> jac_asm;
   // gauss-newton
   for (size_t iter = 0; iter < args_.max_iter; ++iter) {
     VectorXd fc = VectorXd::Zero(constraint_->Nf()); {
@@ -275,13 +307,9 @@ int shell_deformer::solve(double *x) {
         cout << "\t@iter " << iter << " error: " << fc.squaredNorm() << endl;
       }
     }
-    SparseMatrix<double> J(constraint_->Nf(), constraint_->Nx()); {
-      vector<Triplet<double>> trips;
-      constraint_->Jac(&xstar[0], 0, &trips);
-      J.reserve(trips.size());
-      J.setFromTriplets(trips.begin(), trips.end());
-    }
-    solver_.compute(J.transpose()*J);
+    jac_asm.assemble(*constraint_, &xstar[0]);
+    const SparseMatrix<double> &J = jac_asm.matrix();
+    solver_.factorize(J.transpose()*J);
     ASSERT(solver_.info() == Success);
     dx = -solver_.solve(J.transpose()*fc);
     ASSERT(solver_.info() == Success);
@@ -302,6 +330,7 @@ int shell_deformer::solve(double *x) {
     }
   }
   X = xstar;
+  solver_.report();
   return 0;
 }
 
@@ -4,6 +4,8 @@
 #include <zjucad/matrix/matrix.h>
 #include <Eigen/Sparse>
 
+#include "sparse_solver.h"
+
 using mati_t=zjucad::matrix::matrix<size_t>;
 using matd_t=zjucad::matrix::matrix<double>;
 
@@ -35,7 +37,7 @@ private:
   mati_t edges_, diams_;
   std::vector<std::shared_ptr<Constraint<double>>> cbf_;
   std::shared_ptr<Constraint<double>> constraint_;
-  Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>> solver_;
+  reusable_factorization<Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>>> solver_;
 };
 
 }
@@ -0,0 +1,165 @@
+#ifndef SPARSE_ASSEMBLER_H
+#define SPARSE_ASSEMBLER_H
+
+#include <Eigen/Sparse>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "def.h"
+
+namespace riemann {
+
+/// @brief assembles hessians/jacobians whose sparsity pattern does
+/// not change between iterations. The first call goes through triplets
+/// and records, for every entry of the compressed matrix, which element
+/// entries are summed into it. Later calls only write values, either
+/// from HesVal/JacVal when the energy supports it and reports the same
+/// HesPattern/JacPattern key as the recorded one, or from triplets whose
+/// positions match the recorded pattern.
+template <typename T>
+class fixed_pattern_assembler
+{
+public:
+  typedef Eigen::SparseMatrix<T> spmat_t;
+  fixed_pattern_assembler() : nnz_(0), key_(0), valid_(false) {}
+  void reset() {
+    valid_ = false;
+  }
+  const spmat_t &matrix() const {
+    return A_;
+  }
+  int assemble(const Functional<T> &e, const T *x) {
+    const size_t dim = e.Nx(), key = e.HesPattern();
+    size_t nnz = 0;
+    if ( is_reusable(dim, dim) && key == key_ && !e.HesNnz(&nnz) && nnz == nnz_ ) {
+      if ( !e.HesVal(x, val_.data()) ) {
+        gather();
+        return 0;
+      }
+    }
+    std::vector<Eigen::Triplet<T>> trips;
+    e.Hes(x, &trips);
+    return update(dim, dim, key, trips);
+  }
+  int assemble(const Constraint<T> &c, const T *x) {
+    const size_t rows = c.Nf(), cols = c.Nx(), key = c.JacPattern();
+    size_t nnz = 0;
+    if ( is_reusable(rows, cols) && key == key_ && !c.JacNnz(&nnz) && nnz == nnz_ ) {
+      if ( !c.JacVal(x, val_.data()) ) {
+        gather();
+        return 0;
+      }
+    }
+    std::vector<Eigen::Triplet<T>> trips;
+    c.Jac(x, 0, &trips);
+    return update(rows, cols, key, trips);
+  }
+private:
+  bool is_reusable(const size_t rows, const size_t cols) const {
+    return valid_ && A_.rows() == rows && A_.cols() == cols;
+  }
+  bool same_pattern(const std::vector<Eigen::Triplet<T>> &trips) const {
+    if ( trips.size() != nnz_ )
+      return false;
+    for (size_t k = 0; k < trips.size(); ++k) {
+      if ( trips[k].row() != row_[k] || trips[k].col() != col_[k] )
+        return false;
+    }
+    return true;
+  }
+  int update(const size_t rows, const size_t cols, const size_t key,
+             const std::vector<Eigen::Triplet<T>> &trips) {
+    key_ = key;
+    if ( is_reusable(rows, cols) && same_pattern(trips) ) {
+#pragma omp parallel for
+      for (size_t k = 0; k < trips.size(); ++k)
+        val_[k] = trips[k].value();
+      gather();
+      return 0;
+    }
+    build(rows, cols, trips);
+    return 0;
+  }
+  void build(const size_t rows, const size_t cols, const std::vector<Eigen::Triplet<T>> &trips) {
+    nnz_ = trips.size();
+    A_.resize(rows, cols);
+    A_.setFromTriplets(trips.begin(), trips.end());
+    A_.makeCompressed();
+
+    row_.resize(nnz_);
+    col_.resize(nnz_);
+    val_.resize(nnz_);
+    std::vector<int> slot(nnz_);
+    const int *outer = A_.outerIndexPtr();
+    const int *inner = A_.innerIndexPtr();
+#pragma omp parallel for
+    for (size_t k = 0; k < nnz_; ++k) {
+      row_[k] = trips[k].row();
+      col_[k] = trips[k].col();
+      val_[k] = trips[k].value();
+      const int *it = std::lower_bound(inner+outer[col_[k]], inner+outer[col_[k]+1], row_[k]);
+      slot[k] = it-inner;
+    }
+    // stable counting sort, duplicates are summed in the triplet order
+    slot_ptr_.assign(A_.nonZeros()+1, 0);
+    for (size_t k = 0; k < nnz_; ++k)
+      ++slot_ptr_[slot[k]+1];
+    std::partial_sum(slot_ptr_.begin(), slot_ptr_.end(), slot_ptr_.begin());
+    entry_.resize(nnz_);
+    std::vector<size_t> pos(slot_ptr_.begin(), slot_ptr_.end()-1);
+    for (size_t k = 0; k < nnz_; ++k)
+      entry_[pos[slot[k]]++] = k;
+    valid_ = true;
+  }
+  void gather() {
+    T *v = A_.valuePtr();
+#pragma omp parallel for
+    for (size_t s = 0; s < slot_ptr_.size()-1; ++s) {
+      T sum = 0;
+      for (size_t j = slot_ptr_[s]; j < slot_ptr_[s+1]; ++j)
+        sum += val_[entry_[j]];
+      v[s] = sum;
+    }
+  }
+
+  spmat_t A_;
+  size_t nnz_, key_;
+  bool valid_;
+  std::vector<int> row_, col_;
+  std::vector<size_t> slot_ptr_, entry_;
+  std::vector<T> val_;
+};
+
+/// prefix sums of per-element entry counts, for energies that drop the
+/// structural zeros of a constant element hessian
+template <class Count>
+void calc_elem_nnz_ptr(const size_t nbr_elem, Count &&count, std::vector<size_t> &ptr) {
+  ptr.resize(nbr_elem+1);
+  ptr[0] = 0;
+#pragma omp parallel for
+  for (size_t i = 0; i < nbr_elem; ++i)
+    ptr[i+1] = count(i);
+  std::partial_sum(ptr.begin(), ptr.end(), ptr.begin());
+}
+
+/// visits the nonzeros of a column-major n-by-n element hessian in the
+/// order Hes, HesNnz and HesVal all rely on, returns how many it visited
+template <class Visit>
+size_t for_each_elem_nz(const double *H, const size_t n, Visit &&visit) {
+  size_t cnt = 0;
+  for (size_t p = 0; p < n; ++p) {
+    for (size_t q = 0; q < n; ++q) {
+      const double h = H[p+n*q];
+      if ( h != 0.0 ) {
+        visit(p, q, h);
+        ++cnt;
+      }
+    }
+  }
+  return cnt;
+}
+
+}
+
+#endif
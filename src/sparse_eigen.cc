@@ -0,0 +1,317 @@
+#include "sparse_eigen.h"
+
+#include <iostream>
+#include <random>
+#include <numeric>
+#include <cmath>
+
+using namespace std;
+using namespace Eigen;
+
+namespace riemann {
+
+shift_invert_eigensolver::shift_invert_eigensolver(const string &name)
+    : name_(name), normK_(0), normM_(0), stale_(false), solver_(name+" shifted"), iter_(0), nsolve_(0) {}
+
+int shift_invert_eigensolver::compute(const SparseMatrix<double> &K, const VectorXd *M,
+                                      const eigen_args &args) {
+  if ( K.rows() != K.cols() || (M && M->size() != K.cols()) ) {
+    cerr << "[Error] eigen problem of inconsistent size\n";
+    return __LINE__;
+  }
+  if ( M && M->minCoeff() <= 0 ) {
+    cerr << "[Error] eigen problem with non positive mass\n";
+    return __LINE__;
+  }
+  args_ = args;
+  M_ = M ? *M : VectorXd::Ones(K.cols());
+  normM_ = M_.maxCoeff();
+  set_matrix(K);
+  return factorize();
+}
+
+int shift_invert_eigensolver::update(const SparseMatrix<double> &K) {
+  if ( K.rows() != K_.rows() || K.cols() != K_.cols() ) {
+    cerr << "[Error] eigen problem changed its size\n";
+    return __LINE__;
+  }
+  set_matrix(K);
+  stale_ = true;
+  return 0;
+}
+
+void shift_invert_eigensolver::set_matrix(const SparseMatrix<double> &K) {
+  K_ = K;
+  K_.makeCompressed();
+  // K is symmetric, its largest column sum is the infinity norm
+  normK_ = 0;
+  for (size_t j = 0; j < K_.outerSize(); ++j) {
+    double sum = 0;
+    for (SparseMatrix<double>::InnerIterator it(K_, j); it; ++it)
+      sum += fabs(it.value());
+    normK_ = std::max(normK_, sum);
+  }
+}
+
+int shift_invert_eigensolver::set_args(const eigen_args &args) {
+  const bool shifted = (args.sigma != args_.sigma);
+  args_ = args;
+  return shifted ? factorize() : 0;
+}
+
+int shift_invert_eigensolver::factorize() {
+  const size_t n = K_.cols();
+  vector<Triplet<double>> trips;
+  trips.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+    trips.push_back(Triplet<double>(i, i, -args_.sigma*M_[i]));
+  SparseMatrix<double> A(n, n);
+  A.setFromTriplets(trips.begin(), trips.end());
+  A += K_;
+  if ( solver_.factorize(A) ) {
+    cerr << "[Error] factorization of K-sigma*M failed, sigma=" << args_.sigma << endl;
+    return __LINE__;
+  }
+  stale_ = false;
+  return 0;
+}
+
+/// (K-sigma*M)^{-1}M, self-adjoint in the M inner product
+void shift_invert_eigensolver::apply_op(const VectorXd &x, VectorXd &y) {
+  y = solver_.solve(M_.cwiseProduct(x));
+  ++nsolve_;
+}
+
+/// columns of guess first, the rest from a fixed seed so runs repeat
+void shift_invert_eigensolver::init_block(const MatrixXd *guess, const size_t cols, MatrixXd &X) {
+  const size_t n = K_.cols();
+  X.resize(n, cols);
+  size_t c = 0;
+  if ( guess && guess->rows() == n )
+    for ( ; c < cols && c < guess->cols(); ++c)
+      X.col(c) = guess->col(c);
+  std::mt19937 gen(5489u);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  for ( ; c < cols; ++c)
+    for (size_t i = 0; i < n; ++i)
+      X(i, c) = dist(gen);
+}
+
+/// M-orthonormal basis of span(S) with nearly dependent directions
+/// dropped, the second pass restores the orthogonality lost to rounding
+size_t shift_invert_eigensolver::orthonormalize(MatrixXd &S) const {
+  for (size_t pass = 0; pass < 2; ++pass) {
+    VectorXd scale(S.cols());
+    for (size_t i = 0; i < S.cols(); ++i) {
+      const double nrm = sqrt(S.col(i).dot(M_.cwiseProduct(S.col(i))));
+      scale[i] = nrm > 0 ? 1.0/nrm : 0.0;
+    }
+    S = (S*scale.asDiagonal()).eval();
+    const MatrixXd G = S.transpose()*M_.asDiagonal()*S;
+    SelfAdjointEigenSolver<MatrixXd> eig(G);
+    const VectorXd &d = eig.eigenvalues();
+    const double floor = 1e-10*d.maxCoeff();
+    size_t r = 0;
+    for ( ; r < d.size() && d[d.size()-1-r] > floor; ++r);
+    MatrixXd U = eig.eigenvectors().rightCols(r);
+    for (size_t i = 0; i < r; ++i)
+      U.col(i) /= sqrt(d[d.size()-r+i]);
+    S = (S*U).eval();
+  }
+  return S.cols();
+}
+
+double shift_invert_eigensolver::check_residual(const MatrixXd &X, const VectorXd &lambda,
+                                                VectorXd &res, MatrixXd *R) const {
+  MatrixXd KX = K_*X;
+  res.resize(X.cols());
+#pragma omp parallel for
+  for (size_t i = 0; i < X.cols(); ++i) {
+    KX.col(i) -= lambda[i]*M_.cwiseProduct(X.col(i));
+    res[i] = KX.col(i).norm()/((normK_+fabs(lambda[i])*normM_)*X.col(i).norm());
+  }
+  if ( R )
+    R->swap(KX);
+  return res.maxCoeff();
+}
+
+int shift_invert_eigensolver::solve(const MatrixXd *guess) {
+  const size_t n = K_.cols();
+  if ( args_.k == 0 || args_.k >= n ) {
+    cerr << "[Error] can not ask for " << args_.k << " eigenpairs of dimension " << n << endl;
+    return __LINE__;
+  }
+  if ( args_.method == EIG_LOBPCG && args_.which != EIG_SMALLEST ) {
+    cerr << "[Error] LOBPCG only computes the smallest eigenpairs\n";
+    return __LINE__;
+  }
+  if ( args_.method == EIG_LANCZOS && stale_ && factorize() )
+    return __LINE__;
+  if ( !guess && args_.warm_start && evec_.rows() == n )
+    guess = &evec_;
+  nsolve_ = 0;
+  return args_.method == EIG_LOBPCG ? solve_lobpcg(guess) : solve_lanczos(guess);
+}
+
+int shift_invert_eigensolver::solve_lanczos(const MatrixXd *guess) {
+  const size_t n = K_.cols(), k = args_.k;
+  const size_t m = std::min(n, args_.ncv ? std::max(args_.ncv, k+1) : std::max(2*k+1, k+8));
+  // after a restart the best p Ritz vectors span the new basis
+  const size_t p = std::min(m-1, k+(m-k)/2);
+  auto mnorm = [&](const VectorXd &v) { return sqrt(v.dot(M_.cwiseProduct(v))); };
+
+  MatrixXd Q(n, m+1), H = MatrixXd::Zero(m+1, m+1);
+  // a blend of the guesses keeps a component along each of them
+  MatrixXd V;
+  init_block(nullptr, 1, V);
+  if ( guess && guess->rows() == n && guess->cols() > 0 ) {
+    VectorXd g = VectorXd::Zero(n);
+    for (size_t c = 0; c < guess->cols(); ++c)
+      if ( mnorm(guess->col(c)) > 0 )
+        g += guess->col(c)/mnorm(guess->col(c));
+    if ( mnorm(g) > 0 )
+      V.col(0) = g+1e-3*mnorm(g)/mnorm(V.col(0))*V.col(0);
+  }
+  Q.col(0) = V.col(0)/mnorm(V.col(0));
+
+  std::mt19937 gen(5489u);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  VectorXd w, h, theta;
+  MatrixXd S;
+  size_t j0 = 0;
+  double err = 0;
+  for (iter_ = 1; iter_ <= args_.maxiter; ++iter_) {
+    for (size_t j = j0; j < m; ++j) {
+      apply_op(Q.col(j), w);
+      const double wnorm = mnorm(w);
+      // full orthogonalization, classical Gram-Schmidt applied twice
+      h = Q.leftCols(j+1).transpose()*M_.cwiseProduct(w);
+      w -= Q.leftCols(j+1)*h;
+      VectorXd dh = Q.leftCols(j+1).transpose()*M_.cwiseProduct(w);
+      w -= Q.leftCols(j+1)*dh;
+      h += dh;
+      H.block(0, j, j+1, 1) = h;
+      H.block(j, 0, 1, j+1) = h.transpose();
+      double beta = mnorm(w);
+      if ( beta <= 1e-12*wnorm ) {
+        // invariant subspace, go on along a fresh direction if any is left
+        Q.col(j+1).setZero();
+        if ( j+1 < n ) {
+          for (size_t i = 0; i < n; ++i)
+            w[i] = dist(gen);
+          for (size_t pass = 0; pass < 2; ++pass)
+            w -= Q.leftCols(j+1)*(Q.leftCols(j+1).transpose()*M_.cwiseProduct(w));
+          Q.col(j+1) = w/mnorm(w);
+        }
+        beta = 0;
+      } else {
+        Q.col(j+1) = w/beta;
+      }
+      H(j+1, j) = H(j, j+1) = beta;
+    }
+
+    // Ritz pairs, theta = 1/(lambda-sigma)
+    SelfAdjointEigenSolver<MatrixXd> eig(H.topLeftCorner(m, m));
+    vector<size_t> idx(m);
+    std::iota(idx.begin(), idx.end(), 0);
+    const VectorXd &t = eig.eigenvalues();
+    if ( args_.which == EIG_SMALLEST )
+      std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b) { return t[a] > t[b]; });
+    else
+      std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b) { return fabs(t[a]) > fabs(t[b]); });
+    S.resize(m, p);
+    theta.resize(p);
+    for (size_t i = 0; i < p; ++i) {
+      S.col(i) = eig.eigenvectors().col(idx[i]);
+      theta[i] = t[idx[i]];
+    }
+    evec_ = Q.leftCols(m)*S.leftCols(k);
+    eval_.resize(k);
+    for (size_t i = 0; i < k; ++i)
+      eval_[i] = args_.sigma+1.0/theta[i];
+    err = check_residual(evec_, eval_, res_);
+    if ( args_.verbose )
+      printf("\t@lanczos cycle %zu, %zu solves, max residual %e\n", iter_, nsolve_, err);
+    if ( err <= args_.tolerance )
+      break;
+
+    // thick restart, Op*Q_p = Q_p*diag(theta)+beta*q_m*S(m-1, :)
+    const double beta = H(m, m-1);
+    MatrixXd QS = Q.leftCols(m)*S;
+    Q.leftCols(p) = QS;
+    Q.col(p) = Q.col(m);
+    H.setZero();
+    for (size_t i = 0; i < p; ++i) {
+      H(i, i) = theta[i];
+      H(p, i) = H(i, p) = beta*S(m-1, i);
+    }
+    j0 = p;
+  }
+  if ( err > args_.tolerance ) {
+    iter_ = args_.maxiter;
+    cerr << "[Warning] lanczos not converged, max residual " << err << endl;
+    return __LINE__;
+  }
+  return 0;
+}
+
+int shift_invert_eigensolver::solve_lobpcg(const MatrixXd *guess) {
+  const size_t k = args_.k;
+  MatrixXd X, W, P, R, S;
+  init_block(guess, k, X);
+  P.resize(X.rows(), 0);
+  if ( orthonormalize(X) < k ) {
+    init_block(nullptr, k, X);
+    orthonormalize(X);
+  }
+  auto rayleigh_ritz = [&](MatrixXd &Z) {
+    SelfAdjointEigenSolver<MatrixXd> eig(Z.transpose()*(K_*Z));
+    eval_ = eig.eigenvalues().head(k);
+    return (Z*eig.eigenvectors().leftCols(k)).eval();
+  };
+  X = rayleigh_ritz(X);
+
+  double err = 0;
+  for (iter_ = 1; iter_ <= args_.maxiter; ++iter_) {
+    err = check_residual(X, eval_, res_, &R);
+    if ( args_.verbose )
+      printf("\t@lobpcg iter %zu, %zu solves, max residual %e\n", iter_, nsolve_, err);
+    if ( err <= args_.tolerance )
+      break;
+    // precondition the residuals of the pairs not yet converged only
+    vector<size_t> active;
+    for (size_t i = 0; i < k; ++i)
+      if ( res_[i] > args_.tolerance )
+        active.push_back(i);
+    W.resize(X.rows(), active.size());
+    for (size_t i = 0; i < active.size(); ++i) {
+      W.col(i) = solver_.solve(R.col(active[i]));
+      ++nsolve_;
+    }
+    S.resize(X.rows(), X.cols()+W.cols()+P.cols());
+    S << X, W, P;
+    if ( orthonormalize(S) < k ) {
+      cerr << "[Warning] lobpcg basis collapsed\n";
+      break;
+    }
+    MatrixXd Xn = rayleigh_ritz(S);
+    // implicit search direction, spans the same space as the W and P parts
+    P = Xn-X*(X.transpose()*M_.asDiagonal()*Xn);
+    X.swap(Xn);
+  }
+  evec_ = X;
+  if ( err > args_.tolerance ) {
+    iter_ = std::min(iter_, args_.maxiter);
+    cerr << "[Warning] lobpcg not converged, max residual " << err << endl;
+    return __LINE__;
+  }
+  return 0;
+}
+
+void shift_invert_eigensolver::report() const {
+  printf("[info] %s: %zu iterations, %zu shifted solves, max residual %e\n",
+         name_.c_str(), iter_, nsolve_, res_.size() ? res_.maxCoeff() : 0.0);
+  solver_.report();
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef SPARSE_EIGEN_H
+#define SPARSE_EIGEN_H
+
+#include <string>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "sparse_solver.h"
+
+namespace riemann {
+
+enum eigen_method {
+  EIG_LANCZOS,    // thick restarted shift-invert Lanczos
+  EIG_LOBPCG      // block LOBPCG preconditioned by the shifted factorization
+};
+
+enum eigen_which {
+  EIG_SMALLEST,   // k smallest eigenvalues, sigma must lie below them
+  EIG_NEAREST     // k eigenvalues nearest to sigma, Lanczos only
+};
+
+struct eigen_args {
+  size_t k;
+  double sigma;      // shift of the factorized K-sigma*M
+  eigen_method method;
+  eigen_which which;
+  double tolerance;  // on |Kx-lambda*Mx|/((|K|+|lambda||M|)|x|)
+  size_t maxiter;    // restart cycles of Lanczos, block iterations of LOBPCG
+  size_t ncv;        // Lanczos basis size, 0 picks one from k
+  bool warm_start;   // start from the last eigenvectors if any
+  bool verbose;
+  // the default shift keeps a semi-definite K with a kernel factorizable
+  eigen_args() : k(1), sigma(-1e-8), method(EIG_LANCZOS), which(EIG_SMALLEST),
+                 tolerance(1e-8), maxiter(300), ncv(0), warm_start(true), verbose(true) {}
+};
+
+/**
+ * @brief eigenpairs of K x = lambda M x for a symmetric sparse K and a
+ * diagonal positive M, the identity when omitted.
+ *
+ * K-sigma*M is factorized once by compute() and kept across calls, so a
+ * sequence of solves on the same matrices, e.g. with changing k or
+ * starting vectors, only pays for the triangular solves. Both methods
+ * stop on the true residuals of all k pairs. Eigenvectors are returned
+ * M-orthonormal and sorted by eigenvalue, or by distance to sigma.
+ */
+class shift_invert_eigensolver
+{
+public:
+  explicit shift_invert_eigensolver(const std::string &name="eigen solver");
+  int compute(const Eigen::SparseMatrix<double> &K, const Eigen::VectorXd *M=nullptr,
+              const eigen_args &args=eigen_args());
+  /// replaces K by a nearby matrix of the same size but keeps the old
+  /// factorization, which still preconditions LOBPCG well, Lanczos
+  /// refactorizes on the next solve()
+  int update(const Eigen::SparseMatrix<double> &K);
+  /// factorizes K-sigma*M of the current K
+  int factorize();
+  /// guess (n x any) overrides the warm start from the last solve
+  int solve(const Eigen::MatrixXd *guess=nullptr);
+  /// refactorizes only if the shift changes
+  int set_args(const eigen_args &args);
+  const eigen_args &args() const { return args_; }
+  const Eigen::VectorXd &eigenvalues() const { return eval_; }
+  const Eigen::MatrixXd &eigenvectors() const { return evec_; }
+  const Eigen::VectorXd &residuals() const { return res_; }
+  size_t iterations() const { return iter_; }
+  void report() const;
+private:
+  void set_matrix(const Eigen::SparseMatrix<double> &K);
+  void apply_op(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+  void init_block(const Eigen::MatrixXd *guess, const size_t cols, Eigen::MatrixXd &X);
+  size_t orthonormalize(Eigen::MatrixXd &S) const;
+  double check_residual(const Eigen::MatrixXd &X, const Eigen::VectorXd &lambda,
+                        Eigen::VectorXd &res, Eigen::MatrixXd *R=nullptr) const;
+  int solve_lanczos(const Eigen::MatrixXd *guess);
+  int solve_lobpcg(const Eigen::MatrixXd *guess);
+private:
+  const std::string name_;
+  eigen_args args_;
+  Eigen::SparseMatrix<double> K_;
+  Eigen::VectorXd M_;
+  double normK_, normM_;
+  bool stale_;
+  reusable_factorization<Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>>> solver_;
+
+  Eigen::VectorXd eval_, res_;
+  Eigen::MatrixXd evec_;
+  size_t iter_, nsolve_;
+};
+
+}
+
+#endif
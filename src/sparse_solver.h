@@ -0,0 +1,109 @@
+#ifndef SPARSE_SOLVER_H
+#define SPARSE_SOLVER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <Eigen/Sparse>
+
+#include "timer.h"
+
+namespace riemann {
+
+/// @brief wraps an Eigen sparse direct solver for a sequence of systems
+/// sharing one sparsity pattern, as in Newton and Gauss-Newton loops.
+/// Ordering and symbolic analysis run only when the pattern changes,
+/// the numeric factorization only when the values change. Time spent
+/// in each phase is accumulated and printed by report().
+template <class Solver>
+class reusable_factorization
+{
+public:
+  typedef typename Solver::MatrixType spmat_t;
+  typedef typename spmat_t::Scalar scalar_t;
+  typedef typename spmat_t::StorageIndex index_t;
+
+  explicit reusable_factorization(const std::string &name="sparse solver")
+      : name_(name), analyzed_(false), factorized_(false) {
+    std::fill(time_, time_+3, 0.0);
+    std::fill(count_, count_+3, 0);
+  }
+  Solver &solver() {
+    return sol_;
+  }
+  Eigen::ComputationInfo info() const {
+    return sol_.info();
+  }
+  /// forces a fresh symbolic analysis on the next factorize()
+  void reset() {
+    analyzed_ = factorized_ = false;
+  }
+  int factorize(const spmat_t &A) {
+    if ( !A.isCompressed() ) {
+      spmat_t cA = A;
+      cA.makeCompressed();
+      return factorize(cA);
+    }
+    high_resolution_timer clk;
+    if ( !analyzed_ || !same_pattern(A) ) {
+      clk.start();
+      sol_.analyzePattern(A);
+      clk.stop();
+      tick(SYMBOLIC, clk.period());
+      outer_.assign(A.outerIndexPtr(), A.outerIndexPtr()+A.outerSize()+1);
+      inner_.assign(A.innerIndexPtr(), A.innerIndexPtr()+A.nonZeros());
+      rows_ = A.rows();
+      analyzed_ = true;
+      factorized_ = false;
+    } else if ( factorized_ && std::equal(A.valuePtr(), A.valuePtr()+A.nonZeros(), value_.begin()) ) {
+      return 0;
+    }
+    clk.start();
+    sol_.factorize(A);
+    clk.stop();
+    tick(NUMERIC, clk.period());
+    value_.assign(A.valuePtr(), A.valuePtr()+A.nonZeros());
+    factorized_ = (sol_.info() == Eigen::Success);
+    return factorized_ ? 0 : __LINE__;
+  }
+  template <class Rhs>
+  Eigen::Matrix<scalar_t, Eigen::Dynamic, Rhs::ColsAtCompileTime>
+  solve(const Eigen::MatrixBase<Rhs> &b) {
+    high_resolution_timer clk;
+    clk.start();
+    Eigen::Matrix<scalar_t, Eigen::Dynamic, Rhs::ColsAtCompileTime> x = sol_.solve(b);
+    clk.stop();
+    tick(SOLVE, clk.period());
+    return x;
+  }
+  void report() const {
+    printf("[info] %s: symbolic %zu x %.3lf ms, numeric %zu x %.3lf ms, solve %zu x %.3lf ms\n",
+           name_.c_str(), count_[SYMBOLIC], time_[SYMBOLIC], count_[NUMERIC], time_[NUMERIC],
+           count_[SOLVE], time_[SOLVE]);
+  }
+private:
+  enum { SYMBOLIC, NUMERIC, SOLVE };
+  void tick(const int phase, const double msec) {
+    time_[phase] += msec;
+    ++count_[phase];
+  }
+  bool same_pattern(const spmat_t &A) const {
+    return A.rows() == rows_ && A.outerSize()+1 == outer_.size() && A.nonZeros() == inner_.size()
+        && std::equal(outer_.begin(), outer_.end(), A.outerIndexPtr())
+        && std::equal(inner_.begin(), inner_.end(), A.innerIndexPtr());
+  }
+
+  const std::string name_;
+  Solver sol_;
+  bool analyzed_, factorized_;
+  Eigen::Index rows_;
+  std::vector<index_t> outer_, inner_;
+  std::vector<scalar_t> value_;
+  double time_[3];
+  size_t count_[3];
+};
+
+}
+
+#endif
@@ -1,13 +1,13 @@
 #include "spin_trans.h"
 
 #include <iostream>
+#include <numeric>
 #include <jtflib/mesh/util.h>
 #include <jtflib/mesh/mesh.h>
 #include <zjucad/matrix/io.h>
 
 #include "config.h"
 #include "util.h"
-#include "arpaca.h"
 #include "cotmatrix.h"
 
 using namespace std;
@@ -55,23 +55,45 @@ static inline Vector4d quat_prod(const Vector4d &a, const Vector4d &b) {
 /// ATTENTION: NODE IS 4xN MATRIX -
 /// -------------------------------
 spin_trans::spin_trans(const mati_t &tris, const matd_t &nods)
-  : tris_(tris), nods_(nods) {
+  : tris_(tris), nods_(nods), solver_("spin poisson"), eig_("spin eigen"), eig_ready_(false) {
   ASSERT(nods_.size(1) == 4);
-  Mf_.setZero(4*tris_.size(2));
+  solver_.solver().setMode(SimplicialCholeskyLLT);
+  const size_t nf = tris_.size(2);
+  Mf_.setZero(4*nf);
   Mv_.setZero(4*nods_.size(2));
-  for (size_t i = 0; i < tris_.size(2); ++i) {
-    matd_t vert = nods_(colon(1, 3), tris_(colon(), i));
-    const double area = jtf::mesh::cal_face_area(vert);
+  edge_.resize(NoChange, 3*nf);
+  cot_.resize(3*nf);
+  for (size_t i = 0; i < nf; ++i) {
+    matd_t vert = nods_(colon(), tris_(colon(), i));
+    matd_t xyz = vert(colon(1, 3), colon());
+    const double area = jtf::mesh::cal_face_area(xyz);
     Mf_.segment<4>(4*i) = area*Vector4d::Ones();
-    Mv_.segment<4>(4*tris_(0, i)) += area/3*Vector4d::Ones();
-    Mv_.segment<4>(4*tris_(1, i)) += area/3*Vector4d::Ones();
-    Mv_.segment<4>(4*tris_(2, i)) += area/3*Vector4d::Ones();
+    for (size_t j = 0; j < 3; ++j) {
+      const size_t p = (j+1)%3, q = (j+2)%3;
+      Mv_.segment<4>(4*tris_(j, i)) += area/3*Vector4d::Ones();
+      for (size_t k = 0; k < 4; ++k)
+        edge_(k, 3*i+j) = vert(k, q)-vert(k, p);
+      cot_[3*i+j] = cal_cot_val(&vert(1, q), &vert(1, j), &vert(1, p));
+    }
   }
-  rho_ = zeros<double>(tris_.size(2), 1);
+  rho_ = zeros<double>(nf, 1);
+  build_eigen_pattern();
+
   cotmatrix(tris_, nods_(colon(1, 3), colon()), 4, &L_);
   L_ *= -1; // make it semi-positive definite
-  build_dirac_operator(Dirac_);
-  ASSERT(Dirac_.cols() == L_.cols());
+  // fix the first point to remove the kernel of Laplacian
+  g2l_.resize(L_.cols());
+  size_t cnt = 0;
+  for (size_t i = 0; i < g2l_.size(); ++i) {
+    if ( i/4 == 0 )
+      g2l_[i] = -1;
+    else
+      g2l_[i] = cnt++;
+  }
+  Lr_ = L_;
+  rm_spmat_col_row(Lr_, g2l_);
+  solver_.factorize(Lr_);
+  ASSERT(solver_.info() == Success);
 }
 
 void spin_trans::set_curvature_change(const matd_t &delta) {
@@ -79,36 +101,101 @@ void spin_trans::set_curvature_change(const matd_t &delta) {
   rho_ = delta;
 }
 
-void spin_trans::build_dirac_operator(SparseMatrix<double> &D) {
+void spin_trans::set_curvature_change(const size_t face, const double delta) {
+  ASSERT(face < tris_.size(2));
+  rho_[face] = delta;
+}
+
+/// the rows of D-rho of face i, one 4x4 block per corner
+void spin_trans::dirac_block(const size_t i, const double rho, Matrix<double, 4, 12> &A) const {
+  const double w = -0.5/Mf_[4*i];
+  for (size_t j = 0; j < 3; ++j) {
+    Map<Matrix4d> H(A.data()+16*j);
+    conv_quat_to_mat(&edge_(0, 3*i+j), H.data());
+    H *= w;
+    H.diagonal().array() -= rho/3.0;
+  }
+}
+
+void spin_trans::build_eigen_pattern() {
+  const size_t nf = tris_.size(2);
   vector<Triplet<double>> trips;
-  for (size_t i = 0; i < tris_.size(2); ++i) {
-    const double w = -0.5/Mf_[4*i];
-    for (size_t j = 0; j < 3; ++j) {
-      matd_t ej = nods_(colon(), tris_((j+2)%3, i))-nods_(colon(), tris_((j+1)%3, i));
-      matd_t H = zeros<double>(4, 4);
-      conv_quat_to_mat(&ej[0], &H[0]);
-      H *= w;
-      insert_block(4*i, 4*tris_(j, i), &H[0], 4, 4, &trips);
+  trips.reserve(144*nf);
+  for (size_t i = 0; i < nf; ++i)
+    for (size_t a = 0; a < 3; ++a)
+      for (size_t b = 0; b < 3; ++b)
+        for (size_t c = 0; c < 4; ++c)
+          for (size_t r = 0; r < 4; ++r)
+            trips.push_back(Triplet<double>(4*tris_(a, i)+r, 4*tris_(b, i)+c, 0));
+  K_.resize(nods_.size(), nods_.size());
+  K_.setFromTriplets(trips.begin(), trips.end());
+  K_.makeCompressed();
+
+  // the 4 rows of a block column are consecutive, one slot per column
+  const int *outer = K_.outerIndexPtr(), *inner = K_.innerIndexPtr();
+  kslot_.resize(36*nf);
+#pragma omp parallel for
+  for (size_t i = 0; i < nf; ++i) {
+    for (size_t a = 0; a < 3; ++a) {
+      for (size_t b = 0; b < 3; ++b) {
+        for (size_t c = 0; c < 4; ++c) {
+          const int col = 4*tris_(b, i)+c;
+          const int *it = std::lower_bound(inner+outer[col], inner+outer[col+1], (int)(4*tris_(a, i)));
+          kslot_[36*i+12*a+4*b+c] = it-inner;
+        }
+      }
     }
   }
-  D.resize(4*tris_.size(2), nods_.size());
-  D.reserve(trips.size());
-  D.setFromTriplets(trips.begin(), trips.end());
+  rho_done_.clear();
 }
 
-void spin_trans::build_rho_operator(SparseMatrix<double> &R) {
-  vector<Triplet<double>> trips;
-  for (size_t i = 0; i < tris_.size(2); ++i) {
-    const double w = rho_[i]/3.0;
-    if ( w != 0.0 ) {
-      add_diag_block<double, 4>(i, tris_(0, i), w, &trips);
-      add_diag_block<double, 4>(i, tris_(1, i), w, &trips);
-      add_diag_block<double, 4>(i, tris_(2, i), w, &trips);
+/// brings K_ to the current rho, only faces whose rho moved are touched
+/// unless most of them did
+void spin_trans::update_eigen_prob() {
+  const size_t nf = tris_.size(2);
+  vector<size_t> dirty;
+  const bool rebuild = rho_done_.empty();
+  for (size_t i = 0; i < nf; ++i)
+    if ( rebuild || rho_[i] != rho_done_[i] )
+      dirty.push_back(i);
+  if ( dirty.empty() )
+    return;
+  const bool full = rebuild || 4*dirty.size() > nf;
+  if ( full ) {
+    dirty.resize(nf);
+    std::iota(dirty.begin(), dirty.end(), 0);
+    std::fill(K_.valuePtr(), K_.valuePtr()+K_.nonZeros(), 0.0);
+    rho_done_.assign(nf, 0.0);
+  }
+
+  // face contributions in parallel, scattered in chunks
+  const size_t chunk = 4096;
+  vector<Matrix<double, 12, 12>, aligned_allocator<Matrix<double, 12, 12>>> dK(std::min(chunk, dirty.size()));
+  double *val = K_.valuePtr();
+  for (size_t beg = 0; beg < dirty.size(); beg += chunk) {
+    const size_t end = std::min(beg+chunk, dirty.size());
+#pragma omp parallel for
+    for (size_t k = beg; k < end; ++k) {
+      const size_t i = dirty[k];
+      Matrix<double, 4, 12> A;
+      dirac_block(i, rho_[i], A);
+      dK[k-beg] = Mf_[4*i]*A.transpose()*A;
+      if ( !full ) {
+        dirac_block(i, rho_done_[i], A);
+        dK[k-beg] -= Mf_[4*i]*A.transpose()*A;
+      }
+    }
+    for (size_t k = beg; k < end; ++k) {
+      const int *slot = &kslot_[36*dirty[k]];
+      for (size_t a = 0; a < 3; ++a)
+        for (size_t b = 0; b < 3; ++b)
+          for (size_t c = 0; c < 4; ++c)
+            for (size_t r = 0; r < 4; ++r)
+              val[slot[12*a+4*b+c]+r] += dK[k-beg](4*a+r, 4*b+c);
     }
   }
-  R.resize(4*tris_.size(2), nods_.size());
-  R.reserve(trips.size());
-  R.setFromTriplets(trips.begin(), trips.end());
+  for (auto &i : dirty)
+    rho_done_[i] = rho_[i];
 }
 
 int spin_trans::solve_eigen_prob(VectorXd &lambda) {
@@ -116,71 +203,51 @@ int spin_trans::solve_eigen_prob(VectorXd &lambda) {
   /// arbitrary $\rho$, we solve an eigenvalue problem to find
   /// the smallest shift s.t. $(D-\rho)\lambda=\gamma\lambda$
   cout << "[INFO] solve for similarity field\n";
-  build_rho_operator(R_);
-  ASSERT(R_.cols() == L_.cols());
-  SparseMatrix<double> A = Dirac_-R_;
-  VectorXd V = Mv_.cwiseSqrt().cwiseInverse();
-  SparseMatrix<double> LHS = (A*V.asDiagonal()).transpose()*Mf_.asDiagonal()*A*V.asDiagonal();
-  if ( !is_symm(LHS) ) {
-    cerr << "[INFO] unsymmetric matrix for eigen solve\n";
+  update_eigen_prob();
+  if ( !eig_ready_ ) {
+    eigen_args args;
+    args.method = EIG_LOBPCG;
+    args.maxiter = 30;
+    args.verbose = false;
+    if ( eig_.compute(K_, &Mv_, args) )
+      return __LINE__;
+    eig_ready_ = true;
+  } else if ( eig_.update(K_) ) {
     return __LINE__;
   }
-  arpaca::SymmetricEigenSolver<double> solver;
-  solver.SetEigenvalueType(arpaca::MAGNITUDE_SMALLEST);
-  solver.SetMaxIterations(20000);
-  solver.SetNumLanczosVectors(0);
-  solver.SetTolerance(-1);
-  solver.Solve(LHS.cols(), 10, arpaca::MakeDefaultOperator(LHS));
-  printf("[INFO] arpack %d iter, %d converged, %s\n",
-         solver.num_actual_iterations(), solver.num_converged_eigenvalues(), solver.GetInfo());
-  ASSERT(V.size() == solver.eigenvectors().rows());
-  cout << "[INFO] global constant shift: " << solver.eigenvalues()[0] << endl;
-  lambda = V.asDiagonal()*solver.eigenvectors().col(0);
-  return 0;
-}
-
-int spin_trans::solve_eigen_prob_inv_power(VectorXd &lambda) {
-  cout << "[INFO] solve for similarity field\n";
-  build_rho_operator(R_);
-  ASSERT(R_.cols() == L_.cols());
-  SparseMatrix<double> A = Dirac_-R_;
-  VectorXd V = Mv_.cwiseSqrt().cwiseInverse();
-  SparseMatrix<double> LHS = (A*V.asDiagonal()).transpose()*Mf_.asDiagonal()*A*V.asDiagonal();
-  if ( !is_symm(LHS) ) {
-    cerr << "[INFO] unsymmetric matrix for eigen solve\n";
-    return __LINE__;
+  // the factorization of an earlier edit may be too far off to converge
+  if ( eig_.solve() ) {
+    cout << "[INFO] refactorize the eigenproblem\n";
+    if ( eig_.factorize() || eig_.solve() )
+      return __LINE__;
   }
-  SimplicialCholesky<SparseMatrix<double>> solver;
-  solver.compute(LHS);
-  ASSERT(solver.info() == Success);
-  // inverse power method
-  VectorXd eigvec = VectorXd::Ones(LHS.cols());
-  eigvec /= eigvec.norm();
-  for (size_t iter = 0; iter < 3; ++iter) {
-    eigvec = (solver.solve(eigvec)).eval();
-    eigvec /= eigvec.norm();
-  }
-  lambda = V.asDiagonal()*eigvec;
+  printf("[INFO] global constant shift: %lf, %zu iterations\n", eig_.eigenvalues()[0], eig_.iterations());
+  lambda = eig_.eigenvectors().col(0);
   return 0;
 }
 
 void spin_trans::calc_div_f(const VectorXd &lambda, VectorXd &divf) {
-  divf.setZero(nods_.size());
-  for (size_t i = 0; i < tris_.size(2); ++i) {
-    matd_t vert = nods_(colon(), tris_(colon(), i));
+  const size_t nf = tris_.size(2);
+  Matrix4Xd flux(4, 3*nf);
+#pragma omp parallel for
+  for (size_t i = 0; i < nf; ++i) {
     for (size_t j = 0; j < 3; ++j) {
-      const size_t p = j, q = (j+1)%3;
-      matd_t e = vert(colon(), q)-vert(colon(), p);
-      Vector4d epq(&e[0]), lp(&lambda[4*tris_(p, i)]), lq(&lambda[4*tris_(q, i)]),
+      const size_t p = tris_(j, i), q = tris_((j+1)%3, i);
+      const Vector4d epq = edge_.col(3*i+(j+2)%3), lp = lambda.segment<4>(4*p), lq = lambda.segment<4>(4*q),
           lpc = conjugate(lp), lqc = conjugate(lq);
       Vector4d etilde =
            1.0/3*quat_prod(quat_prod(lpc, epq), lp)
           +1.0/6*quat_prod(quat_prod(lpc, epq), lq)
           +1.0/6*quat_prod(quat_prod(lqc, epq), lp)
           +1.0/3*quat_prod(quat_prod(lqc, epq), lq);
-      double cota = cal_cot_val(&vert(1, p), &vert(1, (j+2)%3), &vert(1, q));
-      divf.segment<4>(4*tris_(p, i)) -= 0.5*cota*etilde;
-      divf.segment<4>(4*tris_(q, i)) += 0.5*cota*etilde;
+      flux.col(3*i+j) = 0.5*cot_[3*i+(j+2)%3]*etilde;
+    }
+  }
+  divf.setZero(nods_.size());
+  for (size_t i = 0; i < nf; ++i) {
+    for (size_t j = 0; j < 3; ++j) {
+      divf.segment<4>(4*tris_(j, i)) -= flux.col(3*i+j);
+      divf.segment<4>(4*tris_((j+1)%3, i)) += flux.col(3*i+j);
     }
   }
 }
@@ -191,34 +258,22 @@ int spin_trans::solve_poisson_prob(const VectorXd &lambda, matd_t &x) {
   VectorXd divf;
   calc_div_f(lambda, divf);
 
-  // fix the first point to remove the kernel of Laplacian
-  vector<size_t> g2l(L_.cols());
-  size_t cnt = 0;
-  for (size_t i = 0; i < g2l.size(); ++i) {
-    if ( i/4 == 0 )
-      g2l[i] = -1;
-    else
-      g2l[i] = cnt++;
-  }
   VectorXd rhs = divf-L_*X;
-  rm_spmat_col_row(L_, g2l);
-  rm_vector_row(rhs, g2l);
-
-  solver_.setMode(SimplicialCholeskyLLT);
-  solver_.compute(L_);
-  ASSERT(solver_.info() == Success);
+  rm_vector_row(rhs, g2l_);
   VectorXd dx = solver_.solve(rhs);
   ASSERT(solver_.info() == Success);
 
   VectorXd Dx = VectorXd::Zero(x.size());
-  rc_vector_row(dx, g2l, Dx);
+  rc_vector_row(dx, g2l_, Dx);
   X += Dx;
+  solver_.report();
   return 0;
 }
 
 int spin_trans::deform(matd_t &x) {
   VectorXd lambda;
-  solve_eigen_prob_inv_power(lambda);
+  if ( solve_eigen_prob(lambda) )
+    return __LINE__;
   solve_poisson_prob(lambda, x);
   return 0;
 }
@@ -1,26 +1,41 @@
 #ifndef SPIN_TRANS_H
 #define SPIN_TRANS_H
 
+#include <vector>
 #include <zjucad/matrix/matrix.h>
 #include <Eigen/Sparse>
 
+#include "sparse_solver.h"
+#include "sparse_eigen.h"
+
 using mati_t=zjucad::matrix::matrix<size_t>;
 using matd_t=zjucad::matrix::matrix<double>;
 
 namespace riemann {
 
+/**
+ * @brief spin transformation of a surface for a prescribed change of
+ * mean curvature half density per face.
+ *
+ * The object is an editing session: the Dirac blocks, the pattern of
+ * the eigenproblem, the Laplacian factorization and the last similarity
+ * field survive between deform() calls. An edit only reassembles the
+ * faces whose curvature change moved, and the eigensolve restarts from
+ * the previous field with the previous factorization as preconditioner.
+ */
 class spin_trans
 {
 public:
   spin_trans(const mati_t &tris, const matd_t &nods);
   void set_curvature_change(const matd_t &delta);
+  void set_curvature_change(const size_t face, const double delta);
   int deform(matd_t &x);
 private:
-  void build_dirac_operator(Eigen::SparseMatrix<double> &D);
-  void build_rho_operator(Eigen::SparseMatrix<double> &R);
+  void dirac_block(const size_t i, const double rho, Eigen::Matrix<double, 4, 12> &A) const;
+  void build_eigen_pattern();
+  void update_eigen_prob();
   void calc_div_f(const Eigen::VectorXd &lambda, Eigen::VectorXd &divf);
   int solve_eigen_prob(Eigen::VectorXd &lambda);
-  int solve_eigen_prob_inv_power(Eigen::VectorXd &lambda);
   int solve_poisson_prob(const Eigen::VectorXd &lambda, matd_t &x);
 private:
   const mati_t &tris_;
@@ -28,8 +43,22 @@ private:
   matd_t rho_;
 
   Eigen::VectorXd Mf_, Mv_;
-  Eigen::SparseMatrix<double> Dirac_, R_, L_;
-  Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>> solver_;
+  // per corner: the opposite edge as an imaginary quaternion and the
+  // cotangent of the angle
+  Eigen::Matrix4Xd edge_;
+  Eigen::VectorXd cot_;
+  // (D-rho)^T Mf (D-rho) in a fixed pattern, with the curvature change
+  // each face holds in it and the position of its 4x4 blocks
+  Eigen::SparseMatrix<double> K_;
+  std::vector<double> rho_done_;
+  std::vector<int> kslot_;
+  // the Laplacian with the first vertex pinned only depends on the rest
+  // shape, it is reduced and factorized once
+  Eigen::SparseMatrix<double> L_, Lr_;
+  std::vector<size_t> g2l_;
+  reusable_factorization<Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>>> solver_;
+  shift_invert_eigensolver eig_;
+  bool eig_ready_;
 };
 
 }
@@ -15,6 +15,10 @@ public:
   void stop() {
     t1_ = clk_.now();
   }
+  // elapsed time in msec
+  double period() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t1_-t0_).count()/1000.0;
+  }
   void log() const {
     uint64_t period = std::chrono::duration_cast<std::chrono::milliseconds>(t1_-t0_).count();
     if ( period/1000 > 0 )
@@ -1,9 +1,12 @@
 #include "vec_field_deform.h"
 
+#include <numeric>
 #include <zjucad/matrix/itr_matrix.h>
 #include <jtflib/mesh/io.h>
 #include <Eigen/Geometry>
 
+#include "timer.h"
+
 using namespace std;
 using namespace zjucad::matrix;
 using namespace Eigen;
@@ -38,10 +41,130 @@ int get_ortn_basis(const double *v, double *u, double *w) {
   W /= W.norm();
   std::copy(U.data(), U.data()+3, u);
   std::copy(W.data(), W.data()+3, w);
+  return 0;
+}
+
+//==============================================================================
+/// speed of the edits, as in advector
+static const double FLOW_SPEED = 0.001;
+
+/**
+ * the blend b(s) = 4s^3-3s^4 of s = (r-ri)/(ro-ri) clamped to [0, 1]
+ * covers the inner, intermediate and outer regions without branches,
+ * b' vanishes at both ends and P = 0 outside.
+ *
+ * lip receives an upper bound of |dv/dx| from the closed-form
+ * derivatives, dP/dx = (1-b)He-b'(ge gr^T+gr ge^T)-b''e gr gr^T-b'e Hr
+ * and likewise for Q, with |d(PxQ)/dx| <= |dP/dx||Q|+|P||dQ/dx| and
+ * Frobenius norms throughout.
+ */
+template <int Kind>
+static void eval_flow(const flow_field &f, const size_t m, const double *x, const double *y,
+                      const double *z, const double *t, double *vx, double *vy, double *vz,
+                      double *lip) {
+  const double ri = f.ri, w = f.ro-f.ri;
+  const double c0x = f.c0[0], c0y = f.c0[1], c0z = f.c0[2];
+  const double dcx = f.dc[0], dcy = f.dc[1], dcz = f.dc[2];
+  const double ax = f.a[0], ay = f.a[1], az = f.a[2], aa = f.a.squaredNorm();
+  const double bx = f.b[0], by = f.b[1], bz = f.b[2];
+  const double nx = f.n[0], ny = f.n[1], nz = f.n[2];
+  const Vec3 kn = f.k.cross(f.n);
+  const double kd = f.k.dot(f.n);
+  // Frobenius norms of the constant hessians of e and f
+  const double He = (Kind == flow_field::TWIST) ? 2*aa : 0.0;
+  const double Hf = (Kind == flow_field::TRANSLATE) ? 0.0 : 2*std::sqrt(2.0)*aa;
+#pragma omp simd
+  for (size_t l = 0; l < m; ++l) {
+    const double px = x[l]-c0x-t[l]*dcx, py = y[l]-c0y-t[l]*dcy, pz = z[l]-c0z-t[l]*dcz;
+    double e, ge[3], g, gg[3], r, gr[3], Hr = 0;
+    if ( Kind == flow_field::TRANSLATE ) {
+      e = ax*px+ay*py+az*pz;
+      ge[0] = ax; ge[1] = ay; ge[2] = az;
+      g = bx*px+by*py+bz*pz;
+      gg[0] = bx; gg[1] = by; gg[2] = bz;
+      r = std::sqrt(px*px+py*py+pz*pz);
+      const double ir = r > 1e-16 ? 1.0/r : 0.0;
+      gr[0] = px*ir; gr[1] = py*ir; gr[2] = pz*ir;
+      Hr = std::sqrt(2.0)*ir;
+    } else {
+      // |a x p|^2 = |a|^2|p|^2-(a.p)^2 replaces the generated kernel
+      const double d = ax*px+ay*py+az*pz;
+      g = aa*(px*px+py*py+pz*pz)-d*d;
+      gg[0] = 2*(aa*px-d*ax); gg[1] = 2*(aa*py-d*ay); gg[2] = 2*(aa*pz-d*az);
+      double mx = nx, my = ny, mz = nz;
+      if ( Kind == flow_field::TWIST ) {
+        e = d*d;
+        ge[0] = 2*d*ax; ge[1] = 2*d*ay; ge[2] = 2*d*az;
+      } else {
+        e = d;
+        ge[0] = ax; ge[1] = ay; ge[2] = az;
+        // Rodrigues rotation of the tool normal
+        const double th = f.omega*t[l], ct = std::cos(th), st = std::sin(th);
+        mx = nx*ct+kn[0]*st+f.k[0]*kd*(1-ct);
+        my = ny*ct+kn[1]*st+f.k[1]*kd*(1-ct);
+        mz = nz*ct+kn[2]*st+f.k[2]*kd*(1-ct);
+      }
+      r = mx*px+my*py+mz*pz;
+      gr[0] = mx; gr[1] = my; gr[2] = mz;
+    }
+    const double s = std::min(1.0, std::max(0.0, (r-ri)/w));
+    const double bl = s*s*s*(4-3*s), bj = 12*s*s*(1-s)/w;
+    const double P[3] = {(1-bl)*ge[0]-bj*e*gr[0], (1-bl)*ge[1]-bj*e*gr[1], (1-bl)*ge[2]-bj*e*gr[2]};
+    const double Q[3] = {(1-bl)*gg[0]-bj*g*gr[0], (1-bl)*gg[1]-bj*g*gr[1], (1-bl)*gg[2]-bj*g*gr[2]};
+    vx[l] = FLOW_SPEED*(P[1]*Q[2]-P[2]*Q[1]);
+    vy[l] = FLOW_SPEED*(P[2]*Q[0]-P[0]*Q[2]);
+    vz[l] = FLOW_SPEED*(P[0]*Q[1]-P[1]*Q[0]);
+    if ( lip ) {
+      const double b2 = (s > 0 && s < 1) ? 12*s*std::fabs(2-3*s)/(w*w) : 0.0;
+      const double nr = std::sqrt(gr[0]*gr[0]+gr[1]*gr[1]+gr[2]*gr[2]);
+      const double ne = std::sqrt(ge[0]*ge[0]+ge[1]*ge[1]+ge[2]*ge[2]);
+      const double nf = std::sqrt(gg[0]*gg[0]+gg[1]*gg[1]+gg[2]*gg[2]);
+      const double JP = (1-bl)*He+2*bj*ne*nr+b2*std::fabs(e)*nr*nr+bj*std::fabs(e)*Hr;
+      const double JQ = (1-bl)*Hf+2*bj*nf*nr+b2*std::fabs(g)*nr*nr+bj*std::fabs(g)*Hr;
+      const double nP = std::sqrt(P[0]*P[0]+P[1]*P[1]+P[2]*P[2]);
+      const double nQ = std::sqrt(Q[0]*Q[0]+Q[1]*Q[1]+Q[2]*Q[2]);
+      lip[l] = FLOW_SPEED*(JP*nQ+nP*JQ);
+    }
+  }
+}
+
+void flow_field::eval(const size_t m, const double *x, const double *y, const double *z, const double *t,
+                      double *vx, double *vy, double *vz, double *lip) const {
+  switch ( kind ) {
+    case TRANSLATE: eval_flow<TRANSLATE>(*this, m, x, y, z, t, vx, vy, vz, lip); break;
+    case TWIST: eval_flow<TWIST>(*this, m, x, y, z, t, vx, vy, vz, lip); break;
+    case BEND: eval_flow<BEND>(*this, m, x, y, z, t, vx, vy, vz, lip); break;
+  }
 }
 
-vel_field_deform::vel_field_deform() {
-  advect_ = std::make_shared<advector>(vf_);
+bool flow_field::touches(const Vec3 &ctr, const double rad) const {
+  const Vec3 d = ctr-c0;
+  if ( kind == TRANSLATE ) {
+    // the sphere sweeps a capsule
+    const Vec3 seg = T*dc;
+    const double len2 = seg.squaredNorm();
+    const double u = len2 > 0 ? std::min(1.0, std::max(0.0, d.dot(seg)/len2)) : 0.0;
+    return (d-u*seg).norm() < ro+rad;
+  }
+  const double nn = n.norm();
+  if ( kind == TWIST )
+    return n.dot(d)-nn*rad < ro;
+  // the half space of the rotating normal, sampled with a margin for the
+  // angle between samples
+  const double sweep = std::fabs(omega*T);
+  const size_t ns = std::ceil(sweep/0.05)+1;
+  const double da = sweep/std::max<size_t>(ns-1, 1);
+  for (size_t j = 0; j < ns; ++j) {
+    const Vec3 m = AngleAxisd(std::copysign(j*da, omega), k)*n;
+    if ( m.dot(d)-nn*rad < ro+nn*(d.norm()+rad)*da )
+      return true;
+  }
+  return false;
+}
+
+//==============================================================================
+vel_field_deform::vel_field_deform() : h_(0) {
+  std::fill(dim_, dim_+3, 0);
 }
 
 int vel_field_deform::load_model(const char *file) {
@@ -52,48 +175,264 @@ int vel_field_deform::load_model(const char *file) {
   nods_.resize(nods.size(1), nods.size(2));
   std::copy(cell.begin(), cell.end(), cell_.data());
   std::copy(nods.begin(), nods.end(), nods_.data());
+  build_grid();
   return state;
 }
 
-int vel_field_deform::translate_deform(const Vec3 &src, const Vec3 &des, const double ri, const double ro) {
-  const Vector3d dir = des - src;
-  const size_t substeps = 100;
-  for (size_t i = 0; i < substeps; ++i) {
-    Vec3 c = src + 1.0*i/substeps*dir;
-    vf_.push_back(std::make_shared<vector_field>(c, ri, ro, dir, "translate"));
+void vel_field_deform::set_args(const flow_args &args) {
+  const bool regrid = args.cell_points != args_.cell_points;
+  args_ = args;
+  if ( regrid )
+    build_grid();
+}
+
+void vel_field_deform::build_grid() {
+  const size_t n = nods_.cols();
+  if ( n == 0 )
+    return;
+  lo_ = nods_.rowwise().minCoeff();
+  const Vec3 ext = nods_.rowwise().maxCoeff()-lo_;
+  const double emax = std::max(ext.maxCoeff(), 1e-12);
+  // flat models get at most 512 cells along their thin side
+  const Vec3 box = ext.cwiseMax(Vec3::Constant(emax/512));
+  h_ = std::max(std::cbrt(box.prod()*args_.cell_points/n), emax/512);
+  for (size_t d = 0; d < 3; ++d)
+    dim_[d] = std::floor(ext[d]/h_)+1;
+
+  bin_.resize(n);
 #pragma omp parallel for
-    for (size_t id = 0; id < nods_.cols(); ++id) {
-      nods_.col(id) += (*advect_)(nods_.col(id));
-    }
+  for (size_t i = 0; i < n; ++i)
+    bin_[i] = cell_of(i);
+  grid_ptr_.assign(dim_[0]*dim_[1]*dim_[2]+1, 0);
+  for (auto &c : bin_)
+    ++grid_ptr_[c+1];
+  std::partial_sum(grid_ptr_.begin(), grid_ptr_.end(), grid_ptr_.begin());
+  grid_pts_.resize(n);
+  vector<size_t> pos(grid_ptr_.begin(), grid_ptr_.end()-1);
+  for (size_t i = 0; i < n; ++i)
+    grid_pts_[pos[bin_[i]]++] = i;
+  stray_.clear();
+  is_stray_.assign(n, 0);
+}
+
+size_t vel_field_deform::cell_of(const size_t i) const {
+  size_t c[3];
+  for (size_t d = 0; d < 3; ++d) {
+    const double u = std::floor((nods_(d, i)-lo_[d])/h_);
+    if ( u < 0 || u >= dim_[d] )
+      return -1;
+    c[d] = u;
   }
-  return 0;
+  return c[0]+dim_[0]*(c[1]+dim_[1]*c[2]);
 }
 
-int vel_field_deform::twist_deform(const Vec3 &center, const double ri, const double ro, const Vec3 &n, const size_t times) {
-  for (size_t i = 0; i < times; ++i) {
-    if ( i < 3 )
-      vf_.push_back(std::make_shared<vector_field>(center, ri, ro, n, "twist"));
-#pragma omp parallel for
-    for (size_t id = 0; id < nods_.cols(); ++id) {
-      nods_.col(id) += (*advect_)(nods_.col(id));
+void vel_field_deform::collect_points(const flow_field &f, vector<size_t> &pts) const {
+  pts.clear();
+  const double rad = 0.5*std::sqrt(3.0)*h_;
+  for (size_t k = 0; k < dim_[2]; ++k)
+    for (size_t j = 0; j < dim_[1]; ++j)
+      for (size_t i = 0; i < dim_[0]; ++i) {
+        const size_t c = i+dim_[0]*(j+dim_[1]*k);
+        if ( grid_ptr_[c] == grid_ptr_[c+1] )
+          continue;
+        const Vec3 ctr = lo_+h_*Vec3(i+0.5, j+0.5, k+0.5);
+        if ( !f.touches(ctr, rad) )
+          continue;
+        for (size_t p = grid_ptr_[c]; p < grid_ptr_[c+1]; ++p)
+          if ( !is_stray_[grid_pts_[p]] )
+            pts.push_back(grid_pts_[p]);
+      }
+  for (auto &i : stray_)
+    if ( f.touches(nods_.col(i), 0) )
+      pts.push_back(i);
+}
+
+/**
+ * Every point follows dx/dt = v(x, t) on [0, T] with its own step size,
+ * Bogacki-Shampine 3(2) with the last stage reused. A step is accepted
+ * only when the embedded error is below tolerance*(ro-ri) and dt*L <=
+ * 1/2, L being the largest bound of |dv/dx| from eval_flow over the four
+ * stage points. Chaining the stages, the step map is then x -> x+dt*G(x)
+ * with |dt*dG/dx| <= 0.74 at the point, so its jacobian stays within
+ * distance one of the identity and keeps a positive determinant: no
+ * step folds the mesh around the point. The bound is exact at the stage
+ * points, not over their neighbourhood. Points outside the support over
+ * the whole edit never move and are culled by the grid.
+ */
+int vel_field_deform::advect(const flow_field &f) {
+  if ( f.ro <= f.ri ) {
+    cerr << "[Error] outer radius must exceed the inner one\n";
+    return __LINE__;
+  }
+  high_resolution_timer clk;
+  clk.start();
+  vector<size_t> pts;
+  collect_points(f, pts);
+
+  const size_t B = std::max<size_t>(args_.batch, 1), nb = (pts.size()+B-1)/B;
+  const double tol = args_.tolerance*(f.ro-f.ri), min_step = 1e-9*std::max(f.T, 1.0);
+  size_t steps = 0, rejects = 0, stalled = 0;
+#pragma omp parallel reduction(+:steps,rejects,stalled)
+  {
+    vector<double> buf(27*B);
+    double *X[3] = {&buf[0], &buf[B], &buf[2*B]}, *Y[3] = {&buf[3*B], &buf[4*B], &buf[5*B]};
+    double *K1[3] = {&buf[6*B], &buf[7*B], &buf[8*B]}, *K2[3] = {&buf[9*B], &buf[10*B], &buf[11*B]};
+    double *K3[3] = {&buf[12*B], &buf[13*B], &buf[14*B]}, *K4[3] = {&buf[15*B], &buf[16*B], &buf[17*B]};
+    double *t = &buf[18*B], *ts = &buf[19*B], *dt = &buf[20*B], *h = &buf[21*B], *acc = &buf[22*B];
+    double *L1 = &buf[23*B], *L2 = &buf[24*B], *L3 = &buf[25*B], *L4 = &buf[26*B];
+#pragma omp for schedule(dynamic)
+    for (size_t ib = 0; ib < nb; ++ib) {
+      const size_t beg = ib*B, m = std::min(B, pts.size()-beg);
+      for (size_t l = 0; l < m; ++l) {
+        for (size_t d = 0; d < 3; ++d)
+          X[d][l] = nods_(d, pts[beg+l]);
+        t[l] = 0;
+        dt[l] = 1;
+      }
+      f.eval(m, X[0], X[1], X[2], t, K1[0], K1[1], K1[2], L1);
+      while ( true ) {
+        size_t live = 0;
+        for (size_t l = 0; l < m; ++l) {
+          h[l] = std::min(dt[l], f.T-t[l]);
+          if ( h[l] > 1e-12*f.T )
+            ++live;
+          else
+            h[l] = 0;
+        }
+        if ( live == 0 )
+          break;
+        // the finished lanes take empty steps
+        for (size_t d = 0; d < 3; ++d)
+#pragma omp simd
+          for (size_t l = 0; l < m; ++l)
+            Y[d][l] = X[d][l]+0.5*h[l]*K1[d][l];
+#pragma omp simd
+        for (size_t l = 0; l < m; ++l)
+          ts[l] = t[l]+0.5*h[l];
+        f.eval(m, Y[0], Y[1], Y[2], ts, K2[0], K2[1], K2[2], L2);
+        for (size_t d = 0; d < 3; ++d)
+#pragma omp simd
+          for (size_t l = 0; l < m; ++l)
+            Y[d][l] = X[d][l]+0.75*h[l]*K2[d][l];
+#pragma omp simd
+        for (size_t l = 0; l < m; ++l)
+          ts[l] = t[l]+0.75*h[l];
+        f.eval(m, Y[0], Y[1], Y[2], ts, K3[0], K3[1], K3[2], L3);
+        for (size_t d = 0; d < 3; ++d)
+#pragma omp simd
+          for (size_t l = 0; l < m; ++l)
+            Y[d][l] = X[d][l]+h[l]*(2.0/9*K1[d][l]+1.0/3*K2[d][l]+4.0/9*K3[d][l]);
+#pragma omp simd
+        for (size_t l = 0; l < m; ++l)
+          ts[l] = t[l]+h[l];
+        f.eval(m, Y[0], Y[1], Y[2], ts, K4[0], K4[1], K4[2], L4);
+
+#pragma omp simd
+        for (size_t l = 0; l < m; ++l) {
+          double err = 0;
+          for (size_t d = 0; d < 3; ++d) {
+            const double e = -5.0/72*K1[d][l]+1.0/12*K2[d][l]+1.0/9*K3[d][l]-1.0/8*K4[d][l];
+            err += e*e;
+          }
+          err = h[l]*std::sqrt(err);
+          // q = 1 at the bound dt*L = 1/2
+          const double q = 2*h[l]*std::max(std::max(L1[l], L2[l]), std::max(L3[l], L4[l]));
+          const bool ok = err <= tol && q <= 1;
+          double fac = err > 0 ? 0.9*std::cbrt(tol/err) : 4.0;
+          if ( q > 0 )
+            fac = std::min(fac, 0.9/q);
+          fac = std::min(4.0, std::max(0.2, fac));
+          acc[l] = ok ? 1.0 : 0.0;
+          if ( h[l] > 0 )
+            dt[l] = std::min(args_.max_step, h[l]*fac);
+        }
+        for (size_t l = 0; l < m; ++l) {
+          if ( h[l] == 0 )
+            continue;
+          if ( acc[l] == 0 ) {
+            ++rejects;
+            // give up on the lane rather than accept a bad step
+            if ( dt[l] < min_step ) {
+              ++stalled;
+              t[l] = f.T;
+            }
+            continue;
+          }
+          ++steps;
+          t[l] += h[l];
+          L1[l] = L4[l];
+          for (size_t d = 0; d < 3; ++d) {
+            X[d][l] = Y[d][l];
+            K1[d][l] = K4[d][l];
+          }
+        }
+      }
+      for (size_t l = 0; l < m; ++l)
+        for (size_t d = 0; d < 3; ++d)
+          nods_(d, pts[beg+l]) = X[d][l];
+    }
+  }
+  for (auto &i : pts)
+    if ( !is_stray_[i] && cell_of(i) != bin_[i] ) {
+      is_stray_[i] = 1;
+      stray_.push_back(i);
     }
+  if ( 8*stray_.size() > nods_.cols() )
+    build_grid();
+  clk.stop();
+  if ( stalled ) {
+    cerr << "[Error] step size underflow on " << stalled << " vertices\n";
+    return __LINE__;
   }
+  if ( args_.verbose )
+    printf("[info] advected %zu of %zu vertices, %.2lf steps per vertex, %zu rejected, %.3lf ms\n",
+           pts.size(), (size_t)nods_.cols(), pts.empty() ? 0.0 : 1.0*steps/pts.size(), rejects, clk.period());
   return 0;
 }
 
+int vel_field_deform::translate_deform(const Vec3 &src, const Vec3 &des, const double ri, const double ro) {
+  const size_t substeps = 100;
+  flow_field f;
+  f.kind = flow_field::TRANSLATE;
+  f.c0 = src;
+  f.dc = (des-src)/substeps;
+  if ( get_ortn_basis(&f.dc[0], &f.a[0], &f.b[0]) )
+    return __LINE__;
+  f.n = f.k = Vec3::Zero();
+  f.omega = 0;
+  f.ri = ri;
+  f.ro = ro;
+  f.T = substeps;
+  return advect(f);
+}
+
+int vel_field_deform::twist_deform(const Vec3 &center, const double ri, const double ro, const Vec3 &n, const size_t times) {
+  flow_field f;
+  f.kind = flow_field::TWIST;
+  f.c0 = center;
+  f.dc = f.k = Vec3::Zero();
+  f.a = f.b = f.n = n;
+  f.omega = 0;
+  f.ri = ri;
+  f.ro = ro;
+  f.T = times;
+  return advect(f);
+}
+
 int vel_field_deform::bend_deform(const Vec3 &center, const double ri, const double ro, const Vec3 &axis, const Vec3 &n, const double theta) {
-  const size_t times = theta / (2*0.001);
-  Vec3 normal = n;
-  Matrix3d rot;
-  rot = AngleAxisd(1*0.001, axis);
-  for (size_t i = 0; i < times; ++i) {
-    vf_.push_back(std::make_shared<vector_field>(center, ri, ro, axis, normal));
-    normal = (rot * normal).eval();
-#pragma omp parallel for
-    for (size_t id = 0; id < nods_.cols(); ++id)
-      nods_.col(id) += (*advect_)(nods_.col(id));
-  }
-  return 0;
+  const size_t times = theta / (2*FLOW_SPEED);
+  flow_field f;
+  f.kind = flow_field::BEND;
+  f.c0 = center;
+  f.dc = Vec3::Zero();
+  f.a = f.b = axis;
+  f.n = n;
+  f.k = axis.normalized();
+  f.omega = FLOW_SPEED;
+  f.ri = ri;
+  f.ro = ro;
+  f.T = times;
+  return advect(f);
 }
 
 int vel_field_deform::save_model(const char *file) {
@@ -2,6 +2,8 @@
 #define VEC_FIELD_DEFORM_H
 
 #include <iostream>
+#include <memory>
+#include <vector>
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
 #include <zjucad/matrix/matrix.h>
@@ -312,6 +314,38 @@ private:
   const std::vector<std::shared_ptr<vector_field>> &vfs_;
 };
 
+/**
+ * @brief closed form of the translate, twist and bend fields above as a
+ * function of position and time, with the tool center or normal moving
+ * along the edit, so points can be advected in batches without virtual
+ * calls and with their own time steps.
+ */
+struct flow_field
+{
+  enum kind_t { TRANSLATE, TWIST, BEND };
+  kind_t kind;
+  Vec3 c0, dc;      // tool center at t=0 and its velocity
+  Vec3 a, b;        // axes of the two scalar fields
+  Vec3 n, k;        // tool normal at t=0 and the unit axis it rotates about
+  double omega;     // rotation rate of the normal
+  double ri, ro, T; // blend range and duration, one unit per old substep
+  /// velocities of m points given as separate x, y, z, t arrays, lip
+  /// optionally receives upper bounds of |dv/dx| at the points
+  void eval(const size_t m, const double *x, const double *y, const double *z, const double *t,
+            double *vx, double *vy, double *vz, double *lip=nullptr) const;
+  /// false if the ball (ctr, rad) stays outside the support during [0, T]
+  bool touches(const Vec3 &ctr, const double rad) const;
+};
+
+struct flow_args {
+  double tolerance;    // local error per step relative to ro-ri
+  double max_step;     // in units of the old fixed substep
+  size_t batch;        // points integrated together
+  size_t cell_points;  // average number of points per grid cell
+  bool verbose;
+  flow_args() : tolerance(1e-4), max_step(16), batch(64), cell_points(8), verbose(true) {}
+};
+
 class vel_field_deform
 {
 public:
@@ -321,11 +355,27 @@ public:
   int twist_deform(const Vec3 &center, const double ri, const double ro, const Vec3 &n, const size_t times);
   int bend_deform(const Vec3 &center, const double ri, const double ro, const Vec3 &axis, const Vec3 &n, const double theta);
   int save_model(const char *file);
+  /// a new cell_points rebuilds the grid of an already loaded model
+  void set_args(const flow_args &args);
+  const Eigen::MatrixXd &nods() const { return nods_; }
+private:
+  /// advects the points whose grid cells the field touches
+  int advect(const flow_field &f);
+  void build_grid();
+  /// -1 outside the grid box
+  size_t cell_of(const size_t i) const;
+  void collect_points(const flow_field &f, std::vector<size_t> &pts) const;
 private:
   Eigen::MatrixXi cell_;
   Eigen::MatrixXd nods_;
-  std::vector<std::shared_ptr<vector_field>> vf_;
-  std::shared_ptr<advector> advect_;
+  flow_args args_;
+  // uniform grid over nods_, points leaving their cell or the grid box
+  // are kept aside and tested one by one until the grid is rebuilt
+  Vec3 lo_;
+  double h_;
+  size_t dim_[3];
+  std::vector<size_t> grid_ptr_, grid_pts_, bin_, stray_;
+  std::vector<char> is_stray_;
 };
 
 }
@@ -18,6 +18,7 @@
 #include "util.h"
 #include "petsc_linear_solver.h"
 #include "geometry_extend.h"
+#include "mesh_topology.h"
 
 using namespace std;
 using namespace zjucad::matrix;
@@ -76,7 +77,8 @@ void convert_zyz_to_mat(const VectorXd &abc, VectorXd &mat) {
 class SH_smooth_energy_tet : public Functional<double>
 {
 public:
-  SH_smooth_energy_tet(const mati_t &tets, const matd_t &nods, const double w)
+  SH_smooth_energy_tet(const mati_t &tets, const matd_t &nods, const double w,
+                       shared_ptr<const mesh_topology> topo=nullptr)
       : tets_(tets), w_(w), dim_(3*tets.size(2)) {
     matd_t volume = zeros<double>(tets.size(2), 1); {
       #pragma omp parallel for
@@ -86,17 +88,9 @@ public:
       }
     }
     
-    shared_ptr<face2tet_adjacent> f2t(face2tet_adjacent::create(tets));
-    vector<size_t> buffer;
-    for (size_t i = 0; i < f2t->face2tet_.size(); ++i) {
-      const pair<size_t, size_t> ts = f2t->face2tet_[i];
-      if ( !f2t->is_outside_face(ts) ) {
-        buffer.push_back(ts.first);
-        buffer.push_back(ts.second);
-      }
-    }
-    adjt_.resize(2, buffer.size()/2);
-    std::copy(buffer.begin(), buffer.end(), adjt_.begin());
+    if ( topo.get() == nullptr )
+      topo = mesh_topology::create(tets);
+    topo->interior_cell_pairs(adjt_);
 
     stiff_.resize(adjt_.size(2)); {
       #pragma omp parallel for
@@ -182,11 +176,13 @@ protected:
 class SH_align_energy_tet : public Functional<double>
 {
 public:
-  SH_align_energy_tet(const mati_t &tets, const matd_t &nods, const double w)
+  SH_align_energy_tet(const mati_t &tets, const matd_t &nods, const double w,
+                      shared_ptr<const mesh_topology> topo=nullptr)
       : tets_(tets), w_(w), dim_(3*tets.size(2)) {
-    shared_ptr<face2tet_adjacent> f2t(face2tet_adjacent::create(tets));
-    mati_t surf; bool check_order = true;
-    jtf::mesh::get_outside_face(*f2t, surf, check_order, &nods);
+    if ( topo.get() == nullptr )
+      topo = mesh_topology::create(tets);
+    mati_t surf;
+    topo->outside_facets(nods, surf, &adjt_);
   
     stiff_.resize(surf.size(2)); {
       #pragma omp parallel for
@@ -196,16 +192,12 @@ public:
       stiff_ /= sum_area;
     }
     
-    adjt_.resize(surf.size(2));
     zyz_.resize(3, surf.size(2)); {
       #pragma omp parallel for
       for (size_t i = 0; i < surf.size(2); ++i) {
         matd_t n = zeros<double>(3, 1);
         jtf::mesh::cal_face_normal(nods(colon(), surf(colon(), i)), n);
         normal2zyz(&n[0], &zyz_(0, i));
-
-        const pair<size_t, size_t> t = f2t->query(surf(0, i), surf(1, i), surf(2, i));
-        adjt_[i] = (t.first == -1) ? t.second : t.first;
       }
     }
   }
@@ -277,7 +269,7 @@ private:
   const double w_;
   const size_t dim_;
 
-  mati_t adjt_;
+  vector<size_t> adjt_;
   matd_t stiff_;
   matd_t zyz_;
 };
@@ -326,11 +318,11 @@ private:
 //===============================================================================
 
 cross_frame_opt::cross_frame_opt(const mati_t &tets, const matd_t &nods, const ptree &pt)
-    : tets_(tets), nods_(nods), pt_(pt) {
+    : tets_(tets), nods_(nods), pt_(pt), topo_(mesh_topology::create(tets)) {
   const double ws = pt_.get<double>("weight.smooth.value");
   const double wa = pt_.get<double>("weight.align.value");
-  buffer_.push_back(make_shared<SH_smooth_energy_tet>(tets, nods, ws));
-  buffer_.push_back(make_shared<SH_align_energy_tet>(tets, nods, wa));
+  buffer_.push_back(make_shared<SH_smooth_energy_tet>(tets, nods, ws, topo_));
+  buffer_.push_back(make_shared<SH_align_energy_tet>(tets, nods, wa, topo_));
 }
 
 int cross_frame_opt::solve_laplacian(VectorXd &Fs) const {
@@ -457,8 +449,9 @@ int cross_frame_opt::optimize_frames(VectorXd &abc) const {
 class log_space_smooth_energy : public SH_smooth_energy_tet
 {
 public:
-  log_space_smooth_energy(const mati_t &tets, const matd_t &nods, const double w)
-      : SH_smooth_energy_tet(tets, nods, w) {
+  log_space_smooth_energy(const mati_t &tets, const matd_t &nods, const double w,
+                          const shared_ptr<const mesh_topology> &topo=nullptr)
+      : SH_smooth_energy_tet(tets, nods, w, topo) {
   }
   size_t Nx() const {
     return 3*dim_;
@@ -487,8 +480,9 @@ class l1_smooth_fix_boundary : public SH_smooth_energy_tet
 public:
   l1_smooth_fix_boundary(const mati_t &tets, const matd_t &nods, const VectorXd &x0,
                          const mati_t &g2l, const size_t sub_dim,
-                         const double epsilon, const double w)
-      : SH_smooth_energy_tet(tets, nods, w),
+                         const double epsilon, const double w,
+                         const shared_ptr<const mesh_topology> &topo=nullptr)
+      : SH_smooth_energy_tet(tets, nods, w, topo),
         g2l_(g2l), sub_dim_(sub_dim), epsilon_(epsilon), x0_(x0) {
   }
   size_t Nx() const {
@@ -551,8 +545,9 @@ class sh_smooth_fix_boundary : public SH_smooth_energy_tet
 {
 public:
   sh_smooth_fix_boundary(const mati_t &tets, const matd_t &nods, const VectorXd &x0,
-                         const mati_t &g2l, const size_t sub_dim, const double w)
-      : SH_smooth_energy_tet(tets, nods, w), sub_dim_(sub_dim), x0_(x0), g2l_(g2l) {
+                         const mati_t &g2l, const size_t sub_dim, const double w,
+                         const shared_ptr<const mesh_topology> &topo=nullptr)
+      : SH_smooth_energy_tet(tets, nods, w, topo), sub_dim_(sub_dim), x0_(x0), g2l_(g2l) {
   }
   size_t Nx() const {
     return sub_dim_;
@@ -658,43 +653,19 @@ private:
 };
 
 frame_smoother::frame_smoother(const mati_t &tets, const matd_t &nods, const ptree &pt)
-    : tets_(tets), nods_(nods), pt_(pt) {
+    : tets_(tets), nods_(nods), pt_(pt), topo_(mesh_topology::create(tets)) {
   is_bnd_tet_ = zeros<int>(tets.size(2), 1);
-
-  shared_ptr<face2tet_adjacent> f2t(face2tet_adjacent::create(tets));
-  mati_t surf; bool check_order = true;
-  jtf::mesh::get_outside_face(*f2t, surf, check_order, &nods);
-  for (size_t i = 0; i < surf.size(2); ++i) {
-    const pair<size_t, size_t> t = f2t->query(surf(0, i), surf(1, i), surf(2, i));
-    size_t adjt = (t.first == -1) ? t.second : t.first;
-    is_bnd_tet_[adjt] = 1;
+  for (size_t f = 0; f < topo_->facet_num(); ++f) {
+    if ( topo_->is_boundary_facet(f) )
+      is_bnd_tet_[topo_->facet2cell()(0, f)] = 1;
   }
   cout << setprecision(10);
 }
 
-static shared_ptr<Functional<double>> g_func;
-static size_t g_count;
-
-static void cb(const real_1d_array &x, double &func, real_1d_array &grad, void *ptr) {
-  const size_t dim = g_func->Nx();
-  const double *ptrx = x.getcontent();
-  double *ptrg = grad.getcontent();
-
-  func = 0;
-  g_func->Val(ptrx, &func);
-
-  std::fill(ptrg, ptrg+dim, 0);
-  g_func->Gra(ptrx, ptrg);
-
-  if ( g_count % 100 == 0 )
-    cout << "\t # ITER " << g_count << ", " << func << endl;
-  
-  ++g_count;
-}
-
 static inline double query_log_smoothness(const mati_t &tets, const matd_t &nods,
+                                          const shared_ptr<const mesh_topology> &topo,
                                           const double w, const double *frame) {
-  shared_ptr<log_space_smooth_energy> bm = make_shared<log_space_smooth_energy>(tets, nods, w);
+  shared_ptr<log_space_smooth_energy> bm = make_shared<log_space_smooth_energy>(tets, nods, w, topo);
   double value = 0;
   bm->Val(frame, &value);
   return value;
@@ -716,23 +687,21 @@ int frame_smoother::smoothSH(VectorXd &abc) const {
   ASSERT(cnt == abc.size()-3*sum(is_bnd_tet_));
 
   const double ws = pt_.get<double>("weight.smooth.value");
-  g_func = make_shared<sh_smooth_fix_boundary>(tets_, nods_, abc, g2l, cnt, ws);
+  shared_ptr<Functional<double>> func = make_shared<sh_smooth_fix_boundary>(tets_, nods_, abc, g2l, cnt, ws, topo_);
 
-  g_count = 0;
-   
   const double epsf = pt_.get<double>("lbfgs.epsf.value"), epsx = 0;
   const size_t maxits = pt_.get<size_t>("lbfgs.maxits.value");
 
   VectorXd xopt = abc;
   rm_vector_row(xopt, g2l);
   
-  lbfgs_solve(cb, xopt.data(), xopt.size(), epsf, epsx, maxits);
+  lbfgs_solve(func, xopt.data(), xopt.size(), epsf, epsx, maxits);
 
   rc_vector_row(xopt, g2l, abc);
 
   VectorXd mat;
   convert_zyz_to_mat(abc, mat);
-  cout << "\t ## BEST MATCHING: " << query_log_smoothness(tets_, nods_, ws, mat.data()) << endl;
+  cout << "\t ## BEST MATCHING: " << query_log_smoothness(tets_, nods_, topo_, ws, mat.data()) << endl;
 
   return 0;
 }
@@ -757,24 +726,23 @@ int frame_smoother::smoothL1(VectorXd &mat) const {
   const double abs_eps = pt_.get<double>("abs_eps.value"),
       ws = pt_.get<double>("weight.smooth.value"),
       wo = pt_.get<double>("weight.orth.value");
-  buffer[0] = make_shared<l1_smooth_fix_boundary>(tets_, nods_, mat, g2l, cnt, abs_eps, ws);
+  buffer[0] = make_shared<l1_smooth_fix_boundary>(tets_, nods_, mat, g2l, cnt, abs_eps, ws, topo_);
   buffer[1] = make_shared<frame_orth_energy>(tets_, nods_, g2l, cnt, wo);
+  shared_ptr<Functional<double>> func;
   try {
-    g_func = make_shared<energy_t<double>>(buffer);
+    func = make_shared<energy_t<double>>(buffer);
   } catch ( ... ) {
     cerr << "[Error] L1 energy exceptions!\n";
     exit(EXIT_FAILURE);
   }
 
-  g_count = 0;
-  
   const double epsf = pt_.get<double>("lbfgs.epsf.value"), epsx = 0;
   const size_t maxits = pt_.get<size_t>("lbfgs.maxits.value");
 
   VectorXd xopt = mat;
   rm_vector_row(xopt, g2l);
   
-  lbfgs_solve(cb, xopt.data(), xopt.size(), epsf, epsx, maxits);
+  lbfgs_solve(func, xopt.data(), xopt.size(), epsf, epsx, maxits);
 
   rc_vector_row(xopt, g2l, mat);
   
@@ -787,7 +755,7 @@ int frame_smoother::smoothL1(VectorXd &mat) const {
     itr_matrix<double *>(3, 3, &mat[9*i]) = U*VT;
   }
 
-  cout << "\t ## BEST MATCHING: " << query_log_smoothness(tets_, nods_, ws, mat.data()) << endl;
+  cout << "\t ## BEST MATCHING: " << query_log_smoothness(tets_, nods_, topo_, ws, mat.data()) << endl;
   
   return 0;
 }
@@ -4,6 +4,7 @@
 #include <Eigen/Dense>
 #include <zjucad/matrix/matrix.h>
 #include <boost/property_tree/ptree.hpp>
+#include <memory>
 
 namespace riemann {
 
@@ -40,6 +41,7 @@ using boost::property_tree::ptree;
 
 template <typename T>
 class Functional;
+class mesh_topology;
 
 void convert_zyz_to_mat(const Eigen::VectorXd &abc, Eigen::VectorXd &mat);
 
@@ -54,6 +56,7 @@ private:
   const mati_t &tets_;
   const matd_t &nods_;
   const ptree &pt_;
+  const std::shared_ptr<const mesh_topology> topo_;
   std::vector<std::shared_ptr<Functional<double>>> buffer_;
 };
 
@@ -67,6 +70,7 @@ private:
   const mati_t &tets_;
   const matd_t &nods_;
   const ptree &pt_;
+  const std::shared_ptr<const mesh_topology> topo_;
   zjucad::matrix::matrix<int> is_bnd_tet_;
 };
 
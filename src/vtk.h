@@ -1,12 +1,87 @@
 #ifndef ELASTIC_VTK_H
 #define ELASTIC_VTK_H
 
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+
+/// ASCII keeps the historical text output, BINARY writes the legacy
+/// binary layout (big-endian 32-bit words) with one large write per
+/// array. The mesh and the data calls of one file must agree on it.
+enum vtk_format {
+  VTK_ASCII,
+  VTK_BINARY
+};
+
+namespace vtk_detail {
+
+inline uint32_t to_big_endian(const uint32_t v) {
+  const uint16_t probe = 1;
+  if ( *reinterpret_cast<const uint8_t *>(&probe) == 0 )
+    return v;
+  return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+}
+
+inline uint32_t float_bits(const float v) {
+  uint32_t u;
+  std::memcpy(&u, &v, sizeof(u));
+  return u;
+}
+
+template <typename OS>
+void write_words(OS &os, const std::vector<uint32_t> &buf) {
+  os.write(reinterpret_cast<const char *>(buf.data()), buf.size()*sizeof(uint32_t));
+  os << "\n";
+}
+
+template <typename OS, typename FLOAT>
+void write_float_array(OS &os, const FLOAT *val, const size_t n) {
+  std::vector<uint32_t> buf(n);
+#pragma omp parallel for
+  for (size_t i = 0; i < n; ++i)
+    buf[i] = to_big_endian(float_bits(static_cast<float>(val[i])));
+  write_words(os, buf);
+}
+
+/// order permutes the vertices of each cell, null for identity
+template <typename OS, typename FLOAT, typename INT>
+void unstructured_grid(OS &os, const char *title,
+                       const FLOAT *node, const size_t node_num,
+                       const INT *cell, const size_t cell_num, const size_t cell_size,
+                       const uint32_t cell_type, const int *order=nullptr)
+{
+  os << "# vtk DataFile Version 2.0\n" << title << "\nBINARY\n\nDATASET UNSTRUCTURED_GRID\n";
+  os << "POINTS " << node_num << " float\n";
+  write_float_array(os, node, 3*node_num);
+
+  const size_t stride = cell_size+1;
+  os << "CELLS " << cell_num << " " << cell_num*stride << "\n";
+  std::vector<uint32_t> buf(cell_num*stride);
+#pragma omp parallel for
+  for (size_t i = 0; i < cell_num; ++i) {
+    buf[i*stride] = to_big_endian(cell_size);
+    for (size_t j = 0; j < cell_size; ++j)
+      buf[i*stride+1+j] = to_big_endian(cell[i*cell_size+(order ? order[j] : j)]);
+  }
+  write_words(os, buf);
+
+  os << "CELL_TYPES " << cell_num << "\n";
+  write_words(os, std::vector<uint32_t>(cell_num, to_big_endian(cell_type)));
+}
+
+}
+
 template <typename OS, typename FLOAT, typename INT>
 void line2vtk(
     OS &os,
     const FLOAT *node, size_t node_num,
-    const INT *line, size_t line_num)
+    const INT *line, size_t line_num,
+    const vtk_format fmt=VTK_ASCII)
 {
+  if ( fmt == VTK_BINARY ) {
+    vtk_detail::unstructured_grid(os, "TRI", node, node_num, line, line_num, 2, 3);
+    return;
+  }
   os << "# vtk DataFile Version 2.0\nTRI\nASCII\n\nDATASET UNSTRUCTURED_GRID\n";
 
   os<< "POINTS " << node_num << " float\n";
@@ -25,8 +100,13 @@ void line2vtk(
 template <typename OS,typename FLOAT, typename INT>
 void point2vtk(OS &os,
                const FLOAT *node, size_t node_num,
-               const INT *points, size_t points_num)
+               const INT *points, size_t points_num,
+               const vtk_format fmt=VTK_ASCII)
 {
+  if ( fmt == VTK_BINARY ) {
+    vtk_detail::unstructured_grid(os, "TRI", node, node_num, points, points_num, 1, 1);
+    return;
+  }
   os << "# vtk DataFile Version 2.0\nTRI\nASCII\n\nDATASET UNSTRUCTURED_GRID\n";
 
   os<< "POINTS " << node_num << " float\n";
@@ -46,8 +126,13 @@ template <typename OS, typename FLOAT, typename INT>
 void tri2vtk(
     OS &os,
     const FLOAT *node, size_t node_num,
-    const INT *tri, size_t tri_num)
+    const INT *tri, size_t tri_num,
+    const vtk_format fmt=VTK_ASCII)
 {
+  if ( fmt == VTK_BINARY ) {
+    vtk_detail::unstructured_grid(os, "TRI", node, node_num, tri, tri_num, 3, 5);
+    return;
+  }
   os << "# vtk DataFile Version 2.0\nTRI\nASCII\n\nDATASET UNSTRUCTURED_GRID\n";
 
   os<< "POINTS " << node_num << " float\n";
@@ -66,8 +151,13 @@ template <typename OS, typename FLOAT, typename INT>
 void quad2vtk(
     OS &os,
     const FLOAT *node, size_t node_num,
-    const INT *quad, size_t quad_num)
+    const INT *quad, size_t quad_num,
+    const vtk_format fmt=VTK_ASCII)
 {
+  if ( fmt == VTK_BINARY ) {
+    vtk_detail::unstructured_grid(os, "TRI", node, node_num, quad, quad_num, 4, 9);
+    return;
+  }
   os << "# vtk DataFile Version 2.0\nTRI\nASCII\n\nDATASET UNSTRUCTURED_GRID\n";
 
   os<< "POINTS " << node_num << " float\n";
@@ -85,8 +175,13 @@ template <typename OS, typename FLOAT, typename INT>
 void tet2vtk(
     OS &os,
     const FLOAT *node, size_t node_num,
-    const INT *tet, size_t tet_num)
+    const INT *tet, size_t tet_num,
+    const vtk_format fmt=VTK_ASCII)
 {
+  if ( fmt == VTK_BINARY ) {
+    vtk_detail::unstructured_grid(os, "TET", node, node_num, tet, tet_num, 4, 10);
+    return;
+  }
   os << "# vtk DataFile Version 2.0\nTET\nASCII\n\nDATASET UNSTRUCTURED_GRID\n";
   os << "POINTS " << node_num << " float\n";
   for(size_t i = 0; i < node_num; ++i)
@@ -105,8 +200,14 @@ template <typename OS, typename FLOAT, typename INT>
 void hex2vtk(
     OS &os,
     const FLOAT *node, size_t node_num,
-    const INT *hex, size_t hex_num)
+    const INT *hex, size_t hex_num,
+    const vtk_format fmt=VTK_ASCII)
 {
+  if ( fmt == VTK_BINARY ) {
+    static const int order[8] = {7, 5, 4, 6, 3, 1, 0, 2};
+    vtk_detail::unstructured_grid(os, "TET", node, node_num, hex, hex_num, 8, 12, order);
+    return;
+  }
   os << "# vtk DataFile Version 2.0\nTET\nASCII\n\nDATASET UNSTRUCTURED_GRID\n";
   os << "POINTS " << node_num << " float\n";
   for(size_t i = 0; i < node_num; ++i)
@@ -125,18 +226,37 @@ void hex2vtk(
 }
 
 template <typename OS, typename Iterator, typename INT>
-void vtk_data(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table")
+void vtk_data(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table",
+              const vtk_format fmt=VTK_ASCII)
 {
   os << "SCALARS " << value_name << " float\nLOOKUP_TABLE " << table_name << "\n";
+  if ( fmt == VTK_BINARY ) {
+    std::vector<float> val(size);
+    for(size_t i = 0; i < size; ++i, ++first)
+      val[i] = *first;
+    vtk_detail::write_float_array(os, val.data(), val.size());
+    return;
+  }
   for(size_t i = 0; i < size; ++i, ++first)
     os << *first << "\n";
 }
 
 template <typename OS, typename Iterator, typename INT>
 void vtk_data_rgba(OS &os, Iterator first, INT size, const char *value_name,
-                   const char *table_name = "my_table")
+                   const char *table_name = "my_table", const vtk_format fmt=VTK_ASCII)
 {
   os << "COLOR_SCALARS " << value_name << " 4\n";//\nLOOKUP_TABLE " << table_name << "\n";
+  if ( fmt == VTK_BINARY ) {
+    // binary color scalars are unsigned bytes
+    std::vector<uint8_t> val(4*size);
+    for(size_t i = 0; i < 4*size; ++i, ++first) {
+      const double c = *first;
+      val[i] = static_cast<uint8_t>(c <= 0 ? 0 : (c >= 1 ? 255 : c*255+0.5));
+    }
+    os.write(reinterpret_cast<const char *>(val.data()), val.size());
+    os << "\n";
+    return;
+  }
   for(size_t i = 0; i < size; ++i)
   {
     for(size_t j = 0; j < 4; ++j,++first)
@@ -150,41 +270,45 @@ void vtk_data_rgba(OS &os, Iterator first, INT size, const char *value_name,
   }
 }
 template <typename OS, typename Iterator, typename INT>
-void point_data(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table")
+void point_data(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table",
+                const vtk_format fmt=VTK_ASCII)
 {
   os << "POINT_DATA " << size << "\n";
-  vtk_data(os, first, size, value_name, table_name);
+  vtk_data(os, first, size, value_name, table_name, fmt);
 }
 
 template <typename OS, typename Iterator, typename INT>
-void cell_data(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table")
+void cell_data(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table",
+               const vtk_format fmt=VTK_ASCII)
 {
   os << "CELL_DATA " << size << "\n";
-  vtk_data(os, first, size, value_name, table_name);
+  vtk_data(os, first, size, value_name, table_name, fmt);
 }
 
 template <typename OS, typename Iterator, typename INT>
-void cell_data_rgba(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table")
+void cell_data_rgba(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table",
+                    const vtk_format fmt=VTK_ASCII)
 {
   os << "CELL_DATA " << size << "\n";
-  vtk_data_rgba(os, first, size, value_name, table_name);
+  vtk_data_rgba(os, first, size, value_name, table_name, fmt);
 }
 
 template <typename OS, typename Iterator, typename INT>
-void point_data_rgba(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table")
+void point_data_rgba(OS &os, Iterator first, INT size, const char *value_name, const char *table_name = "my_table",
+                     const vtk_format fmt=VTK_ASCII)
 {
   os << "POINT_DATA " << size << "\n";
-  vtk_data_rgba(os, first, size, value_name, table_name);
+  vtk_data_rgba(os, first, size, value_name, table_name, fmt);
 }
 
 template <typename OS, typename Iterator, typename INT>
 void cell_data_rgba_and_scalar(OS &os, Iterator rgba_first, Iterator scalar_first, INT size,
                                const char *rgba_value_name, const char *scalar_value_name,
-                               const char *table_name = "my_table")
+                               const char *table_name = "my_table", const vtk_format fmt=VTK_ASCII)
 {
   os << "CELL_DATA " << size << "\n";
-  vtk_data_rgba(os, rgba_first, size, rgba_value_name, table_name);
-  vtk_data(os, scalar_first, size, scalar_value_name, table_name);
+  vtk_data_rgba(os, rgba_first, size, rgba_value_name, table_name, fmt);
+  vtk_data(os, scalar_first, size, scalar_value_name, table_name, fmt);
 
 }
 
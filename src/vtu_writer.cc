@@ -0,0 +1,79 @@
+#include "vtu_writer.h"
+
+#include <iostream>
+#include <cstdio>
+
+using namespace std;
+
+namespace riemann {
+
+static bool is_little_endian() {
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const uint8_t *>(&probe) == 1;
+}
+
+namespace {
+/// a raw block of the appended section, prefixed by its byte count
+struct raw_block {
+  const void *ptr;
+  uint64_t bytes;
+};
+}
+
+static void data_array_tag(FILE *fp, const char *type, const char *name, const size_t ncomp,
+                           const uint64_t offset) {
+  fprintf(fp, "        <DataArray type=\"%s\" Name=\"%s\" NumberOfComponents=\"%zu\" "
+          "format=\"appended\" offset=\"%lu\"/>\n", type, name, ncomp, (unsigned long)offset);
+}
+
+int vtu_writer::write(const char *file) const {
+  FILE *fp = fopen(file, "wb");
+  if ( fp == NULL ) {
+    cerr << "[error] can not open " << file << endl;
+    return __LINE__;
+  }
+  vector<raw_block> blocks;
+  uint64_t offset = 0;
+  auto next_block = [&](const void *ptr, const uint64_t bytes) -> uint64_t {
+    const uint64_t curr = offset;
+    blocks.push_back(raw_block{ptr, bytes});
+    offset += sizeof(uint64_t)+bytes;
+    return curr;
+  };
+
+  fprintf(fp, "<?xml version=\"1.0\"?>\n");
+  fprintf(fp, "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"%s\" header_type=\"UInt64\">\n",
+          is_little_endian() ? "LittleEndian" : "BigEndian");
+  fprintf(fp, "  <UnstructuredGrid>\n");
+  fprintf(fp, "    <Piece NumberOfPoints=\"%zu\" NumberOfCells=\"%zu\">\n", nods_.size()/3, offset_.size());
+  fprintf(fp, "      <PointData>\n");
+  for (auto &d : point_data_)
+    data_array_tag(fp, "Float64", d.name.c_str(), d.ncomp, next_block(d.val.data(), sizeof(double)*d.val.size()));
+  fprintf(fp, "      </PointData>\n");
+  fprintf(fp, "      <CellData>\n");
+  for (auto &d : cell_data_)
+    data_array_tag(fp, "Float64", d.name.c_str(), d.ncomp, next_block(d.val.data(), sizeof(double)*d.val.size()));
+  fprintf(fp, "      </CellData>\n");
+  fprintf(fp, "      <Points>\n");
+  data_array_tag(fp, "Float64", "Points", 3, next_block(nods_.data(), sizeof(double)*nods_.size()));
+  fprintf(fp, "      </Points>\n");
+  fprintf(fp, "      <Cells>\n");
+  data_array_tag(fp, "Int64", "connectivity", 1, next_block(conn_.data(), sizeof(int64_t)*conn_.size()));
+  data_array_tag(fp, "Int64", "offsets", 1, next_block(offset_.data(), sizeof(int64_t)*offset_.size()));
+  data_array_tag(fp, "UInt8", "types", 1, next_block(type_.data(), type_.size()));
+  fprintf(fp, "      </Cells>\n");
+  fprintf(fp, "    </Piece>\n");
+  fprintf(fp, "  </UnstructuredGrid>\n");
+  fprintf(fp, "  <AppendedData encoding=\"raw\">\n_");
+  for (auto &b : blocks) {
+    fwrite(&b.bytes, sizeof(uint64_t), 1, fp);
+    fwrite(b.ptr, 1, b.bytes, fp);
+  }
+  fprintf(fp, "\n  </AppendedData>\n");
+  fprintf(fp, "</VTKFile>\n");
+  int rtn = ferror(fp) ? __LINE__ : 0;
+  fclose(fp);
+  return rtn;
+}
+
+}
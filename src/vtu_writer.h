@@ -0,0 +1,97 @@
+#ifndef VTU_WRITER_H
+#define VTU_WRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace riemann {
+
+/// @brief XML unstructured grid (.vtu) with all arrays in one appended
+/// raw block. Points and fields are kept in double precision. Arrays
+/// are packed in parallel and written with a single large write each.
+class vtu_writer
+{
+public:
+  enum cell_type {
+    VTU_LINE = 3,
+    VTU_TRI  = 5,
+    VTU_QUAD = 9,
+    VTU_TET  = 10,
+    VTU_HEX  = 12
+  };
+  /// cells are cell_size x cell_num column-major like mati_t, hex cells
+  /// use the same vertex order as hex2vtk
+  template <typename FLOAT, typename INT>
+  void set_mesh(const FLOAT *node, const size_t node_num,
+                const INT *cell, const size_t cell_num, const size_t cell_size,
+                const cell_type type);
+  /// ncomp x size values, e.g. 3 for vectors
+  template <typename Iterator>
+  void add_point_data(const char *name, Iterator first, const size_t ncomp=1);
+  template <typename Iterator>
+  void add_cell_data(const char *name, Iterator first, const size_t ncomp=1);
+  int write(const char *file) const;
+private:
+  struct data_array {
+    std::string name;
+    size_t ncomp;
+    std::vector<double> val;
+  };
+  template <typename Iterator>
+  void add_data(std::vector<data_array> &arr, const char *name, Iterator first,
+                const size_t ncomp, const size_t n);
+  std::vector<double> nods_;
+  std::vector<int64_t> conn_, offset_;
+  std::vector<uint8_t> type_;
+  std::vector<data_array> point_data_, cell_data_;
+};
+
+template <typename FLOAT, typename INT>
+void vtu_writer::set_mesh(const FLOAT *node, const size_t node_num,
+                          const INT *cell, const size_t cell_num, const size_t cell_size,
+                          const cell_type type) {
+  static const int hex_order[8] = {7, 5, 4, 6, 3, 1, 0, 2};
+  const int *order = (type == VTU_HEX) ? hex_order : nullptr;
+  nods_.resize(3*node_num);
+  conn_.resize(cell_num*cell_size);
+  offset_.resize(cell_num);
+  type_.assign(cell_num, static_cast<uint8_t>(type));
+#pragma omp parallel for
+  for (size_t i = 0; i < 3*node_num; ++i)
+    nods_[i] = node[i];
+#pragma omp parallel for
+  for (size_t i = 0; i < cell_num; ++i) {
+    for (size_t j = 0; j < cell_size; ++j)
+      conn_[i*cell_size+j] = cell[i*cell_size+(order ? order[j] : j)];
+    offset_[i] = (i+1)*cell_size;
+  }
+  point_data_.clear();
+  cell_data_.clear();
+}
+
+template <typename Iterator>
+void vtu_writer::add_data(std::vector<data_array> &arr, const char *name, Iterator first,
+                          const size_t ncomp, const size_t n) {
+  arr.push_back(data_array());
+  data_array &d = arr.back();
+  d.name = name;
+  d.ncomp = ncomp;
+  d.val.resize(ncomp*n);
+  for (size_t i = 0; i < d.val.size(); ++i, ++first)
+    d.val[i] = *first;
+}
+
+template <typename Iterator>
+void vtu_writer::add_point_data(const char *name, Iterator first, const size_t ncomp) {
+  add_data(point_data_, name, first, ncomp, nods_.size()/3);
+}
+
+template <typename Iterator>
+void vtu_writer::add_cell_data(const char *name, Iterator first, const size_t ncomp) {
+  add_data(cell_data_, name, first, ncomp, offset_.size());
+}
+
+}
+
+#endif
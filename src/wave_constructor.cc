@@ -7,6 +7,7 @@
 #include <Eigen/Geometry>
 
 #include "def.h"
+#include "sparse_assembler.h"
 #include "write_vtk.h"
 #include "config.h"
 #include "util.h"
@@ -223,6 +224,23 @@ public:
     }
     return 0;
   }
+  int JacNnz(size_t *nnz) const {
+    *nnz = 10*edge_.size(2);
+    return 0;
+  }
+  int JacVal(const double *x, double *val) const {
+#pragma omp parallel for
+    for (size_t i = 0; i < edge_.size(2); ++i) {
+      double *v = val+10*i;
+      v[0] = w_*1.0;
+      for (size_t k = 0; k < 4; ++k)
+        v[1+k] = -w_*cIJ_(k, i);
+      v[5] = w_*1.0;
+      for (size_t k = 0; k < 4; ++k)
+        v[6+k] = -w_*cJI_(k, i);
+    }
+    return 0;
+  }
 private:
   const mati_t &edge_;
   const matd_t &cIJ_, &cJI_;
@@ -260,6 +278,16 @@ public:
     }
     return 0;
   }
+  int JacNnz(size_t *nnz) const {
+    *nnz = 4*nf_;
+    return 0;
+  }
+  int JacVal(const double *x, double *val) const {
+#pragma omp parallel for
+    for (size_t i = 0; i < 4*nf_; ++i)
+      val[i] = 2*w_*x[i];
+    return 0;
+  }
 private:
   const size_t nx_, nf_;
   const double w_;
@@ -294,6 +322,20 @@ public:
     }
     return 0;
   }
+  int JacNnz(size_t *nnz) const {
+    *nnz = 4*nf_;
+    return 0;
+  }
+  int JacVal(const double *x, double *val) const {
+#pragma omp parallel for
+    for (size_t i = 0; i < nf_; ++i) {
+      val[4*i+0] = w_*x[4*i+3];
+      val[4*i+1] = -w_*x[4*i+2];
+      val[4*i+2] = -w_*x[4*i+1];
+      val[4*i+3] = w_*x[4*i+0];
+    }
+    return 0;
+  }
 private:
   const size_t nx_, nf_;
   const double w_;
@@ -354,6 +396,14 @@ public:
     }
     return 0;
   }
+  int JacNnz(size_t *nnz) const {
+    *nnz = nf_;
+    return 0;
+  }
+  int JacVal(const double *x, double *val) const {
+    std::fill(val, val+nf_, w_);
+    return 0;
+  }
 private:
   const size_t nx_;
   size_t nf_;
@@ -677,6 +727,7 @@ int wave_constructor::solve_wave_soft_feature() {
   const size_t xdim = constraint_->Nx();
   const size_t fdim = constraint_->Nf();
   Map<VectorXd> X(&f_[0], xdim);
+  fixed_pattern_assembler<double> jac_asm;
 
   for (size_t iter = 0; iter < 10000; ++iter) {
     VectorXd cv = VectorXd::Zero(fdim); {
@@ -685,15 +736,11 @@ int wave_constructor::solve_wave_soft_feature() {
         cout << "\t@energy value: " << cv.squaredNorm() << endl;
       }
     }
-    SparseMatrix<double> J(fdim, xdim); {
-      vector<Triplet<double>> trips;
-      constraint_->Jac(&X[0], 0, &trips);
-      J.reserve(trips.size());
-      J.setFromTriplets(trips.begin(), trips.end());
-    }
+    jac_asm.assemble(*constraint_, &X[0]);
+    const SparseMatrix<double> &J = jac_asm.matrix();
     SparseMatrix<double> LHS = J.transpose()*J;
     VectorXd rhs = -J.transpose()*cv;
-    ltl_solver_.compute(LHS);
+    ltl_solver_.factorize(LHS);
     ASSERT(ltl_solver_.info() == Success);
     VectorXd dx = ltl_solver_.solve(rhs);
     ASSERT(ltl_solver_.info() == Success);
@@ -704,6 +751,7 @@ int wave_constructor::solve_wave_soft_feature() {
       break;
     }
   }
+  ltl_solver_.report();
   return 0;
 }
 
@@ -714,6 +762,7 @@ int wave_constructor::solve_wave_hard_feature() {
   Map<VectorXd> X(&f_[0], xdim);
   VectorXd unkown = VectorXd::Zero(xdim+cdim);
   unkown.head(xdim) = X;
+  fixed_pattern_assembler<double> jac_asm;
 
   // solve KKT
   cout.precision(15);
@@ -730,12 +779,8 @@ int wave_constructor::solve_wave_hard_feature() {
       if ( iter % 1 == 0 )
         cout << "\t@feature constraint: " << fv.lpNorm<Infinity>() << endl << endl;
     }
-    SparseMatrix<double> J(fdim, xdim); {
-      vector<Triplet<double>> trips;
-      constraint_->Jac(&X[0], 0, &trips);
-      J.reserve(trips.size());
-      J.setFromTriplets(trips.begin(), trips.end());
-    }
+    jac_asm.assemble(*constraint_, &X[0]);
+    const SparseMatrix<double> &J = jac_asm.matrix();
     SparseMatrix<double> LHS(xdim+cdim, xdim+cdim); {
       vector<Triplet<double>> trips;
       SparseMatrix<double> JTJ = J.transpose()*J;
@@ -753,12 +798,13 @@ int wave_constructor::solve_wave_hard_feature() {
       rhs.head(xdim) = -J.transpose()*cv;
       rhs.tail(cdim) = fv;
     }
-    lu_solver_.compute(LHS);
+    lu_solver_.factorize(LHS);
     ASSERT(lu_solver_.info() == Success);
     VectorXd dx = lu_solver_.solve(rhs);
     ASSERT(lu_solver_.info() == Success);
     unkown += dx;
   }
+  lu_solver_.report();
   X = unkown.head(xdim);
   return 0;
 }
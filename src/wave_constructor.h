@@ -6,6 +6,8 @@
 #include <Eigen/UmfPackSupport>
 #include <jtflib/mesh/mesh.h>
 
+#include "sparse_solver.h"
+
 namespace riemann {
 
 template <typename T>
@@ -53,8 +55,8 @@ private:
   std::vector<std::shared_ptr<Constraint<double>>> buff_;
   std::shared_ptr<Constraint<double>> constraint_;
   std::shared_ptr<Constraint<double>> feature_cons_;
-  Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>> ltl_solver_;
-  Eigen::UmfPackLU<Eigen::SparseMatrix<double>> lu_solver_;
+  reusable_factorization<Eigen::SimplicialCholesky<Eigen::SparseMatrix<double>>> ltl_solver_{"wave gauss-newton"};
+  reusable_factorization<Eigen::UmfPackLU<Eigen::SparseMatrix<double>>> lu_solver_{"wave KKT"};
 };
 
 }
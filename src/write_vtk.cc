@@ -16,17 +16,18 @@ int draw_face_value_to_vtk(const char *filename,
                            const double *vert, const size_t vert_num,
                            const size_t *face, const size_t face_num,
                            const double *data, const size_t type_num,
-                           const vector<string> &data_name) {
-  ofstream os(filename);
+                           const vector<string> &data_name,
+                           const vtk_format fmt) {
+  ofstream os(filename, ios::binary);
   if ( os.fail() )
     return __LINE__;
   os.precision(15);
-  tri2vtk(os, vert, vert_num, face, face_num);
+  tri2vtk(os, vert, vert_num, face, face_num, fmt);
   if ( type_num == 0 )
     return 0;
-  cell_data(os, data, face_num, data_name[0].c_str(), data_name[0].c_str());
+  cell_data(os, data, face_num, data_name[0].c_str(), data_name[0].c_str(), fmt);
   for (size_t i = 1; i < type_num; ++i) {
-    vtk_data(os, data+i*face_num, face_num, data_name[i].c_str(), data_name[i].c_str());
+    vtk_data(os, data+i*face_num, face_num, data_name[i].c_str(), data_name[i].c_str(), fmt);
   }
   os.close();
   return 0;
@@ -35,13 +36,14 @@ int draw_face_value_to_vtk(const char *filename,
 int draw_vert_value_to_vtk(const char *filename,
                            const double *vert, const size_t vert_num,
                            const size_t *face, const size_t face_num,
-                           const double *data) {
-  ofstream os(filename);
+                           const double *data,
+                           const vtk_format fmt) {
+  ofstream os(filename, ios::binary);
   if ( os.fail() )
     return __LINE__;
   os.precision(15);
-  tri2vtk(os, vert, vert_num, face, face_num);
-  point_data(os, data, vert_num, "vert_value", "vert_value");
+  tri2vtk(os, vert, vert_num, face, face_num, fmt);
+  point_data(os, data, vert_num, "vert_value", "vert_value", fmt);
   os.close();
   return 0;
 }
@@ -49,13 +51,14 @@ int draw_vert_value_to_vtk(const char *filename,
 int draw_edge_value_to_vtk(const char *filename,
                            const double *vert, const size_t vert_num,
                            const size_t *edge, const size_t edge_num,
-                           const double *data) {
-  ofstream os(filename);
+                           const double *data,
+                           const vtk_format fmt) {
+  ofstream os(filename, ios::binary);
   if ( os.fail() )
     return __LINE__;
   os.precision(15);
-  line2vtk(os, vert, vert_num, edge, edge_num);
-  cell_data(os, data, edge_num, "edge_value", "edge_value");
+  line2vtk(os, vert, vert_num, edge, edge_num, fmt);
+  cell_data(os, data, edge_num, "edge_value", "edge_value", fmt);
   os.close();
   return 0;
 }
@@ -63,8 +66,9 @@ int draw_edge_value_to_vtk(const char *filename,
 int draw_face_direct_field(const char *filename,
                            const double *vert, const size_t vert_num,
                            const size_t *face, const size_t face_num,
-                           const double *field) {
-  ofstream os(filename);
+                           const double *field,
+                           const vtk_format fmt) {
+  ofstream os(filename, ios::binary);
   if ( os.fail() )
     return __LINE__;
 
@@ -81,7 +85,7 @@ int draw_face_direct_field(const char *filename,
     pts(colon(), i) = nods(colon(), cell(colon(), i))*ones<double>(3, 1)/3.0;
     pts(colon(), i+face_num) = pts(colon(), i)+df(colon(), i);
   }
-  line2vtk(os, pts.begin(), pts.size(2), line.begin(), line.size(2));
+  line2vtk(os, pts.begin(), pts.size(2), line.begin(), line.size(2), fmt);
   os.close();
   return 0;
 }
@@ -89,8 +93,9 @@ int draw_face_direct_field(const char *filename,
 int draw_edge_direct_field(const char *filename,
                            const double *vert, const size_t vert_num,
                            const size_t *edge, const size_t edge_num,
-                           const double *field) {
-  ofstream os(filename);
+                           const double *field,
+                           const vtk_format fmt) {
+  ofstream os(filename, ios::binary);
   if ( os.fail() )
     return __LINE__;
 
@@ -107,15 +112,16 @@ int draw_edge_direct_field(const char *filename,
     pts(colon(), i) = nods(colon(), cell(colon(), i))*ones<double>(2, 1)/2.0;
     pts(colon(), i+edge_num) = pts(colon(), i)+df(colon(), i);
   }
-  line2vtk(os, pts.begin(), pts.size(2), line.begin(), line.size(2));
+  line2vtk(os, pts.begin(), pts.size(2), line.begin(), line.size(2), fmt);
   os.close();
   return 0;
 }
 
 int draw_vert_direct_field(const char *filename,
                            const double *vert, const size_t vert_num,
-                           const double *field) {
-  ofstream os(filename);
+                           const double *field,
+                           const vtk_format fmt) {
+  ofstream os(filename, ios::binary);
   if ( os.fail() )
     return __LINE__;
 
@@ -128,7 +134,7 @@ int draw_vert_direct_field(const char *filename,
   matrix<double> pts(3, 2*vert_num);
   pts(colon(), colon(0, vert_num-1)) = nods-df;
   pts(colon(), colon(vert_num, 2*vert_num-1)) = nods+df;
-  line2vtk(os, pts.begin(), pts.size(2), line.begin(), line.size(2));
+  line2vtk(os, pts.begin(), pts.size(2), line.begin(), line.size(2), fmt);
   os.close();
   return 0;
 }